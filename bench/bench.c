@@ -0,0 +1,390 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+
+#include <time.h>
+#include <unistd.h>
+
+/* Minimum time to spend on each measured function. */
+#define BENCH_MIN_TIME 0.25
+
+/**
+ * Get the current monotonic time in seconds.
+ */
+double bench_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Run a function repeatedly until at least BENCH_MIN_TIME has elapsed.
+ *
+ * @param fn    function to measure.
+ * @param priv  private data to pass to `fn`.
+ * @return      the average time per call in seconds.
+ */
+double bench_run(bench_fn fn, void *priv)
+{
+  double start;
+  double elapsed;
+  size_t reps = 0;
+  size_t batch = 1;
+
+  /* Warm caches and branch predictors. */
+  fn(priv);
+
+  start = bench_time();
+  do
+  {
+    size_t i;
+    for(i = 0; i < batch; i++)
+      fn(priv);
+
+    reps += batch;
+    batch *= 2;
+    elapsed = bench_time() - start;
+  }
+  while(elapsed < BENCH_MIN_TIME);
+
+  return elapsed / reps;
+}
+
+/* Print results as CSV instead of a table. */
+bool bench_csv = false;
+
+/* Largest thread count for benchmarks that scale across threads. */
+unsigned bench_max_threads = 1;
+
+/**
+ * Print a CSV header if it differs from the last one printed. Each table
+ * of rows with the same columns gets its own header, separated from the
+ * previous table by a blank line.
+ *
+ * @param header  column names, comma-separated.
+ */
+void bench_csv_header(const char *header)
+{
+  static const char *current = NULL;
+
+  if(current && !strcmp(current, header))
+    return;
+
+  if(current)
+    printf("\n");
+  printf("%s\n", header);
+  current = header;
+}
+
+/**
+ * Print a single benchmark result. The time is reported per call, which
+ * is one image for every kernel.
+ *
+ * @param group   benchmark group name.
+ * @param name    benchmark name.
+ * @param width   image width of the input.
+ * @param height  image height of the input.
+ * @param seconds average time per call in seconds.
+ * @param bytes   number of input bytes processed per call.
+ */
+void bench_report(const char *group, const char *name, size_t width,
+ size_t height, double seconds, size_t bytes)
+{
+  double pixels_per_sec = width * height / seconds;
+  double mib_per_sec = bytes / seconds / 1048576.0;
+
+  if(bench_csv)
+  {
+    bench_csv_header("group,name,width,height,ns,mib_per_s,pixels_per_s");
+    printf("%s,%s,%zu,%zu,%.0f,%.1f,%.0f\n",
+     group, name, width, height, seconds * 1000000000.0,
+     mib_per_sec, pixels_per_sec);
+  }
+  else
+  {
+    printf("%-12s %-16s %5zux%-5zu %12.0f ns %10.1f MiB/s %10.1f Mpx/s\n",
+     group, name, width, height, seconds * 1000000000.0,
+     mib_per_sec, pixels_per_sec / 1000000.0);
+  }
+}
+
+/**
+ * Get one format for every distinct image size, in increasing order of size.
+ *
+ * @param dest    array to store the formats to.
+ * @param max     size of `dest`.
+ * @param filter  function returning true for formats to include, or `NULL`
+ *                to include all formats.
+ * @return        the number of formats stored to `dest`.
+ */
+size_t bench_get_formats(const struct icns_format **dest, size_t max,
+ bool (*filter)(const struct icns_format *))
+{
+  const struct icns_format *list[64];
+  size_t num_formats = icns_get_format_list(list, 64);
+  size_t num = 0;
+  size_t i;
+  size_t j;
+
+  if(num_formats > 64)
+    num_formats = 64;
+
+  for(i = 0; i < num_formats; i++)
+  {
+    const struct icns_format *f = list[i];
+    size_t size = f->width * f->factor;
+
+    if(filter && !filter(f))
+      continue;
+
+    for(j = 0; j < num; j++)
+      if((size_t)dest[j]->width * dest[j]->factor >= size)
+        break;
+
+    if(j < num && (size_t)dest[j]->width * dest[j]->factor == size)
+      continue;
+
+    if(num >= max)
+      break;
+
+    memmove(dest + j + 1, dest + j, (num - j) * sizeof(dest[0]));
+    dest[j] = f;
+    num++;
+  }
+  return num;
+}
+
+/**
+ * Generate a deterministic icon-like image: a transparent background
+ * with an opaque gradient disc containing a noisy region. This has a
+ * mix of long runs and literals similar to real icons.
+ */
+void bench_generate_pixels(struct rgba_color *pixels,
+ size_t width, size_t height)
+{
+  uint32_t seed = 12345;
+  size_t x;
+  size_t y;
+
+  for(y = 0; y < height; y++)
+  {
+    for(x = 0; x < width; x++)
+    {
+      struct rgba_color *p = &pixels[y * width + x];
+      long dx = (long)(x * 2) - (long)width;
+      long dy = (long)(y * 2) - (long)height;
+
+      if((unsigned long)(dx * dx + dy * dy) > width * height * 3 / 4)
+      {
+        p->r = p->g = p->b = p->a = 0;
+        continue;
+      }
+      p->r = x * 255 / width;
+      p->g = y * 255 / height;
+      p->b = 128;
+      p->a = 255;
+
+      if(x > width / 2 && y > height / 2)
+      {
+        seed = seed * 1103515245u + 12345u;
+        p->r ^= (seed >> 16) & 0x1f;
+        p->b ^= (seed >> 24) & 0x1f;
+      }
+    }
+  }
+}
+
+const char *bench_pattern_name(enum bench_pattern pattern)
+{
+  static const char * const names[NUM_BENCH_PATTERNS] =
+  {
+    "gradient", "flat", "photo", "transparent"
+  };
+  return pattern < NUM_BENCH_PATTERNS ? names[pattern] : "";
+}
+
+static uint8_t bench_clamp(int value)
+{
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/**
+ * Generate a deterministic synthetic icon of a given content type.
+ * Different seeds produce different colors and shapes.
+ */
+void bench_generate_icon(struct rgba_color *pixels,
+ size_t width, size_t height, enum bench_pattern pattern, uint32_t seed)
+{
+  uint8_t base[3];
+  size_t x;
+  size_t y;
+  size_t i;
+
+  seed = seed * 2654435761u + 1;
+  for(i = 0; i < 3; i++)
+  {
+    seed = seed * 1103515245u + 12345u;
+    base[i] = seed >> 24;
+  }
+
+  for(y = 0; y < height; y++)
+  {
+    for(x = 0; x < width; x++)
+    {
+      struct rgba_color *p = &pixels[y * width + x];
+      int fx = x * 256 / width;
+      int fy = y * 256 / height;
+      long dx = (long)(x * 2 + 1) - (long)width;
+      long dy = (long)(y * 2 + 1) - (long)height;
+      long dist2 = dx * dx + dy * dy;
+      long radius2 = (long)(width * height) * 3 / 4;
+      int noise;
+
+      switch(pattern)
+      {
+        case BENCH_GRADIENT:
+          p->r = bench_clamp(base[0] / 2 + fx / 2);
+          p->g = bench_clamp(base[1] / 2 + fy / 2);
+          p->b = bench_clamp(base[2] / 2 + (fx + fy) / 4);
+          p->a = 255;
+          break;
+
+        case BENCH_FLAT:
+          /* Background, a disc, and a bar in three flat colors. */
+          p->r = base[0];
+          p->g = base[1];
+          p->b = base[2];
+          p->a = 255;
+          if(dist2 < radius2 / 2)
+          {
+            p->r = 255 - base[0];
+            p->g = base[2];
+          }
+          if(fy > 160 && fy < 200)
+          {
+            p->r = 0;
+            p->g = 0;
+            p->b = 0;
+          }
+          break;
+
+        case BENCH_PHOTO:
+          seed = seed * 1103515245u + 12345u;
+          noise = (int)(seed >> 16) & 0x3f;
+          p->r = bench_clamp(base[0] / 2 + fx / 3 + noise - 32);
+          noise = (int)(seed >> 22) & 0x3f;
+          p->g = bench_clamp(base[1] / 2 + fy / 3 + noise - 32);
+          noise = (int)(seed >> 10) & 0x3f;
+          p->b = bench_clamp(base[2] / 2 + noise - 32);
+          p->a = 255;
+          break;
+
+        case BENCH_TRANSPARENT:
+        default:
+        {
+          /* Alpha falls off linearly over the outer edge of a disc. */
+          long edge = (long)width * 2;
+          long alpha = (radius2 - dist2) * 255 / (edge > 0 ? edge : 1);
+
+          p->r = bench_clamp(base[0] / 2 + fx / 2);
+          p->g = base[1];
+          p->b = bench_clamp(base[2] / 2 + fy / 2);
+          p->a = bench_clamp(alpha < 0 ? 0 : alpha > 255 ? 255 : alpha);
+          if(!p->a)
+            p->r = p->g = p->b = 0;
+          break;
+        }
+      }
+    }
+  }
+}
+
+static const struct bench_group
+{
+  const char *name;
+  void (*fn)(void);
+}
+bench_groups[] =
+{
+  { "rle",     bench_rle },
+  { "png",     bench_png },
+  { "mask",    bench_mask },
+  { "io",      bench_io },
+  { "convert", bench_convert },
+};
+
+/**
+ * Usage: icnscvt-bench [-c] [-t threads] [group...]
+ *
+ * -c prints CSV instead of a table. Kernel rows are
+ * group,name,width,height,ns,mib_per_s,pixels_per_s and convert rows are
+ * convert,mode,pattern,threads,icons_per_s,peak_rss_kib. Each kind of row
+ * is printed as a separate table with its own header, and tables are
+ * separated by a blank line. -t sets the largest thread count for the
+ * convert group (default: online CPUs).
+ * If any groups are given, only those are run.
+ */
+int main(int argc, char *argv[])
+{
+  size_t num_groups = sizeof(bench_groups) / sizeof(bench_groups[0]);
+  bool run_all = true;
+  bool run[sizeof(bench_groups) / sizeof(bench_groups[0])];
+  size_t i;
+  int j;
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if(cpus > 1)
+    bench_max_threads = cpus;
+
+  memset(run, 0, sizeof(run));
+  for(j = 1; j < argc; j++)
+  {
+    if(!strcmp(argv[j], "-c"))
+    {
+      bench_csv = true;
+      continue;
+    }
+    if(!strcmp(argv[j], "-t") && j + 1 < argc)
+    {
+      int threads = atoi(argv[++j]);
+      bench_max_threads = threads > 1 ? threads : 1;
+      continue;
+    }
+
+    for(i = 0; i < num_groups; i++)
+      if(!strcmp(argv[j], bench_groups[i].name))
+        break;
+
+    if(i >= num_groups)
+    {
+      fprintf(stderr, "usage: %s [-c] [-t threads] [group...]\n", argv[0]);
+      return 1;
+    }
+    run[i] = true;
+    run_all = false;
+  }
+
+  for(i = 0; i < num_groups; i++)
+    if(run_all || run[i])
+      bench_groups[i].fn();
+
+  return 0;
+}
@@ -0,0 +1,69 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_BENCH_H
+#define ICNSCVT_BENCH_H
+
+#include "../src/common.h"
+#include "../src/icns_format.h"
+#include "../src/icns_image.h"
+
+ICNS_BEGIN_DECLS
+
+/* Largest number of distinct image sizes across all formats. */
+#define BENCH_MAX_SIZES 32
+
+/* Synthetic icon content types for the conversion corpus. */
+enum bench_pattern
+{
+  BENCH_GRADIENT,     /* smooth opaque gradients */
+  BENCH_FLAT,         /* flat-colored shapes with hard edges */
+  BENCH_PHOTO,        /* noisy photographic detail */
+  BENCH_TRANSPARENT,  /* antialiased shape on a transparent background */
+  NUM_BENCH_PATTERNS
+};
+
+typedef void (*bench_fn)(void *priv);
+
+extern bool bench_csv;
+extern unsigned bench_max_threads;
+
+double bench_time(void);
+double bench_run(bench_fn fn, void *priv);
+void bench_csv_header(const char *header);
+void bench_report(const char *group, const char *name, size_t width,
+ size_t height, double seconds, size_t bytes);
+size_t bench_get_formats(const struct icns_format **dest, size_t max,
+ bool (*filter)(const struct icns_format *));
+
+void bench_generate_pixels(struct rgba_color *pixels,
+ size_t width, size_t height);
+const char *bench_pattern_name(enum bench_pattern pattern);
+void bench_generate_icon(struct rgba_color *pixels,
+ size_t width, size_t height, enum bench_pattern pattern, uint32_t seed);
+
+void bench_rle(void);
+void bench_png(void);
+void bench_mask(void);
+void bench_io(void);
+void bench_convert(void);
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_BENCH_H */
@@ -0,0 +1,402 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+#include "../src/icns.h"
+#include "../src/icns_io.h"
+#include "../src/icns_png.h"
+#include "../src/icns_thread.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Icons generated per format and content type. */
+#define BENCH_CONVERT_ICONS 2
+
+/* Minimum time to spend on each thread count. */
+#define BENCH_CONVERT_MIN_TIME 0.5
+
+/* Most chunks a single imported icon can prepare (image + mask). */
+#define BENCH_CONVERT_MAX_CHUNKS 4
+
+struct bench_icon
+{
+  const struct icns_format *format;
+  uint8_t *png;
+  size_t png_size;
+};
+
+struct bench_convert_data
+{
+  const struct bench_icon *icons;
+  size_t num_icons;
+  size_t total;
+  unsigned num_tasks;
+  bool recode;
+};
+
+struct bench_convert_result
+{
+  double seconds;
+  long peak_rss;
+};
+
+struct bench_chunk
+{
+  const struct icns_format *format;
+  size_t offset;
+  size_t size;
+};
+
+static void bench_convert_fail(struct icns_data *icns,
+ const struct icns_format *format, const char *what, enum icns_error ret)
+{
+  fprintf(stderr, "bench_convert: %s: %s failed (%d)\n",
+   format->name, what, ret);
+  icns_io_end(icns);
+  exit(1);
+}
+
+/**
+ * Convert one external PNG to ICNS chunks and back to an external PNG
+ * through the format callbacks, as the ICNS and .iconset targets would.
+ */
+static void bench_convert_icon(struct icns_data *icns,
+ const struct bench_icon *icon, uint8_t *buf, size_t buf_size)
+{
+  const struct icns_format *format = icon->format;
+  struct bench_chunk chunks[BENCH_CONVERT_MAX_CHUNKS];
+  struct icns_image *image;
+  size_t num_chunks = 0;
+  size_t pos = 0;
+  size_t i;
+  enum icns_error ret;
+
+  /* External -> ICNS */
+  ret = icns_add_image_for_format(icns, &image, NULL, format);
+  if(ret)
+    bench_convert_fail(icns, format, "add image", ret);
+
+  icns_io_init_read_memory(icns, icon->png, icon->png_size);
+  ret = format->read_from_external(icns, image);
+  icns_io_end(icns);
+  if(ret)
+    bench_convert_fail(icns, format, "read_from_external", ret);
+
+  for(image = icns->images.head; image; image = image->next)
+  {
+    const struct icns_format *f = image->format;
+    size_t size;
+
+    ret = f->prepare_for_icns(icns, image, &size);
+    if(ret)
+      bench_convert_fail(icns, f, "prepare_for_icns", ret);
+
+    if(num_chunks >= BENCH_CONVERT_MAX_CHUNKS || size > buf_size - pos)
+      bench_convert_fail(icns, f, "chunk buffer", ICNS_INTERNAL_ERROR);
+
+    icns_io_init_write_memory(icns, buf + pos, size);
+    ret = f->write_to_icns(icns, image);
+    icns_io_end(icns);
+    if(ret)
+      bench_convert_fail(icns, f, "write_to_icns", ret);
+
+    chunks[num_chunks].format = f;
+    chunks[num_chunks].offset = pos;
+    chunks[num_chunks].size = size;
+    num_chunks++;
+    pos += size;
+  }
+  icns_delete_all_images(icns);
+
+  /* ICNS -> external */
+  for(i = 0; i < num_chunks; i++)
+  {
+    const struct icns_format *f = chunks[i].format;
+
+    ret = icns_add_image_for_format(icns, &image, NULL, f);
+    if(ret && ret != ICNS_IMAGE_EXISTS_FOR_FORMAT)
+      bench_convert_fail(icns, f, "add image", ret);
+
+    icns_io_init_read_memory(icns, buf + chunks[i].offset, chunks[i].size);
+    ret = f->read_from_icns(icns, image, chunks[i].size);
+    icns_io_end(icns);
+    if(ret)
+      bench_convert_fail(icns, f, "read_from_icns", ret);
+  }
+
+  image = icns_get_image_by_format(icns, format);
+  if(!image)
+    bench_convert_fail(icns, format, "get image", ICNS_INTERNAL_ERROR);
+
+  if(format->prepare_for_external)
+  {
+    ret = format->prepare_for_external(icns, image);
+    if(ret)
+      bench_convert_fail(icns, format, "prepare_for_external", ret);
+  }
+
+  icns_io_init_write_memory(icns, buf + pos, buf_size - pos);
+  ret = format->write_to_external(icns, image);
+  icns_io_end(icns);
+  if(ret)
+    bench_convert_fail(icns, format, "write_to_external", ret);
+
+  icns_delete_all_images(icns);
+}
+
+/* Each task converts every `num_tasks`th icon with its own context. */
+static void bench_convert_task_fn(void *priv, unsigned index)
+{
+  const struct bench_convert_data *d = (const struct bench_convert_data *)priv;
+  struct icns_data icns;
+  uint8_t *buf;
+  size_t buf_size = 1024 * 1024 * 4 * 3;
+  size_t i;
+
+  buf = (uint8_t *)malloc(buf_size);
+  if(!buf)
+  {
+    fprintf(stderr, "bench_convert: alloc failed\n");
+    exit(1);
+  }
+
+  icns_initialize_state_data(&icns);
+  icns.force_recoding = d->recode;
+
+  for(i = index; i < d->total; i += d->num_tasks)
+    bench_convert_icon(&icns, &d->icons[i % d->num_icons], buf, buf_size);
+
+  icns_clear_state_data(&icns);
+  free(buf);
+}
+
+/* Reset the peak resident set size to the current one (Linux only). */
+static void bench_peak_rss_reset(void)
+{
+  FILE *f = fopen("/proc/self/clear_refs", "w");
+  if(f)
+  {
+    fputs("5", f);
+    fclose(f);
+  }
+}
+
+/* Peak resident set size of the process since the last reset, in KiB. */
+static long bench_peak_rss(void)
+{
+  struct rusage usage;
+  char line[256];
+  long peak = -1;
+  FILE *f;
+
+  f = fopen("/proc/self/status", "r");
+  if(f)
+  {
+    while(fgets(line, sizeof(line), f))
+      if(sscanf(line, "VmHWM: %ld", &peak) == 1)
+        break;
+    fclose(f);
+  }
+  if(peak >= 0)
+    return peak;
+
+  if(getrusage(RUSAGE_SELF, &usage))
+    return 0;
+
+  return usage.ru_maxrss;
+}
+
+/**
+ * Time one full run at a given thread count. The run happens in a child
+ * process so that its peak RSS is not inflated by earlier runs, which
+ * would otherwise be included in the process-lifetime high-water mark.
+ */
+static struct bench_convert_result bench_convert_measure(
+ struct bench_convert_data *d, unsigned threads)
+{
+  struct bench_convert_result r;
+  int status;
+  int fds[2];
+  pid_t pid;
+
+  if(pipe(fds))
+  {
+    fprintf(stderr, "bench_convert: pipe failed\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0)
+  {
+    fprintf(stderr, "bench_convert: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0)
+  {
+    double start;
+
+    close(fds[0]);
+    bench_peak_rss_reset();
+
+    d->num_tasks = threads;
+    start = bench_time();
+    icns_thread_run(bench_convert_task_fn, d, threads, threads);
+    r.seconds = bench_time() - start;
+    r.peak_rss = bench_peak_rss();
+
+    if(write(fds[1], &r, sizeof(r)) != (ssize_t)sizeof(r))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  if(read(fds[0], &r, sizeof(r)) != (ssize_t)sizeof(r) ||
+   waitpid(pid, &status, 0) != pid ||
+   !WIFEXITED(status) || WEXITSTATUS(status))
+  {
+    fprintf(stderr, "bench_convert: run with %u threads failed\n", threads);
+    exit(1);
+  }
+  close(fds[0]);
+  return r;
+}
+
+static void bench_convert_report(const char *mode, const char *pattern,
+ unsigned threads, size_t icons, struct bench_convert_result r)
+{
+  if(bench_csv)
+  {
+    bench_csv_header("convert,mode,pattern,threads,icons_per_s,peak_rss_kib");
+    printf("convert,%s,%s,%u,%.1f,%ld\n",
+     mode, pattern, threads, icons / r.seconds, r.peak_rss);
+  }
+  else
+  {
+    printf("convert      %-7s %-12s %3u threads %10.1f icons/s %8ld KiB RSS\n",
+     mode, pattern, threads, icons / r.seconds, r.peak_rss);
+  }
+}
+
+static size_t bench_convert_make_corpus(struct bench_icon *icons,
+ enum bench_pattern pattern)
+{
+  const struct icns_format *list[64];
+  struct rgba_color *pixels;
+  struct icns_data icns;
+  size_t num_formats = icns_get_format_list(list, 64);
+  size_t num = 0;
+  size_t i;
+  size_t j;
+
+  if(num_formats > 64)
+    num_formats = 64;
+
+  icns_initialize_state_data(&icns);
+  for(i = 0; i < num_formats; i++)
+  {
+    const struct icns_format *f = list[i];
+    size_t size = f->width * f->factor;
+
+    if(!f->read_from_external || !f->write_to_external ||
+     !f->prepare_for_icns || !f->write_to_icns || !f->read_from_icns)
+      continue;
+
+    pixels = (struct rgba_color *)malloc(size * size * 4);
+    if(!pixels)
+    {
+      fprintf(stderr, "bench_convert: alloc failed\n");
+      exit(1);
+    }
+
+    for(j = 0; j < BENCH_CONVERT_ICONS; j++)
+    {
+      bench_generate_icon(pixels, size, size, pattern, i * 131 + j);
+      if(icns_encode_png_to_buffer(&icns, &icons[num].png,
+       &icons[num].png_size, pixels, size, size, ICNS_PNG_PROFILE_DEFAULT))
+      {
+        fprintf(stderr, "bench_convert: encode failed\n");
+        exit(1);
+      }
+      icons[num].format = f;
+      num++;
+    }
+    free(pixels);
+  }
+  icns_clear_state_data(&icns);
+  return num;
+}
+
+/**
+ * Full external -> ICNS -> external conversions of a synthetic corpus with
+ * one icon set per registered format, at 1, 2, 4, ... N threads. Each
+ * thread converts a share of the icons with its own context. "default"
+ * keeps PNG data as-is where the format allows it; "recode" forces every
+ * image to be decoded and re-encoded. Each thread count runs in its own
+ * process, so the reported peak RSS is for that thread count alone.
+ */
+void bench_convert(void)
+{
+  struct bench_icon icons[64 * BENCH_CONVERT_ICONS];
+  struct bench_convert_data d;
+  unsigned pattern;
+  unsigned mode;
+  size_t i;
+
+  for(pattern = 0; pattern < NUM_BENCH_PATTERNS; pattern++)
+  {
+    d.icons = icons;
+    d.num_icons = bench_convert_make_corpus(icons, pattern);
+
+    for(mode = 0; mode < 2; mode++)
+    {
+      unsigned threads;
+      double start;
+      double t;
+
+      d.recode = mode;
+
+      /* Size the run to take at least BENCH_CONVERT_MIN_TIME serially. */
+      d.total = d.num_icons;
+      d.num_tasks = 1;
+      start = bench_time();
+      bench_convert_task_fn(&d, 0);
+      t = bench_time() - start;
+      if(t < BENCH_CONVERT_MIN_TIME)
+        d.total = d.num_icons * (size_t)(BENCH_CONVERT_MIN_TIME / t + 1);
+
+      for(threads = 1; ; threads *= 2)
+      {
+        if(threads > bench_max_threads)
+          threads = bench_max_threads;
+
+        bench_convert_report(mode ? "recode" : "default",
+         bench_pattern_name(pattern), threads, d.total,
+         bench_convert_measure(&d, threads));
+
+        if(threads >= bench_max_threads)
+          break;
+      }
+    }
+
+    for(i = 0; i < d.num_icons; i++)
+      free(icons[i].png);
+  }
+}
@@ -0,0 +1,144 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+#include "../src/icns.h"
+#include "../src/icns_io.h"
+
+/* Scratch file for the file backend, in the working directory. */
+#define BENCH_IO_FILE "icnscvt-bench.tmp"
+
+/* Size of each read/write call; similar to the (A)RGB pack window. */
+#define BENCH_IO_BLOCK 4096
+
+struct bench_io_data
+{
+  struct icns_data *icns;
+  uint8_t *buf;
+  uint8_t *copy;
+  size_t size;
+};
+
+static void bench_io_fail(struct bench_io_data *d, const char *what)
+{
+  fprintf(stderr, "bench_io: %s failed\n", what);
+  icns_io_end(d->icns);
+  exit(1);
+}
+
+/* Transfer an image-sized buffer in blocks between the stream and `buf`. */
+static void bench_io_transfer(struct bench_io_data *d, bool write)
+{
+  size_t pos;
+
+  for(pos = 0; pos < d->size; pos += BENCH_IO_BLOCK)
+  {
+    size_t n = d->size - pos;
+    if(n > BENCH_IO_BLOCK)
+      n = BENCH_IO_BLOCK;
+
+    if(write ? icns_write_direct(d->icns, d->buf + pos, n) :
+     icns_read_direct(d->icns, d->copy + pos, n))
+      bench_io_fail(d, write ? "write" : "read");
+  }
+}
+
+static void bench_io_memory_write(void *priv)
+{
+  struct bench_io_data *d = (struct bench_io_data *)priv;
+
+  if(icns_io_init_write_memory(d->icns, d->copy, d->size))
+    bench_io_fail(d, "init");
+
+  bench_io_transfer(d, true);
+  icns_io_end(d->icns);
+}
+
+static void bench_io_memory_read(void *priv)
+{
+  struct bench_io_data *d = (struct bench_io_data *)priv;
+
+  if(icns_io_init_read_memory(d->icns, d->buf, d->size))
+    bench_io_fail(d, "init");
+
+  bench_io_transfer(d, false);
+  icns_io_end(d->icns);
+}
+
+static void bench_io_file_write(void *priv)
+{
+  struct bench_io_data *d = (struct bench_io_data *)priv;
+
+  if(icns_io_init_write_file(d->icns, BENCH_IO_FILE))
+    bench_io_fail(d, "init");
+
+  bench_io_transfer(d, true);
+  icns_io_end(d->icns);
+}
+
+static void bench_io_file_read(void *priv)
+{
+  struct bench_io_data *d = (struct bench_io_data *)priv;
+
+  if(icns_io_init_read_file(d->icns, BENCH_IO_FILE))
+    bench_io_fail(d, "init");
+
+  bench_io_transfer(d, false);
+  icns_io_end(d->icns);
+}
+
+void bench_io(void)
+{
+  const struct icns_format *formats[BENCH_MAX_SIZES];
+  size_t num_formats = bench_get_formats(formats, BENCH_MAX_SIZES, NULL);
+  size_t i;
+
+  for(i = 0; i < num_formats; i++)
+  {
+    struct bench_io_data d;
+    size_t size = formats[i]->width * formats[i]->factor;
+    double t;
+
+    /* One uncompressed RGBA image per call. */
+    d.size = size * size * sizeof(struct rgba_color);
+    d.icns = icns_allocate_state_data();
+    d.buf = (uint8_t *)malloc(d.size);
+    d.copy = (uint8_t *)malloc(d.size);
+    if(!d.icns || !d.buf || !d.copy)
+    {
+      fprintf(stderr, "bench_io: alloc failed\n");
+      exit(1);
+    }
+    bench_generate_pixels((struct rgba_color *)d.buf, size, size);
+
+    t = bench_run(bench_io_memory_write, &d);
+    bench_report("io", "memory_write", size, size, t, d.size);
+    t = bench_run(bench_io_memory_read, &d);
+    bench_report("io", "memory_read", size, size, t, d.size);
+    t = bench_run(bench_io_file_write, &d);
+    bench_report("io", "file_write", size, size, t, d.size);
+    t = bench_run(bench_io_file_read, &d);
+    bench_report("io", "file_read", size, size, t, d.size);
+
+    remove(BENCH_IO_FILE);
+    free(d.buf);
+    free(d.copy);
+    icns_delete_state_data(d.icns);
+  }
+}
@@ -0,0 +1,123 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+#include "../src/icns.h"
+#include "../src/icns_format_mask.h"
+#include "../src/icns_pixels.h"
+
+struct bench_mask_data
+{
+  struct icns_data *icns;
+  struct icns_image *rgb;
+  struct icns_image *mask;
+  bool opaque;
+};
+
+static void bench_mask_split(void *priv)
+{
+  struct bench_mask_data *d = (struct bench_mask_data *)priv;
+
+  if(icns_split_alpha_to_8_bit_mask(d->icns, d->mask, d->rgb))
+  {
+    fprintf(stderr, "bench_mask: split failed\n");
+    exit(1);
+  }
+}
+
+static void bench_mask_merge(void *priv)
+{
+  struct bench_mask_data *d = (struct bench_mask_data *)priv;
+
+  if(icns_add_alpha_from_8_bit_mask(d->icns, d->rgb, d->mask))
+  {
+    fprintf(stderr, "bench_mask: merge failed\n");
+    exit(1);
+  }
+}
+
+static void bench_mask_luma(void *priv)
+{
+  struct bench_mask_data *d = (struct bench_mask_data *)priv;
+  size_t num_pixels = d->rgb->real_width * d->rgb->real_height;
+
+  icns_pixels_get_luma(d->mask->data, d->rgb->pixels, num_pixels);
+}
+
+static void bench_mask_opaque_scan(void *priv)
+{
+  struct bench_mask_data *d = (struct bench_mask_data *)priv;
+  size_t num_pixels = d->rgb->real_width * d->rgb->real_height;
+
+  d->opaque = icns_pixels_is_opaque(d->rgb->pixels, num_pixels);
+}
+
+static bool bench_mask_filter(const struct icns_format *format)
+{
+  return format->type == ICNS_24_BIT && icns_get_mask_for_format(format);
+}
+
+void bench_mask(void)
+{
+  const struct icns_format *formats[BENCH_MAX_SIZES];
+  size_t num_formats = bench_get_formats(formats, BENCH_MAX_SIZES,
+   bench_mask_filter);
+  size_t i;
+
+  for(i = 0; i < num_formats; i++)
+  {
+    struct bench_mask_data d;
+    size_t size;
+    double t;
+
+    d.icns = icns_allocate_state_data();
+    if(!d.icns ||
+     icns_add_image_for_format(d.icns, &d.rgb, NULL, formats[i]) ||
+     icns_add_image_for_format(d.icns, &d.mask, d.rgb,
+      icns_get_mask_for_format(formats[i])))
+    {
+      fprintf(stderr, "bench_mask: init failed\n");
+      exit(1);
+    }
+    size = d.rgb->real_width;
+
+    d.rgb->pixels = icns_allocate_pixel_array_for_image(d.icns, d.rgb);
+    if(!d.rgb->pixels)
+    {
+      fprintf(stderr, "bench_mask: alloc failed\n");
+      exit(1);
+    }
+    bench_generate_pixels(d.rgb->pixels, size, size);
+
+    t = bench_run(bench_mask_split, &d);
+    bench_report("mask", "split_alpha", size, size, t, size * size * 4);
+    t = bench_run(bench_mask_merge, &d);
+    bench_report("mask", "merge_alpha", size, size, t, size * size * 4);
+    t = bench_run(bench_mask_luma, &d);
+    bench_report("mask", "luma", size, size, t, size * size * 4);
+
+    /* Scan the whole image, as for an opaque image. */
+    memset(d.mask->data, 255, size * size);
+    icns_pixels_set_alpha(d.rgb->pixels, d.mask->data, size * size);
+    t = bench_run(bench_mask_opaque_scan, &d);
+    bench_report("mask", "opaque_scan", size, size, t, size * size * 4);
+
+    icns_delete_state_data(d.icns);
+  }
+}
@@ -0,0 +1,110 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+#include "../src/icns.h"
+#include "../src/icns_png.h"
+
+struct bench_png_data
+{
+  struct icns_data *icns;
+  struct icns_image *image;
+  struct rgba_color *pixels;
+  uint8_t *png;
+  size_t png_size;
+  size_t size;
+};
+
+static void bench_png_encode(void *priv)
+{
+  struct bench_png_data *d = (struct bench_png_data *)priv;
+  uint8_t *png;
+  size_t png_size;
+
+  if(icns_encode_png_to_buffer(d->icns, &png, &png_size,
+   d->pixels, d->size, d->size, ICNS_PNG_PROFILE_DEFAULT))
+  {
+    fprintf(stderr, "bench_png: encode failed\n");
+    exit(1);
+  }
+  free(png);
+}
+
+static void bench_png_decode(void *priv)
+{
+  struct bench_png_data *d = (struct bench_png_data *)priv;
+
+  if(icns_decode_png_to_pixel_array(d->icns, d->image, d->png, d->png_size))
+  {
+    fprintf(stderr, "bench_png: decode failed\n");
+    exit(1);
+  }
+}
+
+void bench_png(void)
+{
+  const struct icns_format *formats[BENCH_MAX_SIZES];
+  size_t num_formats = bench_get_formats(formats, BENCH_MAX_SIZES, NULL);
+  size_t i;
+
+  for(i = 0; i < num_formats; i++)
+  {
+    struct bench_png_data d;
+    size_t num_pixels;
+    double t;
+
+    d.icns = icns_allocate_state_data();
+    if(!d.icns ||
+     icns_add_image_for_format(d.icns, &d.image, NULL, formats[i]))
+    {
+      fprintf(stderr, "bench_png: init failed\n");
+      exit(1);
+    }
+    d.size = d.image->real_width;
+    num_pixels = d.size * d.size;
+
+    d.pixels = (struct rgba_color *)malloc(num_pixels * sizeof(struct rgba_color));
+    if(!d.pixels)
+    {
+      fprintf(stderr, "bench_png: alloc failed\n");
+      exit(1);
+    }
+    bench_generate_pixels(d.pixels, d.size, d.size);
+
+    if(icns_encode_png_to_buffer(d.icns, &d.png, &d.png_size,
+     d.pixels, d.size, d.size, ICNS_PNG_PROFILE_DEFAULT))
+    {
+      fprintf(stderr, "bench_png: encode failed\n");
+      exit(1);
+    }
+
+    t = bench_run(bench_png_encode, &d);
+    bench_report("png", "encode", d.size, d.size, t, num_pixels * 4);
+    icns_set_png_backend(d.icns, ICNS_PNG_BACKEND_BUILTIN);
+    t = bench_run(bench_png_encode, &d);
+    bench_report("png", "encode-builtin", d.size, d.size, t, num_pixels * 4);
+    icns_set_png_backend(d.icns, ICNS_PNG_BACKEND_LIBPNG);
+    t = bench_run(bench_png_decode, &d);
+    bench_report("png", "decode", d.size, d.size, t, num_pixels * 4);
+
+    free(d.pixels);
+    free(d.png);
+    icns_delete_state_data(d.icns);
+  }
+}
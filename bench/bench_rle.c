@@ -0,0 +1,260 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "bench.h"
+#include "../src/icns.h"
+#include "../src/icns_pixels.h"
+#include "../src/icns_rle.h"
+
+#include <stddef.h>
+
+struct bench_rle_data
+{
+  struct icns_data icns;
+  const struct icns_rle_kernels *kernels;
+  struct rgba_color *pixels;
+  uint8_t *planes;
+  uint8_t *dest;
+  size_t num_pixels;
+  size_t bound;
+  size_t packed_size;
+};
+
+/* Pack all four channels directly from the pixel array (stride 4). */
+static void bench_rle_pack_strided(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  const uint8_t *pixels = (const uint8_t *)d->pixels;
+  size_t pos = 0;
+
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos,
+   pixels + offsetof(struct rgba_color, a), d->num_pixels, 4);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos,
+   pixels + offsetof(struct rgba_color, r), d->num_pixels, 4);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos,
+   pixels + offsetof(struct rgba_color, g), d->num_pixels, 4);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos,
+   pixels + offsetof(struct rgba_color, b), d->num_pixels, 4);
+  d->packed_size = pos;
+}
+
+/* Split into planes, then pack each plane with unit stride. */
+static void bench_rle_pack_planar(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  size_t pos = 0;
+
+  icns_pixels_to_planes(r, g, b, a, d->pixels, n);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos, a, n, 1);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos, r, n, 1);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos, g, n, 1);
+  pos = icns_rle_pack_channel(d->dest, d->bound, pos, b, n, 1);
+  d->packed_size = pos;
+}
+
+/* Split into planes, then pack each plane with the format's fixed size
+ * kernels. */
+static void bench_rle_pack_fixed(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  size_t pos = 0;
+
+  icns_pixels_to_planes(r, g, b, a, d->pixels, n);
+  pos = d->kernels->pack(d->dest, d->bound, pos, a);
+  pos = d->kernels->pack(d->dest, d->bound, pos, r);
+  pos = d->kernels->pack(d->dest, d->bound, pos, g);
+  pos = d->kernels->pack(d->dest, d->bound, pos, b);
+  d->packed_size = pos;
+}
+
+/* Split into planes, then pack each plane with the size-optimal packer. */
+static void bench_rle_pack_optimal(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  size_t pos = 0;
+
+  icns_pixels_to_planes(r, g, b, a, d->pixels, n);
+  pos = icns_rle_pack_channel_optimal(&d->icns, d->dest, d->bound, pos,
+   a, n, 1);
+  pos = icns_rle_pack_channel_optimal(&d->icns, d->dest, d->bound, pos,
+   r, n, 1);
+  pos = icns_rle_pack_channel_optimal(&d->icns, d->dest, d->bound, pos,
+   g, n, 1);
+  pos = icns_rle_pack_channel_optimal(&d->icns, d->dest, d->bound, pos,
+   b, n, 1);
+  d->packed_size = pos;
+}
+
+/* Unpack all four channels directly into the pixel array (stride 4). */
+static void bench_rle_unpack_strided(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  uint8_t *pixels = (uint8_t *)d->pixels;
+  size_t pos = 0;
+
+  pos = icns_rle_unpack_channel(pixels + offsetof(struct rgba_color, a),
+   d->num_pixels, 4, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(pixels + offsetof(struct rgba_color, r),
+   d->num_pixels, 4, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(pixels + offsetof(struct rgba_color, g),
+   d->num_pixels, 4, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(pixels + offsetof(struct rgba_color, b),
+   d->num_pixels, 4, d->dest, d->packed_size, pos);
+}
+
+/* Unpack into planes, then merge the planes into the pixel array. */
+static void bench_rle_unpack_planar(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  size_t pos = 0;
+
+  pos = icns_rle_unpack_channel(a, n, 1, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(r, n, 1, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(g, n, 1, d->dest, d->packed_size, pos);
+  pos = icns_rle_unpack_channel(b, n, 1, d->dest, d->packed_size, pos);
+  icns_planes_to_pixels(d->pixels, r, g, b, a, n);
+}
+
+/* Unpack into planes with the format's fixed size kernels, then merge. */
+static void bench_rle_unpack_fixed(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  size_t pos = 0;
+
+  pos = d->kernels->unpack(a, d->dest, d->packed_size, pos);
+  pos = d->kernels->unpack(r, d->dest, d->packed_size, pos);
+  pos = d->kernels->unpack(g, d->dest, d->packed_size, pos);
+  pos = d->kernels->unpack(b, d->dest, d->packed_size, pos);
+  icns_planes_to_pixels(d->pixels, r, g, b, a, n);
+}
+
+/* Unpack into planes with up to four threads, then merge. */
+static void bench_rle_unpack_threaded(void *priv)
+{
+  struct bench_rle_data *d = (struct bench_rle_data *)priv;
+  size_t n = d->num_pixels;
+  uint8_t *r = d->planes;
+  uint8_t *g = r + n;
+  uint8_t *b = g + n;
+  uint8_t *a = b + n;
+  uint8_t *channels[4] = { a, r, g, b };
+  unsigned bad_channel;
+
+  icns_rle_unpack_channels(channels, 4, n, d->dest, d->packed_size, 0,
+   d->kernels, 4, &bad_channel);
+  icns_planes_to_pixels(d->pixels, r, g, b, a, n);
+}
+
+/* Find the fixed size kernels a packed format uses for this size. */
+static const struct icns_rle_kernels *bench_rle_get_kernels(size_t count)
+{
+  const struct icns_format *list[64];
+  size_t num_formats = icns_get_format_list(list, 64);
+  size_t i;
+
+  if(num_formats > 64)
+    num_formats = 64;
+
+  for(i = 0; i < num_formats; i++)
+    if(list[i]->rle && list[i]->rle->count == count)
+      return list[i]->rle;
+
+  return NULL;
+}
+
+void bench_rle(void)
+{
+  const struct icns_format *formats[BENCH_MAX_SIZES];
+  size_t num_formats = bench_get_formats(formats, BENCH_MAX_SIZES, NULL);
+  size_t i;
+
+  for(i = 0; i < num_formats; i++)
+  {
+    struct bench_rle_data d;
+    size_t size = formats[i]->width * formats[i]->factor;
+    double t;
+
+    icns_initialize_state_data(&d.icns);
+    d.num_pixels = size * size;
+    d.kernels = bench_rle_get_kernels(d.num_pixels);
+    d.bound = icns_rle_channel_bound(d.num_pixels) * 4;
+    d.pixels = (struct rgba_color *)malloc(d.num_pixels * sizeof(struct rgba_color));
+    d.planes = (uint8_t *)malloc(d.num_pixels * 4);
+    d.dest = (uint8_t *)malloc(d.bound);
+    if(!d.pixels || !d.planes || !d.dest)
+    {
+      fprintf(stderr, "bench_rle: alloc failed\n");
+      exit(1);
+    }
+    bench_generate_pixels(d.pixels, size, size);
+
+    t = bench_run(bench_rle_pack_strided, &d);
+    bench_report("rle_pack", "strided", size, size, t, d.num_pixels * 4);
+    t = bench_run(bench_rle_pack_optimal, &d);
+    bench_report("rle_pack", "optimal", size, size, t, d.num_pixels * 4);
+    t = bench_run(bench_rle_pack_planar, &d);
+    bench_report("rle_pack", "planar", size, size, t, d.num_pixels * 4);
+    if(d.kernels)
+    {
+      t = bench_run(bench_rle_pack_fixed, &d);
+      bench_report("rle_pack", "fixed", size, size, t, d.num_pixels * 4);
+    }
+
+    t = bench_run(bench_rle_unpack_strided, &d);
+    bench_report("rle_unpack", "strided", size, size, t, d.num_pixels * 4);
+    t = bench_run(bench_rle_unpack_planar, &d);
+    bench_report("rle_unpack", "planar", size, size, t, d.num_pixels * 4);
+    if(d.kernels)
+    {
+      t = bench_run(bench_rle_unpack_fixed, &d);
+      bench_report("rle_unpack", "fixed", size, size, t, d.num_pixels * 4);
+    }
+    t = bench_run(bench_rle_unpack_threaded, &d);
+    bench_report("rle_unpack", "planar_4t", size, size, t, d.num_pixels * 4);
+
+    free(d.pixels);
+    free(d.planes);
+    free(d.dest);
+  }
+}
@@ -35,6 +35,7 @@ extern "C" {
 
 /* Configured variables. */
 /* #define ICNSCVT_NO_FILESYSTEM */
+/* #define ICNSCVT_NO_THREADS */
 /* End configured variables. */
 
 #ifndef ICNSCVT_EXPORT
@@ -62,17 +63,36 @@ extern "C" {
 /* An icns_image_id array of this size should fit all possible images. */
 #define ICNSCVT_MAX_IMAGES        64
 
+/* PNG compression profiles for `icnscvt_set_png_profile`. */
+#define ICNSCVT_PNG_DEFAULT       0
+#define ICNSCVT_PNG_FAST          1
+#define ICNSCVT_PNG_MAX           2
+#define ICNSCVT_PNG_EXHAUSTIVE    3
+
+/* PNG encoder backends for `icnscvt_set_png_backend`. */
+#define ICNSCVT_PNG_BACKEND_LIBPNG  0
+#define ICNSCVT_PNG_BACKEND_BUILTIN 1
+
+/* PNG input validation levels for `icnscvt_set_png_validation`. */
+#define ICNSCVT_PNG_VALIDATE_DECODE     0
+#define ICNSCVT_PNG_VALIDATE_STRUCTURE  1
+#define ICNSCVT_PNG_VALIDATE_TRUSTED    2
+
 /* Subset numbers for icons that use e.g. dark mode. */
 #define ICNSCVT_SUBSET_MAIN       0
 #define ICNSCVT_SUBSET_DARK_MODE  1
 
 typedef struct libicnscvt_opaque *icnscvt;
+typedef struct libicnscvt_pool_opaque *icnscvt_pool;
 typedef unsigned long icns_format_id;
 typedef ptrdiff_t icns_ssize_t;
 
 typedef void   (*icnscvt_error_func)(const char *message, void *priv);
 typedef size_t (*icnscvt_read_func) (void *dest, size_t sz, void *priv);
 typedef size_t (*icnscvt_write_func)(const void *src, size_t sz, void *priv);
+typedef void  *(*icnscvt_alloc_func)(void *priv, size_t sz);
+typedef void  *(*icnscvt_realloc_func)(void *priv, void *ptr, size_t sz);
+typedef void   (*icnscvt_free_func)(void *priv, void *ptr);
 
 /**
  * Get the 32-bit unsigned integer corresponding to the version of libicnscvt
@@ -113,6 +133,91 @@ ICNSCVT_EXPORT int icnscvt_destroy_context(
   icnscvt context
 );
 
+/**
+ * Reset an existing context so it can be reused for another conversion.
+ * All loaded images are freed and any open stream is closed, but settings
+ * configured on the context (error reporting, thread count, encoder
+ * options, allocator, and arena mode) are kept. This is cheaper than
+ * destroying the context and creating a new one, particularly in arena mode,
+ * where the arena's memory is kept for reuse.
+ *
+ * @param context           context/state data.
+ * @return                  0 on success or a negative value on failure.
+ *                          The only failure state for this function is if
+ *                          the provided context pointer is invalid.
+ */
+ICNSCVT_EXPORT int icnscvt_reset_context(
+  icnscvt context
+);
+
+/**
+ * Create a pool of reusable contexts. Unlike individual contexts, the pool
+ * functions may be called from multiple threads concurrently without a
+ * caller-managed lock (unless libicnscvt was built without threads).
+ *
+ * @param compiled_version  provide ICNSCVT_COMPILED_VERSION to this argument.
+ *                          See `icnscvt_create_context`.
+ * @param max_idle          maximum number of released contexts the pool
+ *                          keeps for reuse. Contexts released while the pool
+ *                          is full are destroyed.
+ * @return                  newly allocated pool, or NULL on failure.
+ */
+ICNSCVT_EXPORT icnscvt_pool icnscvt_create_pool(
+  unsigned compiled_version,
+  unsigned max_idle
+);
+
+/**
+ * Destroy a context pool and all idle contexts held by it. Contexts that
+ * were acquired from the pool and not released are not destroyed, and must
+ * be destroyed with `icnscvt_destroy_context` instead of released.
+ *
+ * @param pool              pool to destroy.
+ * @return                  0 on success or a negative value on failure.
+ *                          The only failure state for this function is if
+ *                          the provided pool pointer is invalid.
+ */
+ICNSCVT_EXPORT int icnscvt_destroy_pool(
+  icnscvt_pool pool
+);
+
+/**
+ * Borrow a context from a pool. An idle context is reused if available;
+ * otherwise, a new context is created. A reused context has the default
+ * settings, like a new context, so arena mode is disabled. If arena mode
+ * was enabled with the default allocator before the context was released,
+ * its arena memory is kept and reused if arena mode is enabled again.
+ *
+ * @param pool              pool to borrow a context from.
+ * @return                  a context on success, or NULL if the pool is
+ *                          invalid or a new context could not be allocated.
+ */
+ICNSCVT_EXPORT icnscvt icnscvt_pool_acquire(
+  icnscvt_pool pool
+);
+
+/**
+ * Return a context to a pool. The context is reset with the same rules as
+ * `icnscvt_reset_context`, then its settings (error reporting, threading,
+ * encoder options, allocator, and arena mode) are restored to their
+ * defaults. If arena mode is enabled and the default allocator is in use,
+ * the arena memory is kept for a borrower that enables arena mode again;
+ * otherwise it is freed. The context should not be used by the caller
+ * afterward.
+ * Any context may be released to a pool, including contexts created by
+ * `icnscvt_create_context`.
+ *
+ * @param pool              pool to return the context to.
+ * @param context           context/state data.
+ * @return                  0 on success or a negative value on failure.
+ *                          The only failure state for this function is if
+ *                          the provided pool or context pointer is invalid.
+ */
+ICNSCVT_EXPORT int icnscvt_pool_release(
+  icnscvt_pool pool,
+  icnscvt context
+);
+
 /**
  * Allocate a buffer in memory using icnscvt's internal allocation functions.
  * This is intended for environments where internal memory can not readily be
@@ -150,6 +255,59 @@ ICNSCVT_EXPORT int icnscvt_free(
   void *buf
 );
 
+/**
+ * Set the allocator used for all memory allocated by this context, including
+ * loaded images, conversion buffers, libpng state, and buffers returned by
+ * `icnscvt_allocate`. The context itself is always allocated by the C
+ * library allocator. The allocator can only be changed while no images are
+ * loaded and arena mode is disabled, and buffers returned by
+ * `icnscvt_allocate` must be freed before it is changed. If threads are
+ * enabled by `icnscvt_set_thread_count`, the allocator functions may be
+ * called from multiple threads concurrently.
+ *
+ * The free function will never be called with a NULL pointer. The realloc
+ * function must behave like `realloc`, but will never be called with a size
+ * of 0 or a NULL pointer.
+ *
+ * @param context           context/state data.
+ * @param alloc_fn          caller-defined allocation function.
+ * @param realloc_fn        caller-defined reallocation function.
+ * @param free_fn           caller-defined free function.
+ * @param priv              private caller-defined data for the allocator.
+ * @return                  0 on success or a negative value on failure.
+ *                          All three functions must be provided, or all
+ *                          three must be NULL to restore the default
+ *                          C library allocator.
+ */
+ICNSCVT_EXPORT int icnscvt_set_allocator(
+  icnscvt context,
+  icnscvt_alloc_func alloc_fn,
+  icnscvt_realloc_func realloc_fn,
+  icnscvt_free_func free_fn,
+  void *priv
+);
+
+/**
+ * Enable or disable arena mode. In arena mode, internal allocations are
+ * carved from large blocks obtained from the context's allocator, and are
+ * all released at once when the context is cleared or destroyed instead of
+ * being freed individually. This reduces allocator overhead and
+ * fragmentation for long-lived contexts that process many icons. Buffers
+ * returned by `icnscvt_allocate` are never allocated from the arena.
+ *
+ * Arena mode can only be changed while no images are loaded. The allocator
+ * can not be changed by `icnscvt_set_allocator` while arena mode is enabled.
+ *
+ * @param context           context/state data.
+ * @param enable            non-zero to enable arena mode;
+ *                          0 (default) to disable arena mode.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_arena_mode(
+  icnscvt context,
+  int enable
+);
+
 /**
  * Set the error reporting level. Errors will be reported by the callback
  * provided to `icnscvt_set_error_function`; otherwise, they will be printed
@@ -199,6 +357,122 @@ ICNSCVT_EXPORT int icnscvt_set_error_function(
   icnscvt_error_func fn
 );
 
+/**
+ * Set the maximum number of threads libicnscvt may use to process a single
+ * API call. Threads are started and joined within the call that uses them;
+ * no threads persist between calls. Work is only split between threads when
+ * the image is large enough for it to help. Threaded output is always
+ * identical to single-threaded output.
+ *
+ * @param context           context/state data.
+ * @param count             maximum number of threads. 0 (default) or 1
+ *                          disables threading. Values above 64 are clamped
+ *                          to 64.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_thread_count(
+  icnscvt context,
+  int count
+);
+
+/**
+ * Enable or disable size-optimal packing for the packed (A)RGB formats
+ * (is32, il32, ih32, it32, ic04, ic05, icsb, and icp4/icp5 in raw mode).
+ * The optimal packer always produces output no larger than the default
+ * packer, but is slower and uses more memory. The output of either packer
+ * can be read by any ICNS reader.
+ *
+ * @param context           context/state data.
+ * @param enable            non-zero to enable size-optimal packing;
+ *                          0 (default) to use the faster default packer.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_optimal_rle(
+  icnscvt context,
+  int enable
+);
+
+/**
+ * Set the compression profile used when encoding PNGs, either for one
+ * format or for every format without its own profile. Only PNGs that are
+ * encoded by libicnscvt are affected; PNGs that are passed through as-is
+ * are never recompressed.
+ *
+ * Profiles:
+ *  ICNSCVT_PNG_DEFAULT (default) - libpng default compression and filtering.
+ *  ICNSCVT_PNG_FAST              - fastest compression with Sub filtering,
+ *                                  for previews and CI.
+ *  ICNSCVT_PNG_MAX               - strongest compression with adaptive
+ *                                  filtering, for release packaging.
+ *  ICNSCVT_PNG_EXHAUSTIVE        - encode with every combination of row
+ *                                  filter (None, Sub, Up, Average, Paeth,
+ *                                  adaptive) and zlib strategy (default,
+ *                                  filtered, RLE) and keep the smallest
+ *                                  result. Roughly twenty times slower
+ *                                  than ICNSCVT_PNG_MAX; intended for
+ *                                  final release builds.
+ *
+ * @param context           context/state data.
+ * @param format            format ID of a format that supports PNG, or 0
+ *                          to set the profile for all formats without
+ *                          their own profile.
+ * @param profile           PNG compression profile.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_png_profile(
+  icnscvt context,
+  icns_format_id format,
+  int profile
+);
+
+/**
+ * Set the backend used to encode PNGs.
+ *
+ * Backends:
+ *  ICNSCVT_PNG_BACKEND_LIBPNG (default) - libpng and zlib, using the
+ *                                          profiles set with
+ *                                          `icnscvt_set_png_profile`.
+ *  ICNSCVT_PNG_BACKEND_BUILTIN          - built-in writer with fast
+ *                                          fixed-Huffman compression.
+ *                                          Much faster than libpng but
+ *                                          produces larger PNGs; intended
+ *                                          for previews and CI. PNG
+ *                                          profiles are ignored.
+ *
+ * @param context           context/state data.
+ * @param backend           PNG encoder backend.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_png_backend(
+  icnscvt context,
+  int backend
+);
+
+/**
+ * Set how input PNGs are validated when they are passed through to the
+ * output without being decoded. PNGs that need to be decoded are always
+ * fully validated.
+ *
+ * Levels:
+ *  ICNSCVT_PNG_VALIDATE_DECODE (default) - decode the image data and
+ *                                          discard it.
+ *  ICNSCVT_PNG_VALIDATE_STRUCTURE        - check the signature, chunk
+ *                                          CRCs, chunk order, and IHDR
+ *                                          (including dimensions), but
+ *                                          do not decompress the image
+ *                                          data.
+ *  ICNSCVT_PNG_VALIDATE_TRUSTED          - as above, but skip the CRCs.
+ *                                          Only for trusted input.
+ *
+ * @param context           context/state data.
+ * @param validation        PNG validation level.
+ * @return                  0 on success or a negative value on failure.
+ */
+ICNSCVT_EXPORT int icnscvt_set_png_validation(
+  icnscvt context,
+  int validation
+);
+
 /**
  * Get the full list of ICNS image formats supported by this libicnscvt.
  *
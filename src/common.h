@@ -39,6 +39,7 @@
 #ifndef RESTRICT
 #define RESTRICT restrict
 #endif
+#define ALWAYS_INLINE       inline __attribute__((always_inline))
 #define NOT_NULL            __attribute__((nonnull))
 #define NOT_NULL_1(a)       __attribute__((nonnull((a))))
 #define NOT_NULL_2(a,b)     __attribute__((nonnull((a),(b))))
@@ -107,9 +108,42 @@ enum icns_target_type
   ICNS_TARGET_ICNS
 };
 
+/* Values match the public ICNSCVT_PNG_* profiles. */
+enum icns_png_profile
+{
+  ICNS_PNG_PROFILE_DEFAULT,
+  ICNS_PNG_PROFILE_FAST,
+  ICNS_PNG_PROFILE_MAX,
+  ICNS_PNG_PROFILE_EXHAUSTIVE
+};
+
+/* Values match the public ICNSCVT_PNG_BACKEND_* values. */
+enum icns_png_backend
+{
+  ICNS_PNG_BACKEND_LIBPNG,
+  ICNS_PNG_BACKEND_BUILTIN
+};
+
+/* Values match the public ICNSCVT_PNG_VALIDATE_* values. */
+enum icns_png_validation
+{
+  ICNS_PNG_VALIDATE_DECODE,
+  ICNS_PNG_VALIDATE_STRUCTURE,
+  ICNS_PNG_VALIDATE_TRUSTED
+};
+
+#define ICNS_MAX_PNG_PROFILES 32
+struct icns_png_profile_override
+{
+  uint32_t magic;
+  enum icns_png_profile profile;
+};
+
+struct icns_arena;
 struct icns_data;
 struct icns_format;
 struct icns_image;
+struct icns_rle_kernels;
 
 struct icns_chunk_header
 {
@@ -128,7 +162,21 @@ struct icns_image_set
   unsigned num_toc;
 };
 
-#define ICNS_ERROR_SIZE 256
+#define ICNS_ERROR_SIZE       256
+#define ICNS_MAX_ERRORS       32
+#define ICNS_ERROR_TEXT_SIZE  2048
+struct icns_error_record
+{
+  const char *file;
+  const char *func;
+  const char *fmt;
+  unsigned line;
+  /* Offset of the formatted message in `error_text`, -1 if the message
+   * was not formatted because the error level would not report it, or -2
+   * if `error_text` was full. */
+  int text;
+};
+
 struct icns_data
 {
 #define ICNS_DATA_MAGIC MAGIC(0xfe,'i','V',0x2a)
@@ -142,6 +190,15 @@ struct icns_data
   enum icns_error_level error_level;
   bool force_recoding;
   bool force_raw_if_available;
+  bool optimal_rle;
+  unsigned num_threads;
+
+  /* PNG encoder profile for formats without an override. */
+  enum icns_png_profile png_profile;
+  struct icns_png_profile_override png_profiles[ICNS_MAX_PNG_PROFILES];
+  unsigned num_png_profiles;
+  enum icns_png_backend png_backend;
+  enum icns_png_validation png_validation;
 
   struct
   {
@@ -173,32 +230,104 @@ struct icns_data
   void *err_priv;
   void (*err_fn)(const char *, void *);
 
+  /* NULL functions: use the C library allocator. */
+  void *alloc_priv;
+  void *(*alloc_fn)(void *, size_t);
+  void *(*realloc_fn)(void *, void *, size_t);
+  void (*free_fn)(void *, void *);
+  /* Non-NULL: carve allocations from this arena (see icns_arena.c). */
+  struct icns_arena *arena;
+  /* Suspended arena, kept for reuse when arena mode is next enabled. */
+  struct icns_arena *idle_arena;
+
   uint32_t requested_inputs[32];
   unsigned num_requested;
 
-  char error_stack[64][ICNS_ERROR_SIZE];
+  /* Errors past ICNS_MAX_ERRORS are counted but not recorded. */
+  struct icns_error_record errors[ICNS_MAX_ERRORS];
+  char error_text[ICNS_ERROR_TEXT_SIZE];
+  unsigned error_text_pos;
   unsigned num_errors;
   bool is_warning;
   bool is_error;
 };
 
-#define W_(...) do { \
-  unsigned i = icns->num_errors; \
-  int pos = snprintf(icns->error_stack[i], ICNS_ERROR_SIZE, "%s:%s:%d: ", \
-   __FILE__, __func__, __LINE__); \
-  snprintf(icns->error_stack[i] + pos, ICNS_ERROR_SIZE - pos, "" __VA_ARGS__); \
-  icns->num_errors++; \
-  icns->is_warning = true; \
-} while(0)
-
-#define E_(...) do { \
-  unsigned i = icns->num_errors; \
-  int pos = snprintf(icns->error_stack[i], ICNS_ERROR_SIZE, "%s:%s:%d: ", \
-   __FILE__, __func__, __LINE__); \
-  snprintf(icns->error_stack[i] + pos, ICNS_ERROR_SIZE - pos, "" __VA_ARGS__); \
-  icns->num_errors++; \
-  icns->is_error = true; \
-} while(0)
+void icns_push_error(struct icns_data *icns, bool is_error,
+  const char *file, const char *func, unsigned line, const char *fmt, ...)
+  NOT_NULL_4(1,3,4,6) __attribute__((format(printf, 6, 7)));
+
+/* Messages are only formatted if the current error level reports them. */
+#define W_(...) \
+  icns_push_error(icns, false, __FILE__, __func__, __LINE__, "" __VA_ARGS__)
+
+#define E_(...) \
+  icns_push_error(icns, true, __FILE__, __func__, __LINE__, "" __VA_ARGS__)
+
+void *icns_arena_alloc(struct icns_data *icns, size_t size) NOT_NULL;
+void *icns_arena_realloc(struct icns_data *icns, void *ptr, size_t size)
+  NOT_NULL_1(1);
+void icns_arena_free(struct icns_data *icns, void *ptr) NOT_NULL_1(1);
+
+/* Allocate directly from the user allocator (see `icns_set_allocator`),
+ * bypassing the arena. Use for memory that outlives a context reset. */
+static inline void *icns_raw_malloc(struct icns_data *icns, size_t size)
+{
+  if(icns->alloc_fn)
+    return icns->alloc_fn(icns->alloc_priv, size);
+
+  return malloc(size);
+}
+
+static inline void *icns_raw_realloc(struct icns_data *icns,
+ void *ptr, size_t size)
+{
+  if(icns->realloc_fn)
+  {
+    if(!ptr)
+      return icns->alloc_fn(icns->alloc_priv, size);
+
+    return icns->realloc_fn(icns->alloc_priv, ptr, size);
+  }
+
+  return realloc(ptr, size);
+}
+
+static inline void icns_raw_free(struct icns_data *icns, void *ptr)
+{
+  if(icns->free_fn)
+  {
+    if(ptr)
+      icns->free_fn(icns->alloc_priv, ptr);
+  }
+  else
+    free(ptr);
+}
+
+/* All internal allocations go through these so the library user can
+ * replace the allocator or enable arena mode. */
+static inline void *icns_malloc(struct icns_data *icns, size_t size)
+{
+  if(icns->arena)
+    return icns_arena_alloc(icns, size);
+
+  return icns_raw_malloc(icns, size);
+}
+
+static inline void *icns_realloc(struct icns_data *icns, void *ptr, size_t size)
+{
+  if(icns->arena)
+    return icns_arena_realloc(icns, ptr, size);
+
+  return icns_raw_realloc(icns, ptr, size);
+}
+
+static inline void icns_free(struct icns_data *icns, void *ptr)
+{
+  if(icns->arena)
+    icns_arena_free(icns, ptr);
+  else
+    icns_raw_free(icns, ptr);
+}
 
 ICNS_END_DECLS
 
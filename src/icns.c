@@ -17,9 +17,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdarg.h>
+
 #include "../include/libicnscvt.h"
 #include "icns.h"
+#include "icns_arena.h"
 #include "icns_image.h"
+#include "icns_io.h"
+#include "icns_thread.h"
 
 /**
  * Allocate and initialize the icnscvt state data.
@@ -62,8 +67,92 @@ static void icns_free_all(struct icns_data *icns)
  */
 void icns_clear_state_data(struct icns_data *icns)
 {
+  /* Buffers from `icnscvt_allocate` may outlive this, so keep the allocator
+   * they need to be freed with. */
+  void *alloc_priv = icns->alloc_priv;
+  void *(*alloc_fn)(void *, size_t) = icns->alloc_fn;
+  void *(*realloc_fn)(void *, void *, size_t) = icns->realloc_fn;
+  void (*free_fn)(void *, void *) = icns->free_fn;
+  struct icns_arena *arena;
+  struct icns_arena *idle_arena;
+
   icns_free_all(icns);
+  icns_arena_reset(icns);
+  arena = icns->arena;
+  idle_arena = icns->idle_arena;
+
   icns_initialize_state_data(icns);
+  icns_set_allocator(icns, alloc_fn, realloc_fn, free_fn, alloc_priv);
+  icns->arena = arena;
+  icns->idle_arena = idle_arena;
+}
+
+/**
+ * Reset the per-conversion state of an icnscvt state data structure so it
+ * can be reused, freeing all images and closing any open stream. Unlike
+ * `icns_clear_state_data`, caller configuration (error reporting, threading,
+ * encoder options, allocator, and arena) is kept, and the error stack and
+ * table of contents are not cleared since they are only read up to their
+ * counts.
+ *
+ * @param icns    current state data structure to reset.
+ */
+void icns_reset_state_data(struct icns_data *icns)
+{
+  icns_io_end(icns);
+  memset(&icns->io, 0, sizeof(icns->io));
+  icns_free_all(icns);
+  icns_arena_reset(icns);
+
+  icns->images.num_images = 0;
+  icns->images.num_toc = 0;
+  icns->state = ICNS_STATE_INIT;
+  icns->input_target = ICNS_TARGET_EXTERNAL;
+  icns->output_target = ICNS_TARGET_EXTERNAL;
+  icns->num_requested = 0;
+  icns->num_errors = 0;
+  icns->error_text_pos = 0;
+  icns->is_warning = false;
+  icns->is_error = false;
+}
+
+/**
+ * Restore the caller configuration of an icnscvt state data structure to
+ * its defaults (error reporting, threading, encoder options, stream
+ * callbacks, allocator, and arena mode). This should be called after
+ * `icns_reset_state_data`. If arena mode is enabled and the default
+ * allocator is in use, the arena is suspended so its blocks can be reused
+ * if arena mode is enabled again; otherwise, the arena is freed with the
+ * allocator it was created with.
+ *
+ * @param icns    current state data structure to restore.
+ */
+void icns_restore_default_settings(struct icns_data *icns)
+{
+  if(icns->alloc_fn)
+    icns_arena_disable(icns);
+  else
+    icns_arena_suspend(icns);
+
+  icns->error_level = ICNS_NO_ERRORS;
+  icns->force_recoding = false;
+  icns->force_raw_if_available = false;
+  icns->optimal_rle = false;
+  icns->num_threads = 0;
+
+  icns->png_profile = ICNS_PNG_PROFILE_DEFAULT;
+  icns->num_png_profiles = 0;
+  icns->png_backend = ICNS_PNG_BACKEND_LIBPNG;
+  icns->png_validation = ICNS_PNG_VALIDATE_DECODE;
+
+  icns->read_priv = NULL;
+  icns->read_fn = NULL;
+  icns->write_priv = NULL;
+  icns->write_fn = NULL;
+  icns->err_priv = NULL;
+  icns->err_fn = NULL;
+
+  icns_set_allocator(icns, NULL, NULL, NULL, NULL);
 }
 
 /**
@@ -76,6 +165,7 @@ void icns_delete_state_data(struct icns_data *icns)
 {
   icns->magic = 0;
   icns_free_all(icns);
+  icns_arena_disable(icns);
   free(icns);
 }
 
@@ -175,6 +265,226 @@ void icns_set_error_function(struct icns_data * RESTRICT icns,
   icns->err_fn = err_func;
 }
 
+/**
+ * Set the maximum number of threads to use for parallel work within
+ * one API call. Counts of 0 and 1 both disable threading.
+ *
+ * @param icns      current state data.
+ * @param count     maximum number of threads (clamped to ICNS_MAX_THREADS).
+ */
+void icns_set_thread_count(struct icns_data *icns, unsigned count)
+{
+  if(count > ICNS_MAX_THREADS)
+    count = ICNS_MAX_THREADS;
+
+  icns->num_threads = count;
+}
+
+/**
+ * Enable or disable size-optimal packing for (A)RGB images. When disabled,
+ * the faster greedy packer is used.
+ *
+ * @param icns      current state data.
+ * @param enable    true to use the size-optimal packer.
+ */
+void icns_set_optimal_rle(struct icns_data *icns, bool enable)
+{
+  icns->optimal_rle = enable;
+}
+
+/**
+ * Set the PNG encoder profile for one format, or for all formats without
+ * their own profile.
+ *
+ * @param icns      current state data.
+ * @param magic     format magic to set the profile for, or 0 to set the
+ *                  profile for formats without their own profile.
+ * @param profile   PNG encoder profile.
+ * @return          `true` on success, or `false` if too many formats
+ *                  already have their own profile.
+ */
+bool icns_set_png_profile(struct icns_data *icns, uint32_t magic,
+ enum icns_png_profile profile)
+{
+  unsigned i;
+
+  if(!magic)
+  {
+    icns->png_profile = profile;
+    return true;
+  }
+
+  for(i = 0; i < icns->num_png_profiles; i++)
+  {
+    if(icns->png_profiles[i].magic == magic)
+    {
+      icns->png_profiles[i].profile = profile;
+      return true;
+    }
+  }
+
+  if(icns->num_png_profiles >= ICNS_MAX_PNG_PROFILES)
+    return false;
+
+  icns->png_profiles[i].magic = magic;
+  icns->png_profiles[i].profile = profile;
+  icns->num_png_profiles++;
+  return true;
+}
+
+/**
+ * Get the PNG encoder profile for a format.
+ *
+ * @param icns      current state data.
+ * @param magic     format magic to get the profile for.
+ * @return          the format's profile if it has one, otherwise the
+ *                  profile for formats without their own profile.
+ */
+enum icns_png_profile icns_get_png_profile(const struct icns_data *icns,
+ uint32_t magic)
+{
+  unsigned i;
+
+  for(i = 0; i < icns->num_png_profiles; i++)
+    if(icns->png_profiles[i].magic == magic)
+      return icns->png_profiles[i].profile;
+
+  return icns->png_profile;
+}
+
+/**
+ * Set the PNG encoder backend: libpng, or the built-in writer, which is
+ * faster but compresses less and ignores the PNG encoder profiles.
+ *
+ * @param icns      current state data.
+ * @param backend   PNG encoder backend.
+ */
+void icns_set_png_backend(struct icns_data *icns,
+ enum icns_png_backend backend)
+{
+  icns->png_backend = backend;
+}
+
+/**
+ * Set how PNGs are validated when loaded without being decoded: by decoding
+ * them anyway, by checking their chunk structure only, or by checking their
+ * chunk structure without CRCs.
+ *
+ * @param icns        current state data.
+ * @param validation  PNG validation level.
+ */
+void icns_set_png_validation(struct icns_data *icns,
+ enum icns_png_validation validation)
+{
+  icns->png_validation = validation;
+}
+
+/**
+ * Set the allocator used for all internal allocations for the current state.
+ * The state data itself is always allocated with the C library allocator.
+ * This should only be changed while no memory is allocated through the
+ * current allocator, i.e. when no images are loaded.
+ *
+ * @param icns        current state data.
+ * @param alloc_fn    allocation function, or NULL to use `malloc`.
+ * @param realloc_fn  reallocation function, or NULL to use `realloc`.
+ * @param free_fn     free function, or NULL to use `free`.
+ * @param priv        private data pointer passed to the allocator functions.
+ */
+void icns_set_allocator(struct icns_data *icns,
+  void *(*alloc_fn)(void *, size_t),
+  void *(*realloc_fn)(void *, void *, size_t),
+  void (*free_fn)(void *, void *), void *priv)
+{
+  icns->alloc_fn = alloc_fn;
+  icns->realloc_fn = realloc_fn;
+  icns->free_fn = free_fn;
+  icns->alloc_priv = priv;
+}
+
+/**
+ * Record an error or warning for the current state; use the `E_` and `W_`
+ * macros instead of calling this directly. The message is only formatted if
+ * the current error level and callback will report error details, so
+ * expected failures (e.g. format probing) don't pay for formatting.
+ *
+ * @param icns      current state data.
+ * @param is_error  true for an error, false for a warning.
+ * @param file      source file of the error.
+ * @param func      function name of the error.
+ * @param line      source line of the error.
+ * @param fmt       printf format string of the message, followed by
+ *                  its arguments.
+ */
+void icns_push_error(struct icns_data *icns, bool is_error,
+  const char *file, const char *func, unsigned line, const char *fmt, ...)
+{
+  unsigned i = icns->num_errors++;
+
+  if(is_error)
+    icns->is_error = true;
+  else
+    icns->is_warning = true;
+
+  if(i < ICNS_MAX_ERRORS)
+  {
+    struct icns_error_record *rec = &icns->errors[i];
+    size_t left = ICNS_ERROR_TEXT_SIZE - icns->error_text_pos;
+
+    rec->file = file;
+    rec->func = func;
+    rec->fmt = fmt;
+    rec->line = line;
+    rec->text = -1;
+
+    if(!icns->err_fn || icns->error_level < ICNS_ERROR_DETAILS)
+      return;
+
+    if(left > 1)
+    {
+      char *text = icns->error_text + icns->error_text_pos;
+      va_list args;
+      int len;
+
+      va_start(args, fmt);
+      len = vsnprintf(text, left, fmt, args);
+      va_end(args);
+      if(len >= 0)
+      {
+        rec->text = icns->error_text_pos;
+        icns->error_text_pos += (size_t)len < left ? (size_t)len + 1 : left;
+      }
+    }
+    else
+      rec->text = -2;
+  }
+}
+
+/**
+ * Get the detail line for a recorded error or warning. If the message was
+ * not formatted when it was recorded, its format string is used instead,
+ * unless it was dropped because the message text buffer was full.
+ *
+ * @param icns    current state data.
+ * @param index   index of the error record (less than `ICNS_MAX_ERRORS`).
+ * @param dest    buffer to store the detail line to.
+ * @param size    size of `dest` in bytes.
+ */
+void icns_get_error_message(const struct icns_data *icns, unsigned index,
+  char *dest, size_t size)
+{
+  const struct icns_error_record *rec = &icns->errors[index];
+  const char *msg = rec->fmt;
+
+  if(rec->text >= 0)
+    msg = icns->error_text + rec->text;
+  else
+  if(rec->text == -2)
+    msg = "(message truncated)";
+
+  snprintf(dest, size, "%s:%s:%u: %s", rec->file, rec->func, rec->line, msg);
+}
+
 /**
  * Flush error data to the error stream at the requested detail level, then
  * return an integer error value. This function resets the context error state.
@@ -194,13 +504,18 @@ int icns_flush_error(struct icns_data *icns, enum icns_error err)
     if((icns->is_error && icns->error_level >= ICNS_ERROR_DETAILS) ||
        (icns->is_warning && icns->error_level >= ICNS_WARNING_DETAILS))
     {
+      char buf[ICNS_ERROR_SIZE];
       unsigned i;
-      for(i = 0; i < icns->num_errors; i++)
-        icns->err_fn(icns->error_stack[i], icns->err_priv);
+      for(i = 0; i < icns->num_errors && i < ICNS_MAX_ERRORS; i++)
+      {
+        icns_get_error_message(icns, i, buf, sizeof(buf));
+        icns->err_fn(buf, icns->err_priv);
+      }
     }
   }
   icns->is_error = false;
   icns->is_warning = false;
   icns->num_errors = 0;
+  icns->error_text_pos = 0;
   return -(int)err;
 }
@@ -27,6 +27,8 @@ ICNS_BEGIN_DECLS
 struct icns_data *icns_allocate_state_data(void);
 void icns_initialize_state_data(struct icns_data *icns) NOT_NULL;
 void icns_clear_state_data(struct icns_data *icns) NOT_NULL;
+void icns_reset_state_data(struct icns_data *icns) NOT_NULL;
+void icns_restore_default_settings(struct icns_data *icns) NOT_NULL;
 void icns_delete_state_data(struct icns_data *icns) NOT_NULL;
 
 void icns_set_error_level(struct icns_data *icns, enum icns_error_level level)
@@ -34,6 +36,22 @@ void icns_set_error_level(struct icns_data *icns, enum icns_error_level level)
 void icns_set_error_function(struct icns_data * RESTRICT icns,
   void * RESTRICT priv, void (*err_func)(const char *message, void *priv))
   NOT_NULL_1(1);
+void icns_set_thread_count(struct icns_data *icns, unsigned count) NOT_NULL;
+void icns_set_optimal_rle(struct icns_data *icns, bool enable) NOT_NULL;
+bool icns_set_png_profile(struct icns_data *icns, uint32_t magic,
+  enum icns_png_profile profile) NOT_NULL;
+enum icns_png_profile icns_get_png_profile(const struct icns_data *icns,
+  uint32_t magic) NOT_NULL;
+void icns_set_png_backend(struct icns_data *icns,
+  enum icns_png_backend backend) NOT_NULL;
+void icns_set_png_validation(struct icns_data *icns,
+  enum icns_png_validation validation) NOT_NULL;
+void icns_set_allocator(struct icns_data *icns,
+  void *(*alloc_fn)(void *, size_t),
+  void *(*realloc_fn)(void *, void *, size_t),
+  void (*free_fn)(void *, void *), void *priv) NOT_NULL_1(1);
+void icns_get_error_message(const struct icns_data *icns, unsigned index,
+  char *dest, size_t size) NOT_NULL;
 int icns_flush_error(struct icns_data *icns, enum icns_error err) NOT_NULL;
 
 ICNS_END_DECLS
@@ -0,0 +1,357 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "icns_arena.h"
+
+#ifndef ICNSCVT_NO_THREADS
+#include <pthread.h>
+#endif
+
+struct icns_arena_block
+{
+  struct icns_arena_block *next;
+  uint8_t *start;
+  uint8_t *end;
+  uint8_t *pos;
+};
+
+struct icns_arena
+{
+  struct icns_arena_block *head;
+  struct icns_arena_block *current;
+  /* Most recent allocation; can be resized or freed in place. */
+  uint8_t *last;
+#ifndef ICNSCVT_NO_THREADS
+  /* Threaded RLE packing allocates from worker threads. */
+  pthread_mutex_t lock;
+#endif
+};
+
+static inline void icns_arena_lock(struct icns_arena *arena)
+{
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_lock(&arena->lock);
+#else
+  (void)arena;
+#endif
+}
+
+static inline void icns_arena_unlock(struct icns_arena *arena)
+{
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_unlock(&arena->lock);
+#else
+  (void)arena;
+#endif
+}
+
+static inline uint8_t *icns_arena_align(uint8_t *pos)
+{
+  uintptr_t p = (uintptr_t)pos;
+  return pos + (-p & (ICNS_ARENA_ALIGN - 1));
+}
+
+/* Each allocation is preceded by its size so it can be resized. */
+static inline size_t *icns_arena_header(void *ptr)
+{
+  return (size_t *)ptr - 1;
+}
+
+static void *icns_arena_block_alloc(struct icns_arena_block *block,
+ size_t size)
+{
+  uint8_t *ptr = icns_arena_align(block->pos + sizeof(size_t));
+  if(ptr > block->end || size > (size_t)(block->end - ptr))
+    return NULL;
+
+  *icns_arena_header(ptr) = size;
+  block->pos = ptr + size;
+  return ptr;
+}
+
+/**
+ * Move the arena to a block with room for at least `size` bytes. The next
+ * block left over from before the last reset is reused if it is large
+ * enough; otherwise, a new block is inserted after the current block.
+ */
+static struct icns_arena_block *icns_arena_next_block(struct icns_data *icns,
+ struct icns_arena *arena, size_t size)
+{
+  struct icns_arena_block *next;
+  size_t capacity = ICNS_ARENA_BLOCK_SIZE;
+
+  next = arena->current ? arena->current->next : arena->head;
+  if(size > capacity - ICNS_ARENA_ALIGN)
+  {
+    if(size > SIZE_MAX - sizeof(struct icns_arena_block) -
+     2 * ICNS_ARENA_ALIGN)
+      return NULL;
+
+    capacity = size + ICNS_ARENA_ALIGN;
+  }
+
+  if(!next || (size_t)(next->end - next->start) < capacity)
+  {
+    struct icns_arena_block *block = (struct icns_arena_block *)
+     icns_raw_malloc(icns, sizeof(struct icns_arena_block) +
+      ICNS_ARENA_ALIGN + capacity);
+    if(!block)
+      return NULL;
+
+    block->start = icns_arena_align((uint8_t *)(block + 1));
+    block->end = block->start + capacity;
+    block->next = next;
+    if(arena->current)
+      arena->current->next = block;
+    else
+      arena->head = block;
+
+    next = block;
+  }
+  next->pos = next->start;
+  arena->current = next;
+  return next;
+}
+
+static void *icns_arena_alloc_locked(struct icns_data *icns,
+ struct icns_arena *arena, size_t size)
+{
+  struct icns_arena_block *block = arena->current;
+  void *ptr = NULL;
+
+  if(block)
+    ptr = icns_arena_block_alloc(block, size);
+
+  if(!ptr)
+  {
+    block = icns_arena_next_block(icns, arena, size);
+    if(!block)
+      return NULL;
+
+    ptr = icns_arena_block_alloc(block, size);
+  }
+  arena->last = (uint8_t *)ptr;
+  return ptr;
+}
+
+/**
+ * Allocate a 64-byte aligned buffer from the arena.
+ *
+ * @param icns    current state data with an enabled arena.
+ * @param size    size of the buffer to allocate.
+ * @return        the allocated buffer, or `NULL` on allocation failure.
+ */
+void *icns_arena_alloc(struct icns_data *icns, size_t size)
+{
+  struct icns_arena *arena = icns->arena;
+  void *ptr;
+
+  icns_arena_lock(arena);
+  ptr = icns_arena_alloc_locked(icns, arena, size);
+  icns_arena_unlock(arena);
+  return ptr;
+}
+
+/**
+ * Resize a buffer allocated from the arena. The most recent allocation is
+ * resized in place when possible; otherwise, the contents are copied to a
+ * new allocation.
+ *
+ * @param icns    current state data with an enabled arena.
+ * @param ptr     buffer to resize, or `NULL` to allocate a new buffer.
+ * @param size    new size of the buffer.
+ * @return        the resized buffer, or `NULL` on allocation failure (in
+ *                which case `ptr` is still valid).
+ */
+void *icns_arena_realloc(struct icns_data *icns, void *ptr, size_t size)
+{
+  struct icns_arena *arena = icns->arena;
+  size_t old_size;
+  void *dest;
+
+  if(!ptr)
+    return icns_arena_alloc(icns, size);
+
+  icns_arena_lock(arena);
+  if(ptr == arena->last &&
+   size <= (size_t)(arena->current->end - arena->last))
+  {
+    *icns_arena_header(ptr) = size;
+    arena->current->pos = arena->last + size;
+    icns_arena_unlock(arena);
+    return ptr;
+  }
+
+  old_size = *icns_arena_header(ptr);
+  dest = icns_arena_alloc_locked(icns, arena, size);
+  if(dest)
+    memcpy(dest, ptr, old_size < size ? old_size : size);
+
+  icns_arena_unlock(arena);
+  return dest;
+}
+
+/**
+ * Free a buffer allocated from the arena. Only the most recent allocation
+ * is actually reclaimed; all other memory is reclaimed by `icns_arena_reset`.
+ *
+ * @param icns    current state data with an enabled arena.
+ * @param ptr     buffer to free (may be `NULL`).
+ */
+void icns_arena_free(struct icns_data *icns, void *ptr)
+{
+  struct icns_arena *arena = icns->arena;
+
+  if(!ptr)
+    return;
+
+  icns_arena_lock(arena);
+  if(ptr == arena->last)
+  {
+    arena->current->pos = (uint8_t *)icns_arena_header(ptr);
+    arena->last = NULL;
+  }
+  icns_arena_unlock(arena);
+}
+
+/**
+ * Enable arena mode for the current state. This should only be done while
+ * no internal allocations are live. Does nothing if arena mode is already
+ * enabled. A suspended arena is resumed with its blocks.
+ *
+ * @param icns    current state data.
+ * @return        `ICNS_OK` on success, otherwise `ICNS_ALLOC_ERROR`.
+ */
+enum icns_error icns_arena_enable(struct icns_data *icns)
+{
+  struct icns_arena *arena;
+
+  if(icns->arena)
+    return ICNS_OK;
+
+  if(icns->idle_arena)
+  {
+    icns->arena = icns->idle_arena;
+    icns->idle_arena = NULL;
+    return ICNS_OK;
+  }
+
+  arena = (struct icns_arena *)icns_raw_malloc(icns, sizeof(struct icns_arena));
+  if(!arena)
+  {
+    E_("failed to allocate arena");
+    return ICNS_ALLOC_ERROR;
+  }
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->last = NULL;
+#ifndef ICNSCVT_NO_THREADS
+  if(pthread_mutex_init(&arena->lock, NULL))
+  {
+    icns_raw_free(icns, arena);
+    E_("failed to initialize arena lock");
+    return ICNS_ALLOC_ERROR;
+  }
+#endif
+  icns->arena = arena;
+  return ICNS_OK;
+}
+
+static void icns_arena_delete(struct icns_data *icns,
+ struct icns_arena *arena)
+{
+  struct icns_arena_block *block;
+  struct icns_arena_block *next;
+
+  if(!arena)
+    return;
+
+  for(block = arena->head; block; block = next)
+  {
+    next = block->next;
+    icns_raw_free(icns, block);
+  }
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_destroy(&arena->lock);
+#endif
+  icns_raw_free(icns, arena);
+}
+
+/**
+ * Disable arena mode for the current state and free all arena blocks,
+ * including those of a suspended arena. This should only be done while no
+ * arena allocations are live.
+ *
+ * @param icns    current state data.
+ */
+void icns_arena_disable(struct icns_data *icns)
+{
+  icns_arena_delete(icns, icns->arena);
+  icns_arena_delete(icns, icns->idle_arena);
+  icns->arena = NULL;
+  icns->idle_arena = NULL;
+}
+
+/**
+ * Disable arena mode for the current state, but keep the arena and its
+ * blocks so the next `icns_arena_enable` can resume it. This should only
+ * be done after `icns_arena_reset`. Does nothing if arena mode is disabled.
+ *
+ * @param icns    current state data.
+ */
+void icns_arena_suspend(struct icns_data *icns)
+{
+  if(!icns->arena)
+    return;
+
+  icns_arena_delete(icns, icns->idle_arena);
+  icns->idle_arena = icns->arena;
+  icns->arena = NULL;
+}
+
+/**
+ * Rewind the arena, invalidating all arena allocations. The blocks used
+ * since the previous reset are kept for reuse by later allocations; any
+ * blocks past them are freed. Does nothing if arena mode is disabled.
+ *
+ * @param icns    current state data.
+ */
+void icns_arena_reset(struct icns_data *icns)
+{
+  struct icns_arena *arena = icns->arena;
+  struct icns_arena_block *block;
+  struct icns_arena_block *next;
+
+  if(!arena)
+    return;
+
+  if(arena->current)
+  {
+    for(block = arena->current->next; block; block = next)
+    {
+      next = block->next;
+      icns_raw_free(icns, block);
+    }
+    arena->current->next = NULL;
+  }
+  arena->current = arena->head;
+  arena->last = NULL;
+  if(arena->head)
+    arena->head->pos = arena->head->start;
+}
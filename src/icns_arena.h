@@ -0,0 +1,42 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_ARENA_H
+#define ICNSCVT_ARENA_H
+
+#include "common.h"
+
+/* Optional bump allocator for a context. When enabled, `icns_malloc` and
+ * friends carve allocations from large blocks that are rewound all at once
+ * when the context is cleared. Allocation functions are declared in
+ * common.h. */
+
+ICNS_BEGIN_DECLS
+
+#define ICNS_ARENA_ALIGN      64
+#define ICNS_ARENA_BLOCK_SIZE (1 << 20)
+
+enum icns_error icns_arena_enable(struct icns_data *icns) NOT_NULL;
+void icns_arena_disable(struct icns_data *icns) NOT_NULL;
+void icns_arena_suspend(struct icns_data *icns) NOT_NULL;
+void icns_arena_reset(struct icns_data *icns) NOT_NULL;
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_ARENA_H */
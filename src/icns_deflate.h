@@ -0,0 +1,61 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_DEFLATE_H
+#define ICNSCVT_DEFLATE_H
+
+#include "common.h"
+
+/* Minimal zlib stream encoder for the built-in PNG writer. Data is
+ * compressed as a single fixed-Huffman deflate block using a greedy
+ * hash chain matcher, or stored if that would be smaller.
+ * This trades compression ratio for speed; use zlib for anything else. */
+
+ICNS_BEGIN_DECLS
+
+#define ICNS_DEFLATE_WINDOW     32768
+#define ICNS_DEFLATE_MIN_MATCH  3
+#define ICNS_DEFLATE_MAX_MATCH  258
+#define ICNS_DEFLATE_HASH_BITS  14
+#define ICNS_DEFLATE_MAX_CHAIN  8
+
+/* Maximum size of a stored deflate block. */
+#define ICNS_DEFLATE_MAX_STORED 65535
+
+/* Worst case size of a zlib stream produced by `icns_zlib_compress_fast`:
+ * the 2 byte header, stored blocks with a 5 byte header per block, and the
+ * 4 byte Adler-32 trailer. */
+static inline size_t icns_zlib_compress_bound(size_t src_size)
+{
+  size_t num_blocks = (src_size + ICNS_DEFLATE_MAX_STORED - 1) /
+   ICNS_DEFLATE_MAX_STORED;
+
+  return src_size + (num_blocks ? num_blocks : 1) * 5 + 6;
+}
+
+uint32_t icns_crc32(uint32_t crc, const uint8_t *src, size_t src_size);
+uint32_t icns_adler32(uint32_t adler, const uint8_t *src, size_t src_size);
+
+enum icns_error icns_zlib_compress_fast(struct icns_data * RESTRICT icns,
+ uint8_t * RESTRICT dest, size_t *dest_size,
+ const uint8_t * RESTRICT src, size_t src_size) NOT_NULL_3(1, 2, 3);
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_DEFLATE_H */
@@ -145,6 +145,12 @@ struct icns_format
    */
   enum icns_error (*write_to_external)(struct icns_data * RESTRICT,
    const struct icns_image *);
+
+  /**
+   * Fixed size kernels to pack and unpack this format's (A)RGB channels
+   * with, or `NULL` if this format does not use packed channels.
+   */
+  const struct icns_rle_kernels *rle;
 };
 
 struct icns_format_option
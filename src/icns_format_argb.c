@@ -23,251 +23,282 @@
 #include "icns_image.h"
 #include "icns_io.h"
 #include "icns_jp2.h"
+#include "icns_pixels.h"
 #include "icns_png.h"
+#include "icns_rle.h"
 
 #include <stddef.h>
 
+/* Size of the stack window (A)RGB data is packed into before writing. */
+#define ICNS_PACK_WINDOW_SIZE 4096
+
+/* Size of the stack window (A)RGB data is read into while unpacking. */
+#define ICNS_UNPACK_WINDOW_SIZE 4096
+
 /**
- * Pack a single (A)RGB channel.
+ * Get the exact size of the ICNS packed encoding of an (A)RGB image
+ * without packing it. This function automatically takes consideration of
+ * alpha vs. non-alpha and it32 padding bytes.
  */
-static size_t icns_rle_pack_channel(uint8_t *dest, size_t dest_size,
- size_t dest_pos, const uint8_t *src, size_t src_count, size_t src_pitch)
+static enum icns_error icns_image_get_packed_24_bit_size(
+ struct icns_data *icns, const struct icns_image *image, size_t *dest)
 {
-  const uint8_t *tmp;
-  size_t src_pos;
-  size_t i;
-  size_t num;
-  uint8_t current;
-  bool has_run = false;
-
-  for(src_pos = 0; dest_pos < dest_size && src_pos < src_count; )
-  {
-    /* Find position of next RLE of length 3 or greater. */
-    tmp = src;
-    i = src_pos;
-    num = 0;
-    while(num <= 128 && i < src_count)
-    {
-      current = *tmp;
-      if(i + 2 < src_count &&
-         tmp[src_pitch] == current &&
-         tmp[src_pitch + src_pitch] == current)
-      {
-        has_run = true;
-        break;
-      }
-      tmp += src_pitch;
-      i++;
-      num++;
-    }
+  const struct icns_format *format = image->format;
+  const uint8_t *pixels = (const uint8_t *)image->pixels;
+  const uint8_t *channels[4];
+  size_t sizes[4];
+  size_t num_pixels = format->width * format->height;
+  size_t size = 0;
+  unsigned num_channels = 0;
+  unsigned i;
+  bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
+  bool padding = (format->magic == icns_magic_it32);
 
-    /* Emit block */
-    if(num > 0)
-    {
-      if(dest_pos + num + 1 > dest_size)
-        return 0;
+  if(is_alpha)
+    channels[num_channels++] = pixels + offsetof(struct rgba_color, a);
+  channels[num_channels++] = pixels + offsetof(struct rgba_color, r);
+  channels[num_channels++] = pixels + offsetof(struct rgba_color, g);
+  channels[num_channels++] = pixels + offsetof(struct rgba_color, b);
 
-      dest[dest_pos++] = num - 1;
-      for(i = 0; i < num; i++)
-      {
-        dest[dest_pos++] = *src;
-        src += src_pitch;
-      }
+  if(!icns_rle_pack_channels(icns, NULL, 0, sizes, channels, num_channels,
+   num_pixels, 4, format->rle, icns->num_threads, icns->optimal_rle))
+  {
+    E_("failed to alloc optimal packing state");
+    return ICNS_ALLOC_ERROR;
+  }
 
-      src_pos += num;
-    }
+  if(padding)
+    size += 4;
 
-    /* Emit run(s) */
-    if(has_run)
-    {
-      current = *src;
-      num = 0;
-      while(src_pos < src_count)
-      {
-        if(*src != current)
-          break;
+  for(i = 0; i < num_channels; i++)
+    size += sizes[i];
 
-        src += src_pitch;
-        src_pos++;
-        num++;
-      }
+  /* Extra byte to allegedly work around blue channel unpacking bugs. */
+  size++;
+  *dest = size;
+  return ICNS_OK;
+}
 
-      while(num > 0)
-      {
-        size_t n = num > 130 ? 130 : num;
-        num -= n;
+/**
+ * Pack channel planes through a fixed-size window that is flushed to the
+ * output stream whenever it fills.
+ */
+static enum icns_error icns_write_24_bit_planes_streaming(
+ struct icns_data *icns, uint8_t * const *channels, unsigned num_channels,
+ size_t num_pixels, bool padding, size_t *total)
+{
+  struct icns_rle_packer packer;
+  uint8_t window[ICNS_PACK_WINDOW_SIZE];
+  size_t pos = 0;
+  unsigned i;
+  enum icns_error ret;
 
-        if(dest_pos + 2 > dest_size)
-          return 0;
+  if(padding)
+  {
+    memset(window, 0, 4);
+    pos = 4;
+  }
 
-        dest[dest_pos++] = n - 3 + 0x80;
-        dest[dest_pos++] = current;
-      }
-      has_run = false;
+  for(i = 0; i < num_channels; i++)
+  {
+    icns_rle_packer_init(&packer, channels[i], num_pixels, 1);
+    while(true)
+    {
+      pos += icns_rle_packer_run(&packer, window + pos, sizeof(window) - pos);
+      if(!packer.count)
+        break;
+
+      ret = icns_write_direct(icns, window, pos);
+      if(ret)
+        return ret;
+
+      *total += pos;
+      pos = 0;
     }
   }
-  if(src_pos < src_count)
-    return 0;
 
-  return dest_pos;
+  /* Extra byte to allegedly work around blue channel unpacking bugs. */
+  if(pos >= sizeof(window))
+  {
+    ret = icns_write_direct(icns, window, pos);
+    if(ret)
+      return ret;
+
+    *total += pos;
+    pos = 0;
+  }
+  window[pos++] = 0;
+
+  ret = icns_write_direct(icns, window, pos);
+  if(ret)
+    return ret;
+
+  *total += pos;
+  return ICNS_OK;
 }
 
 /**
- * Pack an (A)RGB image into its corresponding ICNS packed encoding.
- * This function automatically takes consideration of alpha vs. non-alpha
- * and it32 padding bytes.
+ * Pack channel planes (concurrently, if enabled) into per-channel scratch
+ * buffers, then write the buffers to the output stream in order.
  */
-static enum icns_error icns_image_pack_pixel_array_to_24_bit(
- struct icns_data *icns, struct icns_image *image)
+static enum icns_error icns_write_24_bit_planes_threaded(
+ struct icns_data *icns, uint8_t * const *channels, unsigned num_channels,
+ size_t num_pixels, const struct icns_rle_kernels *kernels, bool padding,
+ size_t *total)
 {
-  const struct icns_format *format = image->format;
-  const struct rgba_color *pixels = image->pixels;
-  const uint8_t *r;
-  const uint8_t *g;
-  const uint8_t *b;
-  const uint8_t *a;
-  uint8_t *data;
-  size_t num_pixels = format->width * format->height;
-  size_t dest_pos;
-  bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
-  bool padding = (format->magic == icns_magic_it32);
-
-  size_t bound = (num_pixels + (num_pixels + 127) / 128);
-  bound *= is_alpha ? 4 : 3;
-  bound += padding ? 4 : 0;
-  bound++;
+  static const uint8_t zero[4] = { 0 };
+  uint8_t *packed[4];
+  uint8_t *scratch;
+  size_t sizes[4];
+  size_t bound = icns_rle_channel_bound(num_pixels);
+  unsigned i;
+  enum icns_error ret = ICNS_OK;
 
-  data = (uint8_t *)malloc(bound);
-  if(!data)
+  scratch = (uint8_t *)icns_malloc(icns, bound * num_channels);
+  if(!scratch)
   {
-    E_("failed to alloc %s data array", is_alpha ? "ARGB" : "24-bit RGB");
+    E_("failed to alloc channel scratch buffers");
     return ICNS_ALLOC_ERROR;
   }
 
-  r = ((const uint8_t *)pixels) + offsetof(struct rgba_color, r);
-  g = ((const uint8_t *)pixels) + offsetof(struct rgba_color, g);
-  b = ((const uint8_t *)pixels) + offsetof(struct rgba_color, b);
+  for(i = 0; i < num_channels; i++)
+    packed[i] = scratch + bound * i;
 
-  dest_pos = 0;
-  if(padding)
+  if(!icns_rle_pack_channels(icns, packed, bound, sizes,
+   (const uint8_t * const *)channels, num_channels, num_pixels, 1,
+   kernels, icns->num_threads, icns->optimal_rle))
   {
-    memset(data, 0, 4);
-    dest_pos += 4;
+    E_("failed to pack channels");
+    ret = icns->optimal_rle ? ICNS_ALLOC_ERROR : ICNS_INTERNAL_ERROR;
+    goto done;
   }
 
-  if(is_alpha)
+  if(padding)
   {
-    a = ((const uint8_t *)pixels) + offsetof(struct rgba_color, a);
+    ret = icns_write_direct(icns, zero, 4);
+    if(ret)
+      goto done;
 
-    dest_pos = icns_rle_pack_channel(data, bound, dest_pos,
-     a, num_pixels, 4);
-    if(!dest_pos)
-    {
-      free(data);
-      E_("failed to pack ARGB alpha channel");
-      return ICNS_DATA_ERROR;
-    }
-  }
-  dest_pos = icns_rle_pack_channel(data, bound, dest_pos,
-   r, num_pixels, 4);
-  if(!dest_pos)
-  {
-    free(data);
-    E_("failed to pack %s red channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
-  }
-  dest_pos = icns_rle_pack_channel(data, bound, dest_pos,
-   g, num_pixels, 4);
-  if(!dest_pos)
-  {
-    free(data);
-    E_("failed to pack %s green channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    *total += 4;
   }
-  dest_pos = icns_rle_pack_channel(data, bound, dest_pos,
-   b, num_pixels, 4);
-  if(!dest_pos)
+
+  for(i = 0; i < num_channels; i++)
   {
-    free(data);
-    E_("failed to pack %s blue channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    ret = icns_write_direct(icns, packed[i], sizes[i]);
+    if(ret)
+      goto done;
+
+    *total += sizes[i];
   }
+
   /* Extra byte to allegedly work around blue channel unpacking bugs. */
-  if(dest_pos + 1 > bound)
-  {
-    free(data);
-    E_("failed to add padding byte");
-    return ICNS_DATA_ERROR;
-  }
-  data[dest_pos++] = 0;
+  ret = icns_write_direct(icns, zero, 1);
+  if(ret)
+    goto done;
 
-  if(image->data)
-    free(image->data);
+  *total += 1;
 
-  image->data = data;
-  image->data_size = dest_pos;
-  return ICNS_OK;
+done:
+  icns_free(icns, scratch);
+  return ret;
 }
 
 /**
- * Unpack a single (A)RGB channel.
+ * Pack an (A)RGB image into its corresponding ICNS packed encoding and
+ * write it directly to the output stream. This function automatically
+ * takes consideration of alpha vs. non-alpha and it32 padding bytes.
+ *
+ * The pixel array is split into contiguous channel planes in a single
+ * pass first so each channel can be packed with unit stride. If threading
+ * is enabled and the image is large enough, or if size-optimal packing is
+ * enabled, the channels are packed into scratch buffers; otherwise, they
+ * are packed through a fixed-size window. Threading does not affect output.
  */
-static size_t icns_rle_unpack_channel(uint8_t *dest, size_t dest_count,
- size_t dest_pitch, const uint8_t *src, size_t src_size, size_t src_pos)
+static enum icns_error icns_image_write_pixel_array_to_24_bit(
+ struct icns_data *icns, const struct icns_image *image)
 {
-  size_t dest_pos;
-  size_t i;
-  size_t num;
+  const struct icns_format *format = image->format;
+  uint8_t *channels[4];
+  uint8_t *planes;
+  uint8_t *r;
+  uint8_t *g;
+  uint8_t *b;
+  uint8_t *a;
+  size_t num_pixels = format->width * format->height;
+  size_t total = 0;
+  unsigned num_channels;
+  bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
+  bool padding = (format->magic == icns_magic_it32);
+  enum icns_error ret;
 
-  for(dest_pos = 0; dest_pos < dest_count && src_pos < src_size; )
+  planes = (uint8_t *)icns_malloc(icns, num_pixels * (is_alpha ? 4 : 3));
+  if(!planes)
   {
-    uint8_t pack_byte = src[src_pos++];
-    uint8_t copy;
-    if(pack_byte >= 0x80)
-    {
-      /* RLE */
-      num = pack_byte - 0x80 + 3;
-      if(src_pos + 1 > src_size || dest_pos + num > dest_count)
-        break;
+    E_("failed to alloc %s channel planes", is_alpha ? "ARGB" : "24-bit RGB");
+    return ICNS_ALLOC_ERROR;
+  }
 
-      copy = src[src_pos++];
-      for(i = 0; i < num; i++, dest_pos++)
-      {
-        *dest = copy;
-        dest += dest_pitch;
-      }
-    }
-    else
-    {
-      /* Literal */
-      num = pack_byte + 1;
-      if(src_pos + num > src_size || dest_pos + num > dest_count)
-        break;
+  r = planes;
+  g = r + num_pixels;
+  b = g + num_pixels;
+  a = is_alpha ? b + num_pixels : NULL;
+  icns_pixels_to_planes(r, g, b, a, image->pixels, num_pixels);
 
-      for(i = 0; i < num; i++, dest_pos++)
-      {
-        *dest = src[src_pos++];
-        dest += dest_pitch;
-      }
-    }
+  num_channels = 0;
+  if(is_alpha)
+    channels[num_channels++] = a;
+  channels[num_channels++] = r;
+  channels[num_channels++] = g;
+  channels[num_channels++] = b;
+
+  if(icns->optimal_rle || (icns->num_threads > 1 &&
+   num_pixels * num_channels >= ICNS_RLE_THREAD_MIN_VALUES))
+  {
+    ret = icns_write_24_bit_planes_threaded(icns, channels, num_channels,
+     num_pixels, format->rle, padding, &total);
+  }
+  else
+  {
+    ret = icns_write_24_bit_planes_streaming(icns, channels, num_channels,
+     num_pixels, padding, &total);
   }
+  icns_free(icns, planes);
 
-  if(dest_pos < dest_count)
-    return 0;
+  if(ret)
+  {
+    E_("failed to write packed %s data", is_alpha ? "ARGB" : "24-bit RGB");
+    return ret;
+  }
 
-  return src_pos;
+  if(total != image->data_size)
+  {
+    E_("packed %s size %zu does not match prepared size %zu",
+     is_alpha ? "ARGB" : "24-bit RGB", total, image->data_size);
+    return ICNS_INTERNAL_ERROR;
+  }
+  return ICNS_OK;
 }
 
 /**
  * Unpack an (A)RGB image from its corresponding ICNS packed encoding.
  * This function automatically takes consideration of alpha vs. non-alpha
  * and it32 padding bytes.
+ *
+ * Each channel is unpacked into a contiguous plane first (concurrently, if
+ * threading is enabled), and the planes are merged into the pixel array in
+ * a single pass afterward.
  */
 static enum icns_error icns_image_unpack_24_bit_to_pixel_array(
  struct icns_data *icns, struct icns_image *image)
 {
   const struct icns_format *format = image->format;
   struct rgba_color *pixels;
+  static const char * const channel_names[] =
+  {
+    "alpha", "red", "green", "blue"
+  };
+  uint8_t *channels[4];
+  uint8_t *planes;
   uint8_t *r;
   uint8_t *g;
   uint8_t *b;
@@ -275,82 +306,234 @@ static enum icns_error icns_image_unpack_24_bit_to_pixel_array(
   const uint8_t *data = image->data;
   size_t num_pixels = image->real_width * image->real_height;
   size_t src_pos;
-  size_t i;
+  unsigned num_channels;
+  unsigned bad_channel;
   bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
   bool padding = (format->magic == icns_magic_it32);
+  enum icns_error ret;
 
-  pixels = icns_allocate_pixel_array_for_image(image);
-  if(!pixels)
+  planes = (uint8_t *)icns_malloc(icns, num_pixels * (is_alpha ? 4 : 3));
+  if(!planes)
   {
-    E_("failed to alloc pixels array");
+    E_("failed to alloc %s channel planes", is_alpha ? "ARGB" : "24-bit RGB");
     return ICNS_ALLOC_ERROR;
   }
 
-  r = ((uint8_t *)pixels) + offsetof(struct rgba_color, r);
-  g = ((uint8_t *)pixels) + offsetof(struct rgba_color, g);
-  b = ((uint8_t *)pixels) + offsetof(struct rgba_color, b);
+  r = planes;
+  g = r + num_pixels;
+  b = g + num_pixels;
+  a = is_alpha ? b + num_pixels : NULL;
 
-  src_pos = padding ? 4 : 0;
+  /* Packed channel order is (alpha,) red, green, blue. */
+  num_channels = 0;
   if(is_alpha)
+    channels[num_channels++] = a;
+  channels[num_channels++] = r;
+  channels[num_channels++] = g;
+  channels[num_channels++] = b;
+
+  src_pos = icns_rle_unpack_channels(channels, num_channels, num_pixels,
+   data, image->data_size, padding ? 4 : 0, format->rle,
+   icns->num_threads, &bad_channel);
+  if(!src_pos)
   {
-    a = ((uint8_t *)pixels) + offsetof(struct rgba_color, a);
+    E_("failed to unpack %s %s channel", is_alpha ? "ARGB" : "24-bit RGB",
+     channel_names[bad_channel + (is_alpha ? 0 : 1)]);
+    goto error;
+  }
 
-    src_pos = icns_rle_unpack_channel(a, num_pixels, 4,
-     data, image->data_size, src_pos);
-    if(!src_pos)
-    {
-      free(pixels);
-      E_("failed to unpack ARGB alpha channel");
-      return ICNS_DATA_ERROR;
-    }
+  /* Allow for one extra byte at the end to work around apparent blue channel
+   * unpacking bugs in some implementations. */
+  if(src_pos < image->data_size - 1)
+  {
+    E_("invalid packed %s data stream", is_alpha ? "ARGB" : "24-bit RGB");
+    goto error;
   }
-  else
+
+  pixels = icns_allocate_pixel_array_for_image(icns, image);
+  if(!pixels)
   {
-    for(i = 0; i < num_pixels; i++)
-      pixels[i].a = 255;
+    icns_free(icns, planes);
+    E_("failed to alloc pixels array");
+    return ICNS_ALLOC_ERROR;
   }
 
-  src_pos = icns_rle_unpack_channel(r, num_pixels, 4,
-   data, image->data_size, src_pos);
-  if(!src_pos)
+  /* Opaque formats get alpha=255 from the merge. */
+  icns_planes_to_pixels(pixels, r, g, b, a, num_pixels);
+  icns_free(icns, planes);
+
+  ret = icns_detach_alpha_view(icns, image);
+  if(ret)
   {
-    free(pixels);
-    E_("failed to unpack %s red channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    icns_free(icns, pixels);
+    return ret;
   }
-  src_pos = icns_rle_unpack_channel(g, num_pixels, 4,
-   data, image->data_size, src_pos);
-  if(!src_pos)
+  if(image->pixels)
+    icns_free(icns, image->pixels);
+
+  image->pixels = pixels;
+  image->dirty_analysis = true;
+  return ICNS_OK;
+
+error:
+  icns_free(icns, planes);
+  return ICNS_DATA_ERROR;
+}
+
+/**
+ * Unpack an (A)RGB image directly from the input stream into a new pixel
+ * array, reading the packed data through a fixed-size window. The packed
+ * data is not kept. This function automatically takes consideration of
+ * alpha vs. non-alpha and it32 padding bytes.
+ */
+static enum icns_error icns_image_stream_24_bit_to_pixel_array(
+ struct icns_data *icns, struct icns_image *image, size_t sz)
+{
+  const struct icns_format *format = image->format;
+  struct icns_rle_unpacker u;
+  struct rgba_color *pixels;
+  static const char * const channel_names[] =
   {
-    free(pixels);
-    E_("failed to unpack %s green channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    "alpha", "red", "green", "blue"
+  };
+  uint8_t window[ICNS_UNPACK_WINDOW_SIZE];
+  uint8_t *channels[4];
+  uint8_t *planes;
+  uint8_t *r;
+  uint8_t *g;
+  uint8_t *b;
+  uint8_t *a;
+  size_t num_pixels = image->real_width * image->real_height;
+  size_t skip;
+  size_t left;
+  size_t extra = 0;
+  unsigned num_channels;
+  unsigned channel = 0;
+  bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
+  bool padding = (format->magic == icns_magic_it32);
+  enum icns_error ret;
+
+  planes = (uint8_t *)icns_malloc(icns, num_pixels * (is_alpha ? 4 : 3));
+  if(!planes)
+  {
+    E_("failed to alloc %s channel planes", is_alpha ? "ARGB" : "24-bit RGB");
+    return ICNS_ALLOC_ERROR;
   }
-  src_pos = icns_rle_unpack_channel(b, num_pixels, 4,
-   data, image->data_size, src_pos);
-  if(!src_pos)
+
+  r = planes;
+  g = r + num_pixels;
+  b = g + num_pixels;
+  a = is_alpha ? b + num_pixels : NULL;
+
+  /* Packed channel order is (alpha,) red, green, blue. */
+  num_channels = 0;
+  if(is_alpha)
+    channels[num_channels++] = a;
+  channels[num_channels++] = r;
+  channels[num_channels++] = g;
+  channels[num_channels++] = b;
+
+  icns_rle_unpacker_init(&u, channels[0], num_pixels, 1);
+  skip = padding ? 4 : 0;
+  for(left = sz; left > 0; )
+  {
+    size_t n = left < sizeof(window) ? left : sizeof(window);
+    size_t pos = 0;
+
+    ret = icns_read_direct(icns, window, n);
+    if(ret)
+    {
+      E_("failed to read packed %s data", is_alpha ? "ARGB" : "24-bit RGB");
+      goto error;
+    }
+    left -= n;
+
+    if(skip)
+    {
+      pos = skip < n ? skip : n;
+      skip -= pos;
+    }
+
+    while(pos < n && channel < num_channels)
+    {
+      pos += icns_rle_unpacker_run(&u, window + pos, n - pos);
+      if(u.error)
+        break;
+
+      if(!u.count && ++channel < num_channels)
+        icns_rle_unpacker_init(&u, channels[channel], num_pixels, 1);
+    }
+    if(u.error)
+      break;
+
+    extra += n - pos;
+  }
+
+  if(channel < num_channels)
   {
-    free(pixels);
-    E_("failed to unpack %s red channel", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    E_("failed to unpack %s %s channel", is_alpha ? "ARGB" : "24-bit RGB",
+     channel_names[channel + (is_alpha ? 0 : 1)]);
+    ret = ICNS_DATA_ERROR;
+    goto error;
   }
 
   /* Allow for one extra byte at the end to work around apparent blue channel
    * unpacking bugs in some implementations. */
-  if(src_pos < image->data_size - 1)
+  if(extra > 1)
   {
-    free(pixels);
     E_("invalid packed %s data stream", is_alpha ? "ARGB" : "24-bit RGB");
-    return ICNS_DATA_ERROR;
+    ret = ICNS_DATA_ERROR;
+    goto error;
   }
 
-  if(image->pixels)
-    free(image->pixels);
+  pixels = icns_allocate_pixel_array_for_image(icns, image);
+  if(!pixels)
+  {
+    E_("failed to alloc pixels array");
+    ret = ICNS_ALLOC_ERROR;
+    goto error;
+  }
+
+  /* Opaque formats get alpha=255 from the merge. */
+  icns_planes_to_pixels(pixels, r, g, b, a, num_pixels);
+  icns_free(icns, planes);
 
+  ret = icns_detach_alpha_view(icns, image);
+  if(ret)
+  {
+    icns_free(icns, pixels);
+    return ret;
+  }
+  icns_clear_image(icns, image);
   image->pixels = pixels;
   return ICNS_OK;
+
+error:
+  icns_free(icns, planes);
+  return ret;
 }
 
+/**
+ * Compute the packed size of an (A)RGB image and mark it to be packed
+ * from its pixel array at write time. Any previous raw data is discarded.
+ */
+static enum icns_error icns_image_prepare_pixel_array_to_24_bit(
+ struct icns_data *icns, struct icns_image *image)
+{
+  size_t size;
+  enum icns_error ret;
+
+  ret = icns_image_get_packed_24_bit_size(icns, image, &size);
+  if(ret)
+    return ret;
+
+  icns_free(icns, image->data);
+  image->data = NULL;
+  image->data_size = size;
+  image->pack_on_write = true;
+  image->dirty_icns = false;
+  return ICNS_OK;
+}
 
 /**
  * Copy mask to is32/il32/ih32/it32 from s8mk/l8mk/h8mk/t8mk.
@@ -395,8 +578,8 @@ static enum icns_error icns_image_prepare_rgb_for_external(
 }
 
 /**
- * Copy mask from is32/il32/ih32/it32 to s8mk/l8mk/h8mk/t8mk, pack
- * (A)RGB, and return the final data size. This function ignores PNG
+ * Copy mask from is32/il32/ih32/it32 to s8mk/l8mk/h8mk/t8mk and return
+ * the final packed (A)RGB data size. This function ignores PNG
  * if it is present (some icon types have bugged support).
  */
 static enum icns_error icns_image_prepare_rgb_for_icns(
@@ -422,23 +605,22 @@ static enum icns_error icns_image_prepare_rgb_for_icns(
     mask = icns_get_image_by_format(icns, mask_format);
     if(mask && !IMAGE_IS_RAW(mask))
     {
-      ret = icns_split_alpha_to_8_bit_mask(icns, mask, image);
+      ret = icns_view_alpha_as_8_bit_mask(icns, mask, image);
       if(ret)
       {
-        E_("failed to copy 8-bit mask out of 24-bit RGB image");
+        E_("failed to view 8-bit mask in 24-bit RGB image");
         return ret;
       }
     }
   }
 
-  /* Prepare (A)RGB. */
-  ret = icns_image_pack_pixel_array_to_24_bit(icns, image);
+  /* Prepare (A)RGB. The packed data is generated when it is written. */
+  ret = icns_image_prepare_pixel_array_to_24_bit(icns, image);
   if(ret)
   {
-    E_("failed to pack %s image", is_alpha ? "ARGB" : "24-bit RGB");
+    E_("failed to prepare %s image", is_alpha ? "ARGB" : "24-bit RGB");
     return ret;
   }
-  image->dirty_icns = false;
   *sz = image->data_size;
   return ICNS_OK;
 }
@@ -448,12 +630,21 @@ static enum icns_error icns_image_prepare_icp4_icp5_for_icns(
 {
   const struct icns_format *format = image->format;
   bool is_alpha = (format->type == ICNS_ARGB_OR_PNG);
-  enum icns_error ret = ICNS_OK;
+  enum icns_error ret;
 
   /* If not in force raw mode, these formats are output as PNG to preserve
-   * alpha information. */
+   * alpha information. The analysis guides the PNG encoder's layout. */
   if(!icns->force_raw_if_available)
+  {
+    if(IMAGE_IS_PIXELS(image) && !IMAGE_IS_PNG(image) &&
+     !IMAGE_IS_JPEG_2000(image))
+    {
+      ret = icns_analyze_image(icns, image);
+      if(ret)
+        return ret;
+    }
     return icns_image_prepare_png_for_icns(icns, image, sz);
+  }
 
   if(!IMAGE_IS_PIXELS(image))
   {
@@ -461,14 +652,13 @@ static enum icns_error icns_image_prepare_icp4_icp5_for_icns(
     return ICNS_INTERNAL_ERROR;
   }
 
-  /* Prepare (A)RGB. */
-  ret = icns_image_pack_pixel_array_to_24_bit(icns, image);
+  /* Prepare (A)RGB. The packed data is generated when it is written. */
+  ret = icns_image_prepare_pixel_array_to_24_bit(icns, image);
   if(ret)
   {
-    E_("failed to pack %s image", is_alpha ? "ARGB" : "24-bit RGB");
+    E_("failed to prepare %s image", is_alpha ? "ARGB" : "24-bit RGB");
     return ret;
   }
-  image->dirty_icns = false;
   *sz = image->data_size;
   return ICNS_OK;
 }
@@ -478,16 +668,39 @@ static enum icns_error icns_image_prepare_icp4_icp5_for_icns(
 static enum icns_error icns_image_read_pixel_array_from_argb(
  struct icns_data * RESTRICT icns, struct icns_image * RESTRICT image, size_t sz)
 {
+  const struct icns_format *format = image->format;
+  size_t num_values = image->real_width * image->real_height *
+   (format->type == ICNS_ARGB_OR_PNG ? 4 : 3);
   uint8_t *data;
   enum icns_error ret;
 
+  /* If the packed data would be discarded anyway, unpack it straight from
+   * the stream. Large images are still loaded first when threading is
+   * enabled so their channels can be unpacked concurrently. */
+  if(icns->force_recoding &&
+   !(icns->num_threads > 1 && num_values >= ICNS_RLE_THREAD_MIN_VALUES))
+  {
+    ret = icns_image_stream_24_bit_to_pixel_array(icns, image, sz);
+    if(ret)
+    {
+      E_("failed to unpack (A)RGB image");
+      return ret;
+    }
+    return ICNS_OK;
+  }
+
   ret = icns_load_direct(icns, &data, sz);
   if(ret)
   {
     E_("failed to load RGB data");
     return ret;
   }
-  icns_clear_image(image);
+  ret = icns_clear_image(icns, image);
+  if(ret)
+  {
+    icns_free(icns, data);
+    return ret;
+  }
   image->data = data;
   image->data_size = sz;
 
@@ -495,13 +708,13 @@ static enum icns_error icns_image_read_pixel_array_from_argb(
   if(ret)
   {
     E_("failed to unpack (A)RGB image");
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
     return ret;
   }
 
   if(icns->force_recoding)
   {
-    free(image->data);
+    icns_free(icns, image->data);
     image->data = NULL;
   }
   return ICNS_OK;
@@ -594,6 +807,9 @@ static enum icns_error icns_image_write_pixel_array_to_argb(
     return ICNS_INTERNAL_ERROR;
   }
 
+  if(image->pack_on_write && IMAGE_IS_PIXELS(image))
+    return icns_image_write_pixel_array_to_24_bit(icns, image);
+
   if(!IMAGE_IS_RAW(image))
   {
     E_("missing internal raw (A)RGB data");
@@ -618,6 +834,10 @@ static enum icns_error icns_image_write_pixel_array_to_icp4_icp5(
     return ICNS_INTERNAL_ERROR;
   }
 
+  if(icns->force_raw_if_available &&
+   image->pack_on_write && IMAGE_IS_PIXELS(image))
+    return icns_image_write_pixel_array_to_24_bit(icns, image);
+
   if(icns->force_raw_if_available && IMAGE_IS_RAW(image))
   {
     enum icns_error ret = icns_write_direct(icns, image->data, image->data_size);
@@ -651,7 +871,8 @@ const struct icns_format icns_format_is32 =
   icns_image_write_pixel_array_to_argb,
   icns_image_prepare_rgb_for_external,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_16x16
 };
 
 
@@ -666,7 +887,8 @@ const struct icns_format icns_format_il32 =
   icns_image_write_pixel_array_to_argb,
   icns_image_prepare_rgb_for_external,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_32x32
 };
 
 
@@ -681,7 +903,8 @@ const struct icns_format icns_format_ih32 =
   icns_image_write_pixel_array_to_argb,
   icns_image_prepare_rgb_for_external,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_48x48
 };
 
 
@@ -696,7 +919,8 @@ const struct icns_format icns_format_it32 =
   icns_image_write_pixel_array_to_argb,
   icns_image_prepare_rgb_for_external,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_128x128
 };
 
 /* PNG allegedly may be bugged, but write it anyway since RGB has no alpha. */
@@ -711,7 +935,8 @@ const struct icns_format icns_format_icp4 =
   icns_image_write_pixel_array_to_icp4_icp5,
   NULL,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_16x16
 };
 
 /* PNG allegedly may be bugged, but write it anyway since RGB has no alpha. */
@@ -726,7 +951,8 @@ const struct icns_format icns_format_icp5 =
   icns_image_write_pixel_array_to_icp4_icp5,
   NULL,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_32x32
 };
 
 /* PNG allegedly may be bugged so import as ARGB always. */
@@ -741,7 +967,8 @@ const struct icns_format icns_format_ic04 =
   icns_image_write_pixel_array_to_argb,
   NULL,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_16x16
 };
 
 /* PNG allegedly may be bugged so import as ARGB always. */
@@ -756,7 +983,8 @@ const struct icns_format icns_format_ic05 =
   icns_image_write_pixel_array_to_argb,
   NULL,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_32x32
 };
 
 /* PNG allegedly may be bugged so import as ARGB always. */
@@ -771,5 +999,6 @@ const struct icns_format icns_format_icsb =
   icns_image_write_pixel_array_to_argb,
   NULL,
   icns_image_read_pixel_array_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  &icns_rle_kernels_18x18
 };
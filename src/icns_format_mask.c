@@ -24,8 +24,11 @@
 #include "icns_format_png.h"
 #include "icns_image.h"
 #include "icns_io.h"
+#include "icns_pixels.h"
 #include "icns_png.h"
 
+#define ICNS_MASK_WINDOW_SIZE 4096
+
 /**
  * Copy an 8-bit mask over the alpha channel of a 24-bit RGB or ARGB image.
  *
@@ -38,7 +41,9 @@
  *                  `ICNS_INTERNAL_ERROR` if `rgb` isn't 24-bit RGB, if `mask`
  *                  isn't an 8-bit mask, if `rgb` and `mask` have mismatched
  *                  dimensions, if `rgb` is missing a pixel array, or if
- *                  `mask` is missing mask data.
+ *                  `mask` is missing mask data;
+ *                  `ICNS_ALLOC_ERROR` if a view of the alpha channel of
+ *                  `rgb` could not be detached.
  */
 enum icns_error icns_add_alpha_from_8_bit_mask(struct icns_data * RESTRICT icns,
  struct icns_image * RESTRICT rgb, const struct icns_image *mask)
@@ -46,7 +51,11 @@ enum icns_error icns_add_alpha_from_8_bit_mask(struct icns_data * RESTRICT icns,
   struct rgba_color *pixels = rgb->pixels;
   const uint8_t *m = mask->data;
   size_t sz = rgb->format->width * rgb->format->height;
-  size_t i;
+  enum icns_error ret;
+
+  /* A view of this image's alpha channel is already in place. */
+  if(mask->alpha_source == rgb)
+    return ICNS_OK;
 
   if(rgb->format->type != ICNS_24_BIT ||
      mask->format->type != ICNS_8_BIT_MASK ||
@@ -58,9 +67,12 @@ enum icns_error icns_add_alpha_from_8_bit_mask(struct icns_data * RESTRICT icns,
     return ICNS_INTERNAL_ERROR;
   }
 
-  for(i = 0; i < sz; i++)
-    pixels[i].a = m[i];
+  ret = icns_detach_alpha_view(icns, rgb);
+  if(ret)
+    return ret;
 
+  icns_pixels_set_alpha(pixels, m, sz);
+  rgb->dirty_analysis = true;
   return ICNS_OK;
 }
 
@@ -85,7 +97,6 @@ enum icns_error icns_split_alpha_to_8_bit_mask(struct icns_data * RESTRICT icns,
   const struct rgba_color *pixels = rgb->pixels;
   uint8_t *data;
   size_t num_pixels = format->width * format->height;
-  size_t i;
 
   if(rgb->format->type != ICNS_24_BIT ||
      mask->format->type != ICNS_8_BIT_MASK ||
@@ -97,27 +108,63 @@ enum icns_error icns_split_alpha_to_8_bit_mask(struct icns_data * RESTRICT icns,
     return ICNS_INTERNAL_ERROR;
   }
 
-  data = (uint8_t *)malloc(num_pixels);
+  data = (uint8_t *)icns_malloc(icns, num_pixels);
   if(!data)
   {
     E_("failed to alloc 8-bit mask array");
     return ICNS_ALLOC_ERROR;
   }
 
-  for(i = 0; i < num_pixels; i++)
-    data[i] = pixels[i].a;
+  icns_pixels_get_alpha(data, pixels, num_pixels);
 
-  icns_clear_image(mask);
+  icns_clear_image(icns, mask);
   mask->data = data;
   mask->data_size = num_pixels;
   mask->format = icns_get_mask_for_format(format);
   return ICNS_OK;
 }
 
+/**
+ * Make an 8-bit mask a view of the alpha channel of a 24-bit RGB or ARGB
+ * image. This works like `icns_split_alpha_to_8_bit_mask`, but the alpha
+ * channel is only copied out when the mask is written or when the RGB
+ * image's pixel array changes.
+ *
+ * @param icns      current state data.
+ * @param mask      mask image. Any data in this image will be replaced with
+ *                  a view of the alpha channel of `rgb`.
+ * @param rgb       RGB image to view the alpha channel of.
+ * @return          `INCS_OK` on success;
+ *                  `ICNS_INTERNAL_ERROR` if `rgb` isn't 24-bit RGB, if `mask`
+ *                  isn't an 8-bit mask, if `rgb` and `mask` have mismatched
+ *                  dimensions, or if `rgb` is missing a pixel array;
+ *                  `ICNS_ALLOC_ERROR` if a previous view of the alpha
+ *                  channel of `rgb` could not be detached.
+ */
+enum icns_error icns_view_alpha_as_8_bit_mask(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT mask, struct icns_image * RESTRICT rgb)
+{
+  if(rgb->format->type != ICNS_24_BIT ||
+     mask->format->type != ICNS_8_BIT_MASK ||
+     rgb->format->width != mask->format->width ||
+     rgb->format->height != mask->format->height ||
+     !IMAGE_IS_PIXELS(rgb))
+  {
+    E_("image and mask formats are incompatible");
+    return ICNS_INTERNAL_ERROR;
+  }
+
+  return icns_set_alpha_view(icns, mask, rgb);
+}
+
 /**
  * Generate an 8-bit mask from a pixel array for import.
  * If the image is fully opaque, use luma to get the mask value.
  * Otherwise, use the alpha value for the mask.
+ *
+ * If the image has a current analysis, its opacity is used directly.
+ * Otherwise, the alpha values are copied while the image is scanned and
+ * replaced with luma only if the image turns out to be opaque.
  */
 static enum icns_error icns_generate_8_bit_mask_from_pixel_array(
  struct icns_data * RESTRICT icns, struct icns_image * RESTRICT image)
@@ -125,8 +172,6 @@ static enum icns_error icns_generate_8_bit_mask_from_pixel_array(
   const struct rgba_color *pixels = image->pixels;
   uint8_t *data;
   size_t num_pixels = image->real_width * image->real_height;
-  size_t i;
-  bool use_alpha = false;
 
   if(!IMAGE_IS_PIXELS(image))
   {
@@ -134,35 +179,25 @@ static enum icns_error icns_generate_8_bit_mask_from_pixel_array(
     return ICNS_INTERNAL_ERROR;
   }
 
-  /* Prescan--is it opaque or is it alpha? */
-  for(i = 0; i < num_pixels; i++)
-  {
-    if(pixels[i].a < 255)
-    {
-      use_alpha = true;
-      break;
-    }
-  }
-
-  data = (uint8_t *)malloc(num_pixels);
+  data = (uint8_t *)icns_malloc(icns, num_pixels);
   if(!data)
   {
     E_("failed to alloc 8-bit mask array");
     return ICNS_ALLOC_ERROR;
   }
 
-  if(use_alpha)
+  if(!image->dirty_analysis)
   {
-    for(i = 0; i < num_pixels; i++)
-      data[i] = pixels[i].a;
+    if(image->analysis.opacity == ICNS_OPACITY_OPAQUE)
+      icns_pixels_get_luma(data, pixels, num_pixels);
+    else
+      icns_pixels_get_alpha(data, pixels, num_pixels);
   }
   else
-  {
-    for(i = 0; i < num_pixels; i++)
-      data[i] = icns_get_luma_for_pixel(pixels[i]);
-  }
+  if(icns_pixels_get_alpha_and_scan(data, pixels, num_pixels))
+    icns_pixels_get_luma(data, pixels, num_pixels);
 
-  free(image->data);
+  icns_free(icns, image->data);
   image->data = data;
   image->data_size = num_pixels;
   return ICNS_OK;
@@ -180,13 +215,32 @@ static enum icns_error icns_generate_pixel_array_from_8_bit_mask(
   size_t num_pixels = image->real_width * image->real_height;
   size_t i;
 
+  if(IMAGE_IS_MASK_VIEW(image))
+  {
+    const struct rgba_color *view = image->alpha_source->pixels;
+
+    pixels = icns_allocate_pixel_array_for_image(icns, image);
+    if(!pixels)
+    {
+      E_("failed to allocate pixel array for 8-bit mask");
+      return ICNS_ALLOC_ERROR;
+    }
+
+    for(i = 0; i < num_pixels; i++)
+    {
+      pixels[i].r = pixels[i].g = pixels[i].b = view[i].a;
+      pixels[i].a = 255;
+    }
+    goto done;
+  }
+
   if(!IMAGE_IS_RAW(image))
   {
     E_("missing internal 8-bit mask data");
     return ICNS_INTERNAL_ERROR;
   }
 
-  pixels = icns_allocate_pixel_array_for_image(image);
+  pixels = icns_allocate_pixel_array_for_image(icns, image);
   if(!pixels)
   {
     E_("failed to allocate pixel array for 8-bit mask");
@@ -203,8 +257,10 @@ static enum icns_error icns_generate_pixel_array_from_8_bit_mask(
     src++;
   }
 
-  free(image->pixels);
+done:
+  icns_free(icns, image->pixels);
   image->pixels = pixels;
+  image->dirty_analysis = true;
   return ICNS_OK;
 }
 
@@ -216,7 +272,7 @@ static enum icns_error icns_generate_pixel_array_from_8_bit_mask(
 static enum icns_error icns_image_prepare_8_bit_mask_for_icns(
  struct icns_data * RESTRICT icns, struct icns_image * RESTRICT image, size_t *sz)
 {
-  if(!IMAGE_IS_RAW(image))
+  if(!IMAGE_IS_RAW(image) && !IMAGE_IS_MASK_VIEW(image))
   {
     E_("missing internal 8-bit mask data");
     return ICNS_INTERNAL_ERROR;
@@ -284,7 +340,7 @@ static enum icns_error icns_image_read_8_bit_mask_direct(
   }
 
   icns_image_mask_dirty_rgb(icns, image);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
   image->data = data;
   image->data_size = sz;
   return ICNS_OK;
@@ -312,7 +368,7 @@ static enum icns_error icns_image_read_8_bit_mask_from_external(
 
   ret = icns_decode_png_to_pixel_array(icns, image, data, sz);
   /* Destroy (do not keep) the PNG data. */
-  free(data);
+  icns_free(icns, data);
   if(ret)
   {
     E_("failed to decode PNG to pixel array");
@@ -328,13 +384,40 @@ static enum icns_error icns_image_read_8_bit_mask_from_external(
 
   /* Destroy stored pixel array--it is not guaranteed to match the preferred
    * output RGBA encoding, so it's better to just regenerate it. */
-  free(image->pixels);
+  icns_free(icns, image->pixels);
   image->pixels = NULL;
+  image->dirty_analysis = true;
 
   icns_image_mask_dirty_rgb(icns, image);
   return ICNS_OK;
 }
 
+/* Copy out and write the alpha channel an 8-bit mask is a view of. */
+static enum icns_error icns_image_write_8_bit_mask_view(
+ struct icns_data * RESTRICT icns, const struct icns_image *image)
+{
+  uint8_t window[ICNS_MASK_WINDOW_SIZE];
+  const struct rgba_color *pixels = image->alpha_source->pixels;
+  size_t left = image->data_size;
+  enum icns_error ret;
+
+  while(left)
+  {
+    size_t sz = left < sizeof(window) ? left : sizeof(window);
+
+    icns_pixels_get_alpha(window, pixels, sz);
+    ret = icns_write_direct(icns, window, sz);
+    if(ret)
+    {
+      E_("failed to write 8-bit mask");
+      return ret;
+    }
+    pixels += sz;
+    left -= sz;
+  }
+  return ICNS_OK;
+}
+
 static enum icns_error icns_image_write_8_bit_mask_direct(
  struct icns_data * RESTRICT icns, const struct icns_image *image)
 {
@@ -346,6 +429,9 @@ static enum icns_error icns_image_write_8_bit_mask_direct(
     return ICNS_INTERNAL_ERROR;
   }
 
+  if(IMAGE_IS_MASK_VIEW(image))
+    return icns_image_write_8_bit_mask_view(icns, image);
+
   if(!IMAGE_IS_RAW(image))
   {
     E_("image is missing 8-bit mask data");
@@ -373,7 +459,8 @@ const struct icns_format icns_format_s8mk =
   icns_image_write_8_bit_mask_direct,
   icns_image_prepare_8_bit_mask_for_external,
   icns_image_read_8_bit_mask_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_l8mk =
@@ -387,7 +474,8 @@ const struct icns_format icns_format_l8mk =
   icns_image_write_8_bit_mask_direct,
   icns_image_prepare_8_bit_mask_for_external,
   icns_image_read_8_bit_mask_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_h8mk =
@@ -401,7 +489,8 @@ const struct icns_format icns_format_h8mk =
   icns_image_write_8_bit_mask_direct,
   icns_image_prepare_8_bit_mask_for_external,
   icns_image_read_8_bit_mask_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_t8mk =
@@ -415,5 +504,6 @@ const struct icns_format icns_format_t8mk =
   icns_image_write_8_bit_mask_direct,
   icns_image_prepare_8_bit_mask_for_external,
   icns_image_read_8_bit_mask_from_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
@@ -39,6 +39,8 @@ enum icns_error icns_add_alpha_from_8_bit_mask(struct icns_data * RESTRICT icns,
  struct icns_image * RESTRICT rgb, const struct icns_image *mask) NOT_NULL;
 enum icns_error icns_split_alpha_to_8_bit_mask(struct icns_data * RESTRICT icns,
  struct icns_image * RESTRICT mask, const struct icns_image *rgb) NOT_NULL;
+enum icns_error icns_view_alpha_as_8_bit_mask(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT mask, struct icns_image * RESTRICT rgb) NOT_NULL;
 
 ICNS_END_DECLS
 
@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "icns.h"
 #include "icns_format_png.h"
 #include "icns_image.h"
 #include "icns_io.h"
@@ -70,8 +71,8 @@ enum icns_error icns_image_prepare_png_for_icns(
     uint8_t *data;
     size_t data_size;
 
-    ret = icns_encode_png_to_buffer(icns, &data, &data_size,
-      image->pixels, image->real_width, image->real_height);
+    ret = icns_encode_image_png_to_buffer(icns, &data, &data_size, image,
+      icns_get_png_profile(icns, image->format->magic));
     if(ret)
     {
       E_("failed to encode pixels to PNG");
@@ -146,14 +147,14 @@ enum icns_error icns_image_read_png(
     ret = icns_get_jp2_info(icns, &st, data, sz);
     if(ret)
     {
-      free(data);
+      icns_free(icns, data);
       E_("failed to verify JPEG 2000 data");
       return ret;
     }
 
     if(st.width != image->real_width || st.height != image->real_height)
     {
-      free(data);
+      icns_free(icns, data);
       E_("JP2 dimensions %" PRIu32 " x %" PRIu32 " don't match expected %zu x %zu",
        st.width, st.height, image->real_width, image->real_height);
       return ICNS_INVALID_DIMENSIONS;
@@ -162,12 +163,17 @@ enum icns_error icns_image_read_png(
     if(options & ICNS_JP2_DECODE)
     {
       /* FIXME: decoding requires libopenjp2 */
-      free(data);
+      icns_free(icns, data);
       E_("can't decode JPEG 2000 image (requires libopenjp2)");
       return ICNS_UNIMPLEMENTED_FORMAT;
     }
-    else
-      icns_clear_image(image);
+
+    ret = icns_clear_image(icns, image);
+    if(ret)
+    {
+      icns_free(icns, data);
+      return ret;
+    }
 
     if(options & ICNS_JP2_KEEP)
     {
@@ -175,7 +181,7 @@ enum icns_error icns_image_read_png(
       image->jp2_size = sz;
     }
     else
-      free(data);
+      icns_free(icns, data);
 
     return ICNS_OK;
   }
@@ -185,21 +191,35 @@ enum icns_error icns_image_read_png(
     if(!allow_png)
       goto bad_format;
 
-    /* Decoding the PNG acts as a validation check, so always do it. */
-    ret = icns_decode_png_to_pixel_array(icns, image, data, sz);
+    /* Decoding the PNG acts as a validation check. If the pixels aren't
+     * needed, the caller may opt for a cheaper structural check instead. */
+    if((options & ICNS_PNG_DECODE) ||
+     icns->png_validation == ICNS_PNG_VALIDATE_DECODE)
+      ret = icns_decode_png_to_pixel_array(icns, image, data, sz);
+    else
+      ret = icns_check_png(icns, image, data, sz,
+       icns->png_validation != ICNS_PNG_VALIDATE_TRUSTED);
     if(ret)
     {
-      free(data);
+      icns_free(icns, data);
       E_("PNG data failed checks");
       return ret;
     }
 
     /* FIXME: if macOS can't display this PNG, force to ICNS_PNG_DECODE */
 
-    /* Discard the decoded pixel array if it wasn't requested by the caller.
-     * This was already done by icns_decode_png_to_pixel_array otherwise. */
+    /* Discard the decoded pixel array if it wasn't requested by the caller
+     * (or any stale image data if the PNG was only checked). This was already
+     * done by icns_decode_png_to_pixel_array otherwise. */
     if(!(options & ICNS_PNG_DECODE))
-      icns_clear_image(image);
+    {
+      ret = icns_clear_image(icns, image);
+      if(ret)
+      {
+        icns_free(icns, data);
+        return ret;
+      }
+    }
 
     if(options & ICNS_PNG_KEEP)
     {
@@ -207,7 +227,7 @@ enum icns_error icns_image_read_png(
       image->png_size = sz;
     }
     else
-      free(data);
+      icns_free(icns, data);
 
     return ICNS_OK;
   }
@@ -215,7 +235,12 @@ enum icns_error icns_image_read_png(
   if(allow_raw)
   {
     /* This is up to the caller to verify, since it is most likely packed. */
-    icns_clear_image(image);
+    ret = icns_clear_image(icns, image);
+    if(ret)
+    {
+      icns_free(icns, data);
+      return ret;
+    }
     image->data = data;
     image->data_size = sz;
     return ICNS_OK;
@@ -226,7 +251,7 @@ bad_format:
     allow_png ? " PNG" : "",
     allow_jp2 ? " JPEG 2000" : "",
     allow_raw ? " (A)RGB" : "");
-  free(data);
+  icns_free(icns, data);
   return ICNS_DATA_ERROR;
 }
 
@@ -311,10 +336,6 @@ static enum icns_error icns_image_write_png_direct_icns(
 enum icns_error icns_image_write_pixel_array_to_png(
  struct icns_data * RESTRICT icns, const struct icns_image *image)
 {
-  const struct rgba_color *pixels = image->pixels;
-  size_t width = image->real_width;
-  size_t height = image->real_height;
-
   if(image->dirty_external && image->format->prepare_for_external)
   {
     E_("image was not prepared for export");
@@ -330,7 +351,8 @@ enum icns_error icns_image_write_pixel_array_to_png(
     E_("missing pixel array");
     return ICNS_INTERNAL_ERROR;
   }
-  return icns_encode_png_to_stream(icns, pixels, width, height);
+  return icns_encode_image_png_to_stream(icns, image,
+   icns_get_png_profile(icns, image->format->magic));
 }
 
 
@@ -345,7 +367,8 @@ const struct icns_format icns_format_icp6 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic07 =
@@ -359,7 +382,8 @@ const struct icns_format icns_format_ic07 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic08 =
@@ -373,7 +397,8 @@ const struct icns_format icns_format_ic08 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic09 =
@@ -387,7 +412,8 @@ const struct icns_format icns_format_ic09 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic10 =
@@ -401,7 +427,8 @@ const struct icns_format icns_format_ic10 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic11 =
@@ -415,7 +442,8 @@ const struct icns_format icns_format_ic11 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic12 =
@@ -429,7 +457,8 @@ const struct icns_format icns_format_ic12 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic13 =
@@ -443,7 +472,8 @@ const struct icns_format icns_format_ic13 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_ic14 =
@@ -457,7 +487,8 @@ const struct icns_format icns_format_ic14 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_icsB =
@@ -471,7 +502,8 @@ const struct icns_format icns_format_icsB =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_sb24 =
@@ -485,7 +517,8 @@ const struct icns_format icns_format_sb24 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
 
 const struct icns_format icns_format_SB24 =
@@ -499,5 +532,6 @@ const struct icns_format icns_format_SB24 =
   icns_image_write_png_direct_icns,
   NULL,
   icns_image_read_png_external,
-  icns_image_write_pixel_array_to_png
+  icns_image_write_pixel_array_to_png,
+  NULL
 };
@@ -19,12 +19,14 @@
 
 #include "icns_format.h"
 #include "icns_image.h"
+#include "icns_pixels.h"
 
-static struct icns_image *icns_alloc_image(const struct icns_format *format)
+static struct icns_image *icns_alloc_image(struct icns_data *icns,
+ const struct icns_format *format)
 {
   struct icns_image *image;
 
-  image = (struct icns_image *)malloc(sizeof(struct icns_image));
+  image = (struct icns_image *)icns_malloc(icns, sizeof(struct icns_image));
   if(!image)
     return NULL;
 
@@ -35,23 +37,68 @@ static struct icns_image *icns_alloc_image(const struct icns_format *format)
   image->real_height = format->height * format->factor;
   image->dirty_external = true;
   image->dirty_icns = true;
+  image->dirty_analysis = true;
   return image;
 }
 
+/* Break the link between an image and the 8-bit mask viewing its alpha
+ * channel. The mask takes ownership of `data`, which may be `NULL`. */
+static void icns_unlink_alpha_view(struct icns_image * RESTRICT image,
+ uint8_t *data)
+{
+  struct icns_image *mask = image->alpha_view;
+
+  if(!data)
+  {
+    mask->data_size = 0;
+    mask->dirty_external = true;
+    mask->dirty_icns = true;
+  }
+
+  mask->data = data;
+  mask->alpha_source = NULL;
+  image->alpha_view = NULL;
+}
+
 /**
  * Clear all loaded image data for an image.
  * This function preserves the format of an image and its position in the
  * current image set. To delete an image, use `icns_delete_image_by_format`
  * instead.
  *
+ * The image is always cleared. If an 8-bit mask is viewing its alpha
+ * channel and the channel can't be copied out, the mask is left empty
+ * and dirty instead, since the view can't outlive the pixel array.
+ *
+ * @param   icns    current state data.
  * @param   image   image to clear data of.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_ALLOC_ERROR` if a mask viewing the alpha channel
+ *                  of this image was left empty.
  */
-void icns_clear_image(struct icns_image *image)
+enum icns_error icns_clear_image(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image)
 {
-  free(image->pixels);
-  free(image->data);
-  free(image->png);
-  free(image->jp2);
+  enum icns_error ret;
+
+  ret = icns_detach_alpha_view(icns, image);
+  if(ret)
+  {
+    W_("%s: mask %s viewing alpha channel left empty", image->format->name,
+     image->alpha_view->format->name);
+    icns_unlink_alpha_view(image, NULL);
+  }
+
+  if(image->alpha_source)
+  {
+    image->alpha_source->alpha_view = NULL;
+    image->alpha_source = NULL;
+  }
+
+  icns_free(icns, image->pixels);
+  icns_free(icns, image->data);
+  icns_free(icns, image->png);
+  icns_free(icns, image->jp2);
 
   /* Only wipe storage fields; leave all other fields intact. */
   image->pixels = NULL;
@@ -61,9 +108,236 @@ void icns_clear_image(struct icns_image *image)
   image->data_size = 0;
   image->png_size = 0;
   image->jp2_size = 0;
+  image->pack_on_write = false;
 
   image->dirty_external = true;
   image->dirty_icns = true;
+  image->dirty_analysis = true;
+  return ret;
+}
+
+/**
+ * Make an 8-bit mask image a view of the alpha channel of another image's
+ * pixel array. The mask's data is replaced by the view, so no copy of the
+ * alpha channel is made until the mask is written or the source changes.
+ * The caller is responsible for checking that the formats are compatible.
+ *
+ * @param   icns    current state data.
+ * @param   mask    8-bit mask image to replace with a view.
+ * @param   source  (A)RGB image with a pixel array to view.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_ALLOC_ERROR` if a previous view of `source` could
+ *                  not be detached.
+ */
+enum icns_error icns_set_alpha_view(struct icns_data *icns,
+ struct icns_image *mask, struct icns_image *source)
+{
+  enum icns_error ret;
+
+  if(source->alpha_view != mask)
+  {
+    ret = icns_detach_alpha_view(icns, source);
+    if(ret)
+      return ret;
+  }
+  icns_clear_image(icns, mask);
+
+  mask->alpha_source = source;
+  mask->data_size = source->real_width * source->real_height;
+  source->alpha_view = mask;
+  return ICNS_OK;
+}
+
+/**
+ * Copy the alpha channel of an image into the 8-bit mask viewing it, if
+ * any, and break the link between them. This must be done before the
+ * pixel array of the image is replaced or modified. If the copy can't be
+ * made, the view is left in place so the caller can keep the pixel array.
+ *
+ * @param   icns    current state data.
+ * @param   image   image that may be the source of an alpha view.
+ * @return          `ICNS_OK` on success or if there is no view;
+ *                  `ICNS_ALLOC_ERROR` if the mask data failed to allocate.
+ */
+enum icns_error icns_detach_alpha_view(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image)
+{
+  struct icns_image *mask = image->alpha_view;
+  uint8_t *data = NULL;
+
+  if(!mask)
+    return ICNS_OK;
+
+  if(IMAGE_IS_PIXELS(image))
+  {
+    data = (uint8_t *)icns_malloc(icns, mask->data_size);
+    if(!data)
+    {
+      E_("failed to alloc mask data for alpha view");
+      return ICNS_ALLOC_ERROR;
+    }
+    icns_pixels_get_alpha(data, image->pixels, mask->data_size);
+  }
+
+  icns_unlink_alpha_view(image, data);
+  return ICNS_OK;
+}
+
+static inline uint32_t icns_pixel_key(struct rgba_color pixel)
+{
+  uint32_t key;
+  memcpy(&key, &pixel, sizeof(key));
+  return key;
+}
+
+/* Add a color to an open addressing set. Returns false if the set is full. */
+static inline bool icns_analysis_add_color(uint32_t * RESTRICT keys,
+ bool * RESTRICT used, unsigned *num_colors, uint32_t key)
+{
+  unsigned pos = (key * 0x9e3779b1u) >> (32 - 9);
+
+  while(used[pos])
+  {
+    if(keys[pos] == key)
+      return true;
+    pos = (pos + 1) & 511;
+  }
+  if(*num_colors >= ICNS_ANALYSIS_MAX_COLORS)
+    return false;
+
+  keys[pos] = key;
+  used[pos] = true;
+  (*num_colors)++;
+  return true;
+}
+
+/* Add a pixel to the grayscale and distinct color results. Returns false
+ * once neither can change anymore. */
+static inline bool icns_analysis_add_pixel(struct icns_image_analysis *a,
+ uint32_t * RESTRICT keys, bool * RESTRICT used, bool *count_colors,
+ uint32_t *prev_key, struct rgba_color pixel)
+{
+  uint32_t key = icns_pixel_key(pixel);
+
+  if(pixel.r != pixel.g || pixel.r != pixel.b)
+    a->grayscale = false;
+
+  /* Runs of one color are common, so skip the set for them. */
+  if(*count_colors && (key != *prev_key || a->num_colors == 0))
+  {
+    if(!icns_analysis_add_color(keys, used, &a->num_colors, key))
+    {
+      a->num_colors = ICNS_ANALYSIS_MAX_COLORS + 1;
+      *count_colors = false;
+    }
+    *prev_key = key;
+  }
+  return a->grayscale || *count_colors;
+}
+
+/**
+ * Analyze the pixel array of an image. The results are stored in
+ * `image->analysis` and are reused until the `dirty_analysis` flag is set,
+ * so the pixel array is only scanned once no matter how many stages
+ * need the results.
+ *
+ * @param   icns    current state data.
+ * @param   image   image to analyze.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_INTERNAL_ERROR` if the image has no pixel array.
+ */
+enum icns_error icns_analyze_image(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image)
+{
+  struct icns_image_analysis *a = &image->analysis;
+  const struct rgba_color *pixels = image->pixels;
+  size_t width = image->real_width;
+  size_t height = image->real_height;
+  /* 2x the maximum number of colors keeps the set at most half full. */
+  uint32_t keys[ICNS_ANALYSIS_MAX_COLORS * 2];
+  bool used[ICNS_ANALYSIS_MAX_COLORS * 2];
+  bool count_colors = true;
+  bool any_clear = false;
+  bool any_partial = false;
+  uint32_t prev_key = 0;
+  size_t x;
+  size_t y;
+
+  if(!image->dirty_analysis)
+    return ICNS_OK;
+
+  if(!IMAGE_IS_PIXELS(image))
+  {
+    E_("missing internal pixel array");
+    return ICNS_INTERNAL_ERROR;
+  }
+
+  memset(used, 0, sizeof(used));
+  a->grayscale = true;
+  a->num_colors = 0;
+
+  /* Opaque images are common, and the vectorized opacity scan rules out
+   * everything but the colors. The bounding box is the whole image. */
+  if(width && height && icns_pixels_is_opaque(pixels, width * height))
+  {
+    size_t i;
+    for(i = 0; i < width * height; i++)
+    {
+      if(!icns_analysis_add_pixel(a, keys, used, &count_colors, &prev_key,
+       pixels[i]))
+        break;
+    }
+    a->opacity = ICNS_OPACITY_OPAQUE;
+    a->left = 0;
+    a->top = 0;
+    a->right = width;
+    a->bottom = height;
+    image->dirty_analysis = false;
+    return ICNS_OK;
+  }
+
+  a->left = width;
+  a->top = height;
+  a->right = 0;
+  a->bottom = 0;
+
+  for(y = 0; y < height; y++)
+  {
+    for(x = 0; x < width; x++)
+    {
+      struct rgba_color pixel = *(pixels++);
+
+      if(pixel.a == 0)
+        any_clear = true;
+      else
+      {
+        if(pixel.a != 255)
+          any_partial = true;
+
+        if(x < a->left)
+          a->left = x;
+        if(x >= a->right)
+          a->right = x + 1;
+        if(y < a->top)
+          a->top = y;
+        a->bottom = y + 1;
+      }
+
+      icns_analysis_add_pixel(a, keys, used, &count_colors, &prev_key, pixel);
+    }
+  }
+
+  if(a->right == 0)
+  {
+    a->left = 0;
+    a->top = 0;
+  }
+
+  a->opacity = any_partial ? ICNS_OPACITY_PARTIAL :
+   any_clear ? ICNS_OPACITY_BINARY : ICNS_OPACITY_OPAQUE;
+
+  image->dirty_analysis = false;
+  return ICNS_OK;
 }
 
 /**
@@ -71,18 +345,20 @@ void icns_clear_image(struct icns_image *image)
  * This does not modify the provided image; the caller must replace the
  * image's pixel array with this buffer, if necessary.
  *
+ * @param   icns        current state data.
  * @param   image       image to create an RGBA pixel array for.
  * @return              RGBA pixel array of the correct size for this image.
  */
 struct rgba_color *icns_allocate_pixel_array_for_image(
- const struct icns_image *image)
+ struct icns_data * RESTRICT icns, const struct icns_image * RESTRICT image)
 {
   const struct icns_format *format = image->format;
   size_t real_width = format->width * format->factor;
   size_t real_height = format->width * format->factor;
   size_t num_pixels = real_width * real_height;
 
-  return (struct rgba_color *)malloc(num_pixels * sizeof(struct rgba_color));
+  return (struct rgba_color *)icns_malloc(icns,
+   num_pixels * sizeof(struct rgba_color));
 }
 
 /* Insert image into the images list. */
@@ -222,7 +498,7 @@ enum icns_error icns_add_image_for_format(struct icns_data *icns,
     return ICNS_IMAGE_EXISTS_FOR_FORMAT;
   }
 
-  image = icns_alloc_image(format);
+  image = icns_alloc_image(icns, format);
   if(!image)
   {
     E_("failed to allocate image");
@@ -233,7 +509,7 @@ enum icns_error icns_add_image_for_format(struct icns_data *icns,
   if(ret)
   {
     E_("failed to insert image into set");
-    free(image);
+    icns_free(icns, image);
     return ret;
   }
   if(dest)
@@ -249,6 +525,8 @@ enum icns_error icns_add_image_for_format(struct icns_data *icns,
  * @param   format        format to delete an image for, if it exists.
  * @return                `ICNS_OK` on successful deletion;
  *                        `ICNS_NO_IMAGE` if no matching image exists;
+ *                        `ICNS_ALLOC_ERROR` if the image was deleted, but
+ *                        a mask viewing its alpha channel was left empty;
  *                        otherwise, an icns_error value.
  */
 enum icns_error icns_delete_image_by_format(struct icns_data *icns,
@@ -268,9 +546,9 @@ enum icns_error icns_delete_image_by_format(struct icns_data *icns,
     return ret;
   }
 
-  icns_clear_image(image);
-  free(image);
-  return ICNS_OK;
+  ret = icns_clear_image(icns, image);
+  icns_free(icns, image);
+  return ret;
 }
 
 /**
@@ -287,8 +565,8 @@ void icns_delete_all_images(struct icns_data *icns)
   for(image = images->head; image; image = next)
   {
     next = image->next;
-    icns_clear_image(image);
-    free(image);
+    icns_clear_image(icns, image);
+    icns_free(icns, image);
   }
   images->head = NULL;
   images->tail = NULL;
@@ -35,12 +35,39 @@ struct rgba_color
   uint8_t a;
 };
 
+enum icns_opacity
+{
+  ICNS_OPACITY_OPAQUE,    /* every pixel has alpha 255 */
+  ICNS_OPACITY_BINARY,    /* every pixel has alpha 0 or 255 */
+  ICNS_OPACITY_PARTIAL    /* at least one pixel has alpha between 1 and 254 */
+};
+
+/* Distinct colors are only counted up to this limit (palette size). */
+#define ICNS_ANALYSIS_MAX_COLORS 256
+
+/* Facts about an image's pixel array, computed by `icns_analyze_image`. */
+struct icns_image_analysis
+{
+  enum icns_opacity opacity;
+  bool grayscale;       /* r == g == b for every pixel */
+  unsigned num_colors;  /* distinct RGBA values; ICNS_ANALYSIS_MAX_COLORS + 1
+                         * if there are more than ICNS_ANALYSIS_MAX_COLORS */
+
+  /* Bounding box of pixels with non-zero alpha. `right` and `bottom` are
+   * exclusive. All fields are 0 if the image is fully transparent. */
+  size_t left;
+  size_t top;
+  size_t right;
+  size_t bottom;
+};
+
 struct icns_image
 {
 #define IMAGE_IS_RAW(img)       ((img)->data != NULL)
 #define IMAGE_IS_PIXELS(img)    ((img)->pixels != NULL)
 #define IMAGE_IS_PNG(img)       ((img)->png != NULL)
 #define IMAGE_IS_JPEG_2000(img) ((img)->jp2 != NULL)
+#define IMAGE_IS_MASK_VIEW(img) ((img)->alpha_source != NULL)
 
   struct icns_image *next;
   struct icns_image *prev;
@@ -58,6 +85,18 @@ struct icns_image
 
   bool dirty_external;
   bool dirty_icns;
+  bool pack_on_write;   /* data is packed from pixels when written to ICNS;
+                         * data_size is the exact packed size. */
+  bool dirty_analysis;  /* analysis is stale: set whenever pixels are
+                         * replaced or modified. */
+  struct icns_image_analysis analysis;
+
+  /* An 8-bit mask can be a view of the alpha channel of its (A)RGB image
+   * instead of owning `data`. Both images reference each other; clearing
+   * the (A)RGB image copies the alpha channel into the mask first, and
+   * clearing the mask just drops the reference. */
+  struct icns_image *alpha_source;  /* mask: image this is a view of */
+  struct icns_image *alpha_view;    /* (A)RGB: mask viewing this image */
 };
 
 /* Get the apparent brightness (luma) for an RGBX pixel. */
@@ -71,10 +110,18 @@ static inline uint8_t icns_get_luma_for_pixel(struct rgba_color pixel)
   return (total + 512u) / 1024u;
 }
 
-void icns_clear_image(struct icns_image *image) NOT_NULL;
+enum icns_error icns_clear_image(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image) NOT_NULL;
+enum icns_error icns_set_alpha_view(struct icns_data *icns,
+ struct icns_image *mask, struct icns_image *source) NOT_NULL;
+enum icns_error icns_detach_alpha_view(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image) NOT_NULL;
+enum icns_error icns_analyze_image(struct icns_data * RESTRICT icns,
+ struct icns_image * RESTRICT image) NOT_NULL;
 
 struct rgba_color *icns_allocate_pixel_array_for_image(
- const struct icns_image *image) NOT_NULL;
+ struct icns_data * RESTRICT icns, const struct icns_image * RESTRICT image)
+ NOT_NULL;
 
 struct icns_image *icns_get_image_by_format(struct icns_data *icns,
  const struct icns_format *format) NOT_NULL;
@@ -353,7 +353,7 @@ enum icns_error icns_load_direct(struct icns_data *icns,
     return ICNS_INTERNAL_ERROR;
   }
 
-  buf = malloc(count ? count : 1);
+  buf = icns_malloc(icns, count ? count : 1);
   if(!buf)
   {
     E_("failed to allocate buffer");
@@ -365,7 +365,7 @@ enum icns_error icns_load_direct(struct icns_data *icns,
   ret = icns_read_direct(icns, (uint8_t *)buf, count);
   if(ret)
   {
-    free(buf);
+    icns_free(icns, buf);
     return ret;
   }
   *dest = (uint8_t *)buf;
@@ -406,14 +406,14 @@ enum icns_error icns_load_direct_auto(struct icns_data *icns,
     alloc = alloc ? alloc << 1 : 8192;
     if(alloc < sz)
     {
-      free(buf);
+      icns_free(icns, buf);
       E_("failed to allocate buffer");
       return ICNS_ALLOC_ERROR;
     }
-    tmp = realloc(buf, alloc);
+    tmp = icns_realloc(icns, buf, alloc);
     if(!tmp)
     {
-      free(buf);
+      icns_free(icns, buf);
       E_("failed to allocate buffer");
       return ICNS_ALLOC_ERROR;
     }
@@ -421,7 +421,7 @@ enum icns_error icns_load_direct_auto(struct icns_data *icns,
 
     sz += icns->read_fn(buf + sz, alloc - sz, icns->read_priv);
   }
-  tmp = realloc(buf, sz ? sz : 1);
+  tmp = icns_realloc(icns, buf, sz ? sz : 1);
   if(tmp)
     buf = (uint8_t *)tmp;
 
@@ -645,7 +645,7 @@ enum icns_error icns_read_directory(struct icns_data *icns,
 
   while(1)
   {
-    struct icns_dir_entry *next = icns_io_readdir(dir);
+    struct icns_dir_entry *next = icns_io_readdir(icns, dir);
     if(!next)
       break;
     if(!base)
@@ -672,14 +672,16 @@ enum icns_error icns_read_directory(struct icns_data *icns,
 /**
  * Free a directory contents linked list (as provided by `icns_read_directory`).
  *
+ * @param icns        current state data.
  * @param entries     the base entry of the linked list to be freed.
  */
-void icns_free_directory(struct icns_dir_entry *entries)
+void icns_free_directory(struct icns_data *icns,
+ struct icns_dir_entry *entries)
 {
   while(entries)
   {
     struct icns_dir_entry *next = entries->next;
-    free(entries);
+    icns_free(icns, entries);
     entries = next;
   }
 }
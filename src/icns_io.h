@@ -99,7 +99,8 @@ enum icns_error icns_mkdir(struct icns_data *icns, const char *path) NOT_NULL;
 enum icns_error icns_unlink(struct icns_data *icns, const char *path) NOT_NULL;
 enum icns_error icns_read_directory(struct icns_data *icns,
  struct icns_dir_entry **dest, const char *path) NOT_NULL;
-void icns_free_directory(struct icns_dir_entry *entries);
+void icns_free_directory(struct icns_data *icns,
+ struct icns_dir_entry *entries) NOT_NULL_1(1);
 
 ICNS_END_DECLS
 
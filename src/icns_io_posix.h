@@ -84,7 +84,8 @@ icns_dirtype *icns_io_opendir(const char *path)
 }
 
 NOT_NULL
-struct icns_dir_entry *icns_io_readdir(icns_dirtype *dir)
+struct icns_dir_entry *icns_io_readdir(struct icns_data *icns,
+ icns_dirtype *dir)
 {
   struct icns_dir_entry *ent;
   struct dirent *d;
@@ -112,7 +113,7 @@ struct icns_dir_entry *icns_io_readdir(icns_dirtype *dir)
   if(sz < sizeof(struct icns_dir_entry))
     sz = sizeof(struct icns_dir_entry);
 
-  ent = (struct icns_dir_entry *)malloc(sz);
+  ent = (struct icns_dir_entry *)icns_malloc(icns, sz);
   if(!ent)
     return NULL;
 
@@ -0,0 +1,570 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "icns_pixels.h"
+#include "icns_simd.h"
+
+#include <stddef.h>
+
+#ifdef ICNS_SIMD_SSE2
+
+/* Extract one byte lane of 16 pixels into 16 contiguous values. */
+static inline __m128i icns_pixels_extract_lane_sse2(
+ __m128i p0, __m128i p1, __m128i p2, __m128i p3, int shift)
+{
+  const __m128i lo = _mm_set1_epi32(0xff);
+  __m128i v0 = _mm_and_si128(_mm_srli_epi32(p0, shift), lo);
+  __m128i v1 = _mm_and_si128(_mm_srli_epi32(p1, shift), lo);
+  __m128i v2 = _mm_and_si128(_mm_srli_epi32(p2, shift), lo);
+  __m128i v3 = _mm_and_si128(_mm_srli_epi32(p3, shift), lo);
+
+  return _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3));
+}
+
+/* Get the luma (as 32-bit values) of 4 pixels in one vector. */
+static inline __m128i icns_pixels_luma4_sse2(__m128i p, __m128i weights)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(512);
+  __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(p, zero), weights);
+  __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), weights);
+
+  /* Each pixel is two adjacent partial sums; total them in even lanes. */
+  lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+  hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+  lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(2,0,2,0));
+  hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(2,0,2,0));
+
+  return _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), round), 10);
+}
+
+static size_t icns_pixels_get_alpha_sse2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16)
+  {
+    const __m128i *src = (const __m128i *)(pixels + i);
+    _mm_storeu_si128((__m128i *)(dest + i),
+     icns_pixels_extract_lane_sse2(_mm_loadu_si128(src + 0),
+      _mm_loadu_si128(src + 1), _mm_loadu_si128(src + 2),
+      _mm_loadu_si128(src + 3), a_shift));
+  }
+  return i;
+}
+
+static size_t icns_pixels_set_alpha_sse2(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT alpha, size_t count)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  const __m128i keep = _mm_set1_epi32((int)~(0xffu << a_shift));
+  const __m128i zero = _mm_setzero_si128();
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16)
+  {
+    __m128i *dest = (__m128i *)(pixels + i);
+    __m128i a = _mm_loadu_si128((const __m128i *)(alpha + i));
+    __m128i a_lo = _mm_unpacklo_epi8(a, zero);
+    __m128i a_hi = _mm_unpackhi_epi8(a, zero);
+    __m128i a32[4];
+    int j;
+
+    a32[0] = _mm_unpacklo_epi16(a_lo, zero);
+    a32[1] = _mm_unpackhi_epi16(a_lo, zero);
+    a32[2] = _mm_unpacklo_epi16(a_hi, zero);
+    a32[3] = _mm_unpackhi_epi16(a_hi, zero);
+    for(j = 0; j < 4; j++)
+    {
+      __m128i p = _mm_and_si128(_mm_loadu_si128(dest + j), keep);
+      _mm_storeu_si128(dest + j,
+       _mm_or_si128(p, _mm_slli_epi32(a32[j], a_shift)));
+    }
+  }
+  return i;
+}
+
+static size_t icns_pixels_get_alpha_and_scan_sse2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count, bool *opaque)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  const __m128i ones = _mm_set1_epi8((char)0xff);
+  __m128i acc = ones;
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16)
+  {
+    const __m128i *src = (const __m128i *)(pixels + i);
+    __m128i a = icns_pixels_extract_lane_sse2(_mm_loadu_si128(src + 0),
+     _mm_loadu_si128(src + 1), _mm_loadu_si128(src + 2),
+     _mm_loadu_si128(src + 3), a_shift);
+
+    _mm_storeu_si128((__m128i *)(dest + i), a);
+    acc = _mm_and_si128(acc, a);
+  }
+  *opaque = _mm_movemask_epi8(_mm_cmpeq_epi8(acc, ones)) == 0xffff;
+  return i;
+}
+
+/* Returns the start of the first block of 16 containing a transparent
+ * pixel, or the end of the last full block. */
+static size_t icns_pixels_scan_opaque_sse2(
+ const struct rgba_color *pixels, size_t count)
+{
+  const unsigned lanes = 0x1111u << offsetof(struct rgba_color, a);
+  const __m128i ones = _mm_set1_epi8((char)0xff);
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16)
+  {
+    const __m128i *src = (const __m128i *)(pixels + i);
+    __m128i p = _mm_and_si128(
+     _mm_and_si128(_mm_loadu_si128(src + 0), _mm_loadu_si128(src + 1)),
+     _mm_and_si128(_mm_loadu_si128(src + 2), _mm_loadu_si128(src + 3)));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(p, ones));
+    if((m & lanes) != lanes)
+      break;
+  }
+  return i;
+}
+
+static size_t icns_pixels_get_luma_sse2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count,
+ const int16_t *weights)
+{
+  const __m128i w = _mm_loadu_si128((const __m128i *)weights);
+  size_t i;
+
+  for(i = 0; i + 16 <= count; i += 16)
+  {
+    const __m128i *src = (const __m128i *)(pixels + i);
+    __m128i v0 = icns_pixels_luma4_sse2(_mm_loadu_si128(src + 0), w);
+    __m128i v1 = icns_pixels_luma4_sse2(_mm_loadu_si128(src + 1), w);
+    __m128i v2 = icns_pixels_luma4_sse2(_mm_loadu_si128(src + 2), w);
+    __m128i v3 = icns_pixels_luma4_sse2(_mm_loadu_si128(src + 3), w);
+
+    _mm_storeu_si128((__m128i *)(dest + i),
+     _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+  }
+  return i;
+}
+
+#endif /* ICNS_SIMD_SSE2 */
+
+#ifdef ICNS_SIMD_AVX2
+
+/* Pack 32 values (0-255) in four vectors of 32-bit lanes into bytes. */
+ICNS_TARGET_AVX2
+static inline __m256i icns_pixels_pack32_avx2(
+ __m256i v0, __m256i v1, __m256i v2, __m256i v3)
+{
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  __m256i v = _mm256_packus_epi16(_mm256_packs_epi32(v0, v1),
+   _mm256_packs_epi32(v2, v3));
+
+  /* Packing works within 128-bit lanes; restore the order of the pixels. */
+  return _mm256_permutevar8x32_epi32(v, order);
+}
+
+/* Get the luma (as 32-bit values) of 8 pixels in one vector. */
+ICNS_TARGET_AVX2
+static inline __m256i icns_pixels_luma8_avx2(__m256i p, __m256i weights)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi32(512);
+  __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(p, zero), weights);
+  __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(p, zero), weights);
+
+  lo = _mm256_add_epi32(lo, _mm256_srli_epi64(lo, 32));
+  hi = _mm256_add_epi32(hi, _mm256_srli_epi64(hi, 32));
+  lo = _mm256_shuffle_epi32(lo, _MM_SHUFFLE(2,0,2,0));
+  hi = _mm256_shuffle_epi32(hi, _MM_SHUFFLE(2,0,2,0));
+
+  return _mm256_srli_epi32(
+   _mm256_add_epi32(_mm256_unpacklo_epi64(lo, hi), round), 10);
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_pixels_get_alpha_avx2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  const __m256i lo = _mm256_set1_epi32(0xff);
+  size_t i;
+
+  for(i = 0; i + 32 <= count; i += 32)
+  {
+    const __m256i *src = (const __m256i *)(pixels + i);
+    __m256i v[4];
+    int j;
+
+    for(j = 0; j < 4; j++)
+    {
+      v[j] = _mm256_and_si256(
+       _mm256_srli_epi32(_mm256_loadu_si256(src + j), a_shift), lo);
+    }
+    _mm256_storeu_si256((__m256i *)(dest + i),
+     icns_pixels_pack32_avx2(v[0], v[1], v[2], v[3]));
+  }
+  return i;
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_pixels_get_alpha_and_scan_avx2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count, bool *opaque)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  const __m256i lo = _mm256_set1_epi32(0xff);
+  const __m256i ones = _mm256_set1_epi8((char)0xff);
+  __m256i acc = ones;
+  size_t i;
+
+  for(i = 0; i + 32 <= count; i += 32)
+  {
+    const __m256i *src = (const __m256i *)(pixels + i);
+    __m256i v[4];
+    __m256i a;
+    int j;
+
+    for(j = 0; j < 4; j++)
+    {
+      v[j] = _mm256_and_si256(
+       _mm256_srli_epi32(_mm256_loadu_si256(src + j), a_shift), lo);
+    }
+    a = icns_pixels_pack32_avx2(v[0], v[1], v[2], v[3]);
+    _mm256_storeu_si256((__m256i *)(dest + i), a);
+    acc = _mm256_and_si256(acc, a);
+  }
+  *opaque = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(acc, ones)) ==
+   0xffffffffu;
+  return i;
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_pixels_set_alpha_avx2(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT alpha, size_t count)
+{
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+  const __m256i keep = _mm256_set1_epi32((int)~(0xffu << a_shift));
+  size_t i;
+
+  for(i = 0; i + 8 <= count; i += 8)
+  {
+    __m256i *dest = (__m256i *)(pixels + i);
+    __m256i a = _mm256_cvtepu8_epi32(
+     _mm_loadl_epi64((const __m128i *)(alpha + i)));
+    __m256i p = _mm256_and_si256(_mm256_loadu_si256(dest), keep);
+
+    _mm256_storeu_si256(dest, _mm256_or_si256(p, _mm256_slli_epi32(a, a_shift)));
+  }
+  return i;
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_pixels_scan_opaque_avx2(
+ const struct rgba_color *pixels, size_t count)
+{
+  const unsigned lanes = 0x11111111u << offsetof(struct rgba_color, a);
+  const __m256i ones = _mm256_set1_epi8((char)0xff);
+  size_t i;
+
+  for(i = 0; i + 32 <= count; i += 32)
+  {
+    const __m256i *src = (const __m256i *)(pixels + i);
+    __m256i p = _mm256_and_si256(
+     _mm256_and_si256(_mm256_loadu_si256(src + 0), _mm256_loadu_si256(src + 1)),
+     _mm256_and_si256(_mm256_loadu_si256(src + 2), _mm256_loadu_si256(src + 3)));
+    unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(p, ones));
+    if((m & lanes) != lanes)
+      break;
+  }
+  return i;
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_pixels_get_luma_avx2(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count,
+ const int16_t *weights)
+{
+  const __m256i w = _mm256_broadcastsi128_si256(
+   _mm_loadu_si128((const __m128i *)weights));
+  size_t i;
+
+  for(i = 0; i + 32 <= count; i += 32)
+  {
+    const __m256i *src = (const __m256i *)(pixels + i);
+    __m256i v[4];
+    int j;
+
+    for(j = 0; j < 4; j++)
+      v[j] = icns_pixels_luma8_avx2(_mm256_loadu_si256(src + j), w);
+
+    _mm256_storeu_si256((__m256i *)(dest + i),
+     icns_pixels_pack32_avx2(v[0], v[1], v[2], v[3]));
+  }
+  return i;
+}
+
+#endif /* ICNS_SIMD_AVX2 */
+
+/**
+ * Split an interleaved pixel array into separate channel planes.
+ *
+ * @param r       destination for the red channel (`count` bytes).
+ * @param g       destination for the green channel (`count` bytes).
+ * @param b       destination for the blue channel (`count` bytes).
+ * @param a       destination for the alpha channel (`count` bytes), or
+ *                `NULL` to discard the alpha channel.
+ * @param pixels  pixel array to split.
+ * @param count   number of pixels in `pixels`.
+ */
+void icns_pixels_to_planes(uint8_t * RESTRICT r, uint8_t * RESTRICT g,
+ uint8_t * RESTRICT b, uint8_t * RESTRICT a,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_SSE2
+  const int r_shift = offsetof(struct rgba_color, r) * 8;
+  const int g_shift = offsetof(struct rgba_color, g) * 8;
+  const int b_shift = offsetof(struct rgba_color, b) * 8;
+  const int a_shift = offsetof(struct rgba_color, a) * 8;
+
+  for(; i + 16 <= count; i += 16)
+  {
+    const __m128i *src = (const __m128i *)(pixels + i);
+    __m128i p0 = _mm_loadu_si128(src + 0);
+    __m128i p1 = _mm_loadu_si128(src + 1);
+    __m128i p2 = _mm_loadu_si128(src + 2);
+    __m128i p3 = _mm_loadu_si128(src + 3);
+
+    _mm_storeu_si128((__m128i *)(r + i),
+     icns_pixels_extract_lane_sse2(p0, p1, p2, p3, r_shift));
+    _mm_storeu_si128((__m128i *)(g + i),
+     icns_pixels_extract_lane_sse2(p0, p1, p2, p3, g_shift));
+    _mm_storeu_si128((__m128i *)(b + i),
+     icns_pixels_extract_lane_sse2(p0, p1, p2, p3, b_shift));
+    if(a)
+    {
+      _mm_storeu_si128((__m128i *)(a + i),
+       icns_pixels_extract_lane_sse2(p0, p1, p2, p3, a_shift));
+    }
+  }
+#endif
+
+  for(; i < count; i++)
+  {
+    r[i] = pixels[i].r;
+    g[i] = pixels[i].g;
+    b[i] = pixels[i].b;
+    if(a)
+      a[i] = pixels[i].a;
+  }
+}
+
+/**
+ * Merge separate channel planes into an interleaved pixel array.
+ *
+ * @param pixels  destination pixel array (`count` pixels).
+ * @param r       red channel (`count` bytes).
+ * @param g       green channel (`count` bytes).
+ * @param b       blue channel (`count` bytes).
+ * @param a       alpha channel (`count` bytes), or `NULL` to write
+ *                fully opaque pixels.
+ * @param count   number of pixels to write.
+ */
+void icns_planes_to_pixels(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT r, const uint8_t * RESTRICT g,
+ const uint8_t * RESTRICT b, const uint8_t * RESTRICT a,
+ size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_SSE2
+  const __m128i opaque = _mm_set1_epi8((char)0xff);
+
+  /* Byte interleaving below assumes the r, g, b, a memory order. */
+  if(offsetof(struct rgba_color, r) == 0 &&
+     offsetof(struct rgba_color, g) == 1 &&
+     offsetof(struct rgba_color, b) == 2 &&
+     offsetof(struct rgba_color, a) == 3)
+  {
+    for(; i + 16 <= count; i += 16)
+    {
+      __m128i *dest = (__m128i *)(pixels + i);
+      __m128i vr = _mm_loadu_si128((const __m128i *)(r + i));
+      __m128i vg = _mm_loadu_si128((const __m128i *)(g + i));
+      __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+      __m128i va = a ? _mm_loadu_si128((const __m128i *)(a + i)) : opaque;
+      __m128i rg_lo = _mm_unpacklo_epi8(vr, vg);
+      __m128i rg_hi = _mm_unpackhi_epi8(vr, vg);
+      __m128i ba_lo = _mm_unpacklo_epi8(vb, va);
+      __m128i ba_hi = _mm_unpackhi_epi8(vb, va);
+
+      _mm_storeu_si128(dest + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+      _mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+      _mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+  }
+#endif
+
+  for(; i < count; i++)
+  {
+    pixels[i].r = r[i];
+    pixels[i].g = g[i];
+    pixels[i].b = b[i];
+    pixels[i].a = a ? a[i] : 255;
+  }
+}
+
+/**
+ * Copy the alpha channel of a pixel array to a separate buffer.
+ *
+ * @param dest    destination for the alpha channel (`count` bytes).
+ * @param pixels  pixel array to copy alpha from.
+ * @param count   number of pixels in `pixels`.
+ */
+void icns_pixels_get_alpha(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_AVX2
+  if(icns_cpu_has_avx2())
+    i = icns_pixels_get_alpha_avx2(dest, pixels, count);
+  else
+    i = icns_pixels_get_alpha_sse2(dest, pixels, count);
+#endif
+
+  for(; i < count; i++)
+    dest[i] = pixels[i].a;
+}
+
+/**
+ * Copy the alpha channel of a pixel array to a separate buffer and
+ * determine if every pixel is fully opaque in the same pass.
+ *
+ * @param dest    destination for the alpha channel (`count` bytes).
+ * @param pixels  pixel array to copy alpha from.
+ * @param count   number of pixels in `pixels`.
+ * @return        `true` if every pixel has an alpha of 255, otherwise `false`.
+ */
+bool icns_pixels_get_alpha_and_scan(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  uint8_t acc = 255;
+  bool opaque = true;
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_AVX2
+  if(icns_cpu_has_avx2())
+    i = icns_pixels_get_alpha_and_scan_avx2(dest, pixels, count, &opaque);
+  else
+    i = icns_pixels_get_alpha_and_scan_sse2(dest, pixels, count, &opaque);
+#endif
+
+  for(; i < count; i++)
+  {
+    dest[i] = pixels[i].a;
+    acc &= pixels[i].a;
+  }
+  return opaque && acc == 255;
+}
+
+/**
+ * Replace the alpha channel of a pixel array.
+ *
+ * @param pixels  pixel array to modify.
+ * @param alpha   new alpha channel (`count` bytes).
+ * @param count   number of pixels in `pixels`.
+ */
+void icns_pixels_set_alpha(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT alpha, size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_AVX2
+  if(icns_cpu_has_avx2())
+    i = icns_pixels_set_alpha_avx2(pixels, alpha, count);
+  else
+    i = icns_pixels_set_alpha_sse2(pixels, alpha, count);
+#endif
+
+  for(; i < count; i++)
+    pixels[i].a = alpha[i];
+}
+
+/**
+ * Determine if every pixel in a pixel array is fully opaque.
+ *
+ * @param pixels  pixel array to scan.
+ * @param count   number of pixels in `pixels`.
+ * @return        `true` if every pixel has an alpha of 255, otherwise `false`.
+ */
+bool icns_pixels_is_opaque(const struct rgba_color *pixels, size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_AVX2
+  if(icns_cpu_has_avx2())
+    i = icns_pixels_scan_opaque_avx2(pixels, count);
+  else
+    i = icns_pixels_scan_opaque_sse2(pixels, count);
+#endif
+
+  for(; i < count; i++)
+    if(pixels[i].a < 255)
+      return false;
+
+  return true;
+}
+
+/**
+ * Get the luma of every pixel in a pixel array. The result is identical
+ * to `icns_get_luma_for_pixel`.
+ *
+ * @param dest    destination for the luma values (`count` bytes).
+ * @param pixels  pixel array to get luma from.
+ * @param count   number of pixels in `pixels`.
+ */
+void icns_pixels_get_luma(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count)
+{
+  size_t i = 0;
+
+#ifdef ICNS_SIMD_AVX2
+  /* Weights for the 16-bit expanded channels of two pixels. */
+  int16_t weights[8] = { 0 };
+  weights[offsetof(struct rgba_color, r)] = 306;
+  weights[offsetof(struct rgba_color, g)] = 601;
+  weights[offsetof(struct rgba_color, b)] = 117;
+  memcpy(weights + 4, weights, 4 * sizeof(int16_t));
+
+  if(icns_cpu_has_avx2())
+    i = icns_pixels_get_luma_avx2(dest, pixels, count, weights);
+  else
+    i = icns_pixels_get_luma_sse2(dest, pixels, count, weights);
+#endif
+
+  for(; i < count; i++)
+    dest[i] = icns_get_luma_for_pixel(pixels[i]);
+}
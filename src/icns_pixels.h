@@ -0,0 +1,51 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_PIXELS_H
+#define ICNSCVT_PIXELS_H
+
+#include "common.h"
+#include "icns_image.h"
+
+/* Conversions between the interleaved pixel array (struct rgba_color)
+ * and separate contiguous channel planes, and per-channel helpers. */
+
+ICNS_BEGIN_DECLS
+
+void icns_pixels_to_planes(uint8_t * RESTRICT r, uint8_t * RESTRICT g,
+ uint8_t * RESTRICT b, uint8_t * RESTRICT a,
+ const struct rgba_color * RESTRICT pixels, size_t count) NOT_NULL_4(1,2,3,5);
+void icns_planes_to_pixels(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT r, const uint8_t * RESTRICT g,
+ const uint8_t * RESTRICT b, const uint8_t * RESTRICT a,
+ size_t count) NOT_NULL_4(1,2,3,4);
+void icns_pixels_get_alpha(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count) NOT_NULL;
+bool icns_pixels_get_alpha_and_scan(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count) NOT_NULL;
+void icns_pixels_set_alpha(struct rgba_color * RESTRICT pixels,
+ const uint8_t * RESTRICT alpha, size_t count) NOT_NULL;
+bool icns_pixels_is_opaque(const struct rgba_color *pixels, size_t count)
+ NOT_NULL;
+void icns_pixels_get_luma(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t count) NOT_NULL;
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_PIXELS_H */
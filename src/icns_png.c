@@ -17,13 +17,16 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "icns_deflate.h"
 #include "icns_image.h"
 #include "icns_io.h"
 #include "icns_jp2.h"
 #include "icns_png.h"
+#include "icns_thread.h"
 
 #include <setjmp.h>
 #include <png.h>
+#include <zlib.h>
 
 static const uint8_t magic_png[8] =
 {
@@ -75,6 +78,19 @@ static void icns_png_warn_fn(png_struct *png, const char *message)
   W_("%s\n", message);
 }
 
+/* libpng's internal allocations also go through the context allocator. */
+static png_voidp icns_png_malloc_fn(png_struct *png, png_alloc_size_t size)
+{
+  struct icns_data *icns = (struct icns_data *)png_get_mem_ptr(png);
+  return icns_malloc(icns, size);
+}
+
+static void icns_png_free_fn(png_struct *png, png_voidp ptr)
+{
+  struct icns_data *icns = (struct icns_data *)png_get_mem_ptr(png);
+  icns_free(icns, ptr);
+}
+
 static void icns_png_read_fn(png_struct *png, png_byte *dest, size_t count)
 {
   struct icns_png_reader_data *reader =
@@ -116,8 +132,9 @@ enum icns_error icns_get_png_info(
   int color_type;
   int interlace_type;
 
-  png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-   icns, icns_png_error_fn, icns_png_warn_fn);
+  png = png_create_read_struct_2(PNG_LIBPNG_VER_STRING,
+   icns, icns_png_error_fn, icns_png_warn_fn,
+   icns, icns_png_malloc_fn, icns_png_free_fn);
   if(!png)
   {
     E_("failed to create PNG read struct");
@@ -209,8 +226,9 @@ static enum icns_error icns_decode_png(struct rgba_color **dest,
     return ICNS_DATA_ERROR;
   }
 
-  png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-   icns, icns_png_error_fn, icns_png_warn_fn);
+  png = png_create_read_struct_2(PNG_LIBPNG_VER_STRING,
+   icns, icns_png_error_fn, icns_png_warn_fn,
+   icns, icns_png_malloc_fn, icns_png_free_fn);
   if(!png)
   {
     E_("failed to create PNG read struct");
@@ -247,7 +265,7 @@ static enum icns_error icns_decode_png(struct rgba_color **dest,
     goto error;
   }
 
-  pixels = icns_allocate_pixel_array_for_image(image);
+  pixels = icns_allocate_pixel_array_for_image(icns, image);
   if(!pixels)
   {
     E_("failed to allocate pixel array");
@@ -296,7 +314,7 @@ static enum icns_error icns_decode_png(struct rgba_color **dest,
 error:
   png_destroy_read_struct(&png, info ? &info : NULL, NULL);
 
-  free(pixels);
+  icns_free(icns, pixels);
   return ret;
 }
 
@@ -315,7 +333,9 @@ error:
  *                  `ICNS_PNG_READ_ERROR` if libpng failed to read;
  *                  `ICNS_INVALID_DIMENSIONS` if the PNG doesn't match
  *                                            the format of the image;
- *                  `ICNS_ALLOC_ERROR` if the pixel array failed to allocate.
+ *                  `ICNS_ALLOC_ERROR` if the pixel array failed to allocate
+ *                                     or a mask viewing the alpha channel
+ *                                     was left empty.
  */
 enum icns_error icns_decode_png_to_pixel_array(
  struct icns_data * RESTRICT icns, struct icns_image * RESTRICT image,
@@ -331,11 +351,203 @@ enum icns_error icns_decode_png_to_pixel_array(
     return ret;
   }
 
-  icns_clear_image(image);
+  ret = icns_clear_image(icns, image);
+  if(ret)
+  {
+    icns_free(icns, pixels);
+    return ret;
+  }
   image->pixels = pixels;
   return ICNS_OK;
 }
 
+/* Returns true if a bit depth is valid for a PNG color type. */
+static bool icns_png_valid_depth(unsigned color_type, unsigned depth)
+{
+  switch(color_type)
+  {
+    case PNG_COLOR_TYPE_GRAY:
+      return depth == 1 || depth == 2 || depth == 4 || depth == 8 ||
+       depth == 16;
+    case PNG_COLOR_TYPE_PALETTE:
+      return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+    case PNG_COLOR_TYPE_RGB:
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+      return depth == 8 || depth == 16;
+  }
+  return false;
+}
+
+/**
+ * Check the structure of a PNG without decoding its image data: the
+ * signature, the chunk layout and (optionally) CRCs, the IHDR fields and
+ * dimensions, and the order of the critical chunks and tRNS. IDAT is not
+ * inflated, so corrupt compressed data will not be detected.
+ *
+ * @param icns      current state data.
+ * @param image     image the PNG will be loaded into.
+ * @param png_data  pointer to PNG data in memory.
+ * @param png_size  size of PNG data in memory.
+ * @param check_crc verify chunk CRCs if true.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_DATA_ERROR` if the buffer does not contain a PNG;
+ *                  `ICNS_PNG_READ_ERROR` if the PNG structure is invalid;
+ *                  `ICNS_INVALID_DIMENSIONS` if the PNG doesn't match
+ *                                            the format of the image.
+ */
+enum icns_error icns_check_png(
+ struct icns_data * RESTRICT icns, const struct icns_image * RESTRICT image,
+ const uint8_t *png_data, size_t png_size, bool check_crc)
+{
+  size_t real_width = image->real_width;
+  size_t real_height = image->real_height;
+  size_t pos = sizeof(magic_png);
+  unsigned color_type = 0;
+  bool has_ihdr = false;
+  bool has_plte = false;
+  bool has_trns = false;
+  bool in_idat = false;
+  bool after_idat = false;
+
+  if(!icns_is_file_png(png_data, png_size))
+  {
+    E_("buffer to check is not a PNG");
+    return ICNS_DATA_ERROR;
+  }
+
+  while(true)
+  {
+    const uint8_t *chunk = png_data + pos;
+    uint32_t length;
+    uint32_t type;
+    size_t i;
+
+    if(png_size - pos < 12)
+    {
+      E_("PNG truncated before IEND");
+      return ICNS_PNG_READ_ERROR;
+    }
+    length = icns_get_u32be(chunk);
+    type = icns_get_u32be(chunk + 4);
+    if(length > PNG_UINT_31_MAX || png_size - pos - 12 < length)
+    {
+      E_("PNG chunk length %" PRIu32 " out of bounds", length);
+      return ICNS_PNG_READ_ERROR;
+    }
+    for(i = 4; i < 8; i++)
+    {
+      uint8_t c = chunk[i] & ~0x20;
+      if(c < 'A' || c > 'Z')
+      {
+        E_("invalid PNG chunk type %08" PRIx32, type);
+        return ICNS_PNG_READ_ERROR;
+      }
+    }
+    if(check_crc && icns_get_u32be(chunk + 8 + length) !=
+     icns_crc32(0, chunk + 4, (size_t)length + 4))
+    {
+      E_("PNG chunk %.4s CRC mismatch", (const char *)chunk + 4);
+      return ICNS_PNG_READ_ERROR;
+    }
+    pos += 12 + (size_t)length;
+
+    if(!has_ihdr && type != MAGIC('I','H','D','R'))
+    {
+      E_("PNG chunk %.4s before IHDR", (const char *)chunk + 4);
+      return ICNS_PNG_READ_ERROR;
+    }
+    if(in_idat && type != MAGIC('I','D','A','T'))
+    {
+      in_idat = false;
+      after_idat = true;
+    }
+
+    switch(type)
+    {
+      case MAGIC('I','H','D','R'):
+      {
+        const uint8_t *ihdr = chunk + 8;
+        uint32_t w;
+        uint32_t h;
+
+        if(has_ihdr || length != 13)
+        {
+          E_("invalid PNG IHDR");
+          return ICNS_PNG_READ_ERROR;
+        }
+        has_ihdr = true;
+        w = icns_get_u32be(ihdr);
+        h = icns_get_u32be(ihdr + 4);
+        color_type = ihdr[9];
+
+        if(!icns_png_valid_depth(color_type, ihdr[8]) ||
+         ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] > 1)
+        {
+          E_("invalid PNG IHDR");
+          return ICNS_PNG_READ_ERROR;
+        }
+        if(w != real_width || h != real_height)
+        {
+          E_("PNG dimensions %" PRIu32 " x %" PRIu32 " don't match expected %zu x %zu",
+           w, h, real_width, real_height);
+          return ICNS_INVALID_DIMENSIONS;
+        }
+        break;
+      }
+
+      case MAGIC('P','L','T','E'):
+        if(has_plte || in_idat || after_idat || has_trns ||
+         !(color_type & PNG_COLOR_MASK_COLOR) ||
+         length == 0 || length > 256 * 3 || length % 3)
+        {
+          E_("invalid or misplaced PNG PLTE");
+          return ICNS_PNG_READ_ERROR;
+        }
+        has_plte = true;
+        break;
+
+      case MAGIC('t','R','N','S'):
+        if(has_trns || in_idat || after_idat ||
+         (color_type & PNG_COLOR_MASK_ALPHA) ||
+         (color_type == PNG_COLOR_TYPE_PALETTE && !has_plte))
+        {
+          E_("invalid or misplaced PNG tRNS");
+          return ICNS_PNG_READ_ERROR;
+        }
+        has_trns = true;
+        break;
+
+      case MAGIC('I','D','A','T'):
+        if(after_idat ||
+         (color_type == PNG_COLOR_TYPE_PALETTE && !has_plte))
+        {
+          E_("misplaced PNG IDAT");
+          return ICNS_PNG_READ_ERROR;
+        }
+        in_idat = true;
+        break;
+
+      case MAGIC('I','E','N','D'):
+        if(!after_idat || length != 0)
+        {
+          E_("invalid or misplaced PNG IEND");
+          return ICNS_PNG_READ_ERROR;
+        }
+        return ICNS_OK;
+
+      default:
+        /* Unknown critical chunks can't be safely ignored. */
+        if(!(chunk[4] & 0x20))
+        {
+          E_("unknown critical PNG chunk %.4s", (const char *)chunk + 4);
+          return ICNS_PNG_READ_ERROR;
+        }
+        break;
+    }
+  }
+}
+
 
 /**
  * PNG writer.
@@ -347,21 +559,317 @@ static void icns_png_flush_fn(png_struct *png)
   (void)png;
 }
 
+/* zlib and row filter settings for one encode. -1 keeps libpng's default. */
+struct icns_png_settings
+{
+  int level;
+  int mem_level;
+  int strategy;
+  int filters;
+};
+
+/* Indexed by `icns_png_profile`; not used for ICNS_PNG_PROFILE_EXHAUSTIVE. */
+static const struct icns_png_settings icns_png_profiles[] =
+{
+  { -1, -1, -1, -1 },
+  {  1, -1, -1, PNG_FILTER_SUB },
+  {  9,  9, -1, PNG_ALL_FILTERS },
+};
+
+/* Candidates tried by ICNS_PNG_PROFILE_EXHAUSTIVE: every combination of
+ * row filter (None, Sub, Up, Average, Paeth, adaptive) and zlib strategy
+ * (default, filtered, RLE). Adaptive filtering usually wins for
+ * photographic icons, but a single fixed filter (or none) is often smaller
+ * for flat artwork, and which strategy is best depends on the filter. */
+#define ICNS_PNG_EXHAUSTIVE_FILTER(filter) \
+  { 9, 9, Z_FILTERED,         filter }, \
+  { 9, 9, Z_DEFAULT_STRATEGY, filter }, \
+  { 9, 9, Z_RLE,              filter }
+
+static const struct icns_png_settings icns_png_exhaustive[] =
+{
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_ALL_FILTERS),
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_FILTER_NONE),
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_FILTER_SUB),
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_FILTER_UP),
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_FILTER_AVG),
+  ICNS_PNG_EXHAUSTIVE_FILTER(PNG_FILTER_PAETH),
+};
+
+static void icns_png_apply_settings(png_struct *png,
+ const struct icns_png_settings *s)
+{
+  if(s->level >= 0)
+    png_set_compression_level(png, s->level);
+  if(s->mem_level >= 0)
+    png_set_compression_mem_level(png, s->mem_level);
+  if(s->strategy >= 0)
+    png_set_compression_strategy(png, s->strategy);
+  if(s->filters >= 0)
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, s->filters);
+}
+
+/* The palette lookup set is kept at most half full. */
+#define ICNS_PNG_MAX_PALETTE  256
+#define ICNS_PNG_PALETTE_BITS 9
+#define ICNS_PNG_PALETTE_SET  (1 << ICNS_PNG_PALETTE_BITS)
+
+/* Smallest lossless PNG representation of a pixel array, selected by
+ * `icns_png_select_layout`. For palette images, the set maps each RGBA
+ * value to its palette index. */
+struct icns_png_layout
+{
+  int color_type;
+  int bit_depth;
+  unsigned num_palette;
+  unsigned num_trans;
+  png_color palette[ICNS_PNG_MAX_PALETTE];
+  png_byte trans[ICNS_PNG_MAX_PALETTE];
+
+  uint32_t keys[ICNS_PNG_PALETTE_SET];
+  uint8_t index[ICNS_PNG_PALETTE_SET];
+  bool used[ICNS_PNG_PALETTE_SET];
+};
+
+static inline uint32_t icns_png_pixel_key(struct rgba_color pixel)
+{
+  uint32_t key;
+  memcpy(&key, &pixel, sizeof(key));
+  return key;
+}
+
+static inline unsigned icns_png_palette_pos(
+ const struct icns_png_layout *layout, uint32_t key)
+{
+  unsigned pos = (key * 0x9e3779b1u) >> (32 - ICNS_PNG_PALETTE_BITS);
+
+  while(layout->used[pos] && layout->keys[pos] != key)
+    pos = (pos + 1) & (ICNS_PNG_PALETTE_SET - 1);
+
+  return pos;
+}
+
+/**
+ * Scan a pixel array and select the smallest color type and bit depth
+ * that can store it losslessly: gray, gray+alpha, RGB, RGBA, or a palette
+ * with a tRNS chunk. Palette entries with transparency are sorted first so
+ * the tRNS chunk only needs to cover them.
+ *
+ * If an up-to-date analysis of the pixels is provided and it rules out a
+ * palette, the layout is selected from it without scanning the pixels.
+ *
+ * @param layout    layout to initialize.
+ * @param pixels    pixel array to scan.
+ * @param num       number of pixels in the pixel array.
+ * @param analysis  analysis of the pixel array, or `NULL`.
+ */
+static void icns_png_select_layout(struct icns_png_layout *layout,
+ const struct rgba_color *pixels, size_t num,
+ const struct icns_image_analysis *analysis)
+{
+  uint32_t colors[ICNS_PNG_MAX_PALETTE];
+  uint8_t remap[ICNS_PNG_MAX_PALETTE];
+  unsigned num_colors = 0;
+  bool count_colors = true;
+  bool grayscale = true;
+  bool opaque = true;
+  uint32_t prev_key = 0;
+  unsigned i;
+  unsigned j;
+  size_t n;
+
+  memset(layout->used, 0, sizeof(layout->used));
+
+  if(analysis && (analysis->num_colors > ICNS_PNG_MAX_PALETTE ||
+   (analysis->grayscale && analysis->opacity == ICNS_OPACITY_OPAQUE &&
+    analysis->num_colors > 16)))
+  {
+    grayscale = analysis->grayscale;
+    opaque = analysis->opacity == ICNS_OPACITY_OPAQUE;
+
+    layout->num_palette = 0;
+    layout->num_trans = 0;
+    layout->bit_depth = 8;
+    layout->color_type = grayscale && opaque ? PNG_COLOR_TYPE_GRAY :
+     grayscale ? PNG_COLOR_TYPE_GRAY_ALPHA :
+     opaque ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA;
+    return;
+  }
+
+  for(n = 0; n < num; n++)
+  {
+    struct rgba_color pixel = pixels[n];
+    uint32_t key = icns_png_pixel_key(pixel);
+
+    if(pixel.r != pixel.g || pixel.r != pixel.b)
+      grayscale = false;
+    if(pixel.a != 255)
+      opaque = false;
+
+    /* Runs of one color are common, so skip the set for them. */
+    if(count_colors && (key != prev_key || n == 0))
+    {
+      unsigned pos = icns_png_palette_pos(layout, key);
+      if(!layout->used[pos])
+      {
+        if(num_colors >= ICNS_PNG_MAX_PALETTE)
+        {
+          count_colors = false;
+          if(!grayscale && !opaque)
+            break;
+          continue;
+        }
+        layout->keys[pos] = key;
+        layout->index[pos] = num_colors;
+        layout->used[pos] = true;
+        colors[num_colors++] = key;
+      }
+      prev_key = key;
+    }
+    else
+    if(!count_colors && !grayscale && !opaque)
+      break;
+  }
+
+  layout->num_palette = 0;
+  layout->num_trans = 0;
+  layout->bit_depth = 8;
+
+  if(count_colors)
+  {
+    layout->bit_depth = num_colors <= 2 ? 1 : num_colors <= 4 ? 2 :
+     num_colors <= 16 ? 4 : 8;
+  }
+
+  /* 8-bit gray is already one byte per pixel, so a palette only helps
+   * opaque grayscale images if it allows a smaller bit depth. */
+  if(grayscale && opaque && (!count_colors || layout->bit_depth == 8))
+  {
+    layout->color_type = PNG_COLOR_TYPE_GRAY;
+    layout->bit_depth = 8;
+    return;
+  }
+
+  if(!count_colors)
+  {
+    layout->color_type = grayscale ? PNG_COLOR_TYPE_GRAY_ALPHA :
+     opaque ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGB_ALPHA;
+    return;
+  }
+
+  layout->color_type = PNG_COLOR_TYPE_PALETTE;
+  layout->num_palette = num_colors;
+
+  /* Stable partition: transparent entries first, then opaque entries. */
+  for(i = 0, j = 0; i < num_colors; i++)
+  {
+    struct rgba_color c;
+    memcpy(&c, &colors[i], sizeof(c));
+    if(c.a != 255)
+      remap[i] = j++;
+  }
+  layout->num_trans = j;
+  for(i = 0; i < num_colors; i++)
+  {
+    struct rgba_color c;
+    memcpy(&c, &colors[i], sizeof(c));
+    if(c.a == 255)
+      remap[i] = j++;
+  }
+
+  for(i = 0; i < num_colors; i++)
+  {
+    struct rgba_color c;
+    memcpy(&c, &colors[i], sizeof(c));
+    layout->palette[remap[i]].red = c.r;
+    layout->palette[remap[i]].green = c.g;
+    layout->palette[remap[i]].blue = c.b;
+    layout->trans[remap[i]] = c.a;
+  }
+  for(i = 0; i < ICNS_PNG_PALETTE_SET; i++)
+    if(layout->used[i])
+      layout->index[i] = remap[layout->index[i]];
+}
+
+/* Convert one row of pixels to the format described by `layout`. Palette
+ * indices are written one per byte; libpng packs them. */
+static void icns_png_convert_row(uint8_t * RESTRICT dest,
+ const struct rgba_color * RESTRICT pixels, size_t width,
+ const struct icns_png_layout *layout)
+{
+  uint32_t prev_key = 0;
+  uint8_t prev_index = 0;
+  size_t x;
+
+  switch(layout->color_type)
+  {
+    case PNG_COLOR_TYPE_GRAY:
+      for(x = 0; x < width; x++)
+        dest[x] = pixels[x].r;
+      break;
+
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+      for(x = 0; x < width; x++)
+      {
+        *(dest++) = pixels[x].r;
+        *(dest++) = pixels[x].a;
+      }
+      break;
+
+    case PNG_COLOR_TYPE_RGB:
+      for(x = 0; x < width; x++)
+      {
+        *(dest++) = pixels[x].r;
+        *(dest++) = pixels[x].g;
+        *(dest++) = pixels[x].b;
+      }
+      break;
+
+    case PNG_COLOR_TYPE_PALETTE:
+      for(x = 0; x < width; x++)
+      {
+        uint32_t key = icns_png_pixel_key(pixels[x]);
+        if(key != prev_key || x == 0)
+        {
+          prev_index = layout->index[icns_png_palette_pos(layout, key)];
+          prev_key = key;
+        }
+        dest[x] = prev_index;
+      }
+      break;
+  }
+}
+
 static enum icns_error icns_encode_png(struct icns_data *icns,
  const struct rgba_color *pixels, size_t width, size_t height,
+ const struct icns_png_layout *layout,
+ const struct icns_png_settings *settings,
  png_rw_ptr write_fn, void *write_fn_priv)
 {
   const struct rgba_color *pos;
   png_struct *png = NULL;
   png_info *info = NULL;
+  uint8_t * volatile row = NULL;
   enum icns_error ret;
   size_t i;
 
-  png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
-   icns, icns_png_error_fn, icns_png_warn_fn);
+  if(layout->color_type != PNG_COLOR_TYPE_RGB_ALPHA)
+  {
+    row = (uint8_t *)icns_malloc(icns, width * 3);
+    if(!row)
+    {
+      E_("failed to allocate PNG row buffer");
+      return ICNS_ALLOC_ERROR;
+    }
+  }
+
+  png = png_create_write_struct_2(PNG_LIBPNG_VER_STRING,
+   icns, icns_png_error_fn, icns_png_warn_fn,
+   icns, icns_png_malloc_fn, icns_png_free_fn);
   if(!png)
   {
     E_("failed to create PNG write struct");
+    icns_free(icns, row);
     return ICNS_PNG_INIT_ERROR;
   }
 
@@ -381,59 +889,746 @@ static enum icns_error icns_encode_png(struct icns_data *icns,
   }
 
   png_set_write_fn(png, write_fn_priv, write_fn, icns_png_flush_fn);
+  icns_png_apply_settings(png, settings);
 
-  png_set_IHDR(png, info, width, height, 8,
-   PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+  png_set_IHDR(png, info, width, height, layout->bit_depth,
+   layout->color_type, PNG_INTERLACE_NONE,
    PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+  if(layout->color_type == PNG_COLOR_TYPE_PALETTE)
+  {
+    png_set_PLTE(png, info, layout->palette, layout->num_palette);
+    if(layout->num_trans)
+      png_set_tRNS(png, info, layout->trans, layout->num_trans, NULL);
+  }
   png_write_info(png, info);
 
+  if(layout->bit_depth < 8)
+    png_set_packing(png);
+
   pos = pixels;
   for(i = 0; i < height; i++)
   {
-    png_write_row(png, (png_bytep)pos);
-    pos += width;
+    if(row)
+    {
+      icns_png_convert_row(row, pos, width, layout);
+      png_write_row(png, row);
+    }
+    else
+      png_write_row(png, (png_bytep)pos);
 
+    pos += width;
   }
   png_write_end(png, info);
   png_destroy_write_struct(&png, &info);
+  icns_free(icns, row);
   return ICNS_OK;
 
 error:
   png_destroy_write_struct(&png, &info);
+  icns_free(icns, row);
   return ret;
 }
 
 
-static void icns_png_write_stream_fn(png_struct *png, png_bytep src, size_t size)
+/**
+ * Built-in PNG writer. This writes IHDR/PLTE/tRNS/IDAT/IEND directly and
+ * compresses with `icns_zlib_compress_fast`. It is much faster than libpng
+ * for small images, at the cost of larger output.
+ */
+
+static inline void icns_png_put_u32(uint8_t *dest, uint32_t value)
 {
-  struct icns_data *icns = (struct icns_data *)png_get_io_ptr(png);
+  dest[0] = value >> 24;
+  dest[1] = value >> 16;
+  dest[2] = value >> 8;
+  dest[3] = value;
+}
 
-  if(icns->write_fn(src, size, icns) < size)
-    png_error(png, "write error");
+/* Write the length, type, and CRC of a chunk whose data has already been
+ * written to `dest + 8`. Returns the total size of the chunk. */
+static size_t icns_png_finish_chunk(uint8_t *dest, const char type[4],
+ size_t size)
+{
+  icns_png_put_u32(dest, size);
+  memcpy(dest + 4, type, 4);
+  icns_png_put_u32(dest + 8 + size, icns_crc32(0, dest + 4, size + 4));
+  return size + 12;
+}
+
+static unsigned icns_png_layout_channels(const struct icns_png_layout *layout)
+{
+  switch(layout->color_type)
+  {
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+      return 2;
+    case PNG_COLOR_TYPE_RGB:
+      return 3;
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+      return 4;
+  }
+  return 1;
+}
+
+/* Pack one palette index per byte into `bit_depth` bits per index. */
+static void icns_png_pack_row(uint8_t * RESTRICT dest,
+ const uint8_t * RESTRICT src, size_t width, unsigned bit_depth)
+{
+  unsigned per_byte = 8 / bit_depth;
+  size_t x;
+
+  for(x = 0; x < width; x += per_byte)
+  {
+    unsigned value = 0;
+    unsigned i;
+
+    for(i = 0; i < per_byte; i++)
+    {
+      value <<= bit_depth;
+      if(x + i < width)
+        value |= src[x + i];
+    }
+    *(dest++) = value;
+  }
+}
+
+/* Get one unfiltered scanline. `tmp` must hold `width` bytes. */
+static void icns_png_unfiltered_row(uint8_t * RESTRICT dest,
+ uint8_t * RESTRICT tmp, const struct rgba_color *pixels, size_t width,
+ const struct icns_png_layout *layout)
+{
+  if(layout->color_type == PNG_COLOR_TYPE_RGB_ALPHA)
+    memcpy(dest, pixels, width * sizeof(struct rgba_color));
+  else
+  if(layout->bit_depth < 8)
+  {
+    icns_png_convert_row(tmp, pixels, width, layout);
+    icns_png_pack_row(dest, tmp, width, layout->bit_depth);
+  }
+  else
+    icns_png_convert_row(dest, pixels, width, layout);
+}
+
+static inline uint8_t icns_png_paeth(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+
+  if(pa <= pb && pa <= pc)
+    return a;
+  if(pb <= pc)
+    return b;
+  return c;
+}
+
+/* Apply one PNG filter to a scanline. `prev` is the unfiltered previous
+ * scanline, or all zeroes for the first scanline. */
+static void icns_png_filter(uint8_t * RESTRICT dest, const uint8_t *cur,
+ const uint8_t *prev, size_t row_bytes, unsigned bpp, unsigned type)
+{
+  size_t x;
+
+  switch(type)
+  {
+    case PNG_FILTER_VALUE_NONE:
+      memcpy(dest, cur, row_bytes);
+      break;
+
+    case PNG_FILTER_VALUE_SUB:
+      for(x = 0; x < bpp; x++)
+        dest[x] = cur[x];
+      for(; x < row_bytes; x++)
+        dest[x] = cur[x] - cur[x - bpp];
+      break;
+
+    case PNG_FILTER_VALUE_UP:
+      for(x = 0; x < row_bytes; x++)
+        dest[x] = cur[x] - prev[x];
+      break;
+
+    case PNG_FILTER_VALUE_AVG:
+      for(x = 0; x < bpp; x++)
+        dest[x] = cur[x] - (prev[x] >> 1);
+      for(; x < row_bytes; x++)
+        dest[x] = cur[x] - ((cur[x - bpp] + prev[x]) >> 1);
+      break;
+
+    case PNG_FILTER_VALUE_PAETH:
+      for(x = 0; x < bpp; x++)
+        dest[x] = cur[x] - prev[x];
+      for(; x < row_bytes; x++)
+        dest[x] = cur[x] - icns_png_paeth(cur[x - bpp], prev[x], prev[x - bpp]);
+      break;
+  }
+}
+
+/* libpng's heuristic: the sum of the filtered bytes as signed values. */
+static size_t icns_png_filter_cost(const uint8_t *row, size_t row_bytes)
+{
+  size_t sum = 0;
+  size_t x;
+
+  for(x = 0; x < row_bytes; x++)
+    sum += row[x] < 128 ? row[x] : 256 - row[x];
+
+  return sum;
+}
+
+static inline size_t icns_png_row_bytes(const struct icns_png_layout *layout,
+ size_t width)
+{
+  return (width * icns_png_layout_channels(layout) * layout->bit_depth + 7) / 8;
+}
+
+/* Size of the work buffer required by `icns_png_filter_rows`. */
+static inline size_t icns_png_filter_work_size(
+ const struct icns_png_layout *layout, size_t width)
+{
+  return icns_png_row_bytes(layout, width) * 3 + width;
 }
 
 /**
- * Encode a pixel array into a PNG and write it directly to the output stream.
- * On error, this may have written incomplete PNG data to the stream.
+ * Convert and filter rows `y0` through `y1 - 1` into the PNG scanline format.
+ * If more than one filter is allowed, each row uses the filter with the
+ * lowest `icns_png_filter_cost`, like libpng. Any range of rows can be
+ * filtered independently of the others.
+ *
+ * @param dest      destination for the scanline of row `y0`.
+ * @param work      work buffer of `icns_png_filter_work_size` bytes.
+ * @param pixels    full pixel array.
+ * @param width     width of pixel array, in real pixels.
+ * @param y0        first row to filter.
+ * @param y1        row after the last row to filter.
+ * @param layout    color type and bit depth to encode with.
+ * @param filters   mask of allowed PNG_FILTER_* values.
+ */
+static void icns_png_filter_rows(uint8_t * RESTRICT dest,
+ uint8_t * RESTRICT work, const struct rgba_color *pixels, size_t width,
+ size_t y0, size_t y1, const struct icns_png_layout *layout, unsigned filters)
+{
+  unsigned bpp = icns_png_layout_channels(layout) * layout->bit_depth / 8;
+  size_t row_bytes = icns_png_row_bytes(layout, width);
+  uint8_t *prev = work;
+  uint8_t *cur = work + row_bytes;
+  uint8_t *trial = cur + row_bytes;
+  uint8_t *tmp = trial + row_bytes;
+  unsigned type;
+  size_t y;
+
+  if(bpp < 1)
+    bpp = 1;
+
+  if(y0 > 0)
+    icns_png_unfiltered_row(prev, tmp, pixels + (y0 - 1) * width, width,
+     layout);
+  else
+    memset(prev, 0, row_bytes);
+
+  for(y = y0; y < y1; y++, dest += row_bytes + 1)
+  {
+    uint8_t *swap;
+
+    icns_png_unfiltered_row(cur, tmp, pixels + y * width, width, layout);
+
+    if(!(filters & (filters - 1)))
+    {
+      for(type = 0; !(filters & (PNG_FILTER_NONE << type)); type++);
+      dest[0] = type;
+      icns_png_filter(dest + 1, cur, prev, row_bytes, bpp, type);
+    }
+    else
+    {
+      size_t best = SIZE_MAX;
+      for(type = 0; type <= PNG_FILTER_VALUE_PAETH; type++)
+      {
+        size_t cost;
+        if(!(filters & (PNG_FILTER_NONE << type)))
+          continue;
+
+        icns_png_filter(trial, cur, prev, row_bytes, bpp, type);
+        cost = icns_png_filter_cost(trial, row_bytes);
+        if(cost < best)
+        {
+          best = cost;
+          dest[0] = type;
+          memcpy(dest + 1, trial, row_bytes);
+        }
+      }
+    }
+    swap = prev;
+    prev = cur;
+    cur = swap;
+  }
+}
+
+/* Worst case size of the signature, IHDR, PLTE, and tRNS. */
+#define ICNS_PNG_HEADER_BOUND \
+ (sizeof(magic_png) + (13 + 12) + (3 * ICNS_PNG_MAX_PALETTE + 12) + \
+  (ICNS_PNG_MAX_PALETTE + 12))
+
+/* Write the signature, IHDR, and (for palette images) PLTE and tRNS.
+ * Returns the number of bytes written. */
+static size_t icns_png_write_header(uint8_t *out, size_t width, size_t height,
+ const struct icns_png_layout *layout)
+{
+  size_t pos;
+
+  memcpy(out, magic_png, sizeof(magic_png));
+  pos = sizeof(magic_png);
+
+  icns_png_put_u32(out + pos + 8, width);
+  icns_png_put_u32(out + pos + 12, height);
+  out[pos + 16] = layout->bit_depth;
+  out[pos + 17] = layout->color_type;
+  out[pos + 18] = PNG_COMPRESSION_TYPE_BASE;
+  out[pos + 19] = PNG_FILTER_TYPE_BASE;
+  out[pos + 20] = PNG_INTERLACE_NONE;
+  pos += icns_png_finish_chunk(out + pos, "IHDR", 13);
+
+  if(layout->color_type == PNG_COLOR_TYPE_PALETTE)
+  {
+    unsigned i;
+    for(i = 0; i < layout->num_palette; i++)
+    {
+      out[pos + 8 + i * 3 + 0] = layout->palette[i].red;
+      out[pos + 8 + i * 3 + 1] = layout->palette[i].green;
+      out[pos + 8 + i * 3 + 2] = layout->palette[i].blue;
+    }
+    pos += icns_png_finish_chunk(out + pos, "PLTE", layout->num_palette * 3);
+
+    if(layout->num_trans)
+    {
+      memcpy(out + pos + 8, layout->trans, layout->num_trans);
+      pos += icns_png_finish_chunk(out + pos, "tRNS", layout->num_trans);
+    }
+  }
+  return pos;
+}
+
+/**
+ * Encode a pixel array into a PNG without libpng.
  *
  * @param icns      current state data.
+ * @param dest      pointer to write newly allocated memory pointer on success.
+ * @param dest_size pointer to write newly allocated memory size on success.
  * @param pixels    pixel array to encode into a PNG.
  * @param width     width of pixel array, in real pixels.
  * @param height    height of pixel array, in real pixels.
+ * @param layout    color type and bit depth to encode with.
  * @return          `ICNS_OK` on success;
- *                  `ICNS_PNG_INIT_ERROR` if libpng failed to init;
- *                  `ICNS_PNG_WRITE_ERROR` if libpng failed during write.
+ *                  `ICNS_ALLOC_ERROR` if a buffer failed to allocate;
+ *                  `ICNS_PNG_WRITE_ERROR` if the dimensions are invalid.
  */
-enum icns_error icns_encode_png_to_stream(struct icns_data * RESTRICT icns,
- const struct rgba_color *pixels, size_t width, size_t height)
+static enum icns_error icns_encode_png_builtin(struct icns_data *icns,
+ uint8_t **dest, size_t *dest_size,
+ const struct rgba_color *pixels, size_t width, size_t height,
+ const struct icns_png_layout *layout)
 {
-  return icns_encode_png(icns, pixels, width, height,
-   icns_png_write_stream_fn, icns);
+  size_t raw_size = (icns_png_row_bytes(layout, width) + 1) * height;
+  size_t work_size = icns_png_filter_work_size(layout, width);
+  unsigned filters;
+  size_t max_size;
+  size_t zlib_size;
+  size_t pos;
+  uint8_t *raw;
+  uint8_t *out;
+  void *tmp;
+  enum icns_error ret;
+
+  if(!width || !height || width > PNG_UINT_31_MAX || height > PNG_UINT_31_MAX)
+  {
+    E_("invalid PNG dimensions %zu x %zu", width, height);
+    return ICNS_PNG_WRITE_ERROR;
+  }
+
+  max_size = ICNS_PNG_HEADER_BOUND +
+   (icns_zlib_compress_bound(raw_size) + 12) + 12;
+
+  raw = (uint8_t *)icns_malloc(icns, raw_size + work_size);
+  out = (uint8_t *)icns_malloc(icns, max_size);
+  if(!raw || !out)
+  {
+    E_("failed to allocate PNG buffers");
+    icns_free(icns, raw);
+    icns_free(icns, out);
+    return ICNS_ALLOC_ERROR;
+  }
+
+  /* Palette and packed images use the None filter and everything else
+   * uses Sub, which is cheap and is usually the best fixed filter for
+   * icons. */
+  filters = (layout->color_type == PNG_COLOR_TYPE_PALETTE) ?
+   PNG_FILTER_NONE : PNG_FILTER_SUB;
+  icns_png_filter_rows(raw, raw + raw_size, pixels, width, 0, height,
+   layout, filters);
+
+  pos = icns_png_write_header(out, width, height, layout);
+
+  ret = icns_zlib_compress_fast(icns, out + pos + 8, &zlib_size,
+   raw, raw_size);
+  icns_free(icns, raw);
+  if(ret)
+  {
+    icns_free(icns, out);
+    return ret;
+  }
+  pos += icns_png_finish_chunk(out + pos, "IDAT", zlib_size);
+  pos += icns_png_finish_chunk(out + pos, "IEND", 0);
+
+  tmp = icns_realloc(icns, out, pos);
+  *dest = tmp ? tmp : out;
+  *dest_size = pos;
+  return ICNS_OK;
 }
 
 
+/**
+ * Segmented PNG encoder. Large images are split into segments of about
+ * ICNS_PNG_SEGMENT_SIZE bytes of scanline data, which are filtered and
+ * deflated independently (and concurrently if threading is enabled).
+ * Each segment is primed with the preceding 32k of scanline data and all
+ * but the last end with a sync flush, so the concatenated segments form
+ * one deflate stream. The Adler-32 of each segment is computed alongside
+ * it and the results are combined for the zlib trailer. The segment size
+ * does not depend on the number of threads, so the output is identical
+ * for any thread count.
+ */
+
+#define ICNS_PNG_SEGMENT_SIZE (128 << 10)
+#define ICNS_PNG_ZLIB_WINDOW  32768
+
+struct icns_png_segment
+{
+  uint8_t *out;
+  size_t out_size;
+  size_t raw_size;
+  uint32_t adler;
+  enum icns_error ret;
+};
+
+struct icns_png_segment_task
+{
+  struct icns_data *icns;
+  const struct rgba_color *pixels;
+  const struct icns_png_layout *layout;
+  struct icns_png_segment *segments;
+  unsigned num_segments;
+  size_t width;
+  size_t height;
+  size_t rows_per_segment;
+  size_t row_bytes;
+  unsigned filters;
+  int level;
+  int mem_level;
+  int strategy;
+  uint8_t *raw;
+};
+
+static voidpf icns_png_zalloc(voidpf opaque, uInt items, uInt size)
+{
+  return icns_malloc((struct icns_data *)opaque, (size_t)items * size);
+}
+
+static void icns_png_zfree(voidpf opaque, voidpf ptr)
+{
+  icns_free((struct icns_data *)opaque, ptr);
+}
+
+static size_t icns_png_rows_per_segment(const struct icns_png_layout *layout,
+ size_t width)
+{
+  size_t rows = ICNS_PNG_SEGMENT_SIZE / (icns_png_row_bytes(layout, width) + 1);
+  return rows ? rows : 1;
+}
+
+/* Returns true if an image is large enough to use the segmented encoder. */
+static bool icns_png_use_segments(const struct icns_png_layout *layout,
+ size_t width, size_t height)
+{
+  return height > icns_png_rows_per_segment(layout, width);
+}
+
+static void icns_png_filter_task_fn(void *priv, unsigned index)
+{
+  struct icns_png_segment_task *task = (struct icns_png_segment_task *)priv;
+  struct icns_data *icns = task->icns;
+  size_t y0 = index * task->rows_per_segment;
+  size_t y1 = y0 + task->rows_per_segment;
+  uint8_t *work;
+
+  if(y1 > task->height)
+    y1 = task->height;
+
+  work = (uint8_t *)icns_malloc(icns,
+   icns_png_filter_work_size(task->layout, task->width));
+  if(!work)
+  {
+    task->segments[index].ret = ICNS_ALLOC_ERROR;
+    return;
+  }
+
+  icns_png_filter_rows(task->raw + y0 * (task->row_bytes + 1), work,
+   task->pixels, task->width, y0, y1, task->layout, task->filters);
+  icns_free(icns, work);
+}
+
+static void icns_png_deflate_task_fn(void *priv, unsigned index)
+{
+  struct icns_png_segment_task *task = (struct icns_png_segment_task *)priv;
+  struct icns_png_segment *seg = &task->segments[index];
+  struct icns_data *icns = task->icns;
+  bool last = (index + 1 == task->num_segments);
+  size_t start = index * task->rows_per_segment * (task->row_bytes + 1);
+  size_t end = start + task->rows_per_segment * (task->row_bytes + 1);
+  size_t bound;
+  z_stream zs;
+  int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+  int res;
+
+  if(last)
+    end = task->height * (task->row_bytes + 1);
+
+  seg->raw_size = end - start;
+  seg->adler = icns_adler32(1, task->raw + start, end - start);
+
+  memset(&zs, 0, sizeof(zs));
+  zs.zalloc = icns_png_zalloc;
+  zs.zfree = icns_png_zfree;
+  zs.opaque = icns;
+
+  if(deflateInit2(&zs, task->level, Z_DEFLATED, -15, task->mem_level,
+   task->strategy) != Z_OK)
+  {
+    seg->ret = ICNS_PNG_INIT_ERROR;
+    return;
+  }
+
+  if(start > 0)
+  {
+    size_t dict = start < ICNS_PNG_ZLIB_WINDOW ? start : ICNS_PNG_ZLIB_WINDOW;
+    deflateSetDictionary(&zs, task->raw + start - dict, dict);
+  }
+
+  /* Sync flush adds an empty stored block (at most 6 bytes). */
+  bound = deflateBound(&zs, end - start) + 16;
+  seg->out = (uint8_t *)icns_malloc(icns, bound);
+  if(!seg->out)
+  {
+    deflateEnd(&zs);
+    seg->ret = ICNS_ALLOC_ERROR;
+    return;
+  }
+
+  zs.next_in = task->raw + start;
+  zs.avail_in = end - start;
+  zs.next_out = seg->out;
+  zs.avail_out = bound;
+  res = deflate(&zs, flush);
+
+  if(last ? res != Z_STREAM_END :
+   (res != Z_OK || zs.avail_in || !zs.avail_out))
+    seg->ret = ICNS_PNG_WRITE_ERROR;
+
+  seg->out_size = bound - zs.avail_out;
+  deflateEnd(&zs);
+}
+
+/* zlib header FLEVEL, matching what zlib itself would write. */
+static unsigned icns_png_zlib_header(int level, int strategy)
+{
+  unsigned header = (Z_DEFLATED + ((15 - 8) << 4)) << 8;
+  unsigned flevel;
+
+  if(level == Z_DEFAULT_COMPRESSION)
+    level = 6;
+
+  if(strategy >= Z_HUFFMAN_ONLY || level < 2)
+    flevel = 0;
+  else
+  if(level < 6)
+    flevel = 1;
+  else
+  if(level == 6)
+    flevel = 2;
+  else
+    flevel = 3;
+
+  header |= flevel << 6;
+  return header + 31 - (header % 31);
+}
+
+/**
+ * Encode a large pixel array into a PNG using the segmented encoder.
+ *
+ * @param icns      current state data.
+ * @param dest      pointer to write newly allocated memory pointer on success.
+ * @param dest_size pointer to write newly allocated memory size on success.
+ * @param pixels    pixel array to encode into a PNG.
+ * @param width     width of pixel array, in real pixels.
+ * @param height    height of pixel array, in real pixels.
+ * @param layout    color type and bit depth to encode with.
+ * @param settings  zlib and filter settings; -1 selects libpng's default.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_ALLOC_ERROR` if a buffer failed to allocate;
+ *                  `ICNS_PNG_INIT_ERROR` if zlib failed to init;
+ *                  `ICNS_PNG_WRITE_ERROR` if zlib failed during write.
+ */
+static enum icns_error icns_encode_png_segmented(struct icns_data *icns,
+ uint8_t **dest, size_t *dest_size,
+ const struct rgba_color *pixels, size_t width, size_t height,
+ const struct icns_png_layout *layout,
+ const struct icns_png_settings *settings)
+{
+  struct icns_png_segment_task task;
+  enum icns_error ret = ICNS_OK;
+  size_t raw_size;
+  size_t idat_size;
+  size_t pos;
+  uint32_t adler;
+  uint8_t *out = NULL;
+  unsigned zlib_header;
+  unsigned i;
+
+  if(width > PNG_UINT_31_MAX || height > PNG_UINT_31_MAX)
+  {
+    E_("invalid PNG dimensions %zu x %zu", width, height);
+    return ICNS_PNG_WRITE_ERROR;
+  }
+
+  task.icns = icns;
+  task.pixels = pixels;
+  task.layout = layout;
+  task.width = width;
+  task.height = height;
+  task.row_bytes = icns_png_row_bytes(layout, width);
+  task.rows_per_segment = icns_png_rows_per_segment(layout, width);
+  task.num_segments = (height + task.rows_per_segment - 1) /
+   task.rows_per_segment;
+
+  /* Defaults match libpng's. */
+  if(settings->filters >= 0)
+    task.filters = settings->filters;
+  else
+  if(layout->color_type == PNG_COLOR_TYPE_PALETTE || layout->bit_depth < 8)
+    task.filters = PNG_FILTER_NONE;
+  else
+    task.filters = PNG_ALL_FILTERS;
+
+  task.level = settings->level >= 0 ? settings->level : Z_DEFAULT_COMPRESSION;
+  task.mem_level = settings->mem_level >= 0 ? settings->mem_level : 8;
+  if(settings->strategy >= 0)
+    task.strategy = settings->strategy;
+  else
+    task.strategy = task.filters == PNG_FILTER_NONE ?
+     Z_DEFAULT_STRATEGY : Z_FILTERED;
+
+  task.segments = (struct icns_png_segment *)icns_malloc(icns,
+   task.num_segments * sizeof(struct icns_png_segment));
+  if(!task.segments)
+  {
+    E_("failed to allocate PNG segments");
+    return ICNS_ALLOC_ERROR;
+  }
+  memset(task.segments, 0, task.num_segments * sizeof(struct icns_png_segment));
+
+  raw_size = (task.row_bytes + 1) * height;
+  task.raw = (uint8_t *)icns_malloc(icns, raw_size);
+  if(!task.raw)
+  {
+    E_("failed to allocate PNG scanline buffer");
+    ret = ICNS_ALLOC_ERROR;
+    goto error;
+  }
+
+  icns_thread_run(icns_png_filter_task_fn, &task,
+   task.num_segments, icns->num_threads);
+  for(i = 0; i < task.num_segments; i++)
+  {
+    if(task.segments[i].ret)
+    {
+      E_("failed to filter PNG segment %u", i);
+      ret = task.segments[i].ret;
+      goto error;
+    }
+  }
+
+  icns_thread_run(icns_png_deflate_task_fn, &task,
+   task.num_segments, icns->num_threads);
+  idat_size = 2 + 4;
+  for(i = 0; i < task.num_segments; i++)
+  {
+    if(task.segments[i].ret)
+    {
+      E_("failed to deflate PNG segment %u", i);
+      ret = task.segments[i].ret;
+      goto error;
+    }
+    idat_size += task.segments[i].out_size;
+  }
+  if(idat_size > PNG_UINT_31_MAX)
+  {
+    E_("PNG IDAT too large");
+    ret = ICNS_PNG_WRITE_ERROR;
+    goto error;
+  }
+
+  out = (uint8_t *)icns_malloc(icns,
+   ICNS_PNG_HEADER_BOUND + (idat_size + 12) + 12);
+  if(!out)
+  {
+    E_("failed to allocate PNG buffer");
+    ret = ICNS_ALLOC_ERROR;
+    goto error;
+  }
+
+  pos = icns_png_write_header(out, width, height, layout);
+
+  zlib_header = icns_png_zlib_header(task.level, task.strategy);
+  out[pos + 8] = zlib_header >> 8;
+  out[pos + 9] = zlib_header & 0xff;
+  idat_size = 2;
+  adler = 1;
+  for(i = 0; i < task.num_segments; i++)
+  {
+    memcpy(out + pos + 8 + idat_size, task.segments[i].out,
+     task.segments[i].out_size);
+    idat_size += task.segments[i].out_size;
+    adler = adler32_combine(adler, task.segments[i].adler,
+     (z_off_t)task.segments[i].raw_size);
+  }
+  icns_png_put_u32(out + pos + 8 + idat_size, adler);
+  idat_size += 4;
+
+  pos += icns_png_finish_chunk(out + pos, "IDAT", idat_size);
+  pos += icns_png_finish_chunk(out + pos, "IEND", 0);
+
+  *dest = out;
+  *dest_size = pos;
+  out = NULL;
+
+error:
+  for(i = 0; i < task.num_segments; i++)
+    icns_free(icns, task.segments[i].out);
+  icns_free(icns, task.segments);
+  icns_free(icns, task.raw);
+  icns_free(icns, out);
+  return ret;
+}
+
+
+static void icns_png_write_stream_fn(png_struct *png, png_bytep src, size_t size)
+{
+  struct icns_data *icns = (struct icns_data *)png_get_io_ptr(png);
+
+  if(icns->write_fn(src, size, icns) < size)
+    png_error(png, "write error");
+}
+
 struct icns_buffer_writer
 {
+  struct icns_data *icns;
   uint8_t *buffer;
   size_t pos;
   size_t alloc;
@@ -465,7 +1660,7 @@ static void icns_png_write_buffer_fn(png_struct *png, png_bytep src, size_t size
     if(next_alloc <= b->alloc)
       png_error(png, "alloc size error in write");
 
-    tmp = realloc(b->buffer, next_alloc);
+    tmp = icns_realloc(b->icns, b->buffer, next_alloc);
     if(!tmp)
       png_error(png, "alloc error in write");
 
@@ -477,8 +1672,89 @@ static void icns_png_write_buffer_fn(png_struct *png, png_bytep src, size_t size
   b->pos += size;
 }
 
+/* Encode with an already selected layout; see `icns_encode_png_to_buffer`. */
+static enum icns_error icns_encode_png_layout_to_buffer(
+ struct icns_data *icns, uint8_t **dest, size_t *dest_size,
+ const struct rgba_color *pixels, size_t width, size_t height,
+ enum icns_png_profile profile, const struct icns_png_layout *layout)
+{
+  struct icns_buffer_writer buffer = { icns, NULL, 0, 0 };
+  enum icns_error ret;
+  void *tmp;
+
+  if(icns->png_backend == ICNS_PNG_BACKEND_BUILTIN)
+  {
+    ret = icns_encode_png_builtin(icns, dest, dest_size,
+     pixels, width, height, layout);
+    if(ret)
+      E_("failed to write PNG to buffer");
+    return ret;
+  }
+
+  if(profile != ICNS_PNG_PROFILE_EXHAUSTIVE &&
+   icns_png_use_segments(layout, width, height))
+  {
+    ret = icns_encode_png_segmented(icns, dest, dest_size,
+     pixels, width, height, layout, &icns_png_profiles[profile]);
+    if(ret)
+      E_("failed to write PNG to buffer");
+    return ret;
+  }
+
+  if(profile == ICNS_PNG_PROFILE_EXHAUSTIVE)
+  {
+    /* Encode every candidate and keep the smallest. All candidates are
+     * lossless encodings of the same pixels, so only the size differs. */
+    const size_t num_candidates =
+     sizeof(icns_png_exhaustive) / sizeof(icns_png_exhaustive[0]);
+    size_t i;
+
+    for(i = 0; i < num_candidates; i++)
+    {
+      struct icns_buffer_writer tmp_buf = { icns, NULL, 0, 0 };
+
+      ret = icns_encode_png(icns, pixels, width, height, layout,
+       &icns_png_exhaustive[i], icns_png_write_buffer_fn, &tmp_buf);
+      if(ret)
+      {
+        E_("failed to write PNG to buffer");
+        icns_free(icns, tmp_buf.buffer);
+        icns_free(icns, buffer.buffer);
+        return ret;
+      }
+      if(!buffer.buffer || tmp_buf.pos < buffer.pos)
+      {
+        icns_free(icns, buffer.buffer);
+        buffer = tmp_buf;
+      }
+      else
+        icns_free(icns, tmp_buf.buffer);
+    }
+  }
+  else
+  {
+    ret = icns_encode_png(icns, pixels, width, height, layout,
+     &icns_png_profiles[profile], icns_png_write_buffer_fn, &buffer);
+    if(ret)
+    {
+      E_("failed to write PNG to buffer");
+      icns_free(icns, buffer.buffer);
+      return ret;
+    }
+  }
+  tmp = icns_realloc(icns, buffer.buffer, buffer.pos);
+  *dest = tmp ? tmp : buffer.buffer;
+  *dest_size = buffer.pos;
+  return ICNS_OK;
+}
+
 /**
  * Encode a pixel array into a PNG and write it to a new memory allocation.
+ * The color type and bit depth are selected as for
+ * `icns_encode_png_to_stream`. If the built-in PNG backend is selected,
+ * the profile is ignored. Large images are split into fixed-size segments
+ * that are filtered and compressed in parallel; since the segment size
+ * does not depend on the thread count, neither does the output.
  *
  * @param icns      current state data.
  * @param dest      pointer to write newly allocated memory pointer on success.
@@ -486,28 +1762,130 @@ static void icns_png_write_buffer_fn(png_struct *png, png_bytep src, size_t size
  * @param pixels    pixel array to encode into a PNG.
  * @param width     width of pixel array, in real pixels.
  * @param height    height of pixel array, in real pixels.
+ * @param profile   compression profile to encode with.
  * @return          `ICNS_OK` on success;
+ *                  `ICNS_ALLOC_ERROR` if a row buffer failed to allocate;
  *                  `ICNS_PNG_INIT_ERROR` if libpng failed to init;
  *                  `ICNS_PNG_WRITE_ERROR` if libpng failed during write.
  */
 enum icns_error icns_encode_png_to_buffer(
  struct icns_data * RESTRICT icns, uint8_t **dest, size_t *dest_size,
- const struct rgba_color *pixels, size_t width, size_t height)
+ const struct rgba_color *pixels, size_t width, size_t height,
+ enum icns_png_profile profile)
 {
-  struct icns_buffer_writer buffer = { NULL, 0, 0 };
-  enum icns_error ret;
-  void *tmp;
+  struct icns_png_layout layout;
+  icns_png_select_layout(&layout, pixels, width * height, NULL);
 
-  ret = icns_encode_png(icns, pixels, width, height,
-   icns_png_write_buffer_fn, &buffer);
-  if(ret)
+  return icns_encode_png_layout_to_buffer(icns, dest, dest_size,
+   pixels, width, height, profile, &layout);
+}
+
+/**
+ * Encode an image's pixel array into a PNG and write it to a new memory
+ * allocation. This is `icns_encode_png_to_buffer`, except the image's
+ * analysis is used to select the layout if it is up-to-date.
+ *
+ * @param icns      current state data.
+ * @param dest      pointer to write newly allocated memory pointer on success.
+ * @param dest_size pointer to write newly allocated memory size on success.
+ * @param image     image with a pixel array to encode into a PNG.
+ * @param profile   compression profile to encode with.
+ * @return          see `icns_encode_png_to_buffer`.
+ */
+enum icns_error icns_encode_image_png_to_buffer(
+ struct icns_data * RESTRICT icns, uint8_t **dest, size_t *dest_size,
+ const struct icns_image *image, enum icns_png_profile profile)
+{
+  struct icns_png_layout layout;
+  size_t width = image->real_width;
+  size_t height = image->real_height;
+
+  icns_png_select_layout(&layout, image->pixels, width * height,
+   image->dirty_analysis ? NULL : &image->analysis);
+
+  return icns_encode_png_layout_to_buffer(icns, dest, dest_size,
+   image->pixels, width, height, profile, &layout);
+}
+
+/* Encode with an already selected layout; see `icns_encode_png_to_stream`. */
+static enum icns_error icns_encode_png_layout_to_stream(
+ struct icns_data * RESTRICT icns, const struct rgba_color *pixels,
+ size_t width, size_t height, enum icns_png_profile profile,
+ const struct icns_png_layout *layout)
+{
+  if(profile == ICNS_PNG_PROFILE_EXHAUSTIVE ||
+   icns->png_backend == ICNS_PNG_BACKEND_BUILTIN ||
+   icns_png_use_segments(layout, width, height))
   {
-    E_("failed to write PNG to buffer");
-    free(buffer.buffer);
+    /* The smallest candidate isn't known until all have been encoded,
+     * and the built-in and segmented encoders only write to a buffer. */
+    enum icns_error ret;
+    uint8_t *data;
+    size_t data_size;
+
+    ret = icns_encode_png_layout_to_buffer(icns, &data, &data_size,
+     pixels, width, height, profile, layout);
+    if(ret)
+      return ret;
+
+    ret = icns_write_direct(icns, data, data_size);
+    icns_free(icns, data);
     return ret;
   }
-  tmp = realloc(buffer.buffer, buffer.pos);
-  *dest = tmp ? tmp : buffer.buffer;
-  *dest_size = buffer.pos;
-  return ICNS_OK;
+
+  return icns_encode_png(icns, pixels, width, height, layout,
+   &icns_png_profiles[profile], icns_png_write_stream_fn, icns);
+}
+
+/**
+ * Encode a pixel array into a PNG and write it directly to the output stream.
+ * On error, this may have written incomplete PNG data to the stream.
+ * The color type and bit depth are the smallest that store the pixels
+ * losslessly (see `icns_png_select_layout`). Images that need to be
+ * buffered first (see `icns_encode_png_to_buffer`) are written in one piece.
+ *
+ * @param icns      current state data.
+ * @param pixels    pixel array to encode into a PNG.
+ * @param width     width of pixel array, in real pixels.
+ * @param height    height of pixel array, in real pixels.
+ * @param profile   compression profile to encode with.
+ * @return          `ICNS_OK` on success;
+ *                  `ICNS_ALLOC_ERROR` if a row buffer failed to allocate;
+ *                  `ICNS_PNG_INIT_ERROR` if libpng failed to init;
+ *                  `ICNS_PNG_WRITE_ERROR` if libpng failed during write.
+ */
+enum icns_error icns_encode_png_to_stream(struct icns_data * RESTRICT icns,
+ const struct rgba_color *pixels, size_t width, size_t height,
+ enum icns_png_profile profile)
+{
+  struct icns_png_layout layout;
+  icns_png_select_layout(&layout, pixels, width * height, NULL);
+
+  return icns_encode_png_layout_to_stream(icns, pixels, width, height,
+   profile, &layout);
+}
+
+/**
+ * Encode an image's pixel array into a PNG and write it directly to the
+ * output stream. This is `icns_encode_png_to_stream`, except the image's
+ * analysis is used to select the layout if it is up-to-date.
+ *
+ * @param icns      current state data.
+ * @param image     image with a pixel array to encode into a PNG.
+ * @param profile   compression profile to encode with.
+ * @return          see `icns_encode_png_to_stream`.
+ */
+enum icns_error icns_encode_image_png_to_stream(
+ struct icns_data * RESTRICT icns, const struct icns_image *image,
+ enum icns_png_profile profile)
+{
+  struct icns_png_layout layout;
+  size_t width = image->real_width;
+  size_t height = image->real_height;
+
+  icns_png_select_layout(&layout, image->pixels, width * height,
+   image->dirty_analysis ? NULL : &image->analysis);
+
+  return icns_encode_png_layout_to_stream(icns, image->pixels, width, height,
+   profile, &layout);
 }
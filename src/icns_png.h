@@ -61,12 +61,23 @@ enum icns_error icns_get_png_info(
 enum icns_error icns_decode_png_to_pixel_array(
  struct icns_data * RESTRICT icns, struct icns_image * RESTRICT image,
  const uint8_t *png_data, size_t png_size) NOT_NULL;
+enum icns_error icns_check_png(
+ struct icns_data * RESTRICT icns, const struct icns_image * RESTRICT image,
+ const uint8_t *png_data, size_t png_size, bool check_crc) NOT_NULL;
 
 enum icns_error icns_encode_png_to_stream(struct icns_data * RESTRICT icns,
- const struct rgba_color *pixels, size_t width, size_t height) NOT_NULL;
+ const struct rgba_color *pixels, size_t width, size_t height,
+ enum icns_png_profile profile) NOT_NULL;
 enum icns_error icns_encode_png_to_buffer(
  struct icns_data * RESTRICT icns, uint8_t **dest, size_t *dest_size,
- const struct rgba_color *pixels, size_t width, size_t height) NOT_NULL;
+ const struct rgba_color *pixels, size_t width, size_t height,
+ enum icns_png_profile profile) NOT_NULL;
+enum icns_error icns_encode_image_png_to_stream(
+ struct icns_data * RESTRICT icns, const struct icns_image *image,
+ enum icns_png_profile profile) NOT_NULL;
+enum icns_error icns_encode_image_png_to_buffer(
+ struct icns_data * RESTRICT icns, uint8_t **dest, size_t *dest_size,
+ const struct icns_image *image, enum icns_png_profile profile) NOT_NULL;
 
 ICNS_END_DECLS
 
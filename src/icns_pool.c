@@ -0,0 +1,180 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "icns.h"
+#include "icns_pool.h"
+
+#ifndef ICNSCVT_NO_THREADS
+#include <pthread.h>
+#endif
+
+struct icns_pool
+{
+#define ICNS_POOL_MAGIC MAGIC(0xfe,'p','L',0x2a)
+  uint32_t magic;
+  int compat_version;
+  unsigned max_idle;
+  unsigned num_idle;
+  struct icns_data **idle;
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+static inline void icns_pool_lock(struct icns_pool *pool)
+{
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_lock(&pool->lock);
+#else
+  (void)pool;
+#endif
+}
+
+static inline void icns_pool_unlock(struct icns_pool *pool)
+{
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_unlock(&pool->lock);
+#else
+  (void)pool;
+#endif
+}
+
+/**
+ * Allocate a new state data pool. The pool starts empty; state data are
+ * allocated on demand by `icns_pool_acquire`.
+ *
+ * @param compat_version  compatibility version for new state data.
+ * @param max_idle        maximum number of released state data to keep.
+ * @return                a new pool on success, otherwise `NULL`.
+ */
+struct icns_pool *icns_pool_create(int compat_version, unsigned max_idle)
+{
+  struct icns_pool *pool = (struct icns_pool *)malloc(sizeof(struct icns_pool));
+  if(!pool)
+    return NULL;
+
+  pool->idle = NULL;
+  if(max_idle)
+  {
+    pool->idle = (struct icns_data **)malloc(max_idle * sizeof(pool->idle[0]));
+    if(!pool->idle)
+      goto error;
+  }
+#ifndef ICNSCVT_NO_THREADS
+  if(pthread_mutex_init(&pool->lock, NULL))
+    goto error;
+#endif
+
+  pool->magic = ICNS_POOL_MAGIC;
+  pool->compat_version = compat_version;
+  pool->max_idle = max_idle;
+  pool->num_idle = 0;
+  return pool;
+
+error:
+  free(pool->idle);
+  free(pool);
+  return NULL;
+}
+
+/**
+ * Free a state data pool and all idle state data held by it. State data
+ * acquired from the pool and not yet released are not affected.
+ *
+ * @param pool    pool to free.
+ */
+void icns_pool_delete(struct icns_pool *pool)
+{
+  unsigned i;
+
+  for(i = 0; i < pool->num_idle; i++)
+    icns_delete_state_data(pool->idle[i]);
+
+#ifndef ICNSCVT_NO_THREADS
+  pthread_mutex_destroy(&pool->lock);
+#endif
+  pool->magic = 0;
+  free(pool->idle);
+  free(pool);
+}
+
+/**
+ * Check whether a pointer is a valid pool.
+ *
+ * @param pool    pool pointer to check (may be `NULL`).
+ * @return        `true` if the pool is valid, otherwise `false`.
+ */
+bool icns_pool_is_valid(const struct icns_pool *pool)
+{
+  return pool && pool->magic == ICNS_POOL_MAGIC;
+}
+
+/**
+ * Take a state data from the pool, allocating a new one if the pool has
+ * no idle state data.
+ *
+ * @param pool    pool to acquire state data from.
+ * @return        reset state data on success, otherwise `NULL`.
+ */
+struct icns_data *icns_pool_acquire(struct icns_pool *pool)
+{
+  struct icns_data *icns = NULL;
+
+  icns_pool_lock(pool);
+  if(pool->num_idle)
+    icns = pool->idle[--pool->num_idle];
+  icns_pool_unlock(pool);
+
+  if(!icns)
+  {
+    icns = icns_allocate_state_data();
+    if(icns)
+      icns->compat_version = pool->compat_version;
+  }
+  return icns;
+}
+
+/**
+ * Reset a state data and return it to the pool. Its settings are restored
+ * to their defaults so the next borrower doesn't inherit them, including
+ * arena mode; only the memory of a suspended arena is kept. If the pool
+ * already holds its maximum number of idle state data, the state data is
+ * freed instead.
+ *
+ * @param pool    pool to release the state data to.
+ * @param icns    state data to release.
+ */
+void icns_pool_release(struct icns_pool * RESTRICT pool,
+ struct icns_data * RESTRICT icns)
+{
+  icns_reset_state_data(icns);
+  icns_restore_default_settings(icns);
+  icns->compat_version = pool->compat_version;
+
+  icns_pool_lock(pool);
+  if(pool->num_idle < pool->max_idle)
+  {
+    pool->idle[pool->num_idle++] = icns;
+    icns = NULL;
+  }
+  icns_pool_unlock(pool);
+
+  if(icns)
+    icns_delete_state_data(icns);
+}
@@ -0,0 +1,41 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_POOL_H
+#define ICNSCVT_POOL_H
+
+#include "common.h"
+
+/* Thread-safe pool of reset state data for reuse between conversions.
+ * Define ICNSCVT_NO_THREADS to disable locking. */
+
+ICNS_BEGIN_DECLS
+
+struct icns_pool;
+
+struct icns_pool *icns_pool_create(int compat_version, unsigned max_idle);
+void icns_pool_delete(struct icns_pool *pool) NOT_NULL;
+bool icns_pool_is_valid(const struct icns_pool *pool);
+struct icns_data *icns_pool_acquire(struct icns_pool *pool) NOT_NULL;
+void icns_pool_release(struct icns_pool * RESTRICT pool,
+ struct icns_data * RESTRICT icns) NOT_NULL;
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_POOL_H */
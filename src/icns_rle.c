@@ -0,0 +1,1057 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "icns_rle.h"
+#include "icns_simd.h"
+#include "icns_thread.h"
+
+/* Run detection kernels.
+ *
+ * find_run: return the offset of the first position `i < max` where
+ * src[i], src[i + 1], and src[i + 2] are identical. If there is no such
+ * position, return the lesser of `count` and `max`.
+ *
+ * run_length: return the number of consecutive values starting at src[0]
+ * that are equal to src[0] (at least 1, at most `count`).
+ *
+ * The vectorized kernels handle channel pitches of 1 (planar) and 4 (RGBA);
+ * they never read past the byte of the last value in the channel, so they
+ * are safe to use on any sub-range of a pixel array.
+ */
+static inline size_t icns_rle_find_run_end(size_t count, size_t max)
+{
+  size_t end = count > 2 ? count - 2 : 0;
+  return end < max ? end : max;
+}
+
+static inline size_t icns_rle_find_run_none(size_t count, size_t max)
+{
+  return count < max ? count : max;
+}
+
+static size_t icns_rle_find_run_tail(const uint8_t *src, size_t i,
+ size_t count, size_t pitch, size_t max)
+{
+  size_t end = icns_rle_find_run_end(count, max);
+
+  for(src += i * pitch; i < end; i++, src += pitch)
+    if(src[0] == src[pitch] && src[0] == src[pitch + pitch])
+      return i;
+
+  return icns_rle_find_run_none(count, max);
+}
+
+static size_t icns_rle_run_length_tail(const uint8_t *src, size_t i,
+ size_t count, size_t pitch)
+{
+  uint8_t current = src[0];
+
+  for(src += i * pitch; i < count; i++, src += pitch)
+    if(*src != current)
+      break;
+
+  return i;
+}
+
+static size_t icns_rle_find_run_scalar(const uint8_t *src,
+ size_t count, size_t pitch, size_t max)
+{
+  return icns_rle_find_run_tail(src, 0, count, pitch, max);
+}
+
+static size_t icns_rle_run_length_scalar(const uint8_t *src,
+ size_t count, size_t pitch)
+{
+  return icns_rle_run_length_tail(src, 1, count, pitch);
+}
+
+#ifdef ICNS_SIMD_SSE2
+
+static size_t icns_rle_find_run_sse2(const uint8_t *src,
+ size_t count, size_t pitch, size_t max)
+{
+  size_t end = icns_rle_find_run_end(count, max);
+  size_t i = 0;
+
+  if((pitch == 1 || pitch == 4) && count)
+  {
+    size_t bytes = (count - 1) * pitch + 1;
+    size_t step = 16 / pitch;
+    unsigned lanes = (pitch == 1) ? 0xffffu : 0x1111u;
+
+    for(; i < end && (i + 2) * pitch + 16 <= bytes; i += step)
+    {
+      const uint8_t *pos = src + i * pitch;
+      __m128i a = _mm_loadu_si128((const __m128i *)pos);
+      __m128i b = _mm_loadu_si128((const __m128i *)(pos + pitch));
+      __m128i c = _mm_loadu_si128((const __m128i *)(pos + pitch * 2));
+      __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, b), _mm_cmpeq_epi8(b, c));
+      unsigned m = (unsigned)_mm_movemask_epi8(eq) & lanes;
+      if(m)
+      {
+        i += icns_ctz(m) / pitch;
+        return i < end ? i : icns_rle_find_run_none(count, max);
+      }
+    }
+  }
+  return icns_rle_find_run_tail(src, i, count, pitch, max);
+}
+
+static size_t icns_rle_run_length_sse2(const uint8_t *src,
+ size_t count, size_t pitch)
+{
+  size_t i = 1;
+
+  if(pitch == 1 || pitch == 4)
+  {
+    size_t bytes = (count - 1) * pitch + 1;
+    size_t step = 16 / pitch;
+    unsigned lanes = (pitch == 1) ? 0xffffu : 0x1111u;
+    __m128i current = _mm_set1_epi8((char)src[0]);
+
+    for(; i * pitch + 16 <= bytes; i += step)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *)(src + i * pitch));
+      unsigned m = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(a, current));
+      m &= lanes;
+      if(m)
+        return i + icns_ctz(m) / pitch;
+    }
+  }
+  return icns_rle_run_length_tail(src, i, count, pitch);
+}
+
+#endif /* ICNS_SIMD_SSE2 */
+
+#ifdef ICNS_SIMD_AVX2
+
+ICNS_TARGET_AVX2
+static size_t icns_rle_find_run_avx2(const uint8_t *src,
+ size_t count, size_t pitch, size_t max)
+{
+  size_t end = icns_rle_find_run_end(count, max);
+  size_t i = 0;
+
+  if((pitch == 1 || pitch == 4) && count)
+  {
+    size_t bytes = (count - 1) * pitch + 1;
+    size_t step = 32 / pitch;
+    unsigned lanes = (pitch == 1) ? 0xffffffffu : 0x11111111u;
+
+    for(; i < end && (i + 2) * pitch + 32 <= bytes; i += step)
+    {
+      const uint8_t *pos = src + i * pitch;
+      __m256i a = _mm256_loadu_si256((const __m256i *)pos);
+      __m256i b = _mm256_loadu_si256((const __m256i *)(pos + pitch));
+      __m256i c = _mm256_loadu_si256((const __m256i *)(pos + pitch * 2));
+      __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi8(a, b),
+       _mm256_cmpeq_epi8(b, c));
+      unsigned m = (unsigned)_mm256_movemask_epi8(eq) & lanes;
+      if(m)
+      {
+        i += icns_ctz(m) / pitch;
+        return i < end ? i : icns_rle_find_run_none(count, max);
+      }
+    }
+  }
+  return icns_rle_find_run_tail(src, i, count, pitch, max);
+}
+
+ICNS_TARGET_AVX2
+static size_t icns_rle_run_length_avx2(const uint8_t *src,
+ size_t count, size_t pitch)
+{
+  size_t i = 1;
+
+  if(pitch == 1 || pitch == 4)
+  {
+    size_t bytes = (count - 1) * pitch + 1;
+    size_t step = 32 / pitch;
+    unsigned lanes = (pitch == 1) ? 0xffffffffu : 0x11111111u;
+    __m256i current = _mm256_set1_epi8((char)src[0]);
+
+    for(; i * pitch + 32 <= bytes; i += step)
+    {
+      __m256i a = _mm256_loadu_si256((const __m256i *)(src + i * pitch));
+      unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, current));
+      m &= lanes;
+      if(m)
+        return i + icns_ctz(m) / pitch;
+    }
+  }
+  return icns_rle_run_length_tail(src, i, count, pitch);
+}
+
+#endif /* ICNS_SIMD_AVX2 */
+
+/**
+ * Initialize a resumable packer for a single (A)RGB channel.
+ *
+ * Literals are emitted up to the next run of 3 or more identical values
+ * (or 128 values, whichever is first), and runs are emitted in blocks of
+ * up to 130 values. A run remainder shorter than 3 is left to be emitted
+ * as part of the following literal.
+ *
+ * @param p         packer state to initialize.
+ * @param src       first value of the channel to pack.
+ * @param count     number of values in the channel.
+ * @param pitch     distance between values in the channel, in bytes.
+ */
+void icns_rle_packer_init(struct icns_rle_packer *p,
+ const uint8_t *src, size_t count, size_t pitch)
+{
+  p->src = src;
+  p->count = count;
+  p->pitch = pitch;
+  p->literal = 0;
+  p->run = 0;
+  p->find_run = icns_rle_find_run_scalar;
+  p->run_length = icns_rle_run_length_scalar;
+
+#ifdef ICNS_SIMD_SSE2
+  p->find_run = icns_rle_find_run_sse2;
+  p->run_length = icns_rle_run_length_sse2;
+#endif
+#ifdef ICNS_SIMD_AVX2
+  if(icns_cpu_has_avx2())
+  {
+    p->find_run = icns_rle_find_run_avx2;
+    p->run_length = icns_rle_run_length_avx2;
+  }
+#endif
+}
+
+/* Continue packing a channel. This is a template for the fixed size
+ * kernels below; `pitch` should be a constant.
+ * If `checked` is false, `dest` must have room for the worst case packed
+ * size of the rest of the channel (see `icns_rle_channel_bound`). */
+static ALWAYS_INLINE size_t icns_rle_packer_run_tmpl(struct icns_rle_packer *p,
+ uint8_t *dest, size_t dest_size, size_t pitch, bool checked)
+{
+  const uint8_t *src = p->src;
+  size_t left = p->count;
+  size_t dest_pos = 0;
+  size_t num;
+  size_t i;
+
+  while(left)
+  {
+    if(!p->run && !p->literal)
+    {
+      /* Find position of next RLE of length 3 or greater. */
+      num = p->find_run(src, left, pitch, ICNS_RLE_MAX_LITERAL);
+      if(num)
+        p->literal = num;
+      else
+        p->run = p->run_length(src, left, pitch);
+    }
+
+    if(p->run)
+    {
+      /* Emit run */
+      num = p->run > ICNS_RLE_MAX_RUN ? ICNS_RLE_MAX_RUN : p->run;
+      if(dest)
+      {
+        if(checked && dest_size - dest_pos < 2)
+          break;
+
+        dest[dest_pos] = num - ICNS_RLE_MIN_RUN + 0x80;
+        dest[dest_pos + 1] = *src;
+      }
+      dest_pos += 2;
+      p->run -= num;
+      if(p->run < ICNS_RLE_MIN_RUN)
+        p->run = 0;
+    }
+    else
+    {
+      /* Emit block */
+      num = p->literal;
+      if(dest)
+      {
+        if(checked && dest_size - dest_pos < num + 1)
+          break;
+
+        dest[dest_pos] = num - 1;
+        if(pitch == 1)
+        {
+          memcpy(dest + dest_pos + 1, src, num);
+        }
+        else
+        {
+          for(i = 0; i < num; i++)
+            dest[dest_pos + 1 + i] = src[i * pitch];
+        }
+      }
+      dest_pos += num + 1;
+      p->literal = 0;
+    }
+    src += num * pitch;
+    left -= num;
+  }
+
+  p->src = src;
+  p->count = left;
+  return dest_pos;
+}
+
+/**
+ * Continue packing a channel. Packing stops at the end of the channel or
+ * at the first token that does not fit in the remaining space in `dest`;
+ * the next call resumes from that token. Output is identical regardless of
+ * how it is split between calls.
+ *
+ * @param p         packer state.
+ * @param dest      destination buffer for packed data, or `NULL` to only
+ *                  count the packed size of the rest of the channel.
+ * @param dest_size size of destination buffer (ignored if `dest` is `NULL`).
+ * @return          the number of bytes written to (or counted for) `dest`.
+ */
+size_t icns_rle_packer_run(struct icns_rle_packer *p,
+ uint8_t *dest, size_t dest_size)
+{
+  return icns_rle_packer_run_tmpl(p, dest, dest_size, p->pitch, true);
+}
+
+/**
+ * Get the exact packed size of a single (A)RGB channel without
+ * writing the packed data anywhere.
+ *
+ * @param src       first value of the channel to pack.
+ * @param count     number of values in the channel.
+ * @param pitch     distance between values in the channel, in bytes.
+ * @return          the packed size of the channel.
+ */
+size_t icns_rle_packed_size(const uint8_t *src, size_t count, size_t pitch)
+{
+  struct icns_rle_packer p;
+
+  icns_rle_packer_init(&p, src, count, pitch);
+  return icns_rle_packer_run(&p, NULL, 0);
+}
+
+/**
+ * Pack a single (A)RGB channel.
+ *
+ * @param dest      destination buffer for packed data.
+ * @param dest_size size of destination buffer.
+ * @param dest_pos  position in the destination buffer to start packing at.
+ * @param src       first value of the channel to pack.
+ * @param src_count number of values in the channel.
+ * @param src_pitch distance between values in the channel, in bytes.
+ * @return          the position in `dest` after the packed channel on
+ *                  success, or 0 if `dest` is too small.
+ */
+size_t icns_rle_pack_channel(uint8_t *dest, size_t dest_size,
+ size_t dest_pos, const uint8_t *src, size_t src_count, size_t src_pitch)
+{
+  struct icns_rle_packer p;
+
+  if(dest_pos > dest_size)
+    return 0;
+
+  icns_rle_packer_init(&p, src, src_count, src_pitch);
+  dest_pos += icns_rle_packer_run(&p, dest + dest_pos, dest_size - dest_pos);
+  if(p.count)
+    return 0;
+
+  return dest_pos;
+}
+
+/* Monotonic queue of prefix positions for the sliding window minimums
+ * used by `icns_rle_pack_channel_optimal`. Neither window can hold more
+ * than ICNS_RLE_MAX_RUN positions. */
+#define ICNS_RLE_WINDOW_SIZE 256
+#define ICNS_RLE_WINDOW_FRONT(w) ((w).pos[(w).head & (ICNS_RLE_WINDOW_SIZE - 1)])
+#define ICNS_RLE_WINDOW_BACK(w) ((w).pos[((w).tail - 1) & (ICNS_RLE_WINDOW_SIZE - 1)])
+#define ICNS_RLE_WINDOW_PUSH(w, p) ((w).pos[(w).tail++ & (ICNS_RLE_WINDOW_SIZE - 1)] = (p))
+
+struct icns_rle_window
+{
+  size_t pos[ICNS_RLE_WINDOW_SIZE];
+  unsigned head;
+  unsigned tail;
+};
+
+/**
+ * Pack a single (A)RGB channel into the smallest possible packed stream.
+ *
+ * The minimum packed size of every prefix of the channel is found with
+ * dynamic programming: each prefix ends with either a literal of 1-128
+ * values or a run of 3-130 identical values, whichever gives the smaller
+ * total. The best start for each is tracked with a sliding window
+ * minimum, so this runs in linear time, but it is still slower than the
+ * greedy packer and allocates temporary memory proportional to the
+ * channel size.
+ *
+ * @param icns      current state data (for the temporary allocation).
+ * @param dest      destination buffer for packed data, or `NULL` to only
+ *                  get the packed size.
+ * @param dest_size size of destination buffer.
+ * @param dest_pos  position in the destination buffer to start packing at.
+ * @param src       first value of the channel to pack.
+ * @param src_count number of values in the channel.
+ * @param src_pitch distance between values in the channel, in bytes.
+ * @return          the position in `dest` after the packed channel on
+ *                  success, or 0 if `dest` is too small or allocation
+ *                  failed. If `dest` is `NULL`, `dest_pos` plus the
+ *                  packed size.
+ */
+size_t icns_rle_pack_channel_optimal(struct icns_data *icns,
+ uint8_t *dest, size_t dest_size, size_t dest_pos,
+ const uint8_t *src, size_t src_count, size_t src_pitch)
+{
+  struct icns_rle_window literal;
+  struct icns_rle_window run;
+  uint32_t *cost;
+  int16_t *step;
+  size_t equal = 0;
+  size_t i;
+  size_t j;
+  size_t n;
+
+  if(!src_count)
+    return dest_pos;
+
+  cost = (uint32_t *)icns_malloc(icns, (src_count + 1) *
+   (sizeof(uint32_t) + sizeof(int16_t)));
+  if(!cost)
+    return 0;
+
+  /* step[i] > 0: prefix i ends in a literal of step[i] values;
+   * step[i] < 0: prefix i ends in a run of -step[i] values. */
+  step = (int16_t *)(cost + src_count + 1);
+  cost[0] = 0;
+  step[0] = 0;
+  literal.head = literal.tail = 0;
+  run.head = run.tail = 0;
+
+  for(i = 1; i <= src_count; i++)
+  {
+    uint32_t best;
+    int16_t best_step;
+
+    /* A literal ending at i starting at j costs cost[j] + (i - j) + 1, so
+     * the best start minimizes cost[j] - j over the last 128 positions. */
+    j = i - 1;
+    while(literal.tail != literal.head &&
+     cost[ICNS_RLE_WINDOW_BACK(literal)] + j >=
+     cost[j] + ICNS_RLE_WINDOW_BACK(literal))
+      literal.tail--;
+    ICNS_RLE_WINDOW_PUSH(literal, j);
+    if(ICNS_RLE_WINDOW_FRONT(literal) + ICNS_RLE_MAX_LITERAL < i)
+      literal.head++;
+
+    j = ICNS_RLE_WINDOW_FRONT(literal);
+    best = cost[j] + (i - j) + 1;
+    best_step = i - j;
+
+    /* Number of identical values ending at value i - 1. */
+    if(i >= 2 && src[(i - 1) * src_pitch] == src[(i - 2) * src_pitch])
+      equal++;
+    else
+      equal = 1;
+
+    /* A run ending at i starting at j costs cost[j] + 2, where j is in the
+     * last min(equal, 130) positions, excluding the last two. */
+    if(equal < ICNS_RLE_MIN_RUN)
+    {
+      run.head = run.tail = 0;
+      cost[i] = best;
+      step[i] = best_step;
+      continue;
+    }
+
+    j = i - ICNS_RLE_MIN_RUN;
+    while(run.tail != run.head && cost[ICNS_RLE_WINDOW_BACK(run)] >= cost[j])
+      run.tail--;
+    ICNS_RLE_WINDOW_PUSH(run, j);
+    if(ICNS_RLE_WINDOW_FRONT(run) + ICNS_RLE_MAX_RUN < i)
+      run.head++;
+
+    j = ICNS_RLE_WINDOW_FRONT(run);
+    if(cost[j] + 2 < best)
+    {
+      best = cost[j] + 2;
+      best_step = -(int16_t)(i - j);
+    }
+    cost[i] = best;
+    step[i] = best_step;
+  }
+
+  if(!dest)
+  {
+    dest_pos += cost[src_count];
+    icns_free(icns, cost);
+    return dest_pos;
+  }
+
+  if(dest_pos > dest_size || dest_size - dest_pos < cost[src_count])
+  {
+    icns_free(icns, cost);
+    return 0;
+  }
+
+  /* Walk the chosen steps back from the end, writing tokens back to front. */
+  dest_pos += cost[src_count];
+  n = dest_pos;
+  for(i = src_count; i > 0; )
+  {
+    if(step[i] < 0)
+    {
+      size_t num = -step[i];
+      i -= num;
+      dest[--n] = src[i * src_pitch];
+      dest[--n] = num - ICNS_RLE_MIN_RUN + 0x80;
+    }
+    else
+    {
+      size_t num = step[i];
+      size_t j;
+      i -= num;
+      for(j = num; j > 0; j--)
+        dest[--n] = src[(i + j - 1) * src_pitch];
+      dest[--n] = num - 1;
+    }
+  }
+  icns_free(icns, cost);
+  return dest_pos;
+}
+
+/**
+ * Find the end of a single packed (A)RGB channel by walking its control
+ * bytes only, without unpacking it. A channel accepted by this function
+ * will always be accepted by `icns_rle_unpack_channel` with the same
+ * parameters, and both return the same position.
+ *
+ * @param src         packed data buffer.
+ * @param src_size    size of packed data buffer.
+ * @param src_pos     position in `src` the packed channel starts at.
+ * @param count       number of values in the channel.
+ * @return            the position in `src` after the packed channel on
+ *                    success, or 0 if the packed data is invalid.
+ */
+size_t icns_rle_scan_channel(const uint8_t *src, size_t src_size,
+ size_t src_pos, size_t count)
+{
+  size_t dest_pos;
+  size_t num;
+  size_t len;
+
+  for(dest_pos = 0; dest_pos < count && src_pos < src_size; )
+  {
+    uint8_t pack_byte = src[src_pos++];
+    if(pack_byte >= 0x80)
+    {
+      num = pack_byte - 0x80 + 3;
+      len = 1;
+    }
+    else
+    {
+      num = pack_byte + 1;
+      len = num;
+    }
+
+    if(src_pos + len > src_size || dest_pos + num > count)
+      break;
+
+    src_pos += len;
+    dest_pos += num;
+  }
+
+  if(dest_pos < count)
+    return 0;
+
+  return src_pos;
+}
+
+/* Unpack a single (A)RGB channel. This is a template for the pitch
+ * variants below; `dest_pitch` should be a constant.
+ * If `checked` is false, `src` must contain at least 2 bytes per value
+ * after `src_pos`, which is the most a valid channel can use. */
+static ALWAYS_INLINE size_t icns_rle_unpack_channel_tmpl(uint8_t *dest,
+ size_t dest_count, size_t dest_pitch, const uint8_t *src, size_t src_size,
+ size_t src_pos, bool checked)
+{
+  size_t dest_pos;
+  size_t i;
+  size_t num;
+
+  /* Planar destinations use memset/memcpy for all but short tokens,
+   * which are cheaper to copy inline. */
+  for(dest_pos = 0; dest_pos < dest_count; )
+  {
+    uint8_t pack_byte;
+    uint8_t copy;
+    if(checked && src_pos >= src_size)
+      break;
+
+    pack_byte = src[src_pos++];
+    if(pack_byte >= 0x80)
+    {
+      /* RLE */
+      num = pack_byte - 0x80 + 3;
+      if((checked && src_pos + 1 > src_size) || dest_pos + num > dest_count)
+        break;
+
+      copy = src[src_pos++];
+      if(dest_pitch == 1 && num >= 16)
+      {
+        memset(dest, copy, num);
+        dest += num;
+        dest_pos += num;
+      }
+      else
+      {
+        for(i = 0; i < num; i++, dest_pos++)
+        {
+          *dest = copy;
+          dest += dest_pitch;
+        }
+      }
+    }
+    else
+    {
+      /* Literal */
+      num = pack_byte + 1;
+      if((checked && src_pos + num > src_size) || dest_pos + num > dest_count)
+        break;
+
+      if(dest_pitch == 1 && num >= 16)
+      {
+        memcpy(dest, src + src_pos, num);
+        dest += num;
+        dest_pos += num;
+        src_pos += num;
+      }
+      else
+      {
+        for(i = 0; i < num; i++, dest_pos++)
+        {
+          *dest = src[src_pos++];
+          dest += dest_pitch;
+        }
+      }
+    }
+  }
+
+  if(dest_pos < dest_count)
+    return 0;
+
+  return src_pos;
+}
+
+/* Instantiate an unpacker specialized for a pitch. The source bounds
+ * checks are skipped when the remaining packed data is large enough to
+ * hold any valid channel. */
+#define ICNS_RLE_UNPACK_VARIANT(name, pitch) \
+static size_t name(uint8_t *dest, size_t dest_count, size_t dest_pitch, \
+ const uint8_t *src, size_t src_size, size_t src_pos) \
+{ \
+  (void)dest_pitch; \
+  if(src_pos <= src_size && src_size - src_pos >= dest_count * 2) \
+    return icns_rle_unpack_channel_tmpl(dest, dest_count, (pitch), \
+     src, src_size, src_pos, false); \
+  return icns_rle_unpack_channel_tmpl(dest, dest_count, (pitch), \
+   src, src_size, src_pos, true); \
+}
+
+/* Pitch 1 is used to unpack into planes. */
+ICNS_RLE_UNPACK_VARIANT(icns_rle_unpack_p1, 1)
+ICNS_RLE_UNPACK_VARIANT(icns_rle_unpack_any, dest_pitch)
+
+/**
+ * Unpack a single (A)RGB channel. A pitch of 1 is dispatched to a variant
+ * specialized for that pitch.
+ *
+ * @param dest        first value of the channel to unpack to.
+ * @param dest_count  number of values in the channel.
+ * @param dest_pitch  distance between values in the channel, in bytes.
+ * @param src         packed data buffer.
+ * @param src_size    size of packed data buffer.
+ * @param src_pos     position in `src` the packed channel starts at.
+ * @return            the position in `src` after the packed channel on
+ *                    success, or 0 if the packed data is invalid.
+ */
+size_t icns_rle_unpack_channel(uint8_t *dest, size_t dest_count,
+ size_t dest_pitch, const uint8_t *src, size_t src_size, size_t src_pos)
+{
+  if(dest_pitch == 1)
+    return icns_rle_unpack_p1(dest, dest_count, 1, src, src_size, src_pos);
+
+  return icns_rle_unpack_any(dest, dest_count, dest_pitch,
+   src, src_size, src_pos);
+}
+
+/* Instantiate the kernels for channels of `num_values` values. With the
+ * count (and the pitch of planes) constant, the bounds checks can be
+ * dropped whenever the buffer holds the worst case for the channel. */
+#define ICNS_RLE_KERNELS(name, num_values) \
+static size_t name##_pack(uint8_t *dest, size_t dest_size, \
+ size_t dest_pos, const uint8_t *src) \
+{ \
+  struct icns_rle_packer p; \
+  if(dest_pos > dest_size) \
+    return 0; \
+  icns_rle_packer_init(&p, src, (num_values), 1); \
+  if(dest_size - dest_pos >= icns_rle_channel_bound(num_values)) \
+    dest_pos += icns_rle_packer_run_tmpl(&p, dest + dest_pos, 0, 1, false); \
+  else \
+    dest_pos += icns_rle_packer_run_tmpl(&p, dest + dest_pos, \
+     dest_size - dest_pos, 1, true); \
+  return p.count ? 0 : dest_pos; \
+} \
+static size_t name##_packed_size(const uint8_t *src, size_t pitch) \
+{ \
+  struct icns_rle_packer p; \
+  icns_rle_packer_init(&p, src, (num_values), pitch); \
+  if(pitch == 4) \
+    return icns_rle_packer_run_tmpl(&p, NULL, 0, 4, false); \
+  return icns_rle_packer_run_tmpl(&p, NULL, 0, pitch, false); \
+} \
+static size_t name##_unpack(uint8_t *dest, const uint8_t *src, \
+ size_t src_size, size_t src_pos) \
+{ \
+  if(src_pos <= src_size && src_size - src_pos >= (num_values) * 2) \
+    return icns_rle_unpack_channel_tmpl(dest, (num_values), 1, \
+     src, src_size, src_pos, false); \
+  return icns_rle_unpack_channel_tmpl(dest, (num_values), 1, \
+   src, src_size, src_pos, true); \
+} \
+const struct icns_rle_kernels name = \
+{ \
+  (num_values), name##_pack, name##_packed_size, name##_unpack \
+}
+
+ICNS_RLE_KERNELS(icns_rle_kernels_16x16, 16 * 16);
+ICNS_RLE_KERNELS(icns_rle_kernels_18x18, 18 * 18);
+ICNS_RLE_KERNELS(icns_rle_kernels_32x32, 32 * 32);
+ICNS_RLE_KERNELS(icns_rle_kernels_48x48, 48 * 48);
+ICNS_RLE_KERNELS(icns_rle_kernels_128x128, 128 * 128);
+
+/**
+ * Initialize a resumable unpacker for a single (A)RGB channel.
+ *
+ * @param u         unpacker state to initialize.
+ * @param dest      first value of the channel to unpack to.
+ * @param count     number of values in the channel.
+ * @param pitch     distance between values in the channel, in bytes.
+ */
+void icns_rle_unpacker_init(struct icns_rle_unpacker *u,
+ uint8_t *dest, size_t count, size_t pitch)
+{
+  u->dest = dest;
+  u->count = count;
+  u->pitch = pitch;
+  u->literal = 0;
+  u->run = 0;
+  u->error = false;
+}
+
+/**
+ * Continue unpacking a channel from the next part of its packed data.
+ * Tokens may be split anywhere between calls. Unpacking stops at the end
+ * of the channel, at the end of `src`, or at the first token that would
+ * overflow the channel, in which case `error` is set.
+ *
+ * @param u         unpacker state.
+ * @param src       next part of the packed data.
+ * @param src_size  size of `src`.
+ * @return          the number of bytes consumed from `src`.
+ */
+size_t icns_rle_unpacker_run(struct icns_rle_unpacker *u,
+ const uint8_t *src, size_t src_size)
+{
+  uint8_t *dest = u->dest;
+  size_t pitch = u->pitch;
+  size_t left = u->count;
+  size_t src_pos = 0;
+  size_t num;
+  size_t i;
+
+  while(left && src_pos < src_size)
+  {
+    if(u->run)
+    {
+      /* Run value */
+      uint8_t copy = src[src_pos++];
+      num = u->run;
+      if(pitch == 1)
+        memset(dest, copy, num);
+      else
+        for(i = 0; i < num; i++)
+          dest[i * pitch] = copy;
+
+      dest += num * pitch;
+      left -= num;
+      u->run = 0;
+    }
+    else if(u->literal)
+    {
+      /* Literal values (possibly continued from the previous call) */
+      num = u->literal;
+      if(num > src_size - src_pos)
+        num = src_size - src_pos;
+
+      if(pitch == 1)
+        memcpy(dest, src + src_pos, num);
+      else
+        for(i = 0; i < num; i++)
+          dest[i * pitch] = src[src_pos + i];
+
+      src_pos += num;
+      dest += num * pitch;
+      left -= num;
+      u->literal -= num;
+    }
+    else
+    {
+      uint8_t pack_byte = src[src_pos];
+      num = (pack_byte >= 0x80) ? pack_byte - 0x80 + 3 : pack_byte + 1;
+      if(num > left)
+      {
+        u->error = true;
+        break;
+      }
+      src_pos++;
+
+      if(pack_byte >= 0x80)
+        u->run = num;
+      else
+        u->literal = num;
+    }
+  }
+
+  u->dest = dest;
+  u->count = left;
+  return src_pos;
+}
+
+struct icns_rle_pack_task
+{
+  struct icns_data *icns;
+  uint8_t * const *dest;
+  size_t dest_size;
+  size_t *sizes;
+  const uint8_t * const *src;
+  size_t count;
+  size_t pitch;
+  const struct icns_rle_kernels *kernels;
+  bool optimal;
+};
+
+static void icns_rle_pack_task_fn(void *priv, unsigned index)
+{
+  struct icns_rle_pack_task *task = (struct icns_rle_pack_task *)priv;
+  uint8_t *dest = task->dest ? task->dest[index] : NULL;
+
+  if(task->optimal)
+  {
+    task->sizes[index] = icns_rle_pack_channel_optimal(task->icns, dest,
+     task->dest_size, 0, task->src[index], task->count, task->pitch);
+  }
+  else
+  if(dest && task->kernels && task->pitch == 1)
+  {
+    task->sizes[index] = task->kernels->pack(dest,
+     task->dest_size, 0, task->src[index]);
+  }
+  else
+  if(dest)
+  {
+    task->sizes[index] = icns_rle_pack_channel(dest,
+     task->dest_size, 0, task->src[index], task->count, task->pitch);
+  }
+  else
+  if(task->kernels)
+  {
+    task->sizes[index] = task->kernels->packed_size(task->src[index],
+     task->pitch);
+  }
+  else
+  {
+    task->sizes[index] = icns_rle_packed_size(task->src[index],
+     task->count, task->pitch);
+  }
+}
+
+/**
+ * Pack multiple channels into separate buffers, or get the packed size of
+ * each channel. If threading is enabled and the channels are large enough,
+ * the channels are packed concurrently. The output is identical to packing
+ * each channel separately with the selected packer.
+ *
+ * @param icns          current state data (for the optimal packer's
+ *                      temporary allocations, which may be concurrent).
+ * @param dest          destination buffer for each channel, or `NULL` to
+ *                      only get the packed size of each channel.
+ * @param dest_size     size of each destination buffer.
+ * @param sizes         set to the packed size of each channel.
+ * @param src           first value of each channel to pack.
+ * @param num_channels  number of channels to pack.
+ * @param count         number of values in each channel.
+ * @param pitch         distance between values in each channel, in bytes.
+ * @param kernels       fixed size kernels for the greedy packer, or `NULL`.
+ *                      Ignored unless `kernels->count` is `count`.
+ * @param num_threads   maximum number of threads to use.
+ * @param optimal       use `icns_rle_pack_channel_optimal` instead of the
+ *                      greedy packer.
+ * @return              `true` on success, or `false` if a channel did not
+ *                      fit in its destination buffer (or allocation failed).
+ */
+bool icns_rle_pack_channels(struct icns_data *icns,
+ uint8_t * const *dest, size_t dest_size, size_t *sizes,
+ const uint8_t * const *src, unsigned num_channels,
+ size_t count, size_t pitch, const struct icns_rle_kernels *kernels,
+ unsigned num_threads, bool optimal)
+{
+  struct icns_rle_pack_task task;
+  unsigned i;
+
+  if(count * num_channels < ICNS_RLE_THREAD_MIN_VALUES)
+    num_threads = 1;
+  if(kernels && kernels->count != count)
+    kernels = NULL;
+
+  task.icns = icns;
+  task.dest = dest;
+  task.dest_size = dest_size;
+  task.sizes = sizes;
+  task.src = src;
+  task.count = count;
+  task.pitch = pitch;
+  task.kernels = kernels;
+  task.optimal = optimal;
+
+  icns_thread_run(icns_rle_pack_task_fn, &task, num_channels, num_threads);
+
+  for(i = 0; i < num_channels; i++)
+    if(!sizes[i] && count)
+      return false;
+
+  return true;
+}
+
+struct icns_rle_unpack_task
+{
+  uint8_t * const *dest;
+  size_t count;
+  const struct icns_rle_kernels *kernels;
+  const uint8_t *src;
+  size_t src_size;
+  size_t src_pos[4];
+  size_t result[4];
+};
+
+static void icns_rle_unpack_task_fn(void *priv, unsigned index)
+{
+  struct icns_rle_unpack_task *task = (struct icns_rle_unpack_task *)priv;
+
+  if(task->kernels)
+  {
+    task->result[index] = task->kernels->unpack(task->dest[index],
+     task->src, task->src_size, task->src_pos[index]);
+  }
+  else
+  {
+    task->result[index] = icns_rle_unpack_channel(task->dest[index],
+     task->count, 1, task->src, task->src_size, task->src_pos[index]);
+  }
+}
+
+/**
+ * Unpack consecutive packed channels into separate planes. If threading is
+ * enabled and the channels are large enough, the channel boundaries are
+ * found with `icns_rle_scan_channel` first, then the channels are unpacked
+ * concurrently.
+ *
+ * @param dest          destination plane for each channel (`count` bytes).
+ * @param num_channels  number of channels to unpack (at most 4).
+ * @param count         number of values in each channel.
+ * @param src           packed data buffer.
+ * @param src_size      size of packed data buffer.
+ * @param src_pos       position in `src` the first packed channel starts at.
+ * @param kernels       fixed size kernels to unpack with, or `NULL`.
+ *                      Ignored unless `kernels->count` is `count`.
+ * @param num_threads   maximum number of threads to use.
+ * @param bad_channel   set to the index of the first invalid channel
+ *                      on failure.
+ * @return              the position in `src` after the last packed channel
+ *                      on success, or 0 if the packed data is invalid.
+ */
+size_t icns_rle_unpack_channels(uint8_t * const *dest, unsigned num_channels,
+ size_t count, const uint8_t *src, size_t src_size, size_t src_pos,
+ const struct icns_rle_kernels *kernels, unsigned num_threads,
+ unsigned *bad_channel)
+{
+  struct icns_rle_unpack_task task;
+  unsigned i;
+
+  if(kernels && kernels->count != count)
+    kernels = NULL;
+
+  if(num_threads <= 1 || num_channels <= 1 || num_channels > 4 ||
+   count * num_channels < ICNS_RLE_THREAD_MIN_VALUES)
+  {
+    for(i = 0; i < num_channels; i++)
+    {
+      if(kernels)
+        src_pos = kernels->unpack(dest[i], src, src_size, src_pos);
+      else
+        src_pos = icns_rle_unpack_channel(dest[i], count, 1,
+         src, src_size, src_pos);
+      if(!src_pos)
+      {
+        *bad_channel = i;
+        return 0;
+      }
+    }
+    return src_pos;
+  }
+
+  task.dest = dest;
+  task.count = count;
+  task.kernels = kernels;
+  task.src = src;
+  task.src_size = src_size;
+
+  for(i = 0; i < num_channels; i++)
+  {
+    task.src_pos[i] = src_pos;
+    src_pos = icns_rle_scan_channel(src, src_size, src_pos, count);
+    if(!src_pos)
+    {
+      *bad_channel = i;
+      return 0;
+    }
+  }
+
+  icns_thread_run(icns_rle_unpack_task_fn, &task, num_channels, num_threads);
+
+  /* Should never fail after a successful scan. */
+  for(i = 0; i < num_channels; i++)
+  {
+    if(!task.result[i])
+    {
+      *bad_channel = i;
+      return 0;
+    }
+  }
+  return src_pos;
+}
@@ -0,0 +1,130 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_RLE_H
+#define ICNSCVT_RLE_H
+
+#include "common.h"
+
+/* Packed (A)RGB channel codec used by is32/il32/ih32/it32 and the
+ * ARGB formats. Each channel is a stream of control bytes: 0x00-0x7f
+ * is followed by (n + 1) literal bytes, and 0x80-0xff is followed by
+ * one byte to be repeated (n - 0x80 + 3) times. */
+
+ICNS_BEGIN_DECLS
+
+#define ICNS_RLE_MAX_LITERAL  128
+#define ICNS_RLE_MIN_RUN      3
+#define ICNS_RLE_MAX_RUN      130
+
+/* Minimum total number of values in a multi-channel call before the
+ * channels are split between threads. Below this, thread startup costs
+ * more than it saves. */
+#define ICNS_RLE_THREAD_MIN_VALUES  (128 * 128 * 3)
+
+typedef size_t (*icns_rle_find_run_fn)(const uint8_t *src,
+ size_t count, size_t pitch, size_t max);
+typedef size_t (*icns_rle_run_length_fn)(const uint8_t *src,
+ size_t count, size_t pitch);
+
+/* State for packing a channel in multiple steps. */
+struct icns_rle_packer
+{
+  const uint8_t *src;   /* next value to pack */
+  size_t count;         /* values remaining; 0 when finished */
+  size_t pitch;
+  size_t literal;       /* pending literal that did not fit */
+  size_t run;           /* pending run (in values) */
+  icns_rle_find_run_fn find_run;
+  icns_rle_run_length_fn run_length;
+};
+
+/* State for unpacking a channel from packed data split across buffers. */
+struct icns_rle_unpacker
+{
+  uint8_t *dest;        /* next value to unpack to */
+  size_t count;         /* values remaining; 0 when finished */
+  size_t pitch;
+  size_t literal;       /* literal values still to be read */
+  size_t run;           /* run (in values) waiting for its value byte */
+  bool error;           /* a token overflowed the channel */
+};
+
+/* Greedy packer and unpacker for planar channels of one fixed size.
+ * Fixed size (A)RGB formats select theirs with `icns_format::rle`. */
+struct icns_rle_kernels
+{
+  size_t count;         /* number of values in a channel */
+
+  /* Same as `icns_rle_pack_channel` with a pitch of 1. */
+  size_t (*pack)(uint8_t *dest, size_t dest_size, size_t dest_pos,
+   const uint8_t *src);
+  /* Same as `icns_rle_packed_size`. */
+  size_t (*packed_size)(const uint8_t *src, size_t pitch);
+  /* Same as `icns_rle_unpack_channel` with a pitch of 1. */
+  size_t (*unpack)(uint8_t *dest, const uint8_t *src, size_t src_size,
+   size_t src_pos);
+};
+
+extern const struct icns_rle_kernels icns_rle_kernels_16x16;
+extern const struct icns_rle_kernels icns_rle_kernels_18x18;
+extern const struct icns_rle_kernels icns_rle_kernels_32x32;
+extern const struct icns_rle_kernels icns_rle_kernels_48x48;
+extern const struct icns_rle_kernels icns_rle_kernels_128x128;
+
+/* Worst case packed size of a single channel. */
+static inline size_t icns_rle_channel_bound(size_t count)
+{
+  return count + (count + ICNS_RLE_MAX_LITERAL - 1) / ICNS_RLE_MAX_LITERAL;
+}
+
+void icns_rle_packer_init(struct icns_rle_packer *p,
+ const uint8_t *src, size_t count, size_t pitch) NOT_NULL;
+size_t icns_rle_packer_run(struct icns_rle_packer *p,
+ uint8_t *dest, size_t dest_size) NOT_NULL_1(1);
+size_t icns_rle_packed_size(const uint8_t *src, size_t count, size_t pitch)
+ NOT_NULL;
+size_t icns_rle_pack_channel(uint8_t *dest, size_t dest_size,
+ size_t dest_pos, const uint8_t *src, size_t src_count, size_t src_pitch)
+ NOT_NULL;
+size_t icns_rle_scan_channel(const uint8_t *src, size_t src_size,
+ size_t src_pos, size_t count) NOT_NULL;
+size_t icns_rle_unpack_channel(uint8_t *dest, size_t dest_count,
+ size_t dest_pitch, const uint8_t *src, size_t src_size, size_t src_pos)
+ NOT_NULL;
+void icns_rle_unpacker_init(struct icns_rle_unpacker *u,
+ uint8_t *dest, size_t count, size_t pitch) NOT_NULL;
+size_t icns_rle_unpacker_run(struct icns_rle_unpacker *u,
+ const uint8_t *src, size_t src_size) NOT_NULL;
+size_t icns_rle_pack_channel_optimal(struct icns_data *icns,
+ uint8_t *dest, size_t dest_size, size_t dest_pos,
+ const uint8_t *src, size_t src_count, size_t src_pitch) NOT_NULL_2(1,5);
+bool icns_rle_pack_channels(struct icns_data *icns,
+ uint8_t * const *dest, size_t dest_size, size_t *sizes,
+ const uint8_t * const *src, unsigned num_channels,
+ size_t count, size_t pitch, const struct icns_rle_kernels *kernels,
+ unsigned num_threads, bool optimal) NOT_NULL_3(1,4,5);
+size_t icns_rle_unpack_channels(uint8_t * const *dest, unsigned num_channels,
+ size_t count, const uint8_t *src, size_t src_size, size_t src_pos,
+ const struct icns_rle_kernels *kernels, unsigned num_threads,
+ unsigned *bad_channel) NOT_NULL_3(1,4,9);
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_RLE_H */
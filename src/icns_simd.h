@@ -0,0 +1,64 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_SIMD_H
+#define ICNSCVT_SIMD_H
+
+#include "common.h"
+
+/* Compiler and CPU feature detection for the vectorized kernels.
+ * SSE2 is used whenever the compiler targets it (always on x86-64);
+ * AVX2 kernels are compiled with a target attribute and selected at
+ * runtime. Every kernel must also have a scalar fallback. Define
+ * ICNSCVT_NO_SIMD to build only the scalar kernels. */
+
+#if !defined(ICNSCVT_NO_SIMD) && defined(__GNUC__) && \
+ (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ICNS_SIMD_SSE2 1
+#define ICNS_SIMD_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef ICNS_SIMD_AVX2
+#define ICNS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+ICNS_BEGIN_DECLS
+
+/* Get the index of the lowest set bit of a non-zero value. */
+static inline unsigned icns_ctz(unsigned value)
+{
+  return __builtin_ctz(value);
+}
+
+#ifdef ICNS_SIMD_AVX2
+static inline bool icns_cpu_has_avx2(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+#else
+static inline bool icns_cpu_has_avx2(void)
+{
+  return false;
+}
+#endif
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_SIMD_H */
@@ -0,0 +1,113 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "icns_thread.h"
+
+#ifndef ICNSCVT_NO_THREADS
+#include <pthread.h>
+#endif
+
+struct icns_thread_worker
+{
+  icns_thread_fn fn;
+  void *priv;
+  unsigned first;
+  unsigned step;
+  unsigned num_tasks;
+};
+
+static void *icns_thread_worker_main(void *arg)
+{
+  const struct icns_thread_worker *w = (const struct icns_thread_worker *)arg;
+  unsigned i;
+
+  for(i = w->first; i < w->num_tasks; i += w->step)
+    w->fn(w->priv, i);
+
+  return NULL;
+}
+
+/**
+ * Run `num_tasks` calls of `fn` split between up to `num_threads` threads,
+ * including the calling thread, and wait for all of them to complete.
+ * Tasks are numbered 0 through `num_tasks - 1` and each is run exactly once.
+ * If a thread can not be started, its tasks are run on the calling thread.
+ *
+ * @param fn          task function.
+ * @param priv        private data to pass to each task.
+ * @param num_tasks   number of tasks to run.
+ * @param num_threads maximum number of threads to use. Values of 0 and 1
+ *                    run all tasks serially on the calling thread.
+ */
+void icns_thread_run(icns_thread_fn fn, void *priv,
+ unsigned num_tasks, unsigned num_threads)
+{
+  struct icns_thread_worker workers[ICNS_MAX_THREADS];
+  unsigned num_workers;
+  unsigned i;
+#ifndef ICNSCVT_NO_THREADS
+  pthread_t threads[ICNS_MAX_THREADS];
+  bool started[ICNS_MAX_THREADS];
+#endif
+
+  if(num_threads > ICNS_MAX_THREADS)
+    num_threads = ICNS_MAX_THREADS;
+#ifdef ICNSCVT_NO_THREADS
+  num_threads = 1;
+#endif
+
+  num_workers = num_threads < num_tasks ? num_threads : num_tasks;
+  if(num_workers <= 1)
+  {
+    for(i = 0; i < num_tasks; i++)
+      fn(priv, i);
+    return;
+  }
+
+  for(i = 0; i < num_workers; i++)
+  {
+    workers[i].fn = fn;
+    workers[i].priv = priv;
+    workers[i].first = i;
+    workers[i].step = num_workers;
+    workers[i].num_tasks = num_tasks;
+  }
+
+#ifndef ICNSCVT_NO_THREADS
+  for(i = 1; i < num_workers; i++)
+  {
+    started[i] = !pthread_create(&threads[i], NULL,
+     icns_thread_worker_main, &workers[i]);
+  }
+#endif
+
+  icns_thread_worker_main(&workers[0]);
+
+  for(i = 1; i < num_workers; i++)
+  {
+#ifndef ICNSCVT_NO_THREADS
+    if(started[i])
+    {
+      pthread_join(threads[i], NULL);
+      continue;
+    }
+#endif
+    icns_thread_worker_main(&workers[i]);
+  }
+}
@@ -0,0 +1,40 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef ICNSCVT_THREAD_H
+#define ICNSCVT_THREAD_H
+
+#include "common.h"
+
+/* Minimal fork-join helper for splitting independent work between
+ * threads. Define ICNSCVT_NO_THREADS to always run tasks serially on
+ * the calling thread. */
+
+ICNS_BEGIN_DECLS
+
+#define ICNS_MAX_THREADS 64
+
+typedef void (*icns_thread_fn)(void *priv, unsigned index);
+
+void icns_thread_run(icns_thread_fn fn, void *priv,
+ unsigned num_tasks, unsigned num_threads) NOT_NULL_1(1);
+
+ICNS_END_DECLS
+
+#endif /* ICNSCVT_THREAD_H */
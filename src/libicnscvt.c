@@ -24,6 +24,8 @@
 
 #include "common.h"
 #include "icns.h"
+#include "icns_arena.h"
+#include "icns_pool.h"
 #include "icns_format.h"
 //#include "icns_target_external.h"
 //#include "icns_target_icns.h"
@@ -103,21 +105,116 @@ int icnscvt_destroy_context(icnscvt context)
 }
 
 
+int icnscvt_reset_context(icnscvt context)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  icns_reset_state_data(icns);
+  return 0;
+}
+
+
+icnscvt_pool icnscvt_create_pool(unsigned compiled_version, unsigned max_idle)
+{
+  return (icnscvt_pool)icns_pool_create(compiled_version, max_idle);
+}
+
+int icnscvt_destroy_pool(icnscvt_pool pool)
+{
+  if(!icns_pool_is_valid((struct icns_pool *)pool))
+    return -(int)ICNS_NULL_POINTER;
+
+  icns_pool_delete((struct icns_pool *)pool);
+  return 0;
+}
+
+icnscvt icnscvt_pool_acquire(icnscvt_pool pool)
+{
+  if(!icns_pool_is_valid((struct icns_pool *)pool))
+    return NULL;
+
+  return (icnscvt)icns_pool_acquire((struct icns_pool *)pool);
+}
+
+int icnscvt_pool_release(icnscvt_pool pool, icnscvt context)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  if(!icns_pool_is_valid((struct icns_pool *)pool))
+    return -(int)ICNS_NULL_POINTER;
+
+  icns_pool_release((struct icns_pool *)pool, icns);
+  return 0;
+}
+
+
 void *icnscvt_allocate(icnscvt context, size_t size)
 {
   base_check_ptr();
 
   /* Always allocate, even if the size is 0. */
-  return malloc(size ? size : 1);
+  return icns_raw_malloc((struct icns_data *)context, size ? size : 1);
 }
 
 int icnscvt_free(icnscvt context, void *buf)
 {
   base_check();
-  free(buf);
+  icns_raw_free((struct icns_data *)context, buf);
   return 0;
 }
 
+int icnscvt_set_allocator(icnscvt context, icnscvt_alloc_func alloc_fn,
+ icnscvt_realloc_func realloc_fn, icnscvt_free_func free_fn, void *priv)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  if(!alloc_fn != !realloc_fn || !alloc_fn != !free_fn)
+  {
+    E_("allocator functions must all be provided or all be NULL");
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+  if(icns->images.head)
+  {
+    E_("can't change allocator while images are loaded");
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+  if(icns->arena)
+  {
+    E_("can't change allocator while arena mode is enabled");
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  /* A suspended arena came from the default allocator. */
+  if(alloc_fn)
+    icns_arena_disable(icns);
+
+  icns_set_allocator(icns, alloc_fn, realloc_fn, free_fn, priv);
+  return icns_flush_error(icns, ICNS_OK);
+}
+
+int icnscvt_set_arena_mode(icnscvt context, int enable)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  enum icns_error ret = ICNS_OK;
+  base_check();
+
+  if(icns->images.head)
+  {
+    E_("can't change arena mode while images are loaded");
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  if(enable)
+    ret = icns_arena_enable(icns);
+  else
+    icns_arena_disable(icns);
+
+  return icns_flush_error(icns, ret);
+}
+
 
 int icnscvt_set_error_level(icnscvt context, int level)
 {
@@ -146,6 +243,93 @@ int icnscvt_set_error_function(icnscvt context, void *priv, icnscvt_error_func f
   return icns_flush_error(icns, ICNS_OK);
 }
 
+int icnscvt_set_thread_count(icnscvt context, int count)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  if(count < 0)
+  {
+    E_("thread count %d out-of-range", count);
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  icns_set_thread_count(icns, count);
+  return icns_flush_error(icns, ICNS_OK);
+}
+
+int icnscvt_set_png_profile(icnscvt context, icns_format_id format,
+ int profile)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  const struct icns_format *f;
+  base_check();
+
+  if(profile < ICNSCVT_PNG_DEFAULT || profile > ICNSCVT_PNG_EXHAUSTIVE)
+  {
+    E_("PNG profile %d out-of-range", profile);
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  if(format)
+  {
+    f = icns_get_format_by_magic(format);
+    if(!f || !icns_format_supports_png(f))
+    {
+      E_("format ID %lx does not represent a PNG-capable format", format);
+      return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+    }
+  }
+
+  if(!icns_set_png_profile(icns, format, (enum icns_png_profile)profile))
+  {
+    E_("too many per-format PNG profiles");
+    return icns_flush_error(icns, ICNS_INTERNAL_ERROR);
+  }
+  return icns_flush_error(icns, ICNS_OK);
+}
+
+int icnscvt_set_png_backend(icnscvt context, int backend)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  if(backend != ICNSCVT_PNG_BACKEND_LIBPNG &&
+   backend != ICNSCVT_PNG_BACKEND_BUILTIN)
+  {
+    E_("PNG backend %d out-of-range", backend);
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  icns_set_png_backend(icns, (enum icns_png_backend)backend);
+  return icns_flush_error(icns, ICNS_OK);
+}
+
+int icnscvt_set_png_validation(icnscvt context, int validation)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  if(validation < ICNSCVT_PNG_VALIDATE_DECODE ||
+   validation > ICNSCVT_PNG_VALIDATE_TRUSTED)
+  {
+    E_("PNG validation level %d out-of-range", validation);
+    return icns_flush_error(icns, ICNS_INVALID_PARAMETER);
+  }
+
+  icns_set_png_validation(icns, (enum icns_png_validation)validation);
+  return icns_flush_error(icns, ICNS_OK);
+}
+
+int icnscvt_set_optimal_rle(icnscvt context, int enable)
+{
+  struct icns_data *icns = (struct icns_data *)context;
+  base_check();
+
+  icns_set_optimal_rle(icns, enable != 0);
+  return icns_flush_error(icns, ICNS_OK);
+}
+
 
 unsigned icnscvt_get_formats_list(icnscvt context, icns_format_id *dest,
   unsigned dest_count)
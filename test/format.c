@@ -31,6 +31,7 @@
 #include "../src/icns_image.h"
 #include "../src/icns_io.h"
 #include "../src/icns_png.h"
+#include "../src/icns_rle.h"
 
 #include "format_read_from_icns.h"
 #include "format_prepare_for_icns.h"
@@ -117,6 +118,17 @@ void test_format_functions(const struct icns_format *format)
   ASSERT(format->read_from_external, "%s", format->name);
   ASSERT(format->write_to_external, "%s", format->name);
 
+  if(format->type == ICNS_24_BIT || format->type == ICNS_24_BIT_OR_PNG ||
+   format->type == ICNS_ARGB_OR_PNG)
+  {
+    size_t count = format->width * format->height;
+    ASSERT(format->rle, "%s", format->name);
+    ASSERTEQ(format->rle->count, count, "%s: %zu != %zu",
+     format->name, format->rle->count, count);
+  }
+  else
+    ASSERT(!format->rle, "%s", format->name);
+
   test_format_read_from_icns(&icns, test_formats, num_formats, which, i);
   test_format_write_to_icns(&icns, which);
   test_format_prepare_for_icns(&icns, which);
@@ -50,6 +50,7 @@ static inline void clear_image_no_free(struct icns_image *image)
   image->png_size = 0;
   image->jp2_size = 0;
   image->data_size = 0;
+  image->pack_on_write = false;
 }
 
 /* Macro to preserve invocation file/line. */
@@ -141,7 +141,7 @@ static void test_format_prepare_for_external(struct icns_data * RESTRICT icns,
     ASSERT(image->dirty_external, "%s", format->name);
     clear_image_no_free(image);
 
-    image->pixels = icns_allocate_pixel_array_for_image(image);
+    image->pixels = icns_allocate_pixel_array_for_image(icns, image);
     ASSERT(image->pixels, "%s: failed to allocate pixel array", format->name);
     memcpy(image->pixels, compare->pixels, sz * sizeof(struct rgba_color));
 
@@ -196,7 +196,7 @@ static void test_format_prepare_for_external(struct icns_data * RESTRICT icns,
     }
 
     /* Pixels missing, mask set -> ICNS_INTERNAL_ERROR */
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
     ret = format->prepare_for_external(icns, image);
     check_error(icns, ret, ICNS_INTERNAL_ERROR);
   }
@@ -24,6 +24,70 @@
 #include "../src/icns_io.h"
 #include "../src/icns_png.h"
 
+/**
+ * Packed (A)RGB is generated at write time for formats that support it.
+ * Write the prepared image and make sure it matches the expected data.
+ */
+static void check_pack_on_write(struct icns_data * RESTRICT icns,
+  struct icns_image *image, const struct loaded_file *expected)
+{
+  const struct icns_format *format = image->format;
+  enum icns_error ret;
+  uint8_t *buffer;
+  size_t sz;
+
+  ASSERT(image->pack_on_write, "%s", format->name);
+  ASSERT(!image->data, "%s", format->name);
+
+  buffer = (uint8_t *)malloc(OUTPUT_BUFFER_SIZE);
+  ASSERT(buffer, "failed to allocate output buffer");
+
+  ret = icns_io_init_write_memory(icns, buffer, OUTPUT_BUFFER_SIZE);
+  check_ok(icns, ret);
+  ret = format->write_to_icns(icns, image);
+  check_ok(icns, ret);
+  ASSERTEQ(icns->io.pos, expected->data_size,
+    "%s: %zu != %zu", format->name, icns->io.pos, expected->data_size);
+  ASSERTMEM(buffer, expected->data, expected->data_size, "%s", format->name);
+  icns_io_end(icns);
+
+  /* Threaded packing must produce identical output. */
+  icns->num_threads = 4;
+  ret = icns_io_init_write_memory(icns, buffer, OUTPUT_BUFFER_SIZE);
+  check_ok(icns, ret);
+  ret = format->write_to_icns(icns, image);
+  check_ok(icns, ret);
+  ASSERTEQ(icns->io.pos, expected->data_size,
+    "%s: %zu != %zu", format->name, icns->io.pos, expected->data_size);
+  ASSERTMEM(buffer, expected->data, expected->data_size, "%s", format->name);
+  icns_io_end(icns);
+  icns->num_threads = 0;
+
+  /* Too small output -> ICNS_WRITE_ERROR */
+  ret = icns_io_init_write_memory(icns, buffer, expected->data_size - 1);
+  check_ok(icns, ret);
+  ret = format->write_to_icns(icns, image);
+  check_error(icns, ret, ICNS_WRITE_ERROR);
+  icns_io_end(icns);
+
+  /* Optimal packing must never be larger, and the prepared size must
+   * match the written size. */
+  icns->optimal_rle = true;
+  ret = format->prepare_for_icns(icns, image, &sz);
+  check_ok(icns, ret);
+  ASSERT(sz <= expected->data_size,
+    "%s: %zu > %zu", format->name, sz, expected->data_size);
+  ret = icns_io_init_write_memory(icns, buffer, OUTPUT_BUFFER_SIZE);
+  check_ok(icns, ret);
+  ret = format->write_to_icns(icns, image);
+  check_ok(icns, ret);
+  ASSERTEQ(icns->io.pos, sz, "%s: %zu != %zu", format->name, icns->io.pos, sz);
+  icns_io_end(icns);
+  icns->optimal_rle = false;
+  image->data_size = expected->data_size;
+  free(buffer);
+}
+
 /**
  * Generic test for all ICNS encoding handlers.
  *
@@ -91,7 +155,7 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
     ret = icns_decode_png_to_pixel_array(icns, image, image->png, image->png_size);
     check_ok(icns, ret);
     check_pixels(image, compare);
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
 
     /* PNG only -> return PNG size */
     image->png = loaded->data;
@@ -198,13 +262,13 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
     ASSERT(image->dirty_icns, "%s", format->name);
     clear_image_no_free(image);
 
-    /* pixels set only -> convert to raw, return raw size */
+    /* pixels set only -> return exact raw size, pack on write */
     image->pixels = compare->pixels;
     image->dirty_external = true;
     image->dirty_icns = true;
     ret = format->prepare_for_icns(icns, image, &sz);
     check_ok(icns, ret);
-    ASSERT(image->data, "%s", format->name);
+    ASSERT(!image->data, "%s", format->name);
     ASSERT(!image->png, "%s", format->name);
     ASSERT(!image->jp2, "%s", format->name);
     ASSERT(!image->dirty_icns, "%s", format->name);
@@ -214,17 +278,17 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
       "%s: %zu != %zu", format->name, sz, image->data_size);
     ASSERTEQ(sz, loaded_raw->data_size,
       "%s: %zu != %zu", format->name, sz, loaded_raw->data_size);
-    ASSERTMEM(image->data, loaded_raw->data, sz, "%s", format->name);
+    check_pack_on_write(icns, image, loaded_raw);
 
-    /* pixels and raw -> convert to raw (replace), return raw size */
-    free(image->data);
+    /* pixels and raw -> discard raw, return raw size, pack on write */
     image->data = (uint8_t *)malloc(1234);
     ASSERT(image->data, "failed to allocate throwaway buffer");
+    image->pack_on_write = false;
     image->dirty_external = true;
     image->dirty_icns = true;
     ret = format->prepare_for_icns(icns, image, &sz);
     check_ok(icns, ret);
-    ASSERT(image->data, "%s", format->name);
+    ASSERT(!image->data, "%s", format->name);
     ASSERT(!image->png, "%s", format->name);
     ASSERT(!image->jp2, "%s", format->name);
     ASSERT(!image->dirty_icns, "%s", format->name);
@@ -234,9 +298,7 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
       "%s: %zu != %zu", format->name, sz, image->data_size);
     ASSERTEQ(sz, loaded_raw->data_size,
       "%s: %zu != %zu", format->name, sz, loaded_raw->data_size);
-    ASSERTMEM(image->data, loaded_raw->data, sz, "%s", format->name);
-    free(image->data);
-    image->data = NULL;
+    check_pack_on_write(icns, image, loaded_raw);
 
     format_mask = icns_get_mask_for_format(format);
     if(format_mask)
@@ -251,13 +313,13 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
       check_image_dirty(mask); /* Clear flags */
 
       /* When the corresponding mask exists, preparing this image should replace
-       * the raw data for the corresponding mask image with an array of the
+       * the raw data for the corresponding mask image with a view of the
        * input alpha values from this image. */
       image->dirty_external = true;
       image->dirty_icns = true;
       ret = format->prepare_for_icns(icns, image, &sz);
       check_ok(icns, ret);
-      ASSERT(image->data, "%s", format->name);
+      ASSERT(!image->data, "%s", format->name);
       ASSERT(!image->png, "%s", format->name);
       ASSERT(!image->jp2, "%s", format->name);
       ASSERT(!image->dirty_icns, "%s", format->name);
@@ -270,15 +332,21 @@ static void test_format_prepare_for_icns(struct icns_data * RESTRICT icns,
         "%s: %zu != %zu", format->name, sz, image->data_size);
       ASSERTEQ(sz, loaded_raw->data_size,
         "%s: %zu != %zu", format->name, sz, loaded_raw->data_size);
-      ASSERTMEM(image->data, loaded_raw->data, sz, "%s", format->name);
+      check_pack_on_write(icns, image, loaded_raw);
 
-      ASSERT(mask->data, "%s", format->name);
       sz = image->real_width * image->real_height;
+      ASSERT(!mask->data, "%s", format->name);
+      ASSERTEQ(mask->alpha_source, image, "%s", format->name);
+      ASSERTEQ(image->alpha_view, mask, "%s", format->name);
+      ASSERTEQ(mask->data_size, sz, "%s", format->name);
+
+      /* Detaching the view should copy the alpha values into the mask. */
+      icns_detach_alpha_view(icns, image);
+      ASSERTEQ(mask->alpha_source, NULL, "%s", format->name);
+      ASSERTEQ(image->alpha_view, NULL, "%s", format->name);
+      ASSERT(mask->data, "%s", format->name);
       for(j = 0; j < sz; j++)
         ASSERTEQ(mask->data[j], image->pixels[j].a, "%s @ %zu", format->name, j);
-
-      free(image->data);
-      image->data = NULL;
     }
     clear_image_no_free(image);
     icns->force_raw_if_available = false;
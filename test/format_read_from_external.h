@@ -114,7 +114,7 @@ static void test_format_read_from_external(struct icns_data * RESTRICT icns,
   }
   icns_io_end(icns);
   check_image_dirty(image);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 
   /* PNG, force recoding: always pixels (unless a mask) */
   icns->force_recoding = true;
@@ -139,7 +139,7 @@ static void test_format_read_from_external(struct icns_data * RESTRICT icns,
   }
   icns_io_end(icns);
   check_image_dirty(image);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 
   if(icns_format_is_mask(format))
   {
@@ -186,7 +186,7 @@ static void test_format_read_from_external(struct icns_data * RESTRICT icns,
     check_error(icns, ret, ICNS_DATA_ERROR);
 
   icns_io_end(icns);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 
   /* JP2, force recoding: ICNS_UNIMPLEMENTED_FORMAT if supported,
    * otherwise ICNS_DATA_ERROR */
@@ -225,7 +225,7 @@ static void test_format_read_from_external(struct icns_data * RESTRICT icns,
         /* Should load; don't bother to compare */
         check_ok(icns, ret);
         check_image_dirty(image);
-        icns_clear_image(image);
+        icns_clear_image(icns, image);
       }
       else
         check_error(icns, ret, ICNS_INVALID_DIMENSIONS);
@@ -72,7 +72,28 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
     }
     check_image_dirty(image);
 
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
+
+    if(format->type == ICNS_24_BIT)
+    {
+      /* force_recoding -> decode to pixels and discard raw */
+      icns->force_recoding = true;
+      ret = icns_io_init_read_memory(icns, loaded->data, loaded->data_size);
+      check_ok(icns, ret);
+      ret = format->read_from_icns(icns, image, loaded->data_size);
+      check_ok(icns, ret);
+      icns_io_end(icns);
+      icns->force_recoding = false;
+
+      ASSERT(IMAGE_IS_PIXELS(image), "%s", format->name);
+      ASSERT(!IMAGE_IS_RAW(image), "%s", format->name);
+      ASSERT(!IMAGE_IS_PNG(image), "%s", format->name);
+      ASSERT(!IMAGE_IS_JPEG_2000(image), "%s", format->name);
+      check_pixels(image, compare);
+      check_image_dirty(image);
+
+      icns_clear_image(icns, image);
+    }
 
     if(icns_format_is_mask(format))
     {
@@ -122,7 +143,7 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
     ASSERTEQ(image->png_size, loaded->data_size, "%s", format->name);
     ASSERTMEM(image->png, loaded->data, loaded->data_size, "%s", format->name);
     check_image_dirty(image);
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
 
     /* force_recoding -> decode to pixels and discard raw */
     icns->io.pos = 0;
@@ -137,7 +158,7 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
     check_pixels(image, compare);
     check_image_dirty(image);
 
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
   }
   else
   {
@@ -170,7 +191,7 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
     ASSERTEQ(image->jp2_size, loaded->data_size, "%s", format->name);
     ASSERTMEM(image->jp2, loaded->data, loaded->data_size, "%s", format->name);
     check_image_dirty(image);
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
 
     /* force_recoding -> not supported */
     icns->io.pos = 0;
@@ -178,7 +199,7 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
     ret = format->read_from_icns(icns, image, loaded->data_size);
     check_error(icns, ret, ICNS_UNIMPLEMENTED_FORMAT);
     icns_io_end(icns);
-    icns_clear_image(image);
+    icns_clear_image(icns, image);
   }
   else
   {
@@ -220,7 +241,7 @@ static void test_format_read_from_icns(struct icns_data * RESTRICT icns,
           /* Should load; don't bother to compare */
           check_ok(icns, ret);
           check_image_dirty(image);
-          icns_clear_image(image);
+          icns_clear_image(icns, image);
         }
         else
           check_error(icns, ret, ICNS_INVALID_DIMENSIONS);
@@ -86,7 +86,7 @@ static void test_format_write_to_external(struct icns_data * RESTRICT icns,
   check_ok(icns, ret);
   check_pixels(image, compare);
   icns_io_end(icns);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
   check_image_dirty(image); /* Clear flags */
 
   /* If PNG, passthrough PNG. */
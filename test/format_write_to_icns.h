@@ -56,14 +56,14 @@ static void test_format_write_to_icns(struct icns_data * RESTRICT icns,
   icns_io_end(icns);
 
   /* No prepared image data -> always fail */
-  image->pixels = icns_allocate_pixel_array_for_image(image);
+  image->pixels = icns_allocate_pixel_array_for_image(icns, image);
   ASSERT(image->pixels, "%s: failed to allocated pixel array", format->name);
 
   ret = icns_io_init_write_memory(icns, buffer, OUTPUT_BUFFER_SIZE);
   check_ok(icns, ret);
   ret = format->write_to_icns(icns, image);
   check_error(icns, ret, ICNS_INTERNAL_ERROR);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
   icns_io_end(icns);
   check_image_dirty(image); /* Clear flags */
 
@@ -98,6 +98,7 @@ typedef             void (*test_func)(void);
 static inline void clear_error(struct icns_data *icns)
 {
   icns->num_errors = 0;
+  icns->error_text_pos = 0;
   icns->is_error = false;
   icns->is_warning = false;
 }
@@ -120,8 +121,12 @@ static inline void clear_error(struct icns_data *icns)
     if((icns)->num_errors) \
     { \
       size_t _i; \
-      for(_i = 0; _i < (icns)->num_errors; _i++) \
-        OUT("\n    %s", (icns)->error_stack[_i]); \
+      for(_i = 0; _i < (icns)->num_errors && _i < ICNS_MAX_ERRORS; _i++) \
+      { \
+        const struct icns_error_record *_rec = &(icns)->errors[_i]; \
+        OUT("\n    %s:%s:%u: %s", _rec->file, _rec->func, _rec->line, \
+          _rec->text >= 0 ? (icns)->error_text + _rec->text : _rec->fmt); \
+      } \
     } \
     ASSERTEQ(ret, ICNS_OK, "%d != %d", ret, ICNS_OK); \
     ASSERT((icns)->num_errors == 0, "error messages are set"); \
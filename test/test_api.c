@@ -19,6 +19,10 @@
 
  #include <limits.h>
 
+#ifndef ICNSCVT_NO_THREADS
+#include <pthread.h>
+#endif
+
 #include "test.h"
 
 UNITTEST(icnscvt_get_linked_version)
@@ -75,6 +79,299 @@ UNITTEST(icnscvt_destroy_context)
   ASSERTEQ(ret, 0, "");
 }
 
+UNITTEST(icnscvt_reset_context)
+{
+  icnscvt context = NULL;
+  struct icns_data *icns;
+  struct icns_data compare;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_reset_context(context);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_reset_context((icnscvt)&compare);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+  icns = (struct icns_data *)context;
+
+  ret = icnscvt_set_thread_count(context, 4);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  icns->state = ICNS_STATE_PREPARED_FOR_ICNS;
+  icns->num_errors = 1;
+
+  /* State is reset; settings are kept. */
+  ret = icnscvt_reset_context(context);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->num_errors, 0, "%u", icns->num_errors);
+  ASSERTEQ(icns->state, ICNS_STATE_INIT, "%d", icns->state);
+  ASSERTEQ(icns->num_threads, 4, "%u", icns->num_threads);
+  ASSERT(icns->arena, "");
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_create_pool)
+{
+  icnscvt_pool pool;
+  struct icns_data compare;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null pool. */
+  ret = icnscvt_destroy_pool(NULL);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk pool. */
+  ret = icnscvt_destroy_pool((icnscvt_pool)&compare);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  pool = icnscvt_create_pool(ICNSCVT_COMPILED_VERSION, 0);
+  ASSERT(pool, "");
+  ret = icnscvt_destroy_pool(pool);
+  ASSERTEQ(ret, 0, "%d", ret);
+
+  pool = icnscvt_create_pool(ICNSCVT_COMPILED_VERSION, 16);
+  ASSERT(pool, "");
+  ret = icnscvt_destroy_pool(pool);
+  ASSERTEQ(ret, 0, "%d", ret);
+}
+
+UNITTEST(icnscvt_pool_acquire)
+{
+  icnscvt_pool pool;
+  icnscvt a;
+  icnscvt b;
+  struct icns_data compare;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null pool. */
+  a = icnscvt_pool_acquire(NULL);
+  ASSERTEQ(a, NULL, "");
+  /* Error on junk pool. */
+  a = icnscvt_pool_acquire((icnscvt_pool)&compare);
+  ASSERTEQ(a, NULL, "");
+
+  pool = icnscvt_create_pool(ICNSCVT_COMPILED_VERSION, 1);
+  ASSERT(pool, "");
+
+  /* New contexts are created if the pool is empty. */
+  a = icnscvt_pool_acquire(pool);
+  ASSERT(a, "");
+  b = icnscvt_pool_acquire(pool);
+  ASSERT(b, "");
+  ASSERT(a != b, "");
+  ASSERTEQ(((struct icns_data *)a)->compat_version, ICNSCVT_COMPILED_VERSION,
+   "%d", ((struct icns_data *)a)->compat_version);
+
+  /* Acquired contexts are independent of the pool. */
+  icnscvt_destroy_context(b);
+  icnscvt_destroy_pool(pool);
+  icnscvt_destroy_context(a);
+}
+
+static void suppress_errors(const char *message, void *priv)
+{
+  (void)message;
+  (void)priv;
+}
+
+struct count_alloc
+{
+  int allocs;
+  int frees;
+};
+
+static void *count_alloc_fn(void *priv, size_t sz)
+{
+  struct count_alloc *c = (struct count_alloc *)priv;
+  c->allocs++;
+  return malloc(sz);
+}
+
+static void *count_realloc_fn(void *priv, void *ptr, size_t sz)
+{
+  (void)priv;
+  return realloc(ptr, sz);
+}
+
+static void count_free_fn(void *priv, void *ptr)
+{
+  struct count_alloc *c = (struct count_alloc *)priv;
+  c->frees++;
+  free(ptr);
+}
+
+UNITTEST(icnscvt_pool_release)
+{
+  icnscvt_pool pool;
+  icnscvt context;
+  icnscvt a;
+  icnscvt b;
+  icnscvt c;
+  struct icns_data *icns;
+  struct icns_data compare;
+  struct count_alloc count;
+  void *arena;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+  memset(&count, 0, sizeof(count));
+
+  pool = icnscvt_create_pool(ICNSCVT_COMPILED_VERSION, 2);
+  ASSERT(pool, "");
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  /* Error on null or junk pool or context. */
+  ret = icnscvt_pool_release(NULL, context);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  ret = icnscvt_pool_release((icnscvt_pool)&compare, context);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  ret = icnscvt_pool_release(pool, NULL);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  ret = icnscvt_pool_release(pool, (icnscvt)&compare);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  /* Released contexts are reused with default settings, including arena
+   * mode; only the arena memory is kept. */
+  ret = icnscvt_set_thread_count(context, 4);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_error_level(context, 2);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_error_function(context, &count, suppress_errors);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_png_profile(context, 0, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_png_backend(context, ICNSCVT_PNG_BACKEND_BUILTIN);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_TRUSTED);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  arena = ((struct icns_data *)context)->arena;
+  ASSERT(arena, "");
+  ret = icnscvt_pool_release(pool, context);
+  ASSERTEQ(ret, 0, "%d", ret);
+  a = icnscvt_pool_acquire(pool);
+  ASSERTEQ(a, context, "");
+  icns = (struct icns_data *)a;
+  ASSERTEQ(icns->num_threads, 0, "%u", icns->num_threads);
+  ASSERTEQ(icns->error_level, ICNS_NO_ERRORS, "%d", icns->error_level);
+  ASSERTEQ(icns->err_fn, NULL, "");
+  ASSERTEQ(icns->err_priv, NULL, "");
+  ASSERTEQ(icns->png_profile, ICNS_PNG_PROFILE_DEFAULT, "");
+  ASSERTEQ(icns->png_backend, ICNS_PNG_BACKEND_LIBPNG, "");
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_DECODE, "");
+  ASSERTEQ(icns->arena, NULL, "");
+  ASSERTEQ(icns->idle_arena, arena, "");
+
+  /* Enabling arena mode again resumes the kept arena. */
+  ret = icnscvt_set_arena_mode(a, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->arena, arena, "");
+  ASSERTEQ(icns->idle_arena, NULL, "");
+  ret = icnscvt_pool_release(pool, a);
+  ASSERTEQ(ret, 0, "%d", ret);
+  a = icnscvt_pool_acquire(pool);
+  ASSERTEQ(a, context, "");
+
+  /* The next borrower can set an allocator without disabling arena mode;
+   * the kept arena is freed with the default allocator. Arena memory from
+   * a custom allocator is freed with it on release. */
+  ret = icnscvt_set_allocator(a, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->idle_arena, NULL, "");
+  ret = icnscvt_set_arena_mode(a, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_pool_release(pool, a);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
+  a = icnscvt_pool_acquire(pool);
+  ASSERTEQ(a, context, "");
+  ASSERTEQ(icns->alloc_fn, NULL, "");
+  ASSERTEQ(icns->realloc_fn, NULL, "");
+  ASSERTEQ(icns->free_fn, NULL, "");
+  ASSERTEQ(icns->alloc_priv, NULL, "");
+  ASSERTEQ(icns->arena, NULL, "");
+  ASSERTEQ(icns->idle_arena, NULL, "");
+
+  /* Contexts beyond the idle limit are destroyed (ASan/leak checks). */
+  b = icnscvt_pool_acquire(pool);
+  ASSERT(b, "");
+  c = icnscvt_pool_acquire(pool);
+  ASSERT(c, "");
+  ret = icnscvt_pool_release(pool, a);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_pool_release(pool, b);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_pool_release(pool, c);
+  ASSERTEQ(ret, 0, "%d", ret);
+
+  /* Most recently released first. */
+  a = icnscvt_pool_acquire(pool);
+  ASSERTEQ(a, b, "");
+  ret = icnscvt_pool_release(pool, a);
+  ASSERTEQ(ret, 0, "%d", ret);
+
+  icnscvt_destroy_pool(pool);
+}
+
+#ifndef ICNSCVT_NO_THREADS
+static void *pool_thread_fn(void *priv)
+{
+  icnscvt_pool pool = (icnscvt_pool)priv;
+  icnscvt context;
+  void *buf;
+  int i;
+
+  for(i = 0; i < 1000; i++)
+  {
+    context = icnscvt_pool_acquire(pool);
+    if(!context)
+      return NULL;
+
+    buf = icnscvt_allocate(context, 64);
+    icnscvt_free(context, buf);
+    if(icnscvt_pool_release(pool, context) != 0)
+      return NULL;
+  }
+  return priv;
+}
+#endif
+
+UNITTEST(icnscvt_pool_threads)
+{
+#ifndef ICNSCVT_NO_THREADS
+  pthread_t threads[4];
+  icnscvt_pool pool;
+  void *ret;
+  int i;
+
+  pool = icnscvt_create_pool(ICNSCVT_COMPILED_VERSION, 2);
+  ASSERT(pool, "");
+
+  for(i = 0; i < 4; i++)
+    ASSERT(!pthread_create(&threads[i], NULL, pool_thread_fn, pool), "%d", i);
+
+  for(i = 0; i < 4; i++)
+  {
+    pthread_join(threads[i], &ret);
+    ASSERTEQ(ret, pool, "%d", i);
+  }
+
+  icnscvt_destroy_pool(pool);
+#endif
+}
+
 
 UNITTEST(icnscvt_allocate)
 {
@@ -151,10 +448,142 @@ UNITTEST(icnscvt_free)
 }
 
 
-static void suppress_errors(const char *message, void *priv)
+UNITTEST(icnscvt_set_allocator)
 {
-  (void)message;
-  (void)priv;
+  struct icns_data *icns;
+  struct icns_data compare;
+  struct count_alloc count = { 0, 0 };
+  icnscvt context = NULL;
+  uint8_t *buf;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_allocator(context, NULL, NULL, NULL, NULL);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_allocator((icnscvt)&compare, NULL, NULL, NULL, NULL);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+
+  /* Error if only some of the functions are provided. */
+  ret = icnscvt_set_allocator(context, count_alloc_fn, NULL, NULL, &count);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ret = icnscvt_set_allocator(context, count_alloc_fn, count_realloc_fn,
+   NULL, &count);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->alloc_fn, NULL, "");
+
+  /* Error if images are loaded. */
+  icns->images.head = (struct icns_image *)&compare;
+  ret = icnscvt_set_allocator(context, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->alloc_fn, NULL, "");
+  icns->images.head = NULL;
+
+  ret = icnscvt_set_allocator(context, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->alloc_priv, &count, "");
+
+  buf = (uint8_t *)icnscvt_allocate(context, 1234);
+  ASSERT(buf, "");
+  ASSERTEQ(count.allocs, 1, "%d", count.allocs);
+  icnscvt_free(context, buf);
+  ASSERTEQ(count.frees, 1, "%d", count.frees);
+  icnscvt_free(context, NULL);
+  ASSERTEQ(count.frees, 1, "%d", count.frees);
+
+  /* Revert to default. */
+  ret = icnscvt_set_allocator(context, NULL, NULL, NULL, NULL);
+  ASSERTEQ(ret, 0, "%d", ret);
+  buf = (uint8_t *)icnscvt_allocate(context, 1234);
+  ASSERT(buf, "");
+  icnscvt_free(context, buf);
+  ASSERTEQ(count.allocs, 1, "%d", count.allocs);
+  ASSERTEQ(count.frees, 1, "%d", count.frees);
+
+  /* Error if arena mode is enabled. */
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ret = icnscvt_set_allocator(context, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->alloc_fn, NULL, "");
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_set_arena_mode)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  struct count_alloc count = { 0, 0 };
+  icnscvt context = NULL;
+  uint8_t *buf;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_arena_mode((icnscvt)&compare, 1);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+  ASSERTEQ(icns->arena, NULL, "");
+
+  ret = icnscvt_set_allocator(context, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+  ASSERTEQ(ret, 0, "%d", ret);
+
+  /* Error if images are loaded. */
+  icns->images.head = (struct icns_image *)&compare;
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->arena, NULL, "");
+  icns->images.head = NULL;
+
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERT(icns->arena, "");
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERT(icns->arena, "");
+  ASSERTEQ(count.allocs, 1, "%d", count.allocs);
+
+  /* icnscvt_allocate never uses the arena. */
+  buf = (uint8_t *)icnscvt_allocate(context, 1234);
+  ASSERT(buf, "");
+  ASSERTEQ(count.allocs, 2, "%d", count.allocs);
+  icnscvt_free(context, buf);
+  ASSERTEQ(count.frees, 1, "%d", count.frees);
+
+  ret = icnscvt_set_arena_mode(context, 0);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->arena, NULL, "");
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
+
+  /* Destroying the context frees the arena. */
+  ret = icnscvt_set_arena_mode(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  icnscvt_destroy_context(context);
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
 }
 
 UNITTEST(icnscvt_set_error_level)
@@ -282,3 +711,244 @@ UNITTEST(icnscvt_set_error_function)
 
   icnscvt_destroy_context(context);
 }
+
+UNITTEST(icnscvt_set_thread_count)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  icnscvt context = NULL;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_thread_count(context, 4);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_thread_count((icnscvt)&compare, 4);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+  ASSERTEQ(icns->num_threads, 0, "%u", icns->num_threads);
+
+  /* Error if count is invalid. */
+  ret = icnscvt_set_thread_count(context, -1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->num_threads, 0, "%u", icns->num_threads);
+
+  ret = icnscvt_set_thread_count(context, INT_MIN);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->num_threads, 0, "%u", icns->num_threads);
+
+  /* Success for valid counts. */
+  ret = icnscvt_set_thread_count(context, 4);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->num_threads, 4, "%u", icns->num_threads);
+
+  ret = icnscvt_set_thread_count(context, 0);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->num_threads, 0, "%u", icns->num_threads);
+
+  /* Large counts are clamped. */
+  ret = icnscvt_set_thread_count(context, INT_MAX);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->num_threads, 64, "%u", icns->num_threads);
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_set_optimal_rle)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  icnscvt context = NULL;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_optimal_rle(context, 1);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_optimal_rle((icnscvt)&compare, 1);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  ASSERTEQ(icns->optimal_rle, false, "%d", icns->optimal_rle);
+
+  ret = icnscvt_set_optimal_rle(context, 1);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->optimal_rle, true, "%d", icns->optimal_rle);
+
+  ret = icnscvt_set_optimal_rle(context, 0);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->optimal_rle, false, "%d", icns->optimal_rle);
+
+  /* Any non-zero value enables. */
+  ret = icnscvt_set_optimal_rle(context, -5);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->optimal_rle, true, "%d", icns->optimal_rle);
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_set_png_profile)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  icnscvt context = NULL;
+  icns_format_id ic10;
+  icns_format_id is32;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_png_profile(context, 0, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_png_profile((icnscvt)&compare, 0, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+  ic10 = icnscvt_get_format_id_by_name(context, "ic10");
+  is32 = icnscvt_get_format_id_by_name(context, "is32");
+  ASSERT(ic10 && is32, "");
+
+  /* Error if profile is invalid. */
+  ret = icnscvt_set_png_profile(context, 0, -1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ret = icnscvt_set_png_profile(context, ic10, ICNSCVT_PNG_EXHAUSTIVE + 1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+
+  /* Error if format is invalid or doesn't support PNG. */
+  ret = icnscvt_set_png_profile(context, 0x12345678, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ret = icnscvt_set_png_profile(context, is32, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->num_png_profiles, 0, "%u", icns->num_png_profiles);
+
+  ret = icnscvt_set_png_profile(context, 0, ICNSCVT_PNG_FAST);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_profile, ICNS_PNG_PROFILE_FAST, "%d", icns->png_profile);
+
+  ret = icnscvt_set_png_profile(context, ic10, ICNSCVT_PNG_MAX);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_profile, ICNS_PNG_PROFILE_FAST, "%d", icns->png_profile);
+  ASSERTEQ(icns->num_png_profiles, 1, "%u", icns->num_png_profiles);
+  ASSERTEQ(icns->png_profiles[0].magic, ic10, "");
+  ASSERTEQ(icns->png_profiles[0].profile, ICNS_PNG_PROFILE_MAX, "%d",
+   icns->png_profiles[0].profile);
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_set_png_backend)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  icnscvt context = NULL;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_png_backend(context, ICNSCVT_PNG_BACKEND_BUILTIN);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_png_backend((icnscvt)&compare, ICNSCVT_PNG_BACKEND_BUILTIN);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+  ASSERTEQ(icns->png_backend, ICNS_PNG_BACKEND_LIBPNG, "%d",
+   icns->png_backend);
+
+  /* Error if backend is invalid. */
+  ret = icnscvt_set_png_backend(context, -1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ret = icnscvt_set_png_backend(context, ICNSCVT_PNG_BACKEND_BUILTIN + 1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->png_backend, ICNS_PNG_BACKEND_LIBPNG, "%d",
+   icns->png_backend);
+
+  ret = icnscvt_set_png_backend(context, ICNSCVT_PNG_BACKEND_BUILTIN);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_backend, ICNS_PNG_BACKEND_BUILTIN, "%d",
+   icns->png_backend);
+
+  ret = icnscvt_set_png_backend(context, ICNSCVT_PNG_BACKEND_LIBPNG);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_backend, ICNS_PNG_BACKEND_LIBPNG, "%d",
+   icns->png_backend);
+
+  icnscvt_destroy_context(context);
+}
+
+UNITTEST(icnscvt_set_png_validation)
+{
+  struct icns_data *icns;
+  struct icns_data compare;
+  icnscvt context = NULL;
+  int ret;
+
+  memset(&compare, 0, sizeof(compare));
+
+  /* Error on null context. */
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_STRUCTURE);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+  /* Error on junk context. */
+  ret = icnscvt_set_png_validation((icnscvt)&compare, ICNSCVT_PNG_VALIDATE_STRUCTURE);
+  ASSERTEQ(ret, -ICNS_NULL_POINTER, "%d != %d", ret, -ICNS_NULL_POINTER);
+
+  context = icnscvt_create_context(ICNSCVT_COMPILED_VERSION);
+  ASSERT(context, "");
+
+  icns = (struct icns_data *)context;
+  icns->err_priv = NULL;
+  icns->err_fn = suppress_errors;
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_DECODE, "%d",
+   icns->png_validation);
+
+  /* Error if level is invalid. */
+  ret = icnscvt_set_png_validation(context, -1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_TRUSTED + 1);
+  ASSERTEQ(ret, -ICNS_INVALID_PARAMETER, "%d != %d", ret, -ICNS_INVALID_PARAMETER);
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_DECODE, "%d",
+   icns->png_validation);
+
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_STRUCTURE);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_STRUCTURE, "%d",
+   icns->png_validation);
+
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_TRUSTED);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_TRUSTED, "%d",
+   icns->png_validation);
+
+  ret = icnscvt_set_png_validation(context, ICNSCVT_PNG_VALIDATE_DECODE);
+  ASSERTEQ(ret, 0, "%d", ret);
+  ASSERTEQ(icns->png_validation, ICNS_PNG_VALIDATE_DECODE, "%d",
+   icns->png_validation);
+
+  icnscvt_destroy_context(context);
+}
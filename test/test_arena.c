@@ -0,0 +1,270 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "test.h"
+#include "../src/icns.h"
+#include "../src/icns_arena.h"
+#include "../src/icns_rle.h"
+
+struct count_alloc
+{
+  int allocs;
+  int frees;
+};
+
+static void *count_alloc_fn(void *priv, size_t sz)
+{
+  struct count_alloc *c = (struct count_alloc *)priv;
+  c->allocs++;
+  return malloc(sz);
+}
+
+static void *count_realloc_fn(void *priv, void *ptr, size_t sz)
+{
+  (void)priv;
+  return realloc(ptr, sz);
+}
+
+static void count_free_fn(void *priv, void *ptr)
+{
+  struct count_alloc *c = (struct count_alloc *)priv;
+  c->frees++;
+  free(ptr);
+}
+
+#define check_aligned(ptr) \
+  ASSERTEQ((uintptr_t)(ptr) & (ICNS_ARENA_ALIGN - 1), 0, "%p", (void *)(ptr))
+
+UNITTEST(arena_icns_arena_alloc)
+{
+  static const size_t sizes[] =
+  {
+    0, 1, 63, 64, 65, 1000, 4096, ICNS_ARENA_BLOCK_SIZE / 2,
+    ICNS_ARENA_BLOCK_SIZE, ICNS_ARENA_BLOCK_SIZE * 3, 17
+  };
+  uint8_t *bufs[sizeof(sizes) / sizeof(sizes[0])];
+  struct count_alloc count = { 0, 0 };
+  enum icns_error ret;
+  size_t i;
+  size_t j;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+  icns_set_allocator(&icns, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+
+  ret = icns_arena_enable(&icns);
+  check_ok(&icns, ret);
+  ASSERT(icns.arena, "");
+  ASSERTEQ(count.allocs, 1, "%d", count.allocs);
+
+  /* Allocations are aligned and do not overlap. */
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    bufs[i] = (uint8_t *)icns_malloc(&icns, sizes[i]);
+    ASSERT(bufs[i], "%zu", sizes[i]);
+    check_aligned(bufs[i]);
+    memset(bufs[i], (int)i, sizes[i]);
+  }
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    for(j = 0; j < sizes[i]; j++)
+      ASSERTEQ(bufs[i][j], (uint8_t)i, "%zu: %zu", i, j);
+
+  /* Freeing the most recent allocation reclaims it. */
+  icns_free(&icns, bufs[i - 1]);
+  bufs[0] = (uint8_t *)icns_malloc(&icns, 17);
+  ASSERTEQ(bufs[0], bufs[i - 1], "");
+  icns_free(&icns, NULL);
+
+  /* All blocks come from the user allocator and are freed on disable. */
+  ASSERT(count.allocs > 1, "%d", count.allocs);
+  ASSERTEQ(count.frees, 0, "%d", count.frees);
+  icns_arena_disable(&icns);
+  ASSERTEQ(icns.arena, NULL, "");
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
+}
+
+UNITTEST(arena_icns_arena_realloc)
+{
+  uint8_t *a;
+  uint8_t *b;
+  uint8_t *c;
+  enum icns_error ret;
+  size_t i;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  ret = icns_arena_enable(&icns);
+  check_ok(&icns, ret);
+
+  a = (uint8_t *)icns_realloc(&icns, NULL, 100);
+  ASSERT(a, "");
+  check_aligned(a);
+  for(i = 0; i < 100; i++)
+    a[i] = i;
+
+  /* The most recent allocation grows in place. */
+  b = (uint8_t *)icns_realloc(&icns, a, 10000);
+  ASSERTEQ(b, a, "");
+  for(i = 100; i < 10000; i++)
+    b[i] = i;
+
+  /* Other allocations are copied. */
+  c = (uint8_t *)icns_malloc(&icns, 16);
+  ASSERT(c, "");
+  a = (uint8_t *)icns_realloc(&icns, b, 20000);
+  ASSERT(a, "");
+  ASSERT(a != b, "");
+  check_aligned(a);
+  for(i = 0; i < 10000; i++)
+    ASSERTEQ(a[i], (uint8_t)i, "%zu", i);
+
+  /* Shrinking and growing past the end of the block. */
+  b = (uint8_t *)icns_realloc(&icns, a, 50);
+  ASSERTEQ(b, a, "");
+  b = (uint8_t *)icns_realloc(&icns, a, ICNS_ARENA_BLOCK_SIZE * 2);
+  ASSERT(b, "");
+  check_aligned(b);
+  for(i = 0; i < 50; i++)
+    ASSERTEQ(b[i], (uint8_t)i, "%zu", i);
+
+  icns_arena_disable(&icns);
+}
+
+UNITTEST(arena_icns_arena_reset)
+{
+  static uint8_t src_buf[4][128 * 128];
+  static uint8_t dest_buf[4][128 * 130];
+  const uint8_t *src[4] = { src_buf[0], src_buf[1], src_buf[2], src_buf[3] };
+  uint8_t *dest[4] = { dest_buf[0], dest_buf[1], dest_buf[2], dest_buf[3] };
+  struct count_alloc count = { 0, 0 };
+  size_t sizes[4];
+  uint8_t *first;
+  uint8_t *buf;
+  enum icns_error ret;
+  bool ok;
+  int allocs;
+  int i;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+  icns_set_allocator(&icns, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+
+  /* Reset does nothing when the arena is disabled. */
+  icns_arena_reset(&icns);
+
+  ret = icns_arena_enable(&icns);
+  check_ok(&icns, ret);
+
+  first = (uint8_t *)icns_malloc(&icns, 1000);
+  ASSERT(first, "");
+  buf = (uint8_t *)icns_malloc(&icns, ICNS_ARENA_BLOCK_SIZE * 2);
+  ASSERT(buf, "");
+
+  /* Rewinding reuses the same blocks without new allocations. */
+  for(i = 0; i < 4; i++)
+  {
+    icns_clear_state_data(&icns);
+    ASSERT(icns.arena, "");
+    allocs = count.allocs;
+
+    buf = (uint8_t *)icns_malloc(&icns, 1000);
+    ASSERTEQ(buf, first, "");
+    buf = (uint8_t *)icns_malloc(&icns, ICNS_ARENA_BLOCK_SIZE * 2);
+    ASSERT(buf, "");
+    ASSERTEQ(count.allocs, allocs, "%d != %d", count.allocs, allocs);
+  }
+
+  /* Threaded optimal packing allocates from worker threads. */
+  for(i = 0; i < 4; i++)
+    memset(src_buf[i], i, sizeof(src_buf[i]));
+
+  for(i = 0; i < 16; i++)
+  {
+    ok = icns_rle_pack_channels(&icns, dest, sizeof(dest_buf[0]), sizes,
+     src, 4, 128 * 128, 1, NULL, 4, true);
+    ASSERT(ok, "");
+  }
+
+  /* Blocks unused since the last reset are released. */
+  icns_arena_reset(&icns);
+  icns_arena_reset(&icns);
+  ASSERTEQ(count.allocs - count.frees, 2, "%d - %d",
+   count.allocs, count.frees);
+
+  icns_arena_disable(&icns);
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
+}
+
+UNITTEST(arena_icns_arena_suspend)
+{
+  struct count_alloc count = { 0, 0 };
+  uint8_t *first;
+  uint8_t *buf;
+  enum icns_error ret;
+  int allocs;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+  icns_set_allocator(&icns, count_alloc_fn, count_realloc_fn,
+   count_free_fn, &count);
+
+  /* Suspend does nothing when the arena is disabled. */
+  icns_arena_suspend(&icns);
+  ASSERTEQ(icns.idle_arena, NULL, "");
+
+  ret = icns_arena_enable(&icns);
+  check_ok(&icns, ret);
+  first = (uint8_t *)icns_malloc(&icns, 1000);
+  ASSERT(first, "");
+
+  /* A suspended arena is disabled, but keeps its blocks... */
+  icns_arena_reset(&icns);
+  icns_arena_suspend(&icns);
+  ASSERTEQ(icns.arena, NULL, "");
+  ASSERT(icns.idle_arena, "");
+  allocs = count.allocs;
+  buf = (uint8_t *)icns_malloc(&icns, 1000);
+  ASSERT(buf, "");
+  icns_free(&icns, buf);
+  ASSERTEQ(count.allocs, allocs + 1, "%d != %d", count.allocs, allocs + 1);
+
+  /* ...until arena mode is enabled again. */
+  allocs = count.allocs;
+  ret = icns_arena_enable(&icns);
+  check_ok(&icns, ret);
+  ASSERT(icns.arena, "");
+  ASSERTEQ(icns.idle_arena, NULL, "");
+  buf = (uint8_t *)icns_malloc(&icns, 1000);
+  ASSERTEQ(buf, first, "");
+  ASSERTEQ(count.allocs, allocs, "%d != %d", count.allocs, allocs);
+
+  /* Disabling frees a suspended arena too. */
+  icns_arena_reset(&icns);
+  icns_arena_suspend(&icns);
+  icns_arena_disable(&icns);
+  ASSERTEQ(icns.idle_arena, NULL, "");
+  ASSERTEQ(count.allocs, count.frees, "%d != %d", count.allocs, count.frees);
+}
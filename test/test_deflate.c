@@ -0,0 +1,173 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "test.h"
+#include "../src/icns.h"
+#include "../src/icns_deflate.h"
+#include "../src/icns_io.h"
+
+static const char check_str[] = "123456789";
+
+static uint32_t test_random(uint32_t *state)
+{
+  *state = *state * 1103515245u + 12345u;
+  return *state >> 16;
+}
+
+static uint32_t reference_adler32(const uint8_t *src, size_t src_size)
+{
+  uint32_t s1 = 1;
+  uint32_t s2 = 0;
+  size_t i;
+
+  for(i = 0; i < src_size; i++)
+  {
+    s1 = (s1 + src[i]) % 65521;
+    s2 = (s2 + s1) % 65521;
+  }
+  return s1 | (s2 << 16);
+}
+
+UNITTEST(deflate_icns_crc32)
+{
+  const uint8_t *check = (const uint8_t *)check_str;
+  uint32_t crc;
+  size_t i;
+
+  crc = icns_crc32(0, NULL, 0);
+  ASSERTEQ(crc, 0, "%08" PRIx32, crc);
+
+  crc = icns_crc32(0, check, 9);
+  ASSERTEQ(crc, 0xcbf43926, "%08" PRIx32, crc);
+
+  /* Must be independent of how the data is split. */
+  for(i = 0; i <= 9; i++)
+  {
+    crc = icns_crc32(icns_crc32(0, check, i), check + i, 9 - i);
+    ASSERTEQ(crc, 0xcbf43926, "%zu: %08" PRIx32, i, crc);
+  }
+
+  crc = icns_crc32(0, (const uint8_t *)"IEND", 4);
+  ASSERTEQ(crc, 0xae426082, "%08" PRIx32, crc);
+}
+
+UNITTEST(deflate_icns_adler32)
+{
+  static const size_t sizes[] =
+  {
+    0, 1, 15, 16, 17, 31, 5551, 5552, 5553, 65536, 100000
+  };
+  static uint8_t data[100000];
+  uint32_t state = 1;
+  uint32_t a;
+  size_t i;
+
+  a = icns_adler32(1, (const uint8_t *)check_str, 9);
+  ASSERTEQ(a, 0x091e01de, "%08" PRIx32, a);
+
+  /* All 0xff is the worst case for overflow between reductions. */
+  memset(data, 0xff, sizeof(data));
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    a = icns_adler32(1, data, sizes[i]);
+    ASSERTEQ(a, reference_adler32(data, sizes[i]), "%zu: %08" PRIx32,
+      sizes[i], a);
+  }
+
+  for(i = 0; i < sizeof(data); i++)
+    data[i] = test_random(&state);
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    a = icns_adler32(1, data, sizes[i]);
+    ASSERTEQ(a, reference_adler32(data, sizes[i]), "%zu: %08" PRIx32,
+      sizes[i], a);
+
+    /* Unaligned start. */
+    if(sizes[i])
+    {
+      a = icns_adler32(1, data + 1, sizes[i] - 1);
+      ASSERTEQ(a, reference_adler32(data + 1, sizes[i] - 1),
+        "%zu: %08" PRIx32, sizes[i], a);
+    }
+  }
+}
+
+UNITTEST(deflate_icns_zlib_compress_fast)
+{
+  static const size_t sizes[] = { 0, 1, 2, 3, 100, 65535, 65536, 200000 };
+  enum icns_error ret;
+  uint8_t *src;
+  uint8_t *dest;
+  size_t dest_size;
+  size_t bound;
+  uint32_t state = 1;
+  uint32_t adler;
+  size_t i;
+  size_t j;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  src = (uint8_t *)malloc(200000);
+  dest = (uint8_t *)malloc(icns_zlib_compress_bound(200000));
+  ASSERT(src && dest, "failed to allocate buffers");
+
+  for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    size_t sz = sizes[i];
+    bound = icns_zlib_compress_bound(sz);
+
+    /* Random data: large inputs should fall back to stored blocks, which
+     * is exactly the bound. Tiny inputs are smaller as fixed Huffman. */
+    for(j = 0; j < sz; j++)
+      src[j] = test_random(&state);
+
+    ret = icns_zlib_compress_fast(&icns, dest, &dest_size, src, sz);
+    check_ok(&icns, ret);
+    ASSERT(dest_size <= bound, "%zu: %zu > %zu", sz, dest_size, bound);
+    ASSERTEQ(dest[0], 0x78, "%02x", dest[0]);
+    ASSERTEQ(dest[1], 0x01, "%02x", dest[1]);
+    ASSERTEQ((dest[0] * 256 + dest[1]) % 31, 0, "");
+    if(sz >= 65535)
+    {
+      ASSERTEQ(dest_size, bound, "%zu: %zu", sz, dest_size);
+      ASSERTMEM(dest + 7, src, 65535, "%zu", sz);
+    }
+
+    adler = icns_adler32(1, src, sz);
+    ASSERTEQ(icns_get_u32be(dest + dest_size - 4), adler, "%zu", sz);
+
+    /* Repetitive data: should compress well. */
+    for(j = 0; j < sz; j++)
+      src[j] = (j / 7) & 3;
+
+    ret = icns_zlib_compress_fast(&icns, dest, &dest_size, src, sz);
+    check_ok(&icns, ret);
+    ASSERT(dest_size <= bound, "%zu: %zu > %zu", sz, dest_size, bound);
+    if(sz >= 65535)
+      ASSERT(dest_size < sz / 4, "%zu: %zu", sz, dest_size);
+
+    adler = icns_adler32(1, src, sz);
+    ASSERTEQ(icns_get_u32be(dest + dest_size - 4), adler, "%zu", sz);
+  }
+  free(src);
+  free(dest);
+}
@@ -19,6 +19,7 @@
 
 #include "test.h"
 #include "format.h"
+#include "../src/icns.h"
 #include "../src/icns_format_argb.h"
 
 UNITTEST(format_icns_format_is32)
@@ -57,6 +58,60 @@ UNITTEST(format_icns_format_icp5)
   test_format_functions(&icns_format_icp5);
 }
 
+/* icp4/icp5 are always written as PNG outside of raw mode. The image is
+ * analyzed first so the encoder can select its layout from the analysis. */
+UNITTEST(format_icp4_icp5_png_analysis)
+{
+  struct icns_image *image;
+  size_t num_pixels;
+  size_t out_size;
+  size_t i;
+  enum icns_error ret;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  ret = icns_add_image_for_format(&icns, &image, NULL, &icns_format_icp5);
+  check_ok(&icns, ret);
+  image->pixels = icns_allocate_pixel_array_for_image(&icns, image);
+  ASSERT(image->pixels, "");
+  num_pixels = image->real_width * image->real_height;
+  for(i = 0; i < num_pixels; i++)
+  {
+    image->pixels[i].r = i & 0xff;
+    image->pixels[i].g = i >> 2;
+    image->pixels[i].b = 0x80;
+    image->pixels[i].a = 0xff;
+  }
+
+  /* Opaque, more than 256 colors: RGB. */
+  ret = icns_format_icp5.prepare_for_icns(&icns, image, &out_size);
+  check_ok(&icns, ret);
+  ASSERTEQ(image->dirty_analysis, false, "");
+  ASSERTEQ(image->analysis.opacity, ICNS_OPACITY_OPAQUE, "");
+  ASSERTEQ(image->pack_on_write, false, "");
+  ASSERT(IMAGE_IS_PNG(image), "");
+  ASSERTEQ(out_size, image->png_size, "");
+  ASSERTEQ(image->png[25], 2, "color type %u", image->png[25]);
+
+  icns_free(&icns, image->png);
+  image->png = NULL;
+  image->png_size = 0;
+  image->pixels[num_pixels / 2].a = 0x80;
+  image->dirty_analysis = true;
+  image->dirty_icns = true;
+
+  /* Partial alpha: RGBA. */
+  ret = icns_format_icp5.prepare_for_icns(&icns, image, &out_size);
+  check_ok(&icns, ret);
+  ASSERTEQ(image->analysis.opacity, ICNS_OPACITY_PARTIAL, "");
+  ASSERT(IMAGE_IS_PNG(image), "");
+  ASSERTEQ(image->png[25], 6, "color type %u", image->png[25]);
+
+  icns_clear_state_data(&icns);
+}
+
 UNITTEST(format_icns_format_ic04)
 {
   test_format_maybe_generate_raw(&icns_format_ic04);
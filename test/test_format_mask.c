@@ -25,14 +25,14 @@
 #include "../src/icns_format_argb.h"
 #include "../src/icns_format_mask.h"
 
-static void random_pixels(struct icns_image *image)
+static void random_pixels(struct icns_data *icns, struct icns_image *image)
 {
   struct rgba_color *pos;
   size_t sz;
   size_t i;
 
-  icns_clear_image(image);
-  image->pixels = icns_allocate_pixel_array_for_image(image);
+  icns_clear_image(icns, image);
+  image->pixels = icns_allocate_pixel_array_for_image(icns, image);
   ASSERT(image->pixels, "failed to allocate pixel array");
 
   sz = image->real_width * image->real_height;
@@ -47,7 +47,7 @@ static void random_pixels(struct icns_image *image)
   }
 }
 
-static void random_mask(struct icns_image *mask)
+static void random_mask(struct icns_data *icns, struct icns_image *mask)
 {
   uint8_t *pos;
   size_t sz;
@@ -55,7 +55,7 @@ static void random_mask(struct icns_image *mask)
 
   sz = mask->real_width * mask->real_height;
 
-  icns_clear_image(mask);
+  icns_clear_image(icns, mask);
   mask->data = (uint8_t *)malloc(sz);
   mask->data_size = sz;
   ASSERT(mask->data, "failed to allocate pixel array");
@@ -119,7 +119,7 @@ static const struct icns_format fmt_s8mk_rgb =
   icns_magic_is32, "is!fakeformat", "",
   ICNS_24_BIT,
   16, 16, 1,
-  0, NULL, NULL, NULL, NULL, NULL, NULL
+  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 static const struct icns_format fmt_l8mk_rgb =
@@ -127,7 +127,7 @@ static const struct icns_format fmt_l8mk_rgb =
   icns_magic_il32, "il!fakeformat", "",
   ICNS_24_BIT,
   32, 32, 1,
-  0, NULL, NULL, NULL, NULL, NULL, NULL
+  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 static const struct icns_format fmt_h8mk_rgb =
@@ -135,7 +135,7 @@ static const struct icns_format fmt_h8mk_rgb =
   icns_magic_ih32, "ih!fakeformat", "",
   ICNS_24_BIT,
   48, 48, 1,
-  0, NULL, NULL, NULL, NULL, NULL, NULL
+  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 static const struct icns_format fmt_t8mk_rgb =
@@ -143,7 +143,7 @@ static const struct icns_format fmt_t8mk_rgb =
   icns_magic_it32, "it!fakeformat", "",
   ICNS_24_BIT,
   128, 128, 1,
-  0, NULL, NULL, NULL, NULL, NULL, NULL
+  0, NULL, NULL, NULL, NULL, NULL, NULL, NULL
 };
 
 UNITTEST(format_mask_icns_add_alpha_from_8_bit_mask)
@@ -179,14 +179,14 @@ UNITTEST(format_mask_icns_add_alpha_from_8_bit_mask)
   ret = icns_add_image_for_format(&icns, &t8mk_rgb, NULL, &fmt_t8mk_rgb);
   check_ok(&icns, ret);
 
-  random_mask(s8mk);
-  random_mask(l8mk);
-  random_mask(h8mk);
-  /* random_mask(t8mk); */
-  random_pixels(s8mk_rgb);
-  random_pixels(l8mk_rgb);
-  /* random_pixels(h8mk_rgb); */
-  random_pixels(t8mk_rgb);
+  random_mask(&icns, s8mk);
+  random_mask(&icns, l8mk);
+  random_mask(&icns, h8mk);
+  /* random_mask(&icns, t8mk); */
+  random_pixels(&icns, s8mk_rgb);
+  random_pixels(&icns, l8mk_rgb);
+  /* random_pixels(&icns, h8mk_rgb); */
+  random_pixels(&icns, t8mk_rgb);
 
   /* image format != 24-bit -> internal error */
   ret = icns_add_alpha_from_8_bit_mask(&icns, s8mk, l8mk);
@@ -208,8 +208,8 @@ UNITTEST(format_mask_icns_add_alpha_from_8_bit_mask)
   ret = icns_add_alpha_from_8_bit_mask(&icns, t8mk_rgb, t8mk);
   check_error(&icns, ret, ICNS_INTERNAL_ERROR);
 
-  random_mask(t8mk);
-  random_pixels(h8mk_rgb);
+  random_mask(&icns, t8mk);
+  random_pixels(&icns, h8mk_rgb);
 
   check_non_match(s8mk_rgb, s8mk);
   check_non_match(l8mk_rgb, l8mk);
@@ -269,10 +269,10 @@ UNITTEST(format_mask_icns_split_alpha_to_8_bit_mask)
   ret = icns_add_image_for_format(&icns, &t8mk_rgb, NULL, &fmt_t8mk_rgb);
   check_ok(&icns, ret);
 
-  random_pixels(s8mk_rgb);
-  random_pixels(l8mk_rgb);
-  /* random_pixels(h8mk_rgb); */
-  random_pixels(t8mk_rgb);
+  random_pixels(&icns, s8mk_rgb);
+  random_pixels(&icns, l8mk_rgb);
+  /* random_pixels(&icns, h8mk_rgb); */
+  random_pixels(&icns, t8mk_rgb);
 
   /* image format != 24-bit -> internal error */
   ret = icns_split_alpha_to_8_bit_mask(&icns, s8mk, l8mk);
@@ -290,7 +290,7 @@ UNITTEST(format_mask_icns_split_alpha_to_8_bit_mask)
   ret = icns_split_alpha_to_8_bit_mask(&icns, h8mk, h8mk_rgb);
   check_error(&icns, ret, ICNS_INTERNAL_ERROR);
 
-  random_pixels(h8mk_rgb);
+  random_pixels(&icns, h8mk_rgb);
 
   check_non_match(s8mk_rgb, s8mk);
   check_non_match(l8mk_rgb, l8mk);
@@ -317,6 +317,134 @@ UNITTEST(format_mask_icns_split_alpha_to_8_bit_mask)
   icns_clear_state_data(&icns);
 }
 
+static void *fail_alloc_fn(void *priv, size_t sz)
+{
+  (void)priv;
+  (void)sz;
+  return NULL;
+}
+
+static void free_fn(void *priv, void *ptr)
+{
+  (void)priv;
+  free(ptr);
+}
+
+UNITTEST(format_mask_icns_view_alpha_as_8_bit_mask)
+{
+  enum icns_error ret;
+  struct icns_image *s8mk;
+  struct icns_image *h8mk;
+  struct icns_image *t8mk;
+  struct icns_image *s8mk_rgb;
+  struct icns_image *h8mk_rgb;
+  struct icns_image *t8mk_rgb;
+  static uint8_t expected[128 * 128];
+  struct rgba_color orig;
+  size_t i;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  ret = icns_add_image_for_format(&icns, &s8mk, NULL, &icns_format_s8mk);
+  check_ok(&icns, ret);
+  ret = icns_add_image_for_format(&icns, &h8mk, NULL, &icns_format_h8mk);
+  check_ok(&icns, ret);
+  ret = icns_add_image_for_format(&icns, &t8mk, NULL, &icns_format_t8mk);
+  check_ok(&icns, ret);
+  ret = icns_add_image_for_format(&icns, &s8mk_rgb, NULL, &fmt_s8mk_rgb);
+  check_ok(&icns, ret);
+  ret = icns_add_image_for_format(&icns, &h8mk_rgb, NULL, &fmt_h8mk_rgb);
+  check_ok(&icns, ret);
+  ret = icns_add_image_for_format(&icns, &t8mk_rgb, NULL, &fmt_t8mk_rgb);
+  check_ok(&icns, ret);
+
+  random_pixels(&icns, s8mk_rgb);
+  random_pixels(&icns, t8mk_rgb);
+
+  /* non-matched dimensions -> internal error */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, s8mk, t8mk_rgb);
+  check_error(&icns, ret, ICNS_INTERNAL_ERROR);
+  ASSERT(!IMAGE_IS_MASK_VIEW(s8mk), "");
+
+  /* image is missing pixel array -> internal error */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, h8mk, h8mk_rgb);
+  check_error(&icns, ret, ICNS_INTERNAL_ERROR);
+  ASSERT(!IMAGE_IS_MASK_VIEW(h8mk), "");
+
+  /* A view replaces the mask data and is not a copy. */
+  random_mask(&icns, s8mk);
+  ret = icns_view_alpha_as_8_bit_mask(&icns, s8mk, s8mk_rgb);
+  check_ok(&icns, ret);
+  ASSERT(!IMAGE_IS_RAW(s8mk), "");
+  ASSERTEQ(s8mk->alpha_source, s8mk_rgb, "");
+  ASSERTEQ(s8mk_rgb->alpha_view, s8mk, "");
+  ASSERTEQ(s8mk->data_size, (size_t)16 * 16, "");
+
+  /* Adding the alpha back from its own view does nothing. */
+  orig = s8mk_rgb->pixels[0];
+  ret = icns_add_alpha_from_8_bit_mask(&icns, s8mk_rgb, s8mk);
+  check_ok(&icns, ret);
+  ASSERTMEM(&orig, &s8mk_rgb->pixels[0], sizeof(orig), "");
+
+  /* Detaching materializes the alpha channel in the mask. */
+  ret = icns_detach_alpha_view(&icns, s8mk_rgb);
+  check_ok(&icns, ret);
+  ASSERT(!IMAGE_IS_MASK_VIEW(s8mk), "");
+  ASSERTEQ(s8mk_rgb->alpha_view, NULL, "");
+  check_match(s8mk_rgb, s8mk);
+
+  /* If the alpha channel can't be copied out, the view is kept. */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, s8mk, s8mk_rgb);
+  check_ok(&icns, ret);
+  icns_set_allocator(&icns, fail_alloc_fn, NULL, free_fn, NULL);
+  ret = icns_detach_alpha_view(&icns, s8mk_rgb);
+  check_error(&icns, ret, ICNS_ALLOC_ERROR);
+  ASSERTEQ(s8mk->alpha_source, s8mk_rgb, "");
+  ASSERTEQ(s8mk_rgb->alpha_view, s8mk, "");
+  icns_set_allocator(&icns, NULL, NULL, NULL, NULL);
+  ret = icns_detach_alpha_view(&icns, s8mk_rgb);
+  check_ok(&icns, ret);
+  check_match(s8mk_rgb, s8mk);
+
+  /* Clearing the source also materializes the view first... */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, t8mk, t8mk_rgb);
+  check_ok(&icns, ret);
+  for(i = 0; i < 128 * 128; i++)
+    expected[i] = t8mk_rgb->pixels[i].a;
+  ret = icns_clear_image(&icns, t8mk_rgb);
+  check_ok(&icns, ret);
+  ASSERT(!IMAGE_IS_MASK_VIEW(t8mk), "");
+  ASSERT(t8mk->data, "");
+  ASSERTMEM(t8mk->data, expected, 128 * 128, "");
+
+  /* ...and clearing the view only drops the reference. */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, s8mk, s8mk_rgb);
+  check_ok(&icns, ret);
+  ret = icns_clear_image(&icns, s8mk);
+  check_ok(&icns, ret);
+  ASSERTEQ(s8mk_rgb->alpha_view, NULL, "");
+  ASSERT(IMAGE_IS_PIXELS(s8mk_rgb), "");
+
+  /* If the source is cleared and the alpha channel can't be copied out,
+   * the mask is left empty and the error is returned. */
+  ret = icns_view_alpha_as_8_bit_mask(&icns, s8mk, s8mk_rgb);
+  check_ok(&icns, ret);
+  icns_set_allocator(&icns, fail_alloc_fn, NULL, free_fn, NULL);
+  ret = icns_clear_image(&icns, s8mk_rgb);
+  check_error(&icns, ret, ICNS_ALLOC_ERROR);
+  icns_set_allocator(&icns, NULL, NULL, NULL, NULL);
+  ASSERT(!IMAGE_IS_MASK_VIEW(s8mk), "");
+  ASSERTEQ(s8mk_rgb->alpha_view, NULL, "");
+  ASSERTEQ(s8mk->data, NULL, "");
+  ASSERTEQ(s8mk->data_size, 0, "");
+  ASSERT(s8mk->dirty_icns, "");
+  ASSERTEQ(s8mk_rgb->pixels, NULL, "");
+
+  icns_clear_state_data(&icns);
+}
+
 UNITTEST(format_icns_format_s8mk)
 {
   test_format_functions(&icns_format_s8mk);
@@ -168,7 +168,7 @@ static void check_read_png_individual(struct icns_data *icns,
 
   ASSERT(!image->jp2, "%d", opts);
   ASSERT(!image->data, "%d", opts);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 }
 
 static void check_read_jp2_individual(struct icns_data *icns,
@@ -209,7 +209,7 @@ static void check_read_jp2_individual(struct icns_data *icns,
   ASSERT(!image->data, "%d", opts);
   ASSERT(!image->png, "%d", opts);
   ASSERT(!image->pixels, "%d", opts);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 }
 
 static void check_read_raw_individual(struct icns_data *icns,
@@ -235,7 +235,7 @@ static void check_read_raw_individual(struct icns_data *icns,
   ASSERT(!image->png, "%d", opts);
   ASSERT(!image->jp2, "%d", opts);
   ASSERT(!image->pixels, "%d", opts);
-  icns_clear_image(image);
+  icns_clear_image(icns, image);
 }
 
 static void check_read_png_all(struct icns_data *icns, struct icns_image *image,
@@ -271,10 +271,16 @@ static void check_read_png_all(struct icns_data *icns, struct icns_image *image,
 
 UNITTEST(format_png_icns_image_read_png)
 {
+  static const enum icns_png_validation levels[] =
+  {
+    ICNS_PNG_VALIDATE_DECODE,
+    ICNS_PNG_VALIDATE_STRUCTURE,
+    ICNS_PNG_VALIDATE_TRUSTED
+  };
   struct icns_image *image11;
   struct icns_image *image12;
   enum icns_error ret;
-  size_t f, i, j, k;
+  size_t f, i, j, k, v;
 
   struct icns_data icns;
   icns_initialize_state_data(&icns);
@@ -286,22 +292,27 @@ UNITTEST(format_png_icns_image_read_png)
   check_ok(&icns, ret);
 
   /* Verify all deny/keep/decode/both combos with working/bad dimensions.
-   * Switching formats should invert which images get filtered by size. */
-  for(f = 0; f < 2; f++)
+   * Switching formats should invert which images get filtered by size.
+   * Valid PNGs should give the same results for every validation level. */
+  for(v = 0; v < sizeof(levels) / sizeof(levels[0]); v++)
   {
-    for(i = 0; i < num_raw_combos; i++)
+    icns_set_png_validation(&icns, levels[v]);
+    for(f = 0; f < 2; f++)
     {
-      for(j = 0; j < num_jp2_combos; j++)
+      for(i = 0; i < num_raw_combos; i++)
       {
-        for(k = 0; k < num_png_combos; k++)
+        for(j = 0; j < num_jp2_combos; j++)
         {
-          enum icns_image_read_png_options opts =
-           png_combos[k] | jp2_combos[j] | raw_combos[i];
-
-          if(f)
-            check_read_png_all(&icns, image12, opts, false);
-          else
-            check_read_png_all(&icns, image11, opts, true);
+          for(k = 0; k < num_png_combos; k++)
+          {
+            enum icns_image_read_png_options opts =
+             png_combos[k] | jp2_combos[j] | raw_combos[i];
+
+            if(f)
+              check_read_png_all(&icns, image12, opts, false);
+            else
+              check_read_png_all(&icns, image11, opts, true);
+          }
         }
       }
     }
@@ -369,7 +380,7 @@ UNITTEST(format_png_icns_image_prepare_png_for_icns)
   ret = icns_decode_png_to_pixel_array(&icns, image, image->png, image->png_size);
   check_ok(&icns, ret);
   check_pixels(image, compare);
-  icns_clear_image(image);
+  icns_clear_image(&icns, image);
 
   /* pixels + JP2 -> return JP2 size */
   image->pixels = compare->pixels;
@@ -438,7 +449,7 @@ UNITTEST(format_png_icns_image_write_pixel_array_to_png)
   check_ok(&icns, ret);
   ASSERTMEM(pixels, image->pixels,
     image->real_width * image->real_height * sizeof(struct rgba_color), "not identical");
-  icns_clear_image(image);
+  icns_clear_image(&icns, image);
   free(pixels);
 
   /* 2. write should pass through PNG */
@@ -454,7 +465,7 @@ UNITTEST(format_png_icns_image_write_pixel_array_to_png)
 
   ASSERTEQ(sz, icns.io.pos, "write out != PNG size");
   ASSERTMEM(input, icns.io.ptr.dest, sz, "not identical");
-  icns_clear_image(image);
+  icns_clear_image(&icns, image);
 
   /* 3. write should pass through JP2 */
   sz = get_ic11_jp2(&icns, &input);
@@ -469,7 +480,7 @@ UNITTEST(format_png_icns_image_write_pixel_array_to_png)
 
   ASSERTEQ(sz, icns.io.pos, "write out != JP2 size");
   ASSERTMEM(input, icns.io.ptr.dest, sz, "not identical");
-  icns_clear_image(image);
+  icns_clear_image(&icns, image);
 
   /* 4. write should fail with internal error if all of three are missing */
   ret = icns_image_write_pixel_array_to_png(&icns, image);
@@ -63,6 +63,9 @@ UNITTEST(icns_delete_state_data)
 
   /* Ensure most data is not freed. */
   memset(icns, 0xff, sizeof(*icns));
+  icns_set_allocator(icns, NULL, NULL, NULL, NULL);
+  icns->arena = NULL;
+  icns->idle_arena = NULL;
 
   /* Should not leak allocated image. */
   icns->images.head = (struct icns_image *)calloc(1, sizeof(struct icns_image));
@@ -93,6 +96,12 @@ UNITTEST(icns_clear_state_data)
   /* Should free from either with no issue. */
   memset(icns, 0xff, sizeof(*icns));
   memset(&icns_st, 0xff, sizeof(icns_st));
+  icns_set_allocator(icns, NULL, NULL, NULL, NULL);
+  icns->arena = NULL;
+  icns->idle_arena = NULL;
+  icns_set_allocator(&icns_st, NULL, NULL, NULL, NULL);
+  icns_st.arena = NULL;
+  icns_st.idle_arena = NULL;
 
   icns->images.head = (struct icns_image *)calloc(1, sizeof(struct icns_image));
   icns->images.tail = icns->images.head;
@@ -112,6 +121,70 @@ UNITTEST(icns_clear_state_data)
   icns_delete_state_data(icns);
 }
 
+static void reset_error_fn(const char *message, void *priv)
+{
+  (void)message;
+  (void)priv;
+}
+
+UNITTEST(icns_reset_state_data)
+{
+  struct icns_data icns;
+  struct icns_data compare;
+  int priv;
+
+  icns_initialize_state_data(&icns);
+  test_init_compare(&compare);
+
+  /* Should reset fresh state data with no issue. */
+  icns_reset_state_data(&icns);
+  ASSERTMEM(&icns, &compare, sizeof(compare), "should be identical");
+
+  /* Configuration is kept. */
+  icns_set_error_level(&icns, ICNS_WARNING_DETAILS);
+  icns_set_error_function(&icns, &priv, reset_error_fn);
+  icns_set_thread_count(&icns, 4);
+  icns_set_optimal_rle(&icns, true);
+  icns.force_recoding = true;
+  icns.force_raw_if_available = true;
+  compare.error_level = icns.error_level;
+  compare.err_priv = icns.err_priv;
+  compare.err_fn = icns.err_fn;
+  compare.num_threads = icns.num_threads;
+  compare.optimal_rle = icns.optimal_rle;
+  compare.force_recoding = true;
+  compare.force_raw_if_available = true;
+
+  /* Per-conversion state is reset; the error stack and TOC contents are
+   * ignored since only their counts matter. */
+  icns.images.head = (struct icns_image *)calloc(1, sizeof(struct icns_image));
+  icns.images.tail = icns.images.head;
+  icns.images.num_images = 1;
+  ASSERT(icns.images.head, "failed to allocate image");
+  icns.images.num_toc = 3;
+  icns.state = ICNS_STATE_PREPARED_FOR_ICNS;
+  icns.input_target = ICNS_TARGET_ICONSET;
+  icns.output_target = ICNS_TARGET_ICNS;
+  icns.num_requested = 5;
+  icns.io.type = IO_MEMORY;
+  icns.io.pos = 12;
+  icns.io.size = 34;
+  icns.bytes_in = 56;
+  icns.bytes_out = 78;
+  icns.num_errors = 2;
+  icns.is_warning = true;
+  icns.is_error = true;
+  memcpy(compare.images.toc, icns.images.toc, sizeof(compare.images.toc));
+  icns.error_text_pos = 9;
+  memcpy(compare.errors, icns.errors, sizeof(compare.errors));
+  memcpy(compare.error_text, icns.error_text, sizeof(compare.error_text));
+  memcpy(compare.requested_inputs, icns.requested_inputs,
+   sizeof(compare.requested_inputs));
+
+  icns_reset_state_data(&icns);
+  ASSERTMEM(&icns, &compare, sizeof(compare), "should be identical");
+}
+
 
 struct check_error_priv
 {
@@ -121,6 +194,9 @@ struct check_error_priv
   size_t pos;
 };
 
+/* Detail lines pushed by copy_error are prefixed with this location. */
+#define COPY_ERROR_PREFIX "test_icns.c:copy_error:1: "
+
 void check_error_fn(const char *message, void *priv)
 {
   struct check_error_priv *data = (struct check_error_priv *)priv;
@@ -132,6 +208,13 @@ void check_error_fn(const char *message, void *priv)
   ASSERT(data->pos < data->num_compare, "%s: message %zu past end of expected",
     data->title, data->pos);
 
+  if(data->pos > 0)
+  {
+    size_t len = strlen(COPY_ERROR_PREFIX);
+    ASSERT(!strncmp(message, COPY_ERROR_PREFIX, len), "%s: %zu: %s",
+      data->title, data->pos, message);
+    message += len;
+  }
   ASSERTCMP(message, data->compare[data->pos], "%s: %zu", data->title, data->pos);
   data->pos++;
 }
@@ -193,17 +276,124 @@ UNITTEST(icns_set_error_function)
   icns_clear_state_data(&icns);
 }
 
+UNITTEST(icns_set_png_profile)
+{
+  enum icns_png_profile profile;
+  uint32_t i;
+  bool ret;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','1','0'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_DEFAULT, "%d", profile);
+
+  /* Default for formats without their own profile. */
+  ret = icns_set_png_profile(&icns, 0, ICNS_PNG_PROFILE_FAST);
+  ASSERT(ret, "");
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','1','0'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_FAST, "%d", profile);
+
+  /* Per-format profiles override the default and can be replaced. */
+  ret = icns_set_png_profile(&icns, MAGIC('i','c','1','0'),
+    ICNS_PNG_PROFILE_MAX);
+  ASSERT(ret, "");
+  ret = icns_set_png_profile(&icns, MAGIC('i','c','0','9'),
+    ICNS_PNG_PROFILE_DEFAULT);
+  ASSERT(ret, "");
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','1','0'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_MAX, "%d", profile);
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','0','9'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_DEFAULT, "%d", profile);
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','0','8'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_FAST, "%d", profile);
+
+  ret = icns_set_png_profile(&icns, MAGIC('i','c','1','0'),
+    ICNS_PNG_PROFILE_FAST);
+  ASSERT(ret, "");
+  profile = icns_get_png_profile(&icns, MAGIC('i','c','1','0'));
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_FAST, "%d", profile);
+  ASSERTEQ(icns.num_png_profiles, 2, "%u", icns.num_png_profiles);
+
+  /* Fail when the override table is full. */
+  for(i = 2; i < ICNS_MAX_PNG_PROFILES; i++)
+  {
+    ret = icns_set_png_profile(&icns, i, ICNS_PNG_PROFILE_MAX);
+    ASSERT(ret, "%" PRIu32, i);
+  }
+  ret = icns_set_png_profile(&icns, i, ICNS_PNG_PROFILE_MAX);
+  ASSERT(!ret, "");
+  profile = icns_get_png_profile(&icns, i);
+  ASSERTEQ(profile, ICNS_PNG_PROFILE_FAST, "%d", profile);
+}
+
+UNITTEST(icns_push_error)
+{
+  struct check_error_priv priv;
+  char buf[ICNS_ERROR_SIZE];
+  char expected[ICNS_ERROR_SIZE];
+  unsigned i;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  /* Not reported: record the location only. */
+  icns_push_error(&icns, false, "a.c", "fn", 12, "value %d", 34);
+  ASSERTEQ(icns.num_errors, 1, "%u", icns.num_errors);
+  ASSERT(icns.is_warning, "");
+  ASSERT(!icns.is_error, "");
+  ASSERTEQ(icns.errors[0].text, -1, "%d", icns.errors[0].text);
+  ASSERTEQ(icns.error_text_pos, 0, "%u", icns.error_text_pos);
+  icns_get_error_message(&icns, 0, buf, sizeof(buf));
+  ASSERTCMP(buf, "a.c:fn:12: value %d", "");
+  clear_error(&icns);
+
+  /* Reported: the message is formatted. */
+  icns_set_error_level(&icns, ICNS_ERROR_DETAILS);
+  icns_set_error_function(&icns, &priv, check_error_fn);
+  icns_push_error(&icns, true, "a.c", "fn", 12, "value %d", 34);
+  ASSERT(icns.is_error, "");
+  ASSERTEQ(icns.errors[0].text, 0, "%d", icns.errors[0].text);
+  icns_get_error_message(&icns, 0, buf, sizeof(buf));
+  ASSERTCMP(buf, "a.c:fn:12: value 34", "");
+
+  /* Errors past the record limit are counted but not stored, and messages
+   * past the end of the text buffer are truncated. */
+  for(i = 1; i < ICNS_MAX_ERRORS * 2; i++)
+  {
+    icns_push_error(&icns, true, "a.c", "fn", i, "%0*u", ICNS_ERROR_SIZE, i);
+    ASSERT(icns.error_text_pos <= ICNS_ERROR_TEXT_SIZE, "%u",
+      icns.error_text_pos);
+  }
+  ASSERTEQ(icns.num_errors, ICNS_MAX_ERRORS * 2, "%u", icns.num_errors);
+  ASSERTEQ(icns.errors[ICNS_MAX_ERRORS - 1].line, ICNS_MAX_ERRORS - 1, "%u",
+    icns.errors[ICNS_MAX_ERRORS - 1].line);
+  for(i = 0; i < ICNS_MAX_ERRORS; i++)
+    icns_get_error_message(&icns, i, buf, sizeof(buf));
+
+  /* Records past the end of the text buffer don't print their format. */
+  ASSERTEQ(icns.errors[ICNS_MAX_ERRORS - 1].text, -2, "%d",
+    icns.errors[ICNS_MAX_ERRORS - 1].text);
+  icns_get_error_message(&icns, ICNS_MAX_ERRORS - 1, buf, sizeof(buf));
+  snprintf(expected, sizeof(expected), "a.c:fn:%u: (message truncated)",
+    ICNS_MAX_ERRORS - 1);
+  ASSERTCMP(buf, expected, "");
+
+  clear_error(&icns);
+  icns_clear_state_data(&icns);
+}
+
 static void copy_error(struct icns_data *icns, const char * const *messages,
   size_t num_messages, bool is_warning)
 {
   size_t i;
   for(i = 1; i < num_messages; i++)
-    snprintf(icns->error_stack[i - 1], ICNS_ERROR_SIZE, "%s", messages[i]);
-
-  if(num_messages >= 1)
-    icns->num_errors = num_messages - 1;
-  else
-    icns->num_errors = 0;
+  {
+    icns_push_error(icns, !is_warning, "test_icns.c", "copy_error", 1,
+      "%s", messages[i]);
+  }
 
   if(is_warning)
     icns->is_warning = true;
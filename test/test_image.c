@@ -41,6 +41,7 @@ const struct icns_format format_abcd =
   NULL,
   NULL,
   NULL,
+  NULL,
   NULL
 };
 
@@ -55,6 +56,7 @@ const struct icns_format format_ABCE =
   NULL,
   NULL,
   NULL,
+  NULL,
   NULL
 };
 
@@ -69,6 +71,7 @@ const struct icns_format format_Baad =
   NULL,
   NULL,
   NULL,
+  NULL,
   NULL
 };
 
@@ -83,6 +86,7 @@ const struct icns_format format_d00d =
   NULL,
   NULL,
   NULL,
+  NULL,
   NULL
 };
 
@@ -186,7 +190,7 @@ UNITTEST(image_is_macros)
 }
 
 #define clear_check(img, orig) do { \
-  icns_clear_image(&(img)); \
+  icns_clear_image(&icns, &(img)); \
   ASSERTMEM(&(img), &(orig), sizeof(img), ""); \
   check_image_dirty(&(img)); \
 } while(0)
@@ -209,7 +213,7 @@ UNITTEST(image_icns_clear_image)
   memset(&image_a, 0, sizeof(image_a));
   memset(&image_b, 0, sizeof(image_b));
   memset(&image_c, 0, sizeof(image_c));
-  icns_clear_image(&image_a);
+  icns_clear_image(&icns, &image_a);
 
   /* Spoof image data so this can be tested independently. */
   images->head = &image_a;
@@ -233,6 +237,9 @@ UNITTEST(image_icns_clear_image)
   image_b.dirty_icns = true;
   image_c.dirty_external = true;
   image_c.dirty_icns = true;
+  image_a.dirty_analysis = true;
+  image_b.dirty_analysis = true;
+  image_c.dirty_analysis = true;
 
   image_a_original = image_a;
   image_b_original = image_b;
@@ -290,7 +297,8 @@ UNITTEST(image_icns_clear_image)
   (image).real_height = (fmt)->height * (fmt)->factor; \
 } while(0)
 
-static void check_alloc_pixels(const struct icns_format *format)
+static void check_alloc_pixels(struct icns_data *icns,
+ const struct icns_format *format)
 {
   struct rgba_color *pixels;
   struct rgba_color *pos;
@@ -302,7 +310,7 @@ static void check_alloc_pixels(const struct icns_format *format)
   size_t y;
 
   set_format(image, format);
-  pixels = icns_allocate_pixel_array_for_image(&image);
+  pixels = icns_allocate_pixel_array_for_image(icns, &image);
   ASSERT(pixels, "%s", format->name);
 
   /* Should be able to write w * h * f^2 pixels to the allocated buffer for
@@ -324,10 +332,14 @@ static void check_alloc_pixels(const struct icns_format *format)
 
 UNITTEST(image_icns_allocate_pixel_array_for_image)
 {
-  check_alloc_pixels(&format_abcd);
-  check_alloc_pixels(&format_ABCE);
-  check_alloc_pixels(&format_Baad);
-  check_alloc_pixels(&format_d00d);
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  check_alloc_pixels(&icns, &format_abcd);
+  check_alloc_pixels(&icns, &format_ABCE);
+  check_alloc_pixels(&icns, &format_Baad);
+  check_alloc_pixels(&icns, &format_d00d);
 }
 
 UNITTEST(image_icns_get_image_by_format)
@@ -646,3 +658,100 @@ UNITTEST(image_icns_delete_all_images)
   icns_delete_all_images(&icns);
   icns_clear_state_data(&icns);
 }
+
+static void fill_pixels(struct icns_image *image, struct rgba_color color)
+{
+  size_t num_pixels = image->real_width * image->real_height;
+  size_t i;
+
+  for(i = 0; i < num_pixels; i++)
+    image->pixels[i] = color;
+  image->dirty_analysis = true;
+}
+
+#define check_analysis(icns, image, op, gray, colors, l, t, r, b) do { \
+  enum icns_error _ret = icns_analyze_image((icns), (image)); \
+  check_ok((icns), _ret); \
+  ASSERTEQ((image)->dirty_analysis, false, ""); \
+  ASSERTEQ((image)->analysis.opacity, (op), ""); \
+  ASSERTEQ((image)->analysis.grayscale, (gray), ""); \
+  ASSERTEQ((image)->analysis.num_colors, (colors), ""); \
+  ASSERTEQ((image)->analysis.left, (size_t)(l), ""); \
+  ASSERTEQ((image)->analysis.top, (size_t)(t), ""); \
+  ASSERTEQ((image)->analysis.right, (size_t)(r), ""); \
+  ASSERTEQ((image)->analysis.bottom, (size_t)(b), ""); \
+} while(0)
+
+UNITTEST(image_icns_analyze_image)
+{
+  static const struct rgba_color gray = { 0x80, 0x80, 0x80, 0xff };
+  static const struct rgba_color clear = { 0, 0, 0, 0 };
+  struct icns_image *image;
+  size_t width;
+  size_t i;
+  enum icns_error ret;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  ret = icns_add_image_for_format(&icns, &image, NULL, &format_abcd);
+  check_ok(&icns, ret);
+  ASSERTEQ(image->dirty_analysis, true, "");
+  width = image->real_width;
+
+  /* No pixel array -> ICNS_INTERNAL_ERROR */
+  ret = icns_analyze_image(&icns, image);
+  check_error(&icns, ret, ICNS_INTERNAL_ERROR);
+  ASSERTEQ(image->dirty_analysis, true, "");
+
+  image->pixels = icns_allocate_pixel_array_for_image(&icns, image);
+  ASSERT(image->pixels, "");
+
+  fill_pixels(image, gray);
+  check_analysis(&icns, image, ICNS_OPACITY_OPAQUE, true, 1, 0, 0, 128, 128);
+
+  /* Results are reused until the image is marked dirty. */
+  image->pixels[0] = clear;
+  check_analysis(&icns, image, ICNS_OPACITY_OPAQUE, true, 1, 0, 0, 128, 128);
+  image->dirty_analysis = true;
+  check_analysis(&icns, image, ICNS_OPACITY_BINARY, true, 2, 0, 0, 128, 128);
+
+  /* Bounding box of the non-transparent pixels. */
+  fill_pixels(image, clear);
+  check_analysis(&icns, image, ICNS_OPACITY_BINARY, true, 1, 0, 0, 0, 0);
+
+  image->pixels[5 * width + 7] = gray;
+  image->pixels[9 * width + 3].a = 1;
+  image->pixels[12 * width + 4].a = 254;
+  image->dirty_analysis = true;
+  check_analysis(&icns, image, ICNS_OPACITY_PARTIAL, true, 4, 3, 5, 8, 13);
+
+  /* Color and distinct color counting (transparent pixels still count). */
+  image->pixels[10 * width + 10].r = 1;
+  image->dirty_analysis = true;
+  check_analysis(&icns, image, ICNS_OPACITY_PARTIAL, false, 5, 3, 5, 8, 13);
+
+  for(i = 0; i < 256; i++)
+  {
+    image->pixels[i].r = i;
+    image->pixels[i].g = i;
+    image->pixels[i].b = i;
+    image->pixels[i].a = 255;
+  }
+  for(; i < 128 * 128; i++)
+    image->pixels[i] = image->pixels[i & 255];
+  image->dirty_analysis = true;
+  check_analysis(&icns, image, ICNS_OPACITY_OPAQUE, true, 256, 0, 0, 128, 128);
+
+  image->pixels[128 * 128 - 1].g = 0;
+  image->dirty_analysis = true;
+  check_analysis(&icns, image, ICNS_OPACITY_OPAQUE, false,
+   ICNS_ANALYSIS_MAX_COLORS + 1, 0, 0, 128, 128);
+
+  /* Clearing the image marks the analysis stale. */
+  icns_clear_image(&icns, image);
+  ASSERTEQ(image->dirty_analysis, true, "");
+
+  icns_clear_state_data(&icns);
+}
@@ -255,6 +255,6 @@ UNITTEST(io_read_directory)
   ASSERTEQ(get_file_in_directory_by_name(base, "whatever"), NULL,
    "file 'whatever' should not exist in directory");
 
-  icns_free_directory(base);
+  icns_free_directory(&icns, base);
 #endif
 }
@@ -0,0 +1,299 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "test.h"
+#include "../src/icns_pixels.h"
+
+#define MAX_PIXELS 1000
+
+UNITTEST(pixels_icns_pixels_to_planes)
+{
+  static struct rgba_color pixels[MAX_PIXELS];
+  static uint8_t r[MAX_PIXELS + 1];
+  static uint8_t g[MAX_PIXELS + 1];
+  static uint8_t b[MAX_PIXELS + 1];
+  static uint8_t a[MAX_PIXELS + 1];
+  size_t count;
+  size_t i;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    pixels[i].r = rand();
+    pixels[i].g = rand();
+    pixels[i].b = rand();
+    pixels[i].a = rand();
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memset(r, 0xa5, sizeof(r));
+    memset(g, 0xa5, sizeof(g));
+    memset(b, 0xa5, sizeof(b));
+    memset(a, 0xa5, sizeof(a));
+
+    icns_pixels_to_planes(r, g, b, a, pixels, count);
+    for(i = 0; i < count; i++)
+    {
+      ASSERTEQ(r[i], pixels[i].r, "%zu/%zu", i, count);
+      ASSERTEQ(g[i], pixels[i].g, "%zu/%zu", i, count);
+      ASSERTEQ(b[i], pixels[i].b, "%zu/%zu", i, count);
+      ASSERTEQ(a[i], pixels[i].a, "%zu/%zu", i, count);
+    }
+    ASSERTEQ(r[count], 0xa5, "%zu", count);
+    ASSERTEQ(g[count], 0xa5, "%zu", count);
+    ASSERTEQ(b[count], 0xa5, "%zu", count);
+    ASSERTEQ(a[count], 0xa5, "%zu", count);
+
+    /* No alpha plane. */
+    memset(r, 0xa5, sizeof(r));
+    icns_pixels_to_planes(r, g, b, NULL, pixels, count);
+    for(i = 0; i < count; i++)
+      ASSERTEQ(r[i], pixels[i].r, "%zu/%zu", i, count);
+    ASSERTEQ(r[count], 0xa5, "%zu", count);
+  }
+}
+
+UNITTEST(pixels_icns_planes_to_pixels)
+{
+  static struct rgba_color pixels[MAX_PIXELS + 1];
+  static uint8_t r[MAX_PIXELS];
+  static uint8_t g[MAX_PIXELS];
+  static uint8_t b[MAX_PIXELS];
+  static uint8_t a[MAX_PIXELS];
+  size_t count;
+  size_t i;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    r[i] = rand();
+    g[i] = rand();
+    b[i] = rand();
+    a[i] = rand();
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memset(pixels, 0xa5, sizeof(pixels));
+    icns_planes_to_pixels(pixels, r, g, b, a, count);
+    for(i = 0; i < count; i++)
+    {
+      ASSERTEQ(pixels[i].r, r[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].g, g[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].b, b[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].a, a[i], "%zu/%zu", i, count);
+    }
+    ASSERTEQ(pixels[count].r, 0xa5, "%zu", count);
+    ASSERTEQ(pixels[count].a, 0xa5, "%zu", count);
+
+    /* No alpha plane -> opaque. */
+    memset(pixels, 0xa5, sizeof(pixels));
+    icns_planes_to_pixels(pixels, r, g, b, NULL, count);
+    for(i = 0; i < count; i++)
+    {
+      ASSERTEQ(pixels[i].r, r[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].g, g[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].b, b[i], "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].a, 255, "%zu/%zu", i, count);
+    }
+    ASSERTEQ(pixels[count].a, 0xa5, "%zu", count);
+  }
+}
+
+UNITTEST(pixels_icns_pixels_get_alpha)
+{
+  static struct rgba_color pixels[MAX_PIXELS];
+  static uint8_t a[MAX_PIXELS + 1];
+  size_t count;
+  size_t i;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    pixels[i].r = rand();
+    pixels[i].g = rand();
+    pixels[i].b = rand();
+    pixels[i].a = rand();
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memset(a, 0xa5, sizeof(a));
+    icns_pixels_get_alpha(a, pixels, count);
+    for(i = 0; i < count; i++)
+      ASSERTEQ(a[i], pixels[i].a, "%zu/%zu", i, count);
+    ASSERTEQ(a[count], 0xa5, "%zu", count);
+  }
+}
+
+UNITTEST(pixels_icns_pixels_set_alpha)
+{
+  static struct rgba_color pixels[MAX_PIXELS + 1];
+  static struct rgba_color orig[MAX_PIXELS + 1];
+  static uint8_t a[MAX_PIXELS];
+  size_t count;
+  size_t i;
+
+  for(i = 0; i <= MAX_PIXELS; i++)
+  {
+    orig[i].r = rand();
+    orig[i].g = rand();
+    orig[i].b = rand();
+    orig[i].a = rand();
+  }
+  for(i = 0; i < MAX_PIXELS; i++)
+    a[i] = rand();
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memcpy(pixels, orig, sizeof(pixels));
+    icns_pixels_set_alpha(pixels, a, count);
+    for(i = 0; i < count; i++)
+    {
+      ASSERTEQ(pixels[i].r, orig[i].r, "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].g, orig[i].g, "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].b, orig[i].b, "%zu/%zu", i, count);
+      ASSERTEQ(pixels[i].a, a[i], "%zu/%zu", i, count);
+    }
+    ASSERTMEM(&pixels[count], &orig[count], sizeof(struct rgba_color),
+      "%zu", count);
+  }
+}
+
+UNITTEST(pixels_icns_pixels_is_opaque)
+{
+  static struct rgba_color pixels[MAX_PIXELS];
+  size_t count;
+  size_t i;
+  bool ret;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    pixels[i].r = rand();
+    pixels[i].g = rand();
+    pixels[i].b = rand();
+    pixels[i].a = 255;
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    ret = icns_pixels_is_opaque(pixels, count);
+    ASSERT(ret, "%zu", count);
+
+    /* A single transparent pixel anywhere, with any alpha < 255. */
+    for(i = 0; i < count; i += (i < 64) ? 1 : 7)
+    {
+      pixels[i].a = (i & 1) ? 254 : 0;
+      ret = icns_pixels_is_opaque(pixels, count);
+      pixels[i].a = 255;
+      ASSERT(!ret, "%zu/%zu", i, count);
+    }
+
+    /* Past the end -> ignored. */
+    if(count < MAX_PIXELS)
+    {
+      pixels[count].a = 0;
+      ret = icns_pixels_is_opaque(pixels, count);
+      pixels[count].a = 255;
+      ASSERT(ret, "%zu", count);
+    }
+  }
+}
+
+UNITTEST(pixels_icns_pixels_get_alpha_and_scan)
+{
+  static struct rgba_color pixels[MAX_PIXELS];
+  static uint8_t a[MAX_PIXELS + 1];
+  size_t count;
+  size_t i;
+  size_t j;
+  bool ret;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    pixels[i].r = rand();
+    pixels[i].g = rand();
+    pixels[i].b = rand();
+    pixels[i].a = 255;
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memset(a, 0xa5, sizeof(a));
+    ret = icns_pixels_get_alpha_and_scan(a, pixels, count);
+    ASSERT(ret, "%zu", count);
+    for(i = 0; i < count; i++)
+      ASSERTEQ(a[i], 255, "%zu/%zu", i, count);
+    ASSERTEQ(a[count], 0xa5, "%zu", count);
+
+    /* A single transparent pixel anywhere, with any alpha < 255. */
+    for(i = 0; i < count; i += (i < 64) ? 1 : 7)
+    {
+      pixels[i].a = (i & 1) ? 254 : 0;
+      ret = icns_pixels_get_alpha_and_scan(a, pixels, count);
+      ASSERT(!ret, "%zu/%zu", i, count);
+      for(j = 0; j < count; j++)
+        ASSERTEQ(a[j], pixels[j].a, "%zu/%zu/%zu", j, i, count);
+      pixels[i].a = 255;
+    }
+
+    /* Past the end -> ignored. */
+    if(count < MAX_PIXELS)
+    {
+      pixels[count].a = 0;
+      ret = icns_pixels_get_alpha_and_scan(a, pixels, count);
+      pixels[count].a = 255;
+      ASSERT(ret, "%zu", count);
+    }
+  }
+}
+
+UNITTEST(pixels_icns_pixels_get_luma)
+{
+  static struct rgba_color pixels[MAX_PIXELS];
+  static uint8_t luma[MAX_PIXELS + 1];
+  size_t count;
+  size_t i;
+
+  for(i = 0; i < MAX_PIXELS; i++)
+  {
+    pixels[i].r = rand();
+    pixels[i].g = rand();
+    pixels[i].b = rand();
+    pixels[i].a = rand();
+  }
+  /* Extremes to catch overflow. */
+  for(i = 0; i < 64; i++)
+  {
+    pixels[i].r = (i & 1) ? 255 : 0;
+    pixels[i].g = (i & 2) ? 255 : 0;
+    pixels[i].b = (i & 4) ? 255 : 0;
+    pixels[i].a = (i & 8) ? 255 : 0;
+  }
+
+  for(count = 0; count <= MAX_PIXELS; count += (count < 64) ? 1 : 61)
+  {
+    memset(luma, 0xa5, sizeof(luma));
+    icns_pixels_get_luma(luma, pixels, count);
+    for(i = 0; i < count; i++)
+    {
+      ASSERTEQ(luma[i], icns_get_luma_for_pixel(pixels[i]),
+        "%zu/%zu", i, count);
+    }
+    ASSERTEQ(luma[count], 0xa5, "%zu", count);
+  }
+}
@@ -308,6 +308,7 @@ static void test_png_decode(struct icns_data * RESTRICT icns,
     NULL,
     NULL,
     NULL,
+    NULL,
     NULL
   };
   struct icns_image *image;
@@ -351,9 +352,162 @@ UNITTEST(png_icns_decode_png_to_pixel_array)
 }
 
 
+NOT_NULL
+static void test_png_check(struct icns_data * RESTRICT icns,
+ const struct test_png *png)
+{
+  enum icns_error ret;
+  const struct loaded_file *loaded = test_load_cached(icns, png->path);
+  const size_t ihdr_crc = 8 + 8 + 13;
+
+  const struct icns_format tmp_format =
+  {
+    0, "tmp ", "tmp",
+    ICNS_PNG,
+    png->st.width, png->st.height, 1,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+  const struct icns_format wrong_format =
+  {
+    0, "tmp ", "tmp",
+    ICNS_PNG,
+    png->st.width + 1, png->st.height, 1,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+  struct icns_image *image;
+  struct icns_image *wrong;
+  uint8_t *data;
+  size_t size = loaded->data_size;
+
+  ret = icns_add_image_for_format(icns, &image, NULL, &tmp_format);
+  check_ok(icns, ret);
+  ret = icns_add_image_for_format(icns, &wrong, NULL, &wrong_format);
+  check_ok(icns, ret);
+
+  ret = icns_check_png(icns, image, loaded->data, size, true);
+  check_ok(icns, ret);
+  ret = icns_check_png(icns, image, loaded->data, size, false);
+  check_ok(icns, ret);
+  ASSERT(!image->pixels, "'%s': check should not decode", png->path);
+
+  ret = icns_check_png(icns, wrong, loaded->data, size, true);
+  check_error(icns, ret, ICNS_INVALID_DIMENSIONS);
+
+  data = (uint8_t *)malloc(size);
+  ASSERT(data, "failed to alloc buffer");
+
+  /* Bad CRC: only detected if CRCs are checked. */
+  memcpy(data, loaded->data, size);
+  data[ihdr_crc] ^= 0x55;
+  ret = icns_check_png(icns, image, data, size, true);
+  check_error(icns, ret, ICNS_PNG_READ_ERROR);
+  ret = icns_check_png(icns, image, data, size, false);
+  check_ok(icns, ret);
+
+  /* Missing IEND. */
+  memcpy(data, loaded->data, size);
+  ret = icns_check_png(icns, image, data, size - 12, false);
+  check_error(icns, ret, ICNS_PNG_READ_ERROR);
+
+  /* IEND directly after IHDR. */
+  memcpy(data + ihdr_crc + 4, loaded->data + size - 12, 12);
+  ret = icns_check_png(icns, image, data, ihdr_crc + 16, false);
+  check_error(icns, ret, ICNS_PNG_READ_ERROR);
+
+  /* Signature only. */
+  ret = icns_check_png(icns, image, data, 8, false);
+  check_error(icns, ret, ICNS_PNG_READ_ERROR);
+
+  free(data);
+  icns_clear_state_data(icns);
+}
+
+NOT_NULL
+static void test_png_check_not_a_png(struct icns_data * RESTRICT icns,
+ const char *path)
+{
+  enum icns_error ret;
+  const struct loaded_file *loaded = test_load_cached(icns, path);
+
+  const struct icns_format tmp_format =
+  {
+    0, "tmp ", "tmp",
+    ICNS_PNG,
+    16, 16, 1,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+  struct icns_image *image;
+
+  ret = icns_add_image_for_format(icns, &image, NULL, &tmp_format);
+  check_ok(icns, ret);
+
+  ret = icns_check_png(icns, image, loaded->data, loaded->data_size, true);
+  check_error(icns, ret, ICNS_DATA_ERROR);
+
+  icns_clear_state_data(icns);
+}
+
+UNITTEST(png_icns_check_png)
+{
+  size_t i;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  for(i = 0; i < num_png_types; i++)
+    test_png_check(&icns, png_types + i);
+
+  for(i = 0; i < num_png_formats; i++)
+    test_png_check(&icns, png_formats + i);
+
+  for(i = 0; i < num_not_pngs; i++)
+    test_png_check_not_a_png(&icns, not_pngs[i]);
+
+  test_load_cached_cleanup();
+}
+
+
+static const enum icns_png_profile profiles[] =
+{
+  ICNS_PNG_PROFILE_DEFAULT,
+  ICNS_PNG_PROFILE_FAST,
+  ICNS_PNG_PROFILE_MAX,
+  ICNS_PNG_PROFILE_EXHAUSTIVE
+};
+static const size_t num_profiles = sizeof(profiles) / sizeof(profiles[0]);
+
+static const enum icns_png_backend backends[] =
+{
+  ICNS_PNG_BACKEND_LIBPNG,
+  ICNS_PNG_BACKEND_BUILTIN
+};
+static const size_t num_backends = sizeof(backends) / sizeof(backends[0]);
+
 NOT_NULL
 static void test_png_encode_and_decode(struct icns_data * RESTRICT icns,
- const struct test_png *png, bool to_stream)
+ const struct test_png *png, bool to_stream, enum icns_png_profile profile)
 {
   enum icns_error ret;
   const struct loaded_file *compare = test_load_tga_cached(icns,
@@ -370,6 +524,7 @@ static void test_png_encode_and_decode(struct icns_data * RESTRICT icns,
     NULL,
     NULL,
     NULL,
+    NULL,
     NULL
   };
   struct icns_image *image;
@@ -389,7 +544,8 @@ static void test_png_encode_and_decode(struct icns_data * RESTRICT icns,
     ret = icns_io_init_write_memory(icns, png_data, png_alloc);
     check_ok(icns, ret);
 
-    ret = icns_encode_png_to_stream(icns, compare->pixels, compare->w, compare->h);
+    ret = icns_encode_png_to_stream(icns, compare->pixels,
+      compare->w, compare->h, profile);
     check_ok(icns, ret);
 
     png_size = icns->io.pos;
@@ -398,7 +554,7 @@ static void test_png_encode_and_decode(struct icns_data * RESTRICT icns,
   else
   {
     ret = icns_encode_png_to_buffer(icns, &png_data, &png_size,
-      compare->pixels, compare->w, compare->h);
+      compare->pixels, compare->w, compare->h, profile);
     check_ok(icns, ret);
   }
 
@@ -420,22 +576,27 @@ UNITTEST(png_icns_encode_png_to_stream)
   struct rgba_color pixels[pixels_dim * pixels_dim];
   uint8_t buffer[64];
   size_t i;
+  size_t p;
 
   struct icns_data icns;
   icns_initialize_state_data(&icns);
   check_init(&icns);
 
-  for(i = 0; i < num_png_types; i++)
-    test_png_encode_and_decode(&icns, png_types + i, true);
+  for(p = 0; p < num_profiles; p++)
+  {
+    for(i = 0; i < num_png_types; i++)
+      test_png_encode_and_decode(&icns, png_types + i, true, profiles[p]);
 
-  for(i = 0; i < num_png_formats; i++)
-    test_png_encode_and_decode(&icns, png_formats + i, true);
+    for(i = 0; i < num_png_formats; i++)
+      test_png_encode_and_decode(&icns, png_formats + i, true, profiles[p]);
+  }
 
   /* Buffer too small -> should ICNS_PNG_WRITE_ERROR. */
   memset(pixels, 0, sizeof(pixels));
   ret = icns_io_init_write_memory(&icns, buffer, sizeof(buffer));
   check_ok(&icns, ret);
-  ret = icns_encode_png_to_stream(&icns, pixels, pixels_dim, pixels_dim);
+  ret = icns_encode_png_to_stream(&icns, pixels, pixels_dim, pixels_dim,
+    ICNS_PNG_PROFILE_DEFAULT);
   check_error(&icns, ret, ICNS_PNG_WRITE_ERROR);
   icns_io_end(&icns);
 
@@ -445,16 +606,318 @@ UNITTEST(png_icns_encode_png_to_stream)
 UNITTEST(png_icns_encode_png_to_buffer)
 {
   size_t i;
+  size_t p;
 
   struct icns_data icns;
   icns_initialize_state_data(&icns);
   check_init(&icns);
 
-  for(i = 0; i < num_png_types; i++)
-    test_png_encode_and_decode(&icns, png_types + i, false);
+  for(p = 0; p < num_profiles; p++)
+  {
+    for(i = 0; i < num_png_types; i++)
+      test_png_encode_and_decode(&icns, png_types + i, false, profiles[p]);
 
+    for(i = 0; i < num_png_formats; i++)
+      test_png_encode_and_decode(&icns, png_formats + i, false, profiles[p]);
+  }
+
+  test_load_cached_cleanup();
+}
+
+UNITTEST(png_exhaustive_profile)
+{
+  enum icns_error ret;
+  size_t i;
+  size_t p;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  /* The exhaustive search includes the MAX settings, so it should never
+   * produce a larger file than any of the fixed profiles. */
   for(i = 0; i < num_png_formats; i++)
-    test_png_encode_and_decode(&icns, png_formats + i, false);
+  {
+    const struct test_png *png = png_formats + i;
+    const struct loaded_file *compare = test_load_tga_cached(&icns,
+      png->st.width, png->st.height, png->compare);
+    uint8_t *best_data;
+    size_t best_size;
+
+    ret = icns_encode_png_to_buffer(&icns, &best_data, &best_size,
+      compare->pixels, compare->w, compare->h, ICNS_PNG_PROFILE_EXHAUSTIVE);
+    check_ok(&icns, ret);
+
+    for(p = 0; p < num_profiles; p++)
+    {
+      uint8_t *data;
+      size_t size;
+
+      ret = icns_encode_png_to_buffer(&icns, &data, &size,
+        compare->pixels, compare->w, compare->h, profiles[p]);
+      check_ok(&icns, ret);
+      icns_free(&icns, data);
+
+      ASSERT(best_size <= size, "'%s': exhaustive %zu > profile %d %zu",
+        png->path, best_size, (int)profiles[p], size);
+    }
+    icns_free(&icns, best_data);
+  }
+
+  test_load_cached_cleanup();
+}
+
+#define layout_dim 32
+
+static void fill_gray(struct rgba_color *pixels, size_t x, size_t y)
+{
+  uint8_t v = (y * layout_dim + x) & 0xff;
+  *pixels = (struct rgba_color){ v, v, v, 255 };
+}
+
+static void fill_gray_alpha(struct rgba_color *pixels, size_t x, size_t y)
+{
+  uint8_t v = x * 8;
+  *pixels = (struct rgba_color){ v, v, v, (uint8_t)(y * 8) };
+}
+
+static void fill_rgb(struct rgba_color *pixels, size_t x, size_t y)
+{
+  *pixels = (struct rgba_color){ (uint8_t)(x * 8), (uint8_t)(y * 8), 0, 255 };
+}
+
+static void fill_rgba(struct rgba_color *pixels, size_t x, size_t y)
+{
+  *pixels = (struct rgba_color){ (uint8_t)(x * 8), 0, 0, (uint8_t)(y * 8) };
+}
+
+static void fill_two_colors(struct rgba_color *pixels, size_t x, size_t y)
+{
+  *pixels = (x ^ y) & 1 ? (struct rgba_color){ 255, 0, 0, 255 } :
+    (struct rgba_color){ 0, 0, 255, 255 };
+}
+
+static void fill_palette_trns(struct rgba_color *pixels, size_t x, size_t y)
+{
+  static const struct rgba_color colors[3] =
+  {
+    { 255, 0, 0, 255 }, { 0, 255, 0, 255 }, { 0, 0, 255, 128 }
+  };
+  *pixels = colors[(x + y) % 3];
+}
+
+static void fill_gray_few(struct rgba_color *pixels, size_t x, size_t y)
+{
+  uint8_t v = ((x + y) & 3) * 85;
+  *pixels = (struct rgba_color){ v, v, v, 255 };
+}
+
+static const struct test_png_layout
+{
+  const char *name;
+  void (*fill)(struct rgba_color *, size_t, size_t);
+  enum icns_png_type type;
+  unsigned depth;
+  bool has_trns;
+} png_layouts[] =
+{
+  { "gray",           fill_gray,          ICNS_PNG_TYPE_GREY, 8, false },
+  { "gray+alpha",     fill_gray_alpha,    ICNS_PNG_TYPE_GREY_ALPHA, 8, false },
+  { "rgb",            fill_rgb,           ICNS_PNG_TYPE_RGB, 8, false },
+  { "rgba",           fill_rgba,          ICNS_PNG_TYPE_RGBA, 8, false },
+  { "two colors",     fill_two_colors,    ICNS_PNG_TYPE_RGB_INDEXED, 1, false },
+  { "palette+tRNS",   fill_palette_trns,  ICNS_PNG_TYPE_RGB_INDEXED, 2, true },
+  { "gray 4 levels",  fill_gray_few,      ICNS_PNG_TYPE_RGB_INDEXED, 2, false },
+};
+
+UNITTEST(png_encode_color_type)
+{
+  enum icns_error ret;
+  struct rgba_color pixels[layout_dim * layout_dim];
+  size_t b;
+  size_t i;
+  size_t x;
+  size_t y;
+
+  const struct icns_format tmp_format =
+  {
+    0, "tmp ", "tmp",
+    ICNS_PNG,
+    layout_dim, layout_dim, 1,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  for(b = 0; b < num_backends; b++)
+  {
+    for(i = 0; i < sizeof(png_layouts) / sizeof(png_layouts[0]); i++)
+    {
+      const struct test_png_layout *t = png_layouts + i;
+      struct icns_png_stat st;
+      struct icns_image *image;
+      uint8_t *png_data;
+      size_t png_size;
+
+      for(y = 0; y < layout_dim; y++)
+        for(x = 0; x < layout_dim; x++)
+          t->fill(pixels + y * layout_dim + x, x, y);
+
+      icns_set_png_backend(&icns, backends[b]);
+      ret = icns_encode_png_to_buffer(&icns, &png_data, &png_size,
+        pixels, layout_dim, layout_dim, ICNS_PNG_PROFILE_DEFAULT);
+      check_ok(&icns, ret);
+
+      ret = icns_get_png_info(&icns, &st, png_data, png_size);
+      check_ok(&icns, ret);
+      ASSERTEQ(st.type, t->type, "%s: %d", t->name, st.type);
+      ASSERTEQ(st.depth, t->depth, "%s: %u", t->name, st.depth);
+      ASSERTEQ(st.has_trns, t->has_trns, "%s: %d", t->name, st.has_trns);
+
+      ret = icns_add_image_for_format(&icns, &image, NULL, &tmp_format);
+      check_ok(&icns, ret);
+      ret = icns_decode_png_to_pixel_array(&icns, image, png_data, png_size);
+      free(png_data);
+      check_ok(&icns, ret);
+
+      ASSERTMEM(image->pixels, pixels, sizeof(pixels),
+        "%s: pixel data mismatch", t->name);
+
+      icns_clear_state_data(&icns);
+    }
+  }
+}
+
+UNITTEST(png_builtin_backend)
+{
+  size_t i;
+  size_t p;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  /* Profiles are ignored, but shouldn't break anything. The state is
+   * cleared after each image, so the backend needs to be set each time. */
+  for(p = 0; p < num_profiles; p++)
+  {
+    for(i = 0; i < num_png_types; i++)
+    {
+      icns_set_png_backend(&icns, ICNS_PNG_BACKEND_BUILTIN);
+      test_png_encode_and_decode(&icns, png_types + i, p & 1, profiles[p]);
+    }
+    for(i = 0; i < num_png_formats; i++)
+    {
+      icns_set_png_backend(&icns, ICNS_PNG_BACKEND_BUILTIN);
+      test_png_encode_and_decode(&icns, png_formats + i, p & 1, profiles[p]);
+    }
+  }
 
   test_load_cached_cleanup();
 }
+
+#define segment_dim 320
+
+UNITTEST(png_segmented_encode)
+{
+  static const unsigned thread_counts[] = { 1, 2, 3, 8 };
+  const size_t num_thread_counts =
+    sizeof(thread_counts) / sizeof(thread_counts[0]);
+  enum icns_error ret;
+  struct rgba_color *pixels;
+  size_t p;
+  size_t t;
+  size_t x;
+  size_t y;
+
+  const struct icns_format tmp_format =
+  {
+    0, "tmp ", "tmp",
+    ICNS_PNG,
+    segment_dim, segment_dim, 1,
+    0,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  /* Large enough to be split into several segments. */
+  pixels = (struct rgba_color *)malloc(segment_dim * segment_dim *
+    sizeof(*pixels));
+  ASSERT(pixels, "failed to allocate pixels");
+  for(y = 0; y < segment_dim; y++)
+  {
+    for(x = 0; x < segment_dim; x++)
+    {
+      pixels[y * segment_dim + x] = (struct rgba_color)
+      {
+        (uint8_t)((x * 7) ^ (y * 13)), (uint8_t)(x + y),
+        (uint8_t)(x * y), (uint8_t)(255 - (x ^ y))
+      };
+    }
+  }
+
+  /* The output must not depend on the thread count. */
+  for(p = 0; p < num_profiles; p++)
+  {
+    uint8_t *first_data = NULL;
+    size_t first_size = 0;
+
+    if(profiles[p] == ICNS_PNG_PROFILE_EXHAUSTIVE)
+      continue;
+
+    for(t = 0; t < num_thread_counts; t++)
+    {
+      struct icns_image *image;
+      uint8_t *png_data;
+      size_t png_size;
+
+      icns_set_thread_count(&icns, thread_counts[t]);
+      ret = icns_encode_png_to_buffer(&icns, &png_data, &png_size,
+        pixels, segment_dim, segment_dim, profiles[p]);
+      check_ok(&icns, ret);
+
+      if(!first_data)
+      {
+        first_data = png_data;
+        first_size = png_size;
+
+        ret = icns_add_image_for_format(&icns, &image, NULL, &tmp_format);
+        check_ok(&icns, ret);
+        ret = icns_decode_png_to_pixel_array(&icns, image,
+          png_data, png_size);
+        check_ok(&icns, ret);
+        ASSERTMEM(image->pixels, pixels,
+          segment_dim * segment_dim * sizeof(*pixels),
+          "profile %d: pixel data mismatch", (int)profiles[p]);
+        icns_clear_state_data(&icns);
+        continue;
+      }
+      ASSERTEQ(png_size, first_size, "profile %d, %u threads: %zu != %zu",
+        (int)profiles[p], thread_counts[t], png_size, first_size);
+      ASSERTMEM(png_data, first_data, png_size,
+        "profile %d, %u threads: output mismatch",
+        (int)profiles[p], thread_counts[t]);
+      free(png_data);
+    }
+    free(first_data);
+  }
+  free(pixels);
+}
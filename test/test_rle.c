@@ -0,0 +1,701 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "test.h"
+#include "../src/icns.h"
+#include "../src/icns_rle.h"
+
+#define MAX_VALUES 2048
+
+/* Straightforward reference implementation of the greedy packer.
+ * The packer kernels must always produce identical output. */
+static size_t reference_pack(uint8_t *dest, const uint8_t *src, size_t count)
+{
+  size_t dest_pos = 0;
+  size_t pos = 0;
+  size_t num;
+  size_t i;
+
+  while(pos < count)
+  {
+    for(num = 0; num < 128 && pos + num < count; num++)
+    {
+      i = pos + num;
+      if(i + 2 < count && src[i] == src[i + 1] && src[i] == src[i + 2])
+        break;
+    }
+    if(num > 0)
+    {
+      dest[dest_pos++] = num - 1;
+      for(i = 0; i < num; i++)
+        dest[dest_pos++] = src[pos++];
+    }
+    if(num < 128 && pos < count)
+    {
+      for(num = 1; pos + num < count; num++)
+        if(src[pos + num] != src[pos])
+          break;
+
+      while(num >= 3)
+      {
+        size_t n = num > 130 ? 130 : num;
+        dest[dest_pos++] = n - 3 + 0x80;
+        dest[dest_pos++] = src[pos];
+        pos += n;
+        num -= n;
+      }
+    }
+  }
+  return dest_pos;
+}
+
+/* Random values with randomly placed runs of random length. */
+static void random_channel(uint8_t *dest, size_t count, int run_chance)
+{
+  size_t i = 0;
+  while(i < count)
+  {
+    if(rand() % 100 < run_chance)
+    {
+      size_t len = rand() % 300 + 1;
+      uint8_t value = rand();
+      for(; len && i < count; len--)
+        dest[i++] = value;
+    }
+    else
+      dest[i++] = rand();
+  }
+}
+
+static void check_pack(const uint8_t *src, size_t count)
+{
+  static uint8_t expected[MAX_VALUES * 2];
+  static uint8_t packed[MAX_VALUES * 2];
+  static uint8_t rgba[MAX_VALUES * 4];
+  static uint8_t unpacked[MAX_VALUES * 4];
+  size_t expected_size;
+  size_t packed_size;
+  size_t bound = icns_rle_channel_bound(count);
+  size_t i;
+
+  expected_size = reference_pack(expected, src, count);
+  ASSERT(expected_size <= bound, "%zu > %zu", expected_size, bound);
+
+  /* Planar. */
+  packed_size = icns_rle_pack_channel(packed, bound, 0, src, count, 1);
+  ASSERTEQ(packed_size, expected_size, "count=%zu: %zu != %zu",
+    count, packed_size, expected_size);
+  ASSERTMEM(packed, expected, expected_size, "count=%zu", count);
+
+  /* RGBA (stride 4) for every channel offset. */
+  for(i = 0; i < 4; i++)
+  {
+    size_t j;
+    memset(rgba, 0xa5, sizeof(rgba));
+    for(j = 0; j < count; j++)
+      rgba[j * 4 + i] = src[j];
+
+    packed_size = icns_rle_pack_channel(packed, bound, 0, rgba + i, count, 4);
+    ASSERTEQ(packed_size, expected_size, "count=%zu channel=%zu: %zu != %zu",
+      count, i, packed_size, expected_size);
+    ASSERTMEM(packed, expected, expected_size, "count=%zu channel=%zu", count, i);
+  }
+
+  /* Offset into destination. */
+  packed_size = icns_rle_pack_channel(packed, bound + 5, 5, src, count, 1);
+  ASSERTEQ(packed_size, expected_size + 5, "count=%zu: %zu != %zu",
+    count, packed_size, expected_size + 5);
+  ASSERTMEM(packed + 5, expected, expected_size, "count=%zu", count);
+
+  /* Destination too small. */
+  packed_size = icns_rle_pack_channel(packed, expected_size - 1, 0, src, count, 1);
+  ASSERTEQ(packed_size, 0, "count=%zu: %zu", count, packed_size);
+
+  /* Round trip. */
+  packed_size = icns_rle_unpack_channel(unpacked, count, 1,
+    expected, expected_size, 0);
+  ASSERTEQ(packed_size, expected_size, "count=%zu: %zu != %zu",
+    count, packed_size, expected_size);
+  ASSERTMEM(unpacked, src, count, "count=%zu", count);
+}
+
+UNITTEST(rle_icns_rle_pack_channel)
+{
+  static uint8_t src[MAX_VALUES];
+  static const uint8_t run_131[] =
+  {
+    0xff, 0x07, 0x00, 0x07
+  };
+  static uint8_t packed[MAX_VALUES * 2];
+  size_t packed_size;
+  size_t i;
+  int chance;
+
+  /* Run of 131 -> run of 130 followed by a literal of 1. */
+  memset(src, 0x07, 131);
+  packed_size = icns_rle_pack_channel(packed, sizeof(packed), 0, src, 131, 1);
+  ASSERTEQ(packed_size, sizeof(run_131), "%zu", packed_size);
+  ASSERTMEM(packed, run_131, sizeof(run_131), "");
+
+  /* 129 values with no runs -> literal of 128 followed by a literal of 1. */
+  for(i = 0; i < 129; i++)
+    src[i] = (i & 1) ? i : 255 - i;
+  packed_size = icns_rle_pack_channel(packed, sizeof(packed), 0, src, 129, 1);
+  ASSERTEQ(packed_size, 131, "%zu", packed_size);
+  ASSERTEQ(packed[0], 127, "%02x", packed[0]);
+  ASSERTEQ(packed[129], 0, "%02x", packed[129]);
+
+  for(chance = 0; chance <= 100; chance += 5)
+  {
+    for(i = 1; i <= 300; i++)
+    {
+      random_channel(src, i, chance);
+      check_pack(src, i);
+    }
+    random_channel(src, MAX_VALUES, chance);
+    check_pack(src, MAX_VALUES);
+  }
+
+  /* Small value ranges produce many short runs near the SIMD block edges. */
+  for(i = 1; i <= MAX_VALUES; i += 37)
+  {
+    size_t j;
+    for(j = 0; j < i; j++)
+      src[j] = rand() % 3;
+    check_pack(src, i);
+  }
+}
+
+UNITTEST(rle_icns_rle_pack_channel_optimal)
+{
+  static uint8_t src[MAX_VALUES];
+  static uint8_t rgba[MAX_VALUES * 4];
+  static uint8_t expected[MAX_VALUES * 2];
+  static uint8_t packed[MAX_VALUES * 2];
+  static uint8_t unpacked[MAX_VALUES];
+  static const uint8_t run_132_3[] =
+  {
+    0xfe, 'x', 0x80, 'x', 0x87, 'y'
+  };
+  size_t expected_size;
+  size_t packed_size;
+  size_t size;
+  size_t ret;
+  size_t i;
+  int chance;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  /* Run of 132 followed by a run of 10. The greedy packer emits a run of
+   * 130 and a literal of 2; the optimal packer splits into 129 + 3. */
+  memset(src, 'x', 132);
+  memset(src + 132, 'y', 10);
+  expected_size = reference_pack(expected, src, 142);
+  ASSERTEQ(expected_size, 7, "%zu", expected_size);
+  packed_size = icns_rle_pack_channel_optimal(&icns, packed, sizeof(packed),
+    0, src, 142, 1);
+  ASSERTEQ(packed_size, sizeof(run_132_3), "%zu", packed_size);
+  ASSERTMEM(packed, run_132_3, sizeof(run_132_3), "");
+
+  for(chance = 0; chance <= 100; chance += 10)
+  {
+    for(i = 1; i <= MAX_VALUES; i += (i < 300) ? 1 : 97)
+    {
+      size_t j;
+      random_channel(src, i, chance);
+      expected_size = reference_pack(expected, src, i);
+
+      packed_size = icns_rle_pack_channel_optimal(&icns, packed,
+        sizeof(packed), 0, src, i, 1);
+      ASSERT(packed_size, "%d/%zu", chance, i);
+      ASSERT(packed_size <= expected_size, "%d/%zu: %zu > %zu",
+        chance, i, packed_size, expected_size);
+
+      /* Size only. */
+      size = icns_rle_pack_channel_optimal(&icns, NULL, 0, 0, src, i, 1);
+      ASSERTEQ(size, packed_size, "%d/%zu: %zu != %zu",
+        chance, i, size, packed_size);
+
+      /* Round trip. */
+      ret = icns_rle_unpack_channel(unpacked, i, 1, packed, packed_size, 0);
+      ASSERTEQ(ret, packed_size, "%d/%zu: %zu != %zu",
+        chance, i, ret, packed_size);
+      ASSERTMEM(unpacked, src, i, "%d/%zu", chance, i);
+
+      /* Strided source and offset into destination. */
+      for(j = 0; j < i; j++)
+        rgba[j * 4 + 2] = src[j];
+      ret = icns_rle_pack_channel_optimal(&icns, expected, sizeof(expected),
+        5, rgba + 2, i, 4);
+      ASSERTEQ(ret, packed_size + 5, "%d/%zu: %zu != %zu",
+        chance, i, ret, packed_size + 5);
+      ASSERTMEM(expected + 5, packed, packed_size, "%d/%zu", chance, i);
+
+      /* Destination too small. */
+      ret = icns_rle_pack_channel_optimal(&icns, expected, packed_size - 1,
+        0, src, i, 1);
+      ASSERTEQ(ret, 0, "%d/%zu: %zu", chance, i, ret);
+    }
+  }
+}
+
+UNITTEST(rle_icns_rle_packer_run)
+{
+  static const size_t windows[] = { 2, 3, 64, 129, 130, 1000 };
+  static uint8_t src[MAX_VALUES];
+  static uint8_t rgba[MAX_VALUES * 4];
+  static uint8_t expected[MAX_VALUES * 2];
+  static uint8_t packed[MAX_VALUES * 2];
+  struct icns_rle_packer p;
+  size_t expected_size;
+  size_t size;
+  size_t ret;
+  size_t pos;
+  size_t i;
+  size_t j;
+
+  for(i = 1; i <= MAX_VALUES; i += 61)
+  {
+    random_channel(src, i, 40);
+    expected_size = reference_pack(expected, src, i);
+
+    size = icns_rle_packed_size(src, i, 1);
+    ASSERTEQ(size, expected_size, "%zu: %zu != %zu", i, size, expected_size);
+    for(j = 0; j < i; j++)
+      rgba[j * 4 + 1] = src[j];
+    size = icns_rle_packed_size(rgba + 1, i, 4);
+    ASSERTEQ(size, expected_size, "%zu: %zu != %zu", i, size, expected_size);
+
+    /* Any output window of at least 129 bytes must make progress;
+     * smaller windows are allowed to stall on long literals. */
+    for(j = 0; j < sizeof(windows) / sizeof(windows[0]); j++)
+    {
+      icns_rle_packer_init(&p, src, i, 1);
+      pos = 0;
+      while(p.count && pos < sizeof(packed))
+      {
+        size_t window = windows[j];
+        if(window > sizeof(packed) - pos)
+          window = sizeof(packed) - pos;
+
+        ret = icns_rle_packer_run(&p, packed + pos, window);
+        ASSERT(ret <= window, "%zu/%zu: %zu", i, windows[j], ret);
+        if(!ret)
+        {
+          ASSERT(windows[j] < 129, "%zu/%zu: stalled", i, windows[j]);
+          break;
+        }
+        pos += ret;
+      }
+      if(p.count)
+        continue;
+
+      ASSERTEQ(pos, expected_size, "%zu/%zu: %zu != %zu",
+        i, windows[j], pos, expected_size);
+      ASSERTMEM(packed, expected, expected_size, "%zu/%zu", i, windows[j]);
+    }
+  }
+}
+
+UNITTEST(rle_icns_rle_unpack_channel)
+{
+  static const uint8_t packed[] =
+  {
+    0x02, 0x01, 0x02, 0x03,     /* literal 1 2 3 */
+    0x80, 0x04,                 /* run 4 4 4 */
+    0x81, 0x05,                 /* run 5 5 5 5 */
+    0x00, 0x06                  /* literal 6 */
+  };
+  static const uint8_t expected[] =
+  {
+    1, 2, 3, 4, 4, 4, 5, 5, 5, 5, 6
+  };
+  uint8_t rgba[sizeof(expected) * 4];
+  uint8_t dest[sizeof(expected)];
+  size_t ret;
+  size_t i;
+
+  ret = icns_rle_unpack_channel(dest, sizeof(dest), 1,
+    packed, sizeof(packed), 0);
+  ASSERTEQ(ret, sizeof(packed), "%zu", ret);
+  ASSERTMEM(dest, expected, sizeof(expected), "");
+
+  memset(rgba, 0, sizeof(rgba));
+  ret = icns_rle_unpack_channel(rgba + 1, sizeof(expected), 4,
+    packed, sizeof(packed), 0);
+  ASSERTEQ(ret, sizeof(packed), "%zu", ret);
+  for(i = 0; i < sizeof(expected); i++)
+  {
+    ASSERTEQ(rgba[i * 4 + 1], expected[i], "%zu", i);
+    ASSERTEQ(rgba[i * 4 + 0], 0, "%zu", i);
+    ASSERTEQ(rgba[i * 4 + 2], 0, "%zu", i);
+    ASSERTEQ(rgba[i * 4 + 3], 0, "%zu", i);
+  }
+
+  /* Starting offset into packed data. */
+  ret = icns_rle_unpack_channel(dest, 7, 1, packed, sizeof(packed), 4);
+  ASSERTEQ(ret, 8, "%zu", ret);
+  ASSERTMEM(dest, expected + 3, 7, "");
+
+  /* Truncated -> 0 */
+  for(i = 0; i < sizeof(packed); i++)
+  {
+    ret = icns_rle_unpack_channel(dest, sizeof(dest), 1, packed, i, 0);
+    ASSERTEQ(ret, 0, "%zu: %zu", i, ret);
+  }
+
+  /* Token overflowing channel -> 0 */
+  ret = icns_rle_unpack_channel(dest, 9, 1,
+    packed, sizeof(packed), 0);
+  ASSERTEQ(ret, 0, "%zu", ret);
+}
+
+UNITTEST(rle_icns_rle_kernels)
+{
+  static const struct icns_rle_kernels * const kernels[] =
+  {
+    &icns_rle_kernels_16x16,
+    &icns_rle_kernels_18x18,
+    &icns_rle_kernels_32x32,
+    &icns_rle_kernels_48x48,
+    &icns_rle_kernels_128x128
+  };
+  static const size_t sizes[] = { 16, 18, 32, 48, 128 };
+  static uint8_t src[128 * 128];
+  static uint8_t rgba[128 * 128 * 4];
+  static uint8_t expected[128 * 130];
+  static uint8_t packed[128 * 128 * 2 + 4];
+  static uint8_t dest[128 * 128];
+  const struct icns_rle_kernels *k;
+  size_t expected_size;
+  size_t packed_size;
+  size_t count;
+  size_t bound;
+  size_t ret;
+  size_t i;
+  size_t j;
+
+  /* Every kernel set, with and without bounds checks. */
+  for(i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+  {
+    k = kernels[i];
+    count = sizes[i] * sizes[i];
+    bound = icns_rle_channel_bound(count);
+    ASSERTEQ(k->count, count, "%zu: %zu", sizes[i], k->count);
+
+    random_channel(src, count, 40);
+    expected_size = reference_pack(expected, src, count);
+    for(j = 0; j < count; j++)
+      rgba[j * 4 + 1] = src[j];
+
+    ret = k->packed_size(src, 1);
+    ASSERTEQ(ret, expected_size, "%zu: %zu", sizes[i], ret);
+    ret = k->packed_size(rgba + 1, 4);
+    ASSERTEQ(ret, expected_size, "%zu: %zu", sizes[i], ret);
+
+    packed_size = k->pack(packed, bound + 2, 2, src);
+    ASSERTEQ(packed_size, expected_size + 2, "%zu: %zu", sizes[i],
+     packed_size);
+    ASSERTMEM(packed + 2, expected, expected_size, "%zu", sizes[i]);
+
+    memset(packed, 0, sizeof(packed));
+    ret = k->pack(packed, expected_size + 2, 2, src);
+    ASSERTEQ(ret, packed_size, "%zu: %zu", sizes[i], ret);
+    ASSERTMEM(packed + 2, expected, expected_size, "%zu", sizes[i]);
+
+    /* Destination too small -> 0 */
+    ret = k->pack(packed, expected_size + 1, 2, src);
+    ASSERTEQ(ret, 0, "%zu: %zu", sizes[i], ret);
+    ret = k->pack(packed, 1, 2, src);
+    ASSERTEQ(ret, 0, "%zu: %zu", sizes[i], ret);
+
+    memset(dest, 0, sizeof(dest));
+    ret = k->unpack(dest, packed, packed_size, 2);
+    ASSERTEQ(ret, packed_size, "%zu: %zu", sizes[i], ret);
+    ASSERTMEM(dest, src, count, "%zu", sizes[i]);
+
+    memset(dest, 0, sizeof(dest));
+    ret = k->unpack(dest, packed, sizeof(packed), 2);
+    ASSERTEQ(ret, packed_size, "%zu: %zu", sizes[i], ret);
+    ASSERTMEM(dest, src, count, "%zu", sizes[i]);
+
+    /* Truncated -> 0 */
+    ret = k->unpack(dest, packed, packed_size - 1, 2);
+    ASSERTEQ(ret, 0, "%zu: %zu", sizes[i], ret);
+
+    /* Start past the end -> 0 */
+    ret = k->unpack(dest, packed, 1, 2);
+    ASSERTEQ(ret, 0, "%zu: %zu", sizes[i], ret);
+  }
+}
+
+UNITTEST(rle_icns_rle_unpacker_run)
+{
+  static const size_t windows[] = { 1, 2, 3, 64, 129, 1000 };
+  static uint8_t src[MAX_VALUES];
+  static uint8_t packed[MAX_VALUES * 2];
+  static uint8_t dest[MAX_VALUES * 4];
+  struct icns_rle_unpacker u;
+  size_t packed_size;
+  size_t ret;
+  size_t pos;
+  size_t i;
+  size_t j;
+  size_t k;
+
+  for(i = 1; i <= MAX_VALUES; i += 61)
+  {
+    random_channel(src, i, 40);
+    packed_size = icns_rle_pack_channel(packed, sizeof(packed), 0, src, i, 1);
+
+    /* Output must be identical regardless of how the input is split. */
+    for(j = 0; j < sizeof(windows) / sizeof(windows[0]); j++)
+    {
+      memset(dest, 0, i);
+      icns_rle_unpacker_init(&u, dest, i, 1);
+      for(pos = 0; pos < packed_size && u.count; pos += ret)
+      {
+        size_t window = windows[j];
+        if(window > packed_size - pos)
+          window = packed_size - pos;
+
+        ret = icns_rle_unpacker_run(&u, packed + pos, window);
+        ASSERT(!u.error, "%zu/%zu", i, windows[j]);
+        ASSERT(ret <= window, "%zu/%zu: %zu", i, windows[j], ret);
+      }
+      ASSERTEQ(u.count, 0, "%zu/%zu: %zu", i, windows[j], u.count);
+      ASSERTEQ(pos, packed_size, "%zu/%zu: %zu != %zu",
+        i, windows[j], pos, packed_size);
+      ASSERTMEM(dest, src, i, "%zu/%zu", i, windows[j]);
+    }
+
+    memset(dest, 0, i * 4);
+    icns_rle_unpacker_init(&u, dest + 2, i, 4);
+    ret = icns_rle_unpacker_run(&u, packed, packed_size);
+    ASSERTEQ(ret, packed_size, "%zu: %zu", i, ret);
+    for(k = 0; k < i; k++)
+    {
+      ASSERTEQ(dest[k * 4 + 2], src[k], "%zu: %zu", i, k);
+      ASSERTEQ(dest[k * 4 + 0], 0, "%zu: %zu", i, k);
+    }
+
+    /* Token overflowing channel -> error */
+    if(i > 1)
+    {
+      icns_rle_unpacker_init(&u, dest, i - 1, 1);
+      icns_rle_unpacker_run(&u, packed, packed_size);
+      ASSERT(u.error, "%zu", i);
+    }
+  }
+}
+
+UNITTEST(rle_icns_rle_scan_channel)
+{
+  static uint8_t src[MAX_VALUES];
+  static uint8_t packed[MAX_VALUES * 2];
+  static uint8_t dest[MAX_VALUES];
+  size_t packed_size;
+  size_t expected;
+  size_t ret;
+  size_t i;
+  size_t j;
+
+  for(i = 1; i <= MAX_VALUES; i += 97)
+  {
+    random_channel(src, i, 30);
+    packed_size = icns_rle_pack_channel(packed + 3, sizeof(packed) - 3, 0,
+     src, i, 1) + 3;
+
+    ret = icns_rle_scan_channel(packed, packed_size, 3, i);
+    ASSERTEQ(ret, packed_size, "%zu: %zu != %zu", i, ret, packed_size);
+
+    /* Must agree with the unpacker for truncated data and wrong counts. */
+    for(j = 3; j < packed_size; j += 7)
+    {
+      expected = icns_rle_unpack_channel(dest, i, 1, packed, j, 3);
+      ret = icns_rle_scan_channel(packed, j, 3, i);
+      ASSERTEQ(ret, expected, "%zu/%zu: %zu != %zu", i, j, ret, expected);
+    }
+    for(j = 1; j < i + 200; j += 13)
+    {
+      expected = icns_rle_unpack_channel(dest, j, 1, packed, packed_size, 3);
+      ret = icns_rle_scan_channel(packed, packed_size, 3, j);
+      ASSERTEQ(ret, expected, "%zu/%zu: %zu != %zu", i, j, ret, expected);
+    }
+  }
+}
+
+UNITTEST(rle_icns_rle_unpack_channels)
+{
+  static const size_t counts[] = { 1, 300, 128 * 128 };
+  static const unsigned threads[] = { 1, 4 };
+  static const struct icns_rle_kernels * const kernels[] =
+  {
+    NULL, &icns_rle_kernels_128x128
+  };
+  static uint8_t src[4][128 * 128];
+  static uint8_t dest_buf[4][128 * 128];
+  static uint8_t packed[4 * 128 * 130 + 4];
+  uint8_t *dest[4] = { dest_buf[0], dest_buf[1], dest_buf[2], dest_buf[3] };
+  unsigned bad_channel;
+  size_t packed_size;
+  size_t ret;
+  size_t i;
+  size_t j;
+  size_t c;
+
+  for(i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+  {
+    size_t count = counts[i];
+    size_t ends[4];
+
+    packed_size = 2;
+    for(c = 0; c < 4; c++)
+    {
+      random_channel(src[c], count, 40);
+      packed_size = icns_rle_pack_channel(packed, sizeof(packed), packed_size,
+       src[c], count, 1);
+      ASSERT(packed_size, "%zu", count);
+      ends[c] = packed_size;
+    }
+
+    /* Kernels for another count are ignored. */
+    for(j = 0; j < sizeof(threads) / sizeof(threads[0]) * 2; j++)
+    {
+      const struct icns_rle_kernels *k = kernels[j & 1];
+      unsigned t = threads[j >> 1];
+
+      memset(dest_buf, 0, sizeof(dest_buf));
+      ret = icns_rle_unpack_channels(dest, 4, count,
+       packed, packed_size, 2, k, t, &bad_channel);
+      ASSERTEQ(ret, packed_size, "%zu/%zu: %zu != %zu",
+       count, j, ret, packed_size);
+      for(c = 0; c < 4; c++)
+        ASSERTMEM(dest[c], src[c], count, "%zu/%zu: %zu", count, j, c);
+
+      /* Truncated in each channel. */
+      for(c = 0; c < 4; c++)
+      {
+        bad_channel = 12345;
+        ret = icns_rle_unpack_channels(dest, 4, count,
+         packed, ends[c] - 1, 2, k, t, &bad_channel);
+        ASSERTEQ(ret, 0, "%zu/%zu: %zu: %zu", count, j, c, ret);
+        ASSERTEQ(bad_channel, c, "%zu/%zu: %u != %zu",
+         count, j, bad_channel, c);
+      }
+    }
+  }
+}
+
+UNITTEST(rle_icns_rle_pack_channels)
+{
+  static const size_t counts[] = { 0, 1, 300, 128 * 128 };
+  static const unsigned threads[] = { 1, 4 };
+  static const struct icns_rle_kernels * const kernels[] =
+  {
+    NULL, &icns_rle_kernels_128x128
+  };
+  static uint8_t src_buf[4][128 * 128];
+  static uint8_t expected[4][128 * 130];
+  static uint8_t dest_buf[4][128 * 130];
+  static uint8_t optimal[128 * 130];
+  const uint8_t *src[4] = { src_buf[0], src_buf[1], src_buf[2], src_buf[3] };
+  uint8_t *dest[4] = { dest_buf[0], dest_buf[1], dest_buf[2], dest_buf[3] };
+  size_t expected_sizes[4];
+  size_t sizes[4];
+  size_t i;
+  size_t j;
+  size_t c;
+  bool ret;
+
+  struct icns_data icns;
+  icns_initialize_state_data(&icns);
+  check_init(&icns);
+
+  for(i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+  {
+    size_t count = counts[i];
+    size_t bound = icns_rle_channel_bound(count);
+
+    for(c = 0; c < 4; c++)
+    {
+      random_channel(src_buf[c], count, 40);
+      expected_sizes[c] = reference_pack(expected[c], src[c], count);
+    }
+
+    /* Kernels for another count are ignored. */
+    for(j = 0; j < sizeof(threads) / sizeof(threads[0]) * 2; j++)
+    {
+      const struct icns_rle_kernels *k = kernels[j & 1];
+      unsigned t = threads[j >> 1];
+
+      /* Size only. */
+      memset(sizes, 0xff, sizeof(sizes));
+      ret = icns_rle_pack_channels(&icns, NULL, 0, sizes, src, 4, count,
+        1, k, t, false);
+      ASSERT(ret, "%zu/%u", count, t);
+      for(c = 0; c < 4; c++)
+      {
+        ASSERTEQ(sizes[c], expected_sizes[c], "%zu/%u: %zu: %zu != %zu",
+          count, t, c, sizes[c], expected_sizes[c]);
+      }
+
+      /* Pack. */
+      memset(sizes, 0xff, sizeof(sizes));
+      ret = icns_rle_pack_channels(&icns, dest, bound, sizes, src, 4,
+        count, 1, k, t, false);
+      ASSERT(ret, "%zu/%u", count, t);
+      for(c = 0; c < 4; c++)
+      {
+        ASSERTEQ(sizes[c], expected_sizes[c], "%zu/%u: %zu: %zu != %zu",
+          count, t, c, sizes[c], expected_sizes[c]);
+        ASSERTMEM(dest[c], expected[c], sizes[c], "%zu/%u: %zu",
+          count, t, c);
+      }
+
+      /* Too small. */
+      if(count)
+      {
+        ret = icns_rle_pack_channels(&icns, dest, 1, sizes, src, 4, count,
+          1, k, t, false);
+        ASSERT(!ret, "%zu/%u", count, t);
+      }
+
+      /* Optimal packer: never larger, and identical to the single
+       * channel optimal packer. */
+      memset(sizes, 0xff, sizeof(sizes));
+      ret = icns_rle_pack_channels(&icns, dest, bound, sizes, src, 4,
+        count, 1, k, t, true);
+      ASSERT(ret, "%zu/%u", count, t);
+      for(c = 0; c < 4; c++)
+      {
+        size_t size = icns_rle_pack_channel_optimal(&icns, optimal, bound,
+          0, src[c], count, 1);
+        ASSERTEQ(sizes[c], size, "%zu/%u: %zu: %zu != %zu",
+          count, t, c, sizes[c], size);
+        ASSERT(sizes[c] <= expected_sizes[c], "%zu/%u: %zu: %zu > %zu",
+          count, t, c, sizes[c], expected_sizes[c]);
+        ASSERTMEM(dest[c], optimal, sizes[c], "%zu/%u: %zu",
+          count, t, c);
+      }
+    }
+  }
+}
@@ -0,0 +1,64 @@
+/* icnscvt
+ *
+ * Copyright (C) 2025 Alice Rowan <petrifiedrowan@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "test.h"
+#include "../src/icns_thread.h"
+
+#define MAX_TASKS 100
+
+struct thread_test
+{
+  unsigned count[MAX_TASKS];
+};
+
+static const unsigned threads[] = { 0, 1, 2, 3, 4, 8, 64, 1000 };
+static const size_t num_threads = sizeof(threads) / sizeof(threads[0]);
+static const unsigned tasks[] = { 0, 1, 2, 3, 4, 7, 64, MAX_TASKS };
+static const size_t num_tasks = sizeof(tasks) / sizeof(tasks[0]);
+
+static void thread_test_fn(void *priv, unsigned index)
+{
+  struct thread_test *t = (struct thread_test *)priv;
+  t->count[index]++;
+}
+
+UNITTEST(thread_icns_thread_run)
+{
+  struct thread_test t;
+  size_t i;
+  size_t j;
+  unsigned k;
+
+  for(i = 0; i < num_threads; i++)
+  {
+    for(j = 0; j < num_tasks; j++)
+    {
+      memset(&t, 0, sizeof(t));
+      icns_thread_run(thread_test_fn, &t, tasks[j], threads[i]);
+
+      /* Every task runs exactly once. */
+      for(k = 0; k < MAX_TASKS; k++)
+      {
+        unsigned expected = k < tasks[j] ? 1 : 0;
+        ASSERTEQ(t.count[k], expected, "threads=%u tasks=%u: %u: %u != %u",
+         threads[i], tasks[j], k, t.count[k], expected);
+      }
+    }
+  }
+}
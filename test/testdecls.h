@@ -3,9 +3,19 @@ UNITDECL(icns_initialize_state_data)
 UNITDECL(icns_allocate_state_data)
 UNITDECL(icns_delete_state_data)
 UNITDECL(icns_clear_state_data)
+UNITDECL(icns_reset_state_data)
 UNITDECL(icns_set_error_level)
 UNITDECL(icns_set_error_function)
+UNITDECL(icns_set_png_profile)
+UNITDECL(icns_push_error)
 UNITDECL(icns_flush_error)
+UNITDECL(arena_icns_arena_alloc)
+UNITDECL(arena_icns_arena_realloc)
+UNITDECL(arena_icns_arena_reset)
+UNITDECL(arena_icns_arena_suspend)
+UNITDECL(deflate_icns_crc32)
+UNITDECL(deflate_icns_adler32)
+UNITDECL(deflate_icns_zlib_compress_fast)
 UNITDECL(io_icns_put_u32be)
 UNITDECL(io_icns_get_u16be)
 UNITDECL(io_icns_get_u32be)
@@ -35,6 +45,7 @@ UNITDECL(image_icns_get_image_by_format)
 UNITDECL(image_icns_add_image_for_format)
 UNITDECL(image_icns_delete_image_by_format)
 UNITDECL(image_icns_delete_all_images)
+UNITDECL(image_icns_analyze_image)
 UNITDECL(test_load)
 UNITDECL(test_load_compressed)
 UNITDECL(test_save)
@@ -43,11 +54,33 @@ UNITDECL(test_load_tga)
 UNITDECL(test_save_tga)
 UNITDECL(jp2_icns_is_file_jp2)
 UNITDECL(jp2_icns_get_jp2_info)
+UNITDECL(pixels_icns_pixels_to_planes)
+UNITDECL(pixels_icns_planes_to_pixels)
+UNITDECL(pixels_icns_pixels_get_alpha)
+UNITDECL(pixels_icns_pixels_set_alpha)
+UNITDECL(pixels_icns_pixels_is_opaque)
+UNITDECL(pixels_icns_pixels_get_alpha_and_scan)
+UNITDECL(pixels_icns_pixels_get_luma)
 UNITDECL(png_icns_is_file_png)
 UNITDECL(png_icns_get_png_info)
 UNITDECL(png_icns_decode_png_to_pixel_array)
+UNITDECL(png_icns_check_png)
 UNITDECL(png_icns_encode_png_to_stream)
 UNITDECL(png_icns_encode_png_to_buffer)
+UNITDECL(png_exhaustive_profile)
+UNITDECL(png_encode_color_type)
+UNITDECL(png_builtin_backend)
+UNITDECL(png_segmented_encode)
+UNITDECL(rle_icns_rle_pack_channel)
+UNITDECL(rle_icns_rle_pack_channel_optimal)
+UNITDECL(rle_icns_rle_packer_run)
+UNITDECL(rle_icns_rle_unpack_channel)
+UNITDECL(rle_icns_rle_kernels)
+UNITDECL(rle_icns_rle_unpacker_run)
+UNITDECL(rle_icns_rle_scan_channel)
+UNITDECL(rle_icns_rle_unpack_channels)
+UNITDECL(rle_icns_rle_pack_channels)
+UNITDECL(thread_icns_thread_run)
 UNITDECL(format_check_pointers)
 UNITDECL(format_icns_get_format_string)
 UNITDECL(format_icns_get_format_list)
@@ -76,6 +109,7 @@ UNITDECL(format_icns_format_sb24)
 UNITDECL(format_icns_format_SB24)
 UNITDECL(format_mask_icns_add_alpha_from_8_bit_mask)
 UNITDECL(format_mask_icns_split_alpha_to_8_bit_mask)
+UNITDECL(format_mask_icns_view_alpha_as_8_bit_mask)
 UNITDECL(format_icns_format_s8mk)
 UNITDECL(format_icns_format_l8mk)
 UNITDECL(format_icns_format_h8mk)
@@ -86,6 +120,7 @@ UNITDECL(format_icns_format_ih32)
 UNITDECL(format_icns_format_it32)
 UNITDECL(format_icns_format_icp4)
 UNITDECL(format_icns_format_icp5)
+UNITDECL(format_icp4_icp5_png_analysis)
 UNITDECL(format_icns_format_ic04)
 UNITDECL(format_icns_format_ic05)
 UNITDECL(format_icns_format_icsb)
@@ -2,10 +2,22 @@
 UNITDECL(icnscvt_get_linked_version)
 UNITDECL(icnscvt_create_context)
 UNITDECL(icnscvt_destroy_context)
+UNITDECL(icnscvt_reset_context)
+UNITDECL(icnscvt_create_pool)
+UNITDECL(icnscvt_pool_acquire)
+UNITDECL(icnscvt_pool_release)
+UNITDECL(icnscvt_pool_threads)
 UNITDECL(icnscvt_allocate)
 UNITDECL(icnscvt_free)
+UNITDECL(icnscvt_set_allocator)
+UNITDECL(icnscvt_set_arena_mode)
 UNITDECL(icnscvt_set_error_level)
 UNITDECL(icnscvt_set_error_function)
+UNITDECL(icnscvt_set_thread_count)
+UNITDECL(icnscvt_set_optimal_rle)
+UNITDECL(icnscvt_set_png_profile)
+UNITDECL(icnscvt_set_png_backend)
+UNITDECL(icnscvt_set_png_validation)
 UNITDECL(icnscvt_max_images)
 UNITDECL(icnscvt_get_formats_list)
 UNITDECL(icnscvt_get_format_id_by_name)